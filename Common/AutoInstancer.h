@@ -0,0 +1,114 @@
+//***************************************************************************************
+// AutoInstancer.h
+//
+// Merges render items that draw the same thing into instanced draws.
+//***************************************************************************************
+
+#ifndef AUTOINSTANCER_H
+#define AUTOINSTANCER_H
+
+#include "d3dUtil.h"
+#include <map>
+#include <tuple>
+
+///<summary>
+/// Groups an app's render items that draw the same submesh of the same
+/// MeshGeometry with the same topology and material, so each group can be
+/// drawn with one DrawIndexedInstanced.  The scene setup stays as it is:
+/// every item keeps its own World, TexTransform and dirty flag, but its
+/// per-object data goes to an instance slot in a structured buffer rather
+/// than its own constant buffer, and the vertex shader reads slot
+/// FirstInstance + SV_InstanceID of the batch being drawn.
+///
+/// RenderItemT is the app's RenderItem; it needs ObjCBIndex, Mat, Geo,
+/// PrimitiveType, IndexCount, StartIndexLocation and BaseVertexLocation.
+/// The items of a list given to Build are assumed to share a PSO.
+///</summary>
+template<typename RenderItemT>
+class AutoInstancer
+{
+public:
+	struct Batch
+	{
+		// The item whose geometry and material the batch draws with.
+		RenderItemT* First = nullptr;
+		UINT FirstInstance = 0;
+		UINT InstanceCount = 0;
+	};
+
+	// Batches ritems.  Batches are in the order of their first item and
+	// items keep their order within a batch.  Call again if items are added,
+	// removed or change geometry or material.
+	void Build(const std::vector<RenderItemT*>& ritems)
+	{
+		typedef std::tuple<const void*, UINT, UINT, INT, INT, const void*> BatchKey;
+		std::map<BatchKey, UINT> batchIndices;
+
+		mBatches.clear();
+		mInstanceIndices.clear();
+		std::vector<UINT> itemBatches(ritems.size());
+		for(size_t i = 0; i < ritems.size(); ++i)
+		{
+			const RenderItemT* ri = ritems[i];
+			BatchKey key(ri->Geo, ri->IndexCount, ri->StartIndexLocation, ri->BaseVertexLocation,
+				(INT)ri->PrimitiveType, ri->Mat);
+
+			auto it = batchIndices.find(key);
+			if(it == batchIndices.end())
+			{
+				it = batchIndices.insert(std::make_pair(key, (UINT)mBatches.size())).first;
+				Batch batch;
+				batch.First = ritems[i];
+				mBatches.push_back(batch);
+			}
+
+			itemBatches[i] = it->second;
+			mBatches[it->second].InstanceCount++;
+		}
+
+		UINT firstInstance = 0;
+		for(Batch& batch : mBatches)
+		{
+			batch.FirstInstance = firstInstance;
+			firstInstance += batch.InstanceCount;
+			batch.InstanceCount = 0;
+		}
+		mInstanceCount = firstInstance;
+
+		for(size_t i = 0; i < ritems.size(); ++i)
+		{
+			Batch& batch = mBatches[itemBatches[i]];
+			UINT objCBIndex = ritems[i]->ObjCBIndex;
+			if(objCBIndex >= mInstanceIndices.size())
+				mInstanceIndices.resize(objCBIndex + 1, (UINT)-1);
+			mInstanceIndices[objCBIndex] = batch.FirstInstance + batch.InstanceCount++;
+		}
+	}
+
+	const std::vector<Batch>& GetBatches()const
+	{
+		return mBatches;
+	}
+
+	// Instances in all the batches, i.e. the size the instance buffer needs.
+	UINT InstanceCount()const
+	{
+		return mInstanceCount;
+	}
+
+	// The instance slot of the item with this ObjCBIndex.
+	UINT GetInstanceIndex(UINT objCBIndex)const
+	{
+		return mInstanceIndices[objCBIndex];
+	}
+
+private:
+	std::vector<Batch> mBatches;
+
+	// By ObjCBIndex.
+	std::vector<UINT> mInstanceIndices;
+
+	UINT mInstanceCount = 0;
+};
+
+#endif // AUTOINSTANCER_H
@@ -0,0 +1,53 @@
+//***************************************************************************************
+// BenchmarkTimer.h
+//
+// Wall clock timing of a block of code, for the demos' benchmarks.
+//***************************************************************************************
+
+#ifndef BENCHMARKTIMER_H
+#define BENCHMARKTIMER_H
+
+#include "MathHelper.h"
+#include <cfloat>
+#include <chrono>
+
+///<summary>
+/// GameTimer measures frames; this times one call of a function object with
+/// the high resolution clock, for the benchmark tables the demos print.
+///</summary>
+class BenchmarkTimer
+{
+public:
+	// Runs f() once and returns the elapsed wall time in milliseconds.
+	template<typename F>
+	static double TimeMs(F f)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		f();
+		auto end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	// Best of runCount runs of f, in milliseconds.
+	template<typename F>
+	static double BestTimeMs(UINT runCount, F f)
+	{
+		double best = DBL_MAX;
+		for(UINT run = 0; run < runCount; ++run)
+		{
+			best = MathHelper::Min(best, TimeMs(f));
+		}
+		return best;
+	}
+
+	// Stores value through a volatile so the compiler has to compute it, even
+	// when the benchmark never prints it.
+	template<typename T>
+	static void DoNotOptimize(const T& value)
+	{
+		volatile T sink = value;
+		(void)sink;
+	}
+};
+
+#endif // BENCHMARKTIMER_H
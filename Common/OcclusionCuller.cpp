@@ -0,0 +1,493 @@
+//***************************************************************************************
+// OcclusionCuller.cpp
+//***************************************************************************************
+
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace DirectX;
+
+void OcclusionCuller::Initialize(ThreadPool* threadPool, UINT width, UINT height)
+{
+	mThreadPool = threadPool;
+	mWidth = width;
+	mHeight = height;
+	mTilesX = (width + TileWidth - 1) / TileWidth;
+	mTilesY = (height + TileHeight - 1) / TileHeight;
+
+	const UINT tileCount = mTilesX * mTilesY;
+	mDepth.assign((size_t)tileCount * TileWidth * TileHeight / 4, XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
+	mTileMaxDepth.assign(tileCount, 1.0f);
+
+	const UINT threadCount = threadPool->ThreadCount();
+	mThreadTriangles.resize(threadCount);
+	mThreadBins.resize(threadCount);
+	for(auto& bins : mThreadBins)
+	{
+		bins.resize(tileCount);
+	}
+	mThreadRejected.resize(threadCount);
+}
+
+UINT OcclusionCuller::Width()const
+{
+	return mWidth;
+}
+
+UINT OcclusionCuller::Height()const
+{
+	return mHeight;
+}
+
+void OcclusionCuller::Render(FXMMATRIX viewProj, const Occluder* occluders, UINT occluderCount)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	XMStoreFloat4x4(&mViewProj, viewProj);
+
+	// Straight to clip space, and a running count of triangles so a thread
+	// can find the occluder of any triangle.
+	mOccluderTransforms.resize(occluderCount);
+	mFirstTriangles.resize(occluderCount + 1);
+	UINT triangleCount = 0;
+	for(UINT o = 0; o < occluderCount; ++o)
+	{
+		XMStoreFloat4x4(&mOccluderTransforms[o], XMMatrixMultiply(XMLoadFloat4x4(&occluders[o].World), viewProj));
+		mFirstTriangles[o] = triangleCount;
+		triangleCount += occluders[o].IndexCount / 3;
+	}
+	mFirstTriangles[occluderCount] = triangleCount;
+
+	for(UINT t = 0; t < (UINT)mThreadTriangles.size(); ++t)
+	{
+		mThreadTriangles[t].clear();
+		for(auto& bin : mThreadBins[t])
+		{
+			bin.clear();
+		}
+	}
+
+	// Set up and bin the triangles.
+	mThreadPool->ParallelFor(triangleCount, 256, [&](UINT begin, UINT end, UINT threadIndex)
+	{
+		UINT o = (UINT)(std::upper_bound(mFirstTriangles.begin(), mFirstTriangles.end(), begin) - mFirstTriangles.begin()) - 1;
+		XMMATRIX toClip = XMLoadFloat4x4(&mOccluderTransforms[o]);
+
+		for(UINT t = begin; t < end; ++t)
+		{
+			if(t >= mFirstTriangles[o + 1])
+			{
+				while(t >= mFirstTriangles[o + 1])
+					++o;
+				toClip = XMLoadFloat4x4(&mOccluderTransforms[o]);
+			}
+
+			const Occluder& occluder = occluders[o];
+			const UINT* indices = occluder.Indices + 3*(t - mFirstTriangles[o]);
+
+			XMVECTOR v0 = XMVector3Transform(XMLoadFloat3(&occluder.Vertices[indices[0]]), toClip);
+			XMVECTOR v1 = XMVector3Transform(XMLoadFloat3(&occluder.Vertices[indices[1]]), toClip);
+			XMVECTOR v2 = XMVector3Transform(XMLoadFloat3(&occluder.Vertices[indices[2]]), toClip);
+			AddTriangle(v0, v1, v2, threadIndex);
+		}
+	});
+
+	// Each tile on one thread, so no two threads write the same pixels.
+	mThreadPool->ParallelFor(mTilesX * mTilesY, 1, [&](UINT begin, UINT end, UINT threadIndex)
+	{
+		for(UINT tile = begin; tile < end; ++tile)
+		{
+			RasterizeTile(tile);
+		}
+	});
+
+	mTrianglesDrawn = 0;
+	for(const auto& triangles : mThreadTriangles)
+	{
+		mTrianglesDrawn += (UINT)triangles.size();
+	}
+
+	mObjectsTested = 0;
+	mObjectsRejected = 0;
+	mTestMs = 0.0;
+
+	auto end = std::chrono::high_resolution_clock::now();
+	mRenderMs = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void OcclusionCuller::AddTriangle(FXMVECTOR v0, FXMVECTOR v1, FXMVECTOR v2, UINT threadIndex)
+{
+	const XMVECTOR in[3] = { v0, v1, v2 };
+	const float d[3] = { XMVectorGetZ(v0), XMVectorGetZ(v1), XMVectorGetZ(v2) };
+
+	if(d[0] >= 0.0f && d[1] >= 0.0f && d[2] >= 0.0f)
+	{
+		SetupTriangle(v0, v1, v2, threadIndex);
+		return;
+	}
+
+	// Clip to z >= 0, which leaves nothing, a triangle or a quad.
+	XMVECTOR out[4];
+	UINT outCount = 0;
+	for(UINT i = 0; i < 3; ++i)
+	{
+		const UINT j = (i + 1) % 3;
+		if(d[i] >= 0.0f)
+			out[outCount++] = in[i];
+		if((d[i] >= 0.0f) != (d[j] >= 0.0f))
+			out[outCount++] = XMVectorLerp(in[i], in[j], d[i] / (d[i] - d[j]));
+	}
+
+	for(UINT i = 2; i < outCount; ++i)
+	{
+		SetupTriangle(out[0], out[i - 1], out[i], threadIndex);
+	}
+}
+
+void OcclusionCuller::SetupTriangle(FXMVECTOR v0, FXMVECTOR v1, FXMVECTOR v2, UINT threadIndex)
+{
+	// To pixels, y down.
+	const XMVECTOR clip[3] = { v0, v1, v2 };
+	float x[3], y[3], z[3];
+	for(UINT i = 0; i < 3; ++i)
+	{
+		XMFLOAT4 v;
+		XMStoreFloat4(&v, clip[i]);
+		const float invW = 1.0f / v.w;
+		x[i] = (0.5f + 0.5f*v.x*invW) * mWidth;
+		y[i] = (0.5f - 0.5f*v.y*invW) * mHeight;
+		z[i] = v.z*invW;
+	}
+
+	// Front faces are clockwise on screen, which is a positive area with y down.
+	const float area = (x[1] - x[0])*(y[2] - y[0]) - (y[1] - y[0])*(x[2] - x[0]);
+	if( !(area > 0.0f) )
+		return;
+
+	// Pixels whose centers may be inside.
+	const float minX = MathHelper::Max(ceilf(MathHelper::Min(x[0], MathHelper::Min(x[1], x[2])) - 0.5f), 0.0f);
+	const float maxX = MathHelper::Min(floorf(MathHelper::Max(x[0], MathHelper::Max(x[1], x[2])) - 0.5f), (float)mWidth - 1.0f);
+	const float minY = MathHelper::Max(ceilf(MathHelper::Min(y[0], MathHelper::Min(y[1], y[2])) - 0.5f), 0.0f);
+	const float maxY = MathHelper::Min(floorf(MathHelper::Max(y[0], MathHelper::Max(y[1], y[2])) - 0.5f), (float)mHeight - 1.0f);
+	if(minX > maxX || minY > maxY)
+		return;
+
+	Triangle tri;
+	tri.MinX = (int)minX;
+	tri.MaxX = (int)maxX;
+	tri.MinY = (int)minY;
+	tri.MaxY = (int)maxY;
+
+	// Edge i runs from vertex i to the next, evaluated at pixel centers.
+	for(UINT i = 0; i < 3; ++i)
+	{
+		const UINT j = (i + 1) % 3;
+		const float a = y[i] - y[j];
+		const float b = x[j] - x[i];
+		const float c = -(a*x[i] + b*y[i]);
+		tri.Edge[i] = XMFLOAT3(a, b, c + 0.5f*(a + b));
+	}
+
+	const float dzdx = ((z[1] - z[0])*(y[2] - y[0]) - (z[2] - z[0])*(y[1] - y[0])) / area;
+	const float dzdy = ((z[2] - z[0])*(x[1] - x[0]) - (z[1] - z[0])*(x[2] - x[0])) / area;
+	tri.Depth = XMFLOAT3(dzdx, dzdy, z[0] + dzdx*(0.5f - x[0]) + dzdy*(0.5f - y[0]));
+
+	std::vector<Triangle>& triangles = mThreadTriangles[threadIndex];
+	std::vector<std::vector<UINT>>& bins = mThreadBins[threadIndex];
+	const UINT index = (UINT)triangles.size();
+	triangles.push_back(tri);
+
+	for(UINT ty = tri.MinY / TileHeight; ty <= tri.MaxY / TileHeight; ++ty)
+	{
+		for(UINT tx = tri.MinX / TileWidth; tx <= tri.MaxX / TileWidth; ++tx)
+		{
+			bins[ty*mTilesX + tx].push_back(index);
+		}
+	}
+}
+
+void OcclusionCuller::RasterizeTile(UINT tile)
+{
+	const UINT groupsPerRow = TileWidth / 4;
+	const int tileX = (int)((tile % mTilesX) * TileWidth);
+	const int tileY = (int)((tile / mTilesX) * TileHeight);
+
+	XMFLOAT4* depth = &mDepth[(size_t)tile * TileHeight * groupsPerRow];
+	for(UINT i = 0; i < TileHeight * groupsPerRow; ++i)
+	{
+		depth[i] = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	}
+
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR laneOffsets = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	const XMVECTOR four = XMVectorReplicate(4.0f);
+
+	for(UINT t = 0; t < (UINT)mThreadBins.size(); ++t)
+	{
+		const std::vector<Triangle>& triangles = mThreadTriangles[t];
+		for(UINT index : mThreadBins[t][tile])
+		{
+			const Triangle& tri = triangles[index];
+
+			const int minX = MathHelper::Max(tri.MinX, tileX);
+			const int maxX = MathHelper::Min(tri.MaxX, tileX + (int)TileWidth - 1);
+			const int minY = MathHelper::Max(tri.MinY, tileY);
+			const int maxY = MathHelper::Min(tri.MaxY, tileY + (int)TileHeight - 1);
+			const int firstGroup = (minX - tileX) / 4;
+			const int lastGroup = (maxX - tileX) / 4;
+
+			XMVECTOR a[3], b[3], c[3], stepX[3];
+			for(UINT e = 0; e < 3; ++e)
+			{
+				a[e] = XMVectorReplicate(tri.Edge[e].x);
+				b[e] = XMVectorReplicate(tri.Edge[e].y);
+				c[e] = XMVectorReplicate(tri.Edge[e].z);
+				stepX[e] = XMVectorMultiply(a[e], four);
+			}
+			const XMVECTOR dzdx = XMVectorReplicate(tri.Depth.x);
+			const XMVECTOR dzdy = XMVectorReplicate(tri.Depth.y);
+			const XMVECTOR z0 = XMVectorReplicate(tri.Depth.z);
+			const XMVECTOR stepZ = XMVectorMultiply(dzdx, four);
+
+			const XMVECTOR firstX = XMVectorAdd(XMVectorReplicate((float)(tileX + 4*firstGroup)), laneOffsets);
+
+			for(int py = minY; py <= maxY; ++py)
+			{
+				const XMVECTOR rowY = XMVectorReplicate((float)py);
+				XMVECTOR e0 = XMVectorMultiplyAdd(a[0], firstX, XMVectorMultiplyAdd(b[0], rowY, c[0]));
+				XMVECTOR e1 = XMVectorMultiplyAdd(a[1], firstX, XMVectorMultiplyAdd(b[1], rowY, c[1]));
+				XMVECTOR e2 = XMVectorMultiplyAdd(a[2], firstX, XMVectorMultiplyAdd(b[2], rowY, c[2]));
+				XMVECTOR z = XMVectorMultiplyAdd(dzdx, firstX, XMVectorMultiplyAdd(dzdy, rowY, z0));
+
+				XMFLOAT4* row = depth + (py - tileY)*groupsPerRow;
+				for(int g = firstGroup; g <= lastGroup; ++g)
+				{
+					XMVECTOR inside = XMVectorAndInt(XMVectorGreaterOrEqual(e0, zero),
+						XMVectorAndInt(XMVectorGreaterOrEqual(e1, zero), XMVectorGreaterOrEqual(e2, zero)));
+
+					XMVECTOR old = XMLoadFloat4(&row[g]);
+					XMStoreFloat4(&row[g], XMVectorSelect(old, XMVectorMin(old, z), inside));
+
+					e0 = XMVectorAdd(e0, stepX[0]);
+					e1 = XMVectorAdd(e1, stepX[1]);
+					e2 = XMVectorAdd(e2, stepX[2]);
+					z = XMVectorAdd(z, stepZ);
+				}
+			}
+		}
+	}
+
+	// The farthest depth anywhere in the tile.
+	XMVECTOR maxDepth = XMLoadFloat4(&depth[0]);
+	for(UINT i = 1; i < TileHeight * groupsPerRow; ++i)
+	{
+		maxDepth = XMVectorMax(maxDepth, XMLoadFloat4(&depth[i]));
+	}
+	XMFLOAT4 lanes;
+	XMStoreFloat4(&lanes, maxDepth);
+	mTileMaxDepth[tile] = MathHelper::Max(MathHelper::Max(lanes.x, lanes.y), MathHelper::Max(lanes.z, lanes.w));
+}
+
+bool OcclusionCuller::IsVisible(const BoundingBox& worldBox)const
+{
+	XMMATRIX viewProj = XMLoadFloat4x4(&mViewProj);
+
+	// The box's center and axes in clip space.
+	XMFLOAT4 center, axis[3];
+	XMStoreFloat4(&center, XMVector3Transform(XMLoadFloat3(&worldBox.Center), viewProj));
+	XMStoreFloat4(&axis[0], XMVectorScale(viewProj.r[0], worldBox.Extents.x));
+	XMStoreFloat4(&axis[1], XMVectorScale(viewProj.r[1], worldBox.Extents.y));
+	XMStoreFloat4(&axis[2], XMVectorScale(viewProj.r[2], worldBox.Extents.z));
+
+	// The 8 corners as two sets of 4 lanes, one per side of the box in z.
+	const XMVECTOR signX = XMVectorSet(-1.0f, 1.0f, -1.0f, 1.0f);
+	const XMVECTOR signY = XMVectorSet(-1.0f, -1.0f, 1.0f, 1.0f);
+	const XMVECTOR halfWidth = XMVectorReplicate(0.5f * mWidth);
+	const XMVECTOR halfHeight = XMVectorReplicate(0.5f * mHeight);
+
+	XMVECTOR minX = XMVectorReplicate(MathHelper::Infinity);
+	XMVECTOR maxX = XMVectorReplicate(-MathHelper::Infinity);
+	XMVECTOR minY = minX;
+	XMVECTOR maxY = maxX;
+	XMVECTOR minZ = minX;
+
+	const float* c = &center.x;
+	const float* ax = &axis[0].x;
+	const float* ay = &axis[1].x;
+	const float* az = &axis[2].x;
+	for(UINT side = 0; side < 2; ++side)
+	{
+		// lanes[k] is component k (x, y, z, w) of the 4 corners.
+		const float signZ = side == 0 ? -1.0f : 1.0f;
+		XMVECTOR lanes[4];
+		for(UINT k = 0; k < 4; ++k)
+		{
+			lanes[k] = XMVectorMultiplyAdd(signX, XMVectorReplicate(ax[k]),
+				XMVectorMultiplyAdd(signY, XMVectorReplicate(ay[k]), XMVectorReplicate(c[k] + signZ*az[k])));
+		}
+
+		// In front of the near plane: the box may cover the whole screen.
+		if(XMVector4NotEqualInt(XMVectorLess(lanes[2], XMVectorZero()), XMVectorZero()))
+			return true;
+
+		const XMVECTOR invW = XMVectorReciprocal(lanes[3]);
+		const XMVECTOR x = XMVectorMultiplyAdd(XMVectorMultiply(lanes[0], invW), halfWidth, halfWidth);
+		const XMVECTOR y = XMVectorSubtract(halfHeight, XMVectorMultiply(XMVectorMultiply(lanes[1], invW), halfHeight));
+		minX = XMVectorMin(minX, x);
+		maxX = XMVectorMax(maxX, x);
+		minY = XMVectorMin(minY, y);
+		maxY = XMVectorMax(maxY, y);
+		minZ = XMVectorMin(minZ, XMVectorMultiply(lanes[2], invW));
+	}
+
+	XMFLOAT4 lo[3], hi[2];
+	XMStoreFloat4(&lo[0], minX);
+	XMStoreFloat4(&lo[1], minY);
+	XMStoreFloat4(&lo[2], minZ);
+	XMStoreFloat4(&hi[0], maxX);
+	XMStoreFloat4(&hi[1], maxY);
+	const float rectMin[3] =
+	{
+		MathHelper::Min(MathHelper::Min(lo[0].x, lo[0].y), MathHelper::Min(lo[0].z, lo[0].w)),
+		MathHelper::Min(MathHelper::Min(lo[1].x, lo[1].y), MathHelper::Min(lo[1].z, lo[1].w)),
+		MathHelper::Min(MathHelper::Min(lo[2].x, lo[2].y), MathHelper::Min(lo[2].z, lo[2].w))
+	};
+	const float rectMax[2] =
+	{
+		MathHelper::Max(MathHelper::Max(hi[0].x, hi[0].y), MathHelper::Max(hi[0].z, hi[0].w)),
+		MathHelper::Max(MathHelper::Max(hi[1].x, hi[1].y), MathHelper::Max(hi[1].z, hi[1].w))
+	};
+	const float minZValue = rectMin[2];
+
+	// Every pixel the box's screen rectangle touches.
+	const float firstX = MathHelper::Max(floorf(rectMin[0]), 0.0f);
+	const float lastX = MathHelper::Min(ceilf(rectMax[0]) - 1.0f, (float)mWidth - 1.0f);
+	const float firstY = MathHelper::Max(floorf(rectMin[1]), 0.0f);
+	const float lastY = MathHelper::Min(ceilf(rectMax[1]) - 1.0f, (float)mHeight - 1.0f);
+	if(firstX > lastX || firstY > lastY)
+		return false;
+
+	const int x0 = (int)firstX;
+	const int x1 = (int)lastX;
+	const int y0 = (int)firstY;
+	const int y1 = (int)lastY;
+
+	const UINT groupsPerRow = TileWidth / 4;
+	const XMVECTOR boxDepth = XMVectorReplicate(minZValue);
+	const XMVECTOR laneOffsets = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	const XMVECTOR rectMinX = XMVectorReplicate((float)x0);
+	const XMVECTOR rectMaxX = XMVectorReplicate((float)x1);
+
+	for(UINT ty = y0 / TileHeight; ty <= y1 / TileHeight; ++ty)
+	{
+		for(UINT tx = x0 / TileWidth; tx <= x1 / TileWidth; ++tx)
+		{
+			const UINT tile = ty*mTilesX + tx;
+
+			// Every occluder pixel in the tile is in front of the box.
+			if(mTileMaxDepth[tile] < minZValue)
+				continue;
+
+			const int tileX = (int)(tx * TileWidth);
+			const int tileY = (int)(ty * TileHeight);
+			const int rowBegin = MathHelper::Max(y0, tileY);
+			const int rowEnd = MathHelper::Min(y1, tileY + (int)TileHeight - 1);
+			const int firstGroup = (MathHelper::Max(x0, tileX) - tileX) / 4;
+			const int lastGroup = (MathHelper::Min(x1, tileX + (int)TileWidth - 1) - tileX) / 4;
+
+			const XMFLOAT4* depth = &mDepth[(size_t)tile * TileHeight * groupsPerRow];
+			for(int py = rowBegin; py <= rowEnd; ++py)
+			{
+				const XMFLOAT4* row = depth + (py - tileY)*groupsPerRow;
+				for(int g = firstGroup; g <= lastGroup; ++g)
+				{
+					// Only the lanes inside the rectangle.
+					XMVECTOR px = XMVectorAdd(XMVectorReplicate((float)(tileX + 4*g)), laneOffsets);
+					XMVECTOR inRect = XMVectorAndInt(XMVectorGreaterOrEqual(px, rectMinX), XMVectorLessOrEqual(px, rectMaxX));
+
+					// An occluder pixel at or behind the box's nearest point.
+					XMVECTOR behind = XMVectorAndInt(XMVectorGreaterOrEqual(XMLoadFloat4(&row[g]), boxDepth), inRect);
+					if(XMVector4NotEqualInt(behind, XMVectorZero()))
+						return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+UINT OcclusionCuller::TestBoxes(const BoundingBox* worldBoxes, UINT count, BYTE* visible)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::fill(mThreadRejected.begin(), mThreadRejected.end(), 0);
+
+	mThreadPool->ParallelFor(count, 64, [&](UINT begin, UINT end, UINT threadIndex)
+	{
+		UINT rejected = 0;
+		for(UINT i = begin; i < end; ++i)
+		{
+			visible[i] = IsVisible(worldBoxes[i]) ? 1 : 0;
+			rejected += 1 - visible[i];
+		}
+		mThreadRejected[threadIndex] += rejected;
+	});
+
+	UINT rejected = 0;
+	for(UINT threadRejected : mThreadRejected)
+	{
+		rejected += threadRejected;
+	}
+
+	mObjectsTested += count;
+	mObjectsRejected += rejected;
+
+	auto end = std::chrono::high_resolution_clock::now();
+	mTestMs += std::chrono::duration<double, std::milli>(end - start).count();
+
+	return count - rejected;
+}
+
+float OcclusionCuller::GetDepth(UINT x, UINT y)const
+{
+	const UINT groupsPerRow = TileWidth / 4;
+	const UINT tile = (y / TileHeight)*mTilesX + x / TileWidth;
+	const UINT px = x % TileWidth;
+	const UINT py = y % TileHeight;
+
+	const XMFLOAT4& group = mDepth[((size_t)tile*TileHeight + py)*groupsPerRow + px / 4];
+	const float lanes[4] = { group.x, group.y, group.z, group.w };
+	return lanes[px % 4];
+}
+
+UINT OcclusionCuller::TrianglesDrawn()const
+{
+	return mTrianglesDrawn;
+}
+
+UINT OcclusionCuller::ObjectsTested()const
+{
+	return mObjectsTested;
+}
+
+UINT OcclusionCuller::ObjectsRejected()const
+{
+	return mObjectsRejected;
+}
+
+float OcclusionCuller::RejectedFraction()const
+{
+	return mObjectsTested > 0 ? (float)mObjectsRejected / (float)mObjectsTested : 0.0f;
+}
+
+double OcclusionCuller::RenderMs()const
+{
+	return mRenderMs;
+}
+
+double OcclusionCuller::TestMs()const
+{
+	return mTestMs;
+}
@@ -0,0 +1,124 @@
+//***************************************************************************************
+// OcclusionCuller.h
+//
+// CPU occlusion culling against a coarse software depth buffer.
+//***************************************************************************************
+
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include "MathHelper.h"
+#include "ThreadPool.h"
+#include <DirectXCollision.h>
+
+///<summary>
+/// Rasterizes a few low-poly occluders (hills, walls, big boxes) into a small
+/// depth buffer on the CPU, then tests bounding boxes against it so objects
+/// hidden behind them are never drawn or written to an instance buffer.
+///
+/// The buffer is split into TileWidth x TileHeight tiles.  Render sets up the
+/// occluder triangles and bins them to tiles on every thread, then each
+/// tile is rasterized by one thread, 4 pixels at a time, keeping the nearest
+/// depth.  Each tile also keeps its farthest depth, so a box behind a fully
+/// covered tile is rejected without looking at its pixels.
+///
+/// Depth is post-projection z (0 at the near plane, 1 at the far plane).
+/// Occluder coverage is sampled at pixel centers, so at this resolution an
+/// occluder can cover a little more than it really does; occluder meshes
+/// should sit just inside the geometry they stand for.  Boxes that cross
+/// the near plane are always visible.
+///</summary>
+class OcclusionCuller
+{
+public:
+	// A mesh drawn into the depth buffer, with front faces clockwise as in
+	// the rest of the demos.  Vertices and Indices are not copied.
+	struct Occluder
+	{
+		const DirectX::XMFLOAT3* Vertices = nullptr;
+		const UINT* Indices = nullptr;
+		UINT IndexCount = 0;
+		DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	};
+
+	static const UINT TileWidth = 32;
+	static const UINT TileHeight = 16;
+
+	// A width x height depth buffer; the tiles may run past the edges.
+	void Initialize(ThreadPool* threadPool, UINT width, UINT height);
+
+	UINT Width()const;
+	UINT Height()const;
+
+	// Clears the depth buffer and draws the occluders seen through viewProj.
+	void Render(DirectX::FXMMATRIX viewProj, const Occluder* occluders, UINT occluderCount);
+
+	// Whether any part of the world space box may be visible past the
+	// occluders.  Boxes off screen are not.  Safe to call from many threads.
+	bool IsVisible(const DirectX::BoundingBox& worldBox)const;
+
+	// IsVisible for count boxes in parallel, with visible[i] set to 1 or 0.
+	// Returns how many are visible.  Adds to the counters below.
+	UINT TestBoxes(const DirectX::BoundingBox* worldBoxes, UINT count, BYTE* visible);
+
+	// Nearest occluder depth at pixel (x, y), 1 where there is none.
+	float GetDepth(UINT x, UINT y)const;
+
+	// Since the last Render: triangles rasterized (after clipping and back
+	// face culling), boxes tested and rejected, and the time spent.
+	UINT TrianglesDrawn()const;
+	UINT ObjectsTested()const;
+	UINT ObjectsRejected()const;
+	float RejectedFraction()const;
+	double RenderMs()const;
+	double TestMs()const;
+
+private:
+	// A screen space triangle, set up so that for pixel (x, y) the edge
+	// functions Edge[i].x*x + Edge[i].y*y + Edge[i].z are all >= 0 inside
+	// and the depth is Depth.x*x + Depth.y*y + Depth.z.
+	struct Triangle
+	{
+		DirectX::XMFLOAT3 Edge[3];
+		DirectX::XMFLOAT3 Depth;
+		int MinX, MinY, MaxX, MaxY;   // Pixels it may cover, inclusive.
+	};
+
+	// Clips a clip space triangle against the near plane and adds what is
+	// left, front facing and on screen to the thread's bins.
+	void AddTriangle(DirectX::FXMVECTOR v0, DirectX::FXMVECTOR v1, DirectX::FXMVECTOR v2, UINT threadIndex);
+	void SetupTriangle(DirectX::FXMVECTOR v0, DirectX::FXMVECTOR v1, DirectX::FXMVECTOR v2, UINT threadIndex);
+
+	void RasterizeTile(UINT tile);
+
+	ThreadPool* mThreadPool = nullptr;
+
+	UINT mWidth = 0;
+	UINT mHeight = 0;
+	UINT mTilesX = 0;
+	UINT mTilesY = 0;
+
+	DirectX::XMFLOAT4X4 mViewProj = MathHelper::Identity4x4();
+
+	// Tile by tile, row by row, 4 pixels per entry.
+	std::vector<DirectX::XMFLOAT4> mDepth;
+	std::vector<float> mTileMaxDepth;
+
+	// Per thread: the triangles it set up, and for each tile the indices of
+	// those that touch it.
+	std::vector<std::vector<Triangle>> mThreadTriangles;
+	std::vector<std::vector<std::vector<UINT>>> mThreadBins;
+	std::vector<UINT> mThreadRejected;
+
+	// Occluder transforms, and the first triangle of each occluder.
+	std::vector<DirectX::XMFLOAT4X4> mOccluderTransforms;
+	std::vector<UINT> mFirstTriangles;
+
+	UINT mTrianglesDrawn = 0;
+	UINT mObjectsTested = 0;
+	UINT mObjectsRejected = 0;
+	double mRenderMs = 0.0;
+	double mTestMs = 0.0;
+};
+
+#endif // OCCLUSIONCULLER_H
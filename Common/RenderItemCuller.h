@@ -0,0 +1,189 @@
+//***************************************************************************************
+// RenderItemCuller.h
+//
+// Camera frustum culling of the demos' per-layer RenderItem lists.
+//***************************************************************************************
+
+#ifndef RENDERITEMCULLER_H
+#define RENDERITEMCULLER_H
+
+#include "d3dUtil.h"
+
+///<summary>
+/// Culls each layer of render items against the camera frustum once per
+/// frame, before Draw, so DrawRenderItems only sees the visible ones.
+///
+/// RenderItemT is the app's RenderItem; it needs World, ObjCBIndex, Geo,
+/// IndexCount, StartIndexLocation and BaseVertexLocation, which every
+/// demo's has.  An item's local bounds are taken from the CPU copy of its
+/// geometry (vertex position first, as in all the demos' vertex formats)
+/// the first time it is seen, and kept by ObjCBIndex.  Items with no CPU
+/// copy, such as the waves, whose vertex buffer is rewritten every frame,
+/// are always visible.  So are the items of layers left out of the mask:
+/// the sky (drawn around the eye in the shader), screen space quads, and
+/// anything moved on the GPU.
+///
+/// IsVisible lets UpdateObjectCBs leave hidden items dirty instead of
+/// writing their constants.
+///</summary>
+template<typename RenderItemT>
+class RenderItemCuller
+{
+public:
+	// Culls layers[l] for each l in layerMask; the other layers pass through
+	// untouched.  layers must stay alive until the next Cull.
+	void Cull(DirectX::FXMMATRIX view, DirectX::CXMMATRIX proj,
+		const std::vector<RenderItemT*>* layers, UINT layerCount, UINT layerMask = ~0u)
+	{
+		DirectX::BoundingFrustum viewFrustum;
+		DirectX::BoundingFrustum::CreateFromMatrix(viewFrustum, proj);
+		DirectX::BoundingFrustum worldFrustum;
+		viewFrustum.Transform(worldFrustum, DirectX::XMMatrixInverse(nullptr, view));
+
+		mLayers = layers;
+		mLayerMask = layerMask;
+		mVisible.resize(layerCount);
+		mItemsTested = 0;
+		mItemsVisible = 0;
+		++mCullCount;
+
+		// An item in more than one culled layer is visible if it is in any,
+		// and is counted once.
+		for(UINT l = 0; l < layerCount; ++l)
+		{
+			if( (layerMask & (1u << l)) == 0 )
+				continue;
+
+			for(const RenderItemT* ri : layers[l])
+			{
+				ItemInfo& item = GetItem(ri->ObjCBIndex);
+				item.Visible = false;
+				if(item.LastCull != mCullCount)
+				{
+					item.LastCull = mCullCount;
+					++mItemsTested;
+				}
+			}
+		}
+
+		for(UINT l = 0; l < layerCount; ++l)
+		{
+			mVisible[l].clear();
+			if( (layerMask & (1u << l)) == 0 )
+				continue;
+
+			for(RenderItemT* ri : layers[l])
+			{
+				ItemInfo& item = GetItem(ri->ObjCBIndex);
+				if(!item.HasBounds)
+					ComputeLocalBounds(*ri, item);
+
+				bool visible = !item.Cullable;
+				if(!visible)
+				{
+					DirectX::BoundingBox worldBounds;
+					item.LocalBounds.Transform(worldBounds, DirectX::XMLoadFloat4x4(&ri->World));
+					visible = worldFrustum.Contains(worldBounds) != DirectX::DISJOINT;
+				}
+
+				if(visible)
+				{
+					mVisible[l].push_back(ri);
+					if(!item.Visible)
+						++mItemsVisible;
+					item.Visible = true;
+				}
+			}
+		}
+	}
+
+	// The items of layer l to draw this frame, in their original order.
+	const std::vector<RenderItemT*>& Visible(UINT l)const
+	{
+		return (mLayerMask & (1u << l)) != 0 ? mVisible[l] : mLayers[l];
+	}
+
+	// Whether the item with this ObjCBIndex is drawn this frame.  Items never
+	// culled are.
+	bool IsVisible(UINT objCBIndex)const
+	{
+		return objCBIndex >= mItems.size() || mItems[objCBIndex].Visible;
+	}
+
+	// Distinct items (by ObjCBIndex) in the culled layers, by the last Cull.
+	UINT ItemsTested()const
+	{
+		return mItemsTested;
+	}
+
+	UINT ItemsVisible()const
+	{
+		return mItemsVisible;
+	}
+
+	UINT DrawsAvoided()const
+	{
+		return mItemsTested - mItemsVisible;
+	}
+
+private:
+	struct ItemInfo
+	{
+		DirectX::BoundingBox LocalBounds;
+		bool HasBounds = false;
+		bool Cullable = false;
+		bool Visible = true;
+		UINT LastCull = 0;
+	};
+
+	ItemInfo& GetItem(UINT objCBIndex)
+	{
+		if(objCBIndex >= mItems.size())
+			mItems.resize(objCBIndex + 1);
+		return mItems[objCBIndex];
+	}
+
+	// Bounds of the vertices the item's indices use.
+	static void ComputeLocalBounds(const RenderItemT& ri, ItemInfo& item)
+	{
+		item.HasBounds = true;
+
+		const MeshGeometry* geo = ri.Geo;
+		if(geo == nullptr || geo->VertexBufferCPU == nullptr || geo->IndexBufferCPU == nullptr || ri.IndexCount == 0)
+			return;
+
+		const BYTE* vertices = static_cast<const BYTE*>(geo->VertexBufferCPU->GetBufferPointer());
+		const void* indices = geo->IndexBufferCPU->GetBufferPointer();
+
+		DirectX::XMVECTOR vMin = DirectX::XMVectorReplicate(MathHelper::Infinity);
+		DirectX::XMVECTOR vMax = DirectX::XMVectorReplicate(-MathHelper::Infinity);
+		for(UINT i = ri.StartIndexLocation; i < ri.StartIndexLocation + ri.IndexCount; ++i)
+		{
+			UINT index = geo->IndexFormat == DXGI_FORMAT_R16_UINT ?
+				static_cast<const std::uint16_t*>(indices)[i] : static_cast<const std::uint32_t*>(indices)[i];
+
+			const DirectX::XMFLOAT3* pos = reinterpret_cast<const DirectX::XMFLOAT3*>(
+				vertices + (size_t)(ri.BaseVertexLocation + (INT)index) * geo->VertexByteStride);
+			DirectX::XMVECTOR p = DirectX::XMLoadFloat3(pos);
+			vMin = DirectX::XMVectorMin(vMin, p);
+			vMax = DirectX::XMVectorMax(vMax, p);
+		}
+
+		DirectX::XMStoreFloat3(&item.LocalBounds.Center, DirectX::XMVectorScale(DirectX::XMVectorAdd(vMin, vMax), 0.5f));
+		DirectX::XMStoreFloat3(&item.LocalBounds.Extents, DirectX::XMVectorScale(DirectX::XMVectorSubtract(vMax, vMin), 0.5f));
+		item.Cullable = true;
+	}
+
+	const std::vector<RenderItemT*>* mLayers = nullptr;
+	UINT mLayerMask = 0;
+	std::vector<std::vector<RenderItemT*>> mVisible;
+
+	// By ObjCBIndex.
+	std::vector<ItemInfo> mItems;
+
+	UINT mCullCount = 0;
+	UINT mItemsTested = 0;
+	UINT mItemsVisible = 0;
+};
+
+#endif // RENDERITEMCULLER_H
@@ -0,0 +1,146 @@
+//***************************************************************************************
+// RenderQueue.cpp
+//***************************************************************************************
+
+#include "RenderQueue.h"
+#include <utility>
+
+namespace
+{
+	const UINT DepthShift = 0;
+	const UINT MaterialShift = DepthShift + RenderQueue::DepthBits;
+	const UINT GeometryShift = MaterialShift + RenderQueue::MaterialBits;
+	const UINT PsoShift = GeometryShift + RenderQueue::GeometryBits;
+	const UINT LayerShift = PsoShift + RenderQueue::PsoBits;
+
+	UINT GetField(UINT64 key, UINT shift, UINT bits)
+	{
+		return (UINT)((key >> shift) & ((1ull << bits) - 1));
+	}
+}
+
+UINT64 RenderQueue::MakeKey(UINT layer, UINT pso, UINT geometry, UINT material, float depth)
+{
+	const UINT maxDepth = (1u << DepthBits) - 1;
+	depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+
+	return ((UINT64)(layer & ((1u << LayerBits) - 1)) << LayerShift) |
+		((UINT64)(pso & ((1u << PsoBits) - 1)) << PsoShift) |
+		((UINT64)(geometry & ((1u << GeometryBits) - 1)) << GeometryShift) |
+		((UINT64)(material & ((1u << MaterialBits) - 1)) << MaterialShift) |
+		((UINT64)(depth*maxDepth) << DepthShift);
+}
+
+UINT RenderQueue::GetLayer(UINT64 key)
+{
+	return GetField(key, LayerShift, LayerBits);
+}
+
+UINT RenderQueue::GetPso(UINT64 key)
+{
+	return GetField(key, PsoShift, PsoBits);
+}
+
+UINT RenderQueue::GetGeometry(UINT64 key)
+{
+	return GetField(key, GeometryShift, GeometryBits);
+}
+
+UINT RenderQueue::GetMaterial(UINT64 key)
+{
+	return GetField(key, MaterialShift, MaterialBits);
+}
+
+void RenderQueue::Clear()
+{
+	mEntries.clear();
+}
+
+void RenderQueue::Add(UINT64 key, UINT item)
+{
+	mEntries.push_back({ key, item });
+}
+
+void RenderQueue::Sort()
+{
+	const UINT count = (UINT)mEntries.size();
+	mScratch.resize(count);
+	mSortPasses = 0;
+
+	// Counts of every byte value at every byte position, in one read.
+	UINT counts[8][256] = {};
+	for(const Entry& e : mEntries)
+	{
+		for(UINT b = 0; b < 8; ++b)
+		{
+			counts[b][(e.Key >> (8*b)) & 0xff]++;
+		}
+	}
+
+	Entry* src = mEntries.data();
+	Entry* dst = mScratch.data();
+	for(UINT b = 0; b < 8; ++b)
+	{
+		// Every key has the same byte here: nothing would move.
+		if(count == 0 || counts[b][(src[0].Key >> (8*b)) & 0xff] == count)
+			continue;
+
+		UINT offsets[256];
+		UINT sum = 0;
+		for(UINT v = 0; v < 256; ++v)
+		{
+			offsets[v] = sum;
+			sum += counts[b][v];
+		}
+
+		for(UINT i = 0; i < count; ++i)
+		{
+			dst[offsets[(src[i].Key >> (8*b)) & 0xff]++] = src[i];
+		}
+
+		std::swap(src, dst);
+		mSortPasses++;
+	}
+
+	if(src != mEntries.data())
+		mEntries.swap(mScratch);
+}
+
+UINT RenderQueue::Size()const
+{
+	return (UINT)mEntries.size();
+}
+
+UINT64 RenderQueue::GetKey(UINT i)const
+{
+	return mEntries[i].Key;
+}
+
+UINT RenderQueue::GetItem(UINT i)const
+{
+	return mEntries[i].Item;
+}
+
+RenderQueue::BindCounts RenderQueue::CountBinds()const
+{
+	BindCounts binds;
+	for(UINT i = 0; i < (UINT)mEntries.size(); ++i)
+	{
+		const UINT64 key = mEntries[i].Key;
+		const UINT64 prev = i > 0 ? mEntries[i - 1].Key : 0;
+
+		// A new layer or PSO sets the PSO even if the id happens to repeat.
+		if(i == 0 || GetLayer(key) != GetLayer(prev) || GetPso(key) != GetPso(prev))
+			binds.Pso++;
+		if(i == 0 || GetGeometry(key) != GetGeometry(prev))
+			binds.Geometry++;
+		if(i == 0 || GetMaterial(key) != GetMaterial(prev))
+			binds.Material++;
+	}
+	return binds;
+}
+
+UINT RenderQueue::SortPasses()const
+{
+	return mSortPasses;
+}
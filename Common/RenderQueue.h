@@ -0,0 +1,78 @@
+//***************************************************************************************
+// RenderQueue.h
+//
+// Draws sorted by 64-bit state keys.
+//***************************************************************************************
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <Windows.h>
+#include <vector>
+
+///<summary>
+/// A frame's draws as 64-bit sort keys, each with the index of the item it
+/// draws.  From the most significant bits down a key holds the layer, PSO,
+/// geometry, material and depth, so after Sort the draws are grouped by
+/// the state that is most expensive to change, and DrawRenderItems only
+/// sets what differs from the previous draw.
+///
+/// The ids are the app's: typically the layer, the PSO it draws with, an
+/// index per MeshGeometry (and topology) and the material's MatCBIndex.
+/// Depth is in [0, 1], nearest first; pass 1 - depth to sort a layer back
+/// to front.
+///</summary>
+class RenderQueue
+{
+public:
+	// Field widths, from the most significant.
+	static const UINT LayerBits = 4;
+	static const UINT PsoBits = 8;
+	static const UINT GeometryBits = 12;
+	static const UINT MaterialBits = 16;
+	static const UINT DepthBits = 24;
+
+	static UINT64 MakeKey(UINT layer, UINT pso, UINT geometry, UINT material, float depth);
+
+	static UINT GetLayer(UINT64 key);
+	static UINT GetPso(UINT64 key);
+	static UINT GetGeometry(UINT64 key);
+	static UINT GetMaterial(UINT64 key);
+
+	void Clear();
+	void Add(UINT64 key, UINT item);
+
+	// Stable LSD radix sort on the keys, 8 bits a pass.  Passes over bytes
+	// that are the same in every key are skipped.
+	void Sort();
+
+	UINT Size()const;
+	UINT64 GetKey(UINT i)const;
+	UINT GetItem(UINT i)const;
+
+	// State changes drawing the queue in its current order takes when
+	// each state is only set when it differs from the previous draw.
+	struct BindCounts
+	{
+		UINT Pso = 0;
+		UINT Geometry = 0;
+		UINT Material = 0;
+	};
+	BindCounts CountBinds()const;
+
+	// Radix passes the last Sort made (at most 8).
+	UINT SortPasses()const;
+
+private:
+	struct Entry
+	{
+		UINT64 Key;
+		UINT Item;
+	};
+
+	std::vector<Entry> mEntries;
+	std::vector<Entry> mScratch;
+	UINT mSortPasses = 0;
+};
+
+#endif // RENDERQUEUE_H
@@ -0,0 +1,241 @@
+//***************************************************************************************
+// StaticBatcher.cpp
+//***************************************************************************************
+
+#include "StaticBatcher.h"
+#include "MathHelper.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <set>
+#include <tuple>
+
+using namespace DirectX;
+
+namespace
+{
+	const UINT MaxChunkVertices = 65536;
+
+	UINT ReadIndex(const MeshGeometry& geo, UINT i)
+	{
+		const void* indices = geo.IndexBufferCPU->GetBufferPointer();
+		return geo.IndexFormat == DXGI_FORMAT_R16_UINT ?
+			static_cast<const std::uint16_t*>(indices)[i] : static_cast<const std::uint32_t*>(indices)[i];
+	}
+}
+
+StaticBatcher::StaticBatcher(const VertexLayout& layout, float chunkSize)
+	: mLayout(layout), mChunkSize(chunkSize)
+{
+}
+
+bool StaticBatcher::Add(const MeshGeometry& geo, UINT indexCount, UINT startIndexLocation, INT baseVertexLocation,
+	const XMFLOAT4X4& world, const XMFLOAT4X4& texTransform, UINT materialId)
+{
+	// The submesh's vertices are the range its indices span.
+	UINT minIndex = UINT_MAX;
+	UINT maxIndex = 0;
+	for(UINT i = startIndexLocation; i < startIndexLocation + indexCount; ++i)
+	{
+		UINT index = ReadIndex(geo, i);
+		minIndex = MathHelper::Min(minIndex, index);
+		maxIndex = MathHelper::Max(maxIndex, index);
+	}
+	const UINT vertexCount = indexCount > 0 ? maxIndex - minIndex + 1 : 0;
+
+	// Its indices would not fit in 16 bits relative to a chunk's base vertex.
+	if(vertexCount > MaxChunkVertices)
+		return false;
+
+	Item item;
+	item.Geo = &geo;
+	item.IndexCount = indexCount;
+	item.StartIndexLocation = startIndexLocation;
+	item.BaseVertexLocation = baseVertexLocation;
+	item.MinIndex = indexCount > 0 ? minIndex : 0;
+	item.VertexCount = vertexCount;
+	item.World = world;
+	item.TexTransform = texTransform;
+	item.MaterialId = materialId;
+	mItems.push_back(item);
+	return true;
+}
+
+void StaticBatcher::Bake(const Item& item, BakedItem& baked)const
+{
+	const MeshGeometry& geo = *item.Geo;
+	const UINT stride = mLayout.ByteStride;
+	const UINT minIndex = item.MinIndex;
+	const UINT vertexCount = item.VertexCount;
+
+	const BYTE* source = static_cast<const BYTE*>(geo.VertexBufferCPU->GetBufferPointer()) +
+		(size_t)(item.BaseVertexLocation + (INT)minIndex) * stride;
+	baked.Vertices.assign(source, source + (size_t)vertexCount * stride);
+
+	XMMATRIX world = XMLoadFloat4x4(&item.World);
+	XMMATRIX normalTransform = MathHelper::InverseTranspose(world);
+	XMMATRIX texTransform = XMLoadFloat4x4(&item.TexTransform);
+
+	XMVECTOR vMin = XMVectorReplicate(MathHelper::Infinity);
+	XMVECTOR vMax = XMVectorReplicate(-MathHelper::Infinity);
+	for(UINT v = 0; v < vertexCount; ++v)
+	{
+		BYTE* vertex = &baked.Vertices[(size_t)v * stride];
+
+		XMFLOAT3* pos = reinterpret_cast<XMFLOAT3*>(vertex + mLayout.PositionOffset);
+		XMVECTOR p = XMVector3TransformCoord(XMLoadFloat3(pos), world);
+		XMStoreFloat3(pos, p);
+		vMin = XMVectorMin(vMin, p);
+		vMax = XMVectorMax(vMax, p);
+
+		if(mLayout.NormalOffset != NoAttribute)
+		{
+			XMFLOAT3* normal = reinterpret_cast<XMFLOAT3*>(vertex + mLayout.NormalOffset);
+			XMStoreFloat3(normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(normal), normalTransform)));
+		}
+
+		if(mLayout.TangentOffset != NoAttribute)
+		{
+			XMFLOAT3* tangent = reinterpret_cast<XMFLOAT3*>(vertex + mLayout.TangentOffset);
+			XMStoreFloat3(tangent, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(tangent), world)));
+		}
+
+		if(mLayout.TexCOffset != NoAttribute)
+		{
+			XMFLOAT2* texC = reinterpret_cast<XMFLOAT2*>(vertex + mLayout.TexCOffset);
+			XMVECTOR t = XMVectorSet(texC->x, texC->y, 0.0f, 1.0f);
+			XMStoreFloat2(texC, XMVector4Transform(t, texTransform));
+		}
+	}
+
+	XMStoreFloat3(&baked.Bounds.Center, XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f));
+	XMStoreFloat3(&baked.Bounds.Extents, XMVectorScale(XMVectorSubtract(vMax, vMin), 0.5f));
+
+	// A mirroring transform turns clockwise triangles counterclockwise.
+	const bool flip = XMVectorGetX(XMMatrixDeterminant(world)) < 0.0f;
+	baked.Indices.resize(item.IndexCount);
+	for(UINT i = 0; i < item.IndexCount; ++i)
+	{
+		baked.Indices[i] = (std::uint16_t)(ReadIndex(geo, item.StartIndexLocation + i) - minIndex);
+	}
+	if(flip)
+	{
+		for(UINT i = 0; i + 2 < item.IndexCount; i += 3)
+		{
+			std::swap(baked.Indices[i + 1], baked.Indices[i + 2]);
+		}
+	}
+
+	baked.MaterialId = item.MaterialId;
+	baked.CellX = (int)std::floor(baked.Bounds.Center.x / mChunkSize);
+	baked.CellZ = (int)std::floor(baked.Bounds.Center.z / mChunkSize);
+}
+
+void StaticBatcher::Build()
+{
+	mVertices.clear();
+	mIndices.clear();
+	mChunks.clear();
+	mSourceByteSize = 0;
+
+	std::vector<BakedItem> baked(mItems.size());
+	std::set<std::tuple<const MeshGeometry*, UINT, UINT, INT>> submeshes;
+	for(size_t i = 0; i < mItems.size(); ++i)
+	{
+		const Item& item = mItems[i];
+		Bake(item, baked[i]);
+
+		auto submesh = std::make_tuple(item.Geo, item.IndexCount, item.StartIndexLocation, item.BaseVertexLocation);
+		if(submeshes.insert(submesh).second)
+		{
+			UINT indexSize = item.Geo->IndexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+			mSourceByteSize += baked[i].Vertices.size() + (UINT64)item.IndexCount * indexSize;
+		}
+	}
+
+	// By material, then cell, keeping the order items were added in.
+	std::vector<UINT> order(baked.size());
+	for(UINT i = 0; i < (UINT)order.size(); ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](UINT a, UINT b)
+	{
+		return std::make_tuple(baked[a].MaterialId, baked[a].CellX, baked[a].CellZ) <
+			std::make_tuple(baked[b].MaterialId, baked[b].CellX, baked[b].CellZ);
+	});
+
+	const UINT stride = mLayout.ByteStride;
+	XMVECTOR vMin = XMVectorZero();
+	XMVECTOR vMax = XMVectorZero();
+	UINT chunkVertexCount = 0;
+	const BakedItem* previous = nullptr;
+	for(UINT i : order)
+	{
+		const BakedItem& item = baked[i];
+		const UINT itemVertexCount = (UINT)(item.Vertices.size() / stride);
+
+		bool newChunk = previous == nullptr || item.MaterialId != previous->MaterialId ||
+			item.CellX != previous->CellX || item.CellZ != previous->CellZ ||
+			chunkVertexCount + itemVertexCount > MaxChunkVertices;
+		if(newChunk)
+		{
+			Chunk chunk;
+			chunk.MaterialId = item.MaterialId;
+			chunk.StartIndexLocation = (UINT)mIndices.size();
+			chunk.BaseVertexLocation = (INT)(mVertices.size() / stride);
+			mChunks.push_back(chunk);
+
+			vMin = XMVectorReplicate(MathHelper::Infinity);
+			vMax = XMVectorReplicate(-MathHelper::Infinity);
+			chunkVertexCount = 0;
+		}
+
+		Chunk& chunk = mChunks.back();
+		for(std::uint16_t index : item.Indices)
+		{
+			mIndices.push_back((std::uint16_t)(index + chunkVertexCount));
+		}
+		mVertices.insert(mVertices.end(), item.Vertices.begin(), item.Vertices.end());
+		chunkVertexCount += itemVertexCount;
+		chunk.IndexCount += (UINT)item.Indices.size();
+		chunk.ItemCount++;
+
+		XMVECTOR center = XMLoadFloat3(&item.Bounds.Center);
+		XMVECTOR extents = XMLoadFloat3(&item.Bounds.Extents);
+		vMin = XMVectorMin(vMin, XMVectorSubtract(center, extents));
+		vMax = XMVectorMax(vMax, XMVectorAdd(center, extents));
+		XMStoreFloat3(&chunk.Bounds.Center, XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f));
+		XMStoreFloat3(&chunk.Bounds.Extents, XMVectorScale(XMVectorSubtract(vMax, vMin), 0.5f));
+
+		previous = &item;
+	}
+}
+
+const std::vector<BYTE>& StaticBatcher::GetVertices()const
+{
+	return mVertices;
+}
+
+const std::vector<std::uint16_t>& StaticBatcher::GetIndices()const
+{
+	return mIndices;
+}
+
+const std::vector<StaticBatcher::Chunk>& StaticBatcher::GetChunks()const
+{
+	return mChunks;
+}
+
+UINT StaticBatcher::ItemCount()const
+{
+	return (UINT)mItems.size();
+}
+
+UINT64 StaticBatcher::SourceByteSize()const
+{
+	return mSourceByteSize;
+}
+
+UINT64 StaticBatcher::BatchedByteSize()const
+{
+	return mVertices.size() + mIndices.size() * sizeof(std::uint16_t);
+}
@@ -0,0 +1,126 @@
+//***************************************************************************************
+// StaticBatcher.h
+//
+// Bakes render items that never move into merged world space geometry.
+//***************************************************************************************
+
+#ifndef STATICBATCHER_H
+#define STATICBATCHER_H
+
+#include "d3dUtil.h"
+#include <cstdint>
+
+///<summary>
+/// Pre-transforms the submeshes of static items (floors, walls, columns)
+/// into world space at load time and merges those sharing a material into
+/// one vertex and index buffer, so they need no per-object constants and
+/// draw as a few large chunks instead of one draw each.
+///
+/// Items are grouped by material and by the chunkSize x chunkSize cell of
+/// the xz plane their center falls in; each group is a chunk with its own
+/// world space bounds, so the chunks can still be frustum culled.  A chunk
+/// holds at most 65536 vertices (16-bit indices relative to its
+/// BaseVertexLocation), and a group that would not fit is split.  An item
+/// whose own indices span more vertices than that can't be batched; Add
+/// refuses it and the app keeps drawing it as before.
+///
+/// The source geometry must keep its CPU copies.  Positions are
+/// transformed by the world matrix, normals by its inverse transpose,
+/// tangents by the world matrix and texture coordinates by the item's
+/// TexTransform, all in the app's own vertex format.  Triangles of items
+/// with a mirroring world matrix are flipped to keep their winding.
+///</summary>
+class StaticBatcher
+{
+public:
+	// Byte offsets of the attributes in the app's vertex, NoAttribute for
+	// those it does not have.  Positions and normals are float3s, tangents
+	// float3s and texture coordinates float2s.
+	static const UINT NoAttribute = ~0u;
+	struct VertexLayout
+	{
+		UINT ByteStride = 0;
+		UINT PositionOffset = 0;
+		UINT NormalOffset = NoAttribute;
+		UINT TangentOffset = NoAttribute;
+		UINT TexCOffset = NoAttribute;
+	};
+
+	struct Chunk
+	{
+		// As passed to Add.
+		UINT MaterialId = 0;
+
+		// DrawIndexedInstanced parameters in the merged buffers.
+		UINT IndexCount = 0;
+		UINT StartIndexLocation = 0;
+		INT BaseVertexLocation = 0;
+
+		UINT ItemCount = 0;
+		DirectX::BoundingBox Bounds;
+	};
+
+	StaticBatcher(const VertexLayout& layout, float chunkSize);
+
+	// Adds an item drawing indexCount indices of geo, as its RenderItem does.
+	// Returns false, and adds nothing, if its indices span more than 65536
+	// vertices.
+	bool Add(const MeshGeometry& geo, UINT indexCount, UINT startIndexLocation, INT baseVertexLocation,
+		const DirectX::XMFLOAT4X4& world, const DirectX::XMFLOAT4X4& texTransform, UINT materialId);
+
+	// Bakes the items added so far.  Chunks come out by material, then cell.
+	void Build();
+
+	// The merged buffers, ready for d3dUtil::CreateDefaultBuffer.
+	const std::vector<BYTE>& GetVertices()const;
+	const std::vector<std::uint16_t>& GetIndices()const;
+	const std::vector<Chunk>& GetChunks()const;
+
+	UINT ItemCount()const;
+
+	// Vertex and index bytes the items use in their source geometry, each
+	// distinct submesh counted once, against the merged buffers' size.
+	UINT64 SourceByteSize()const;
+	UINT64 BatchedByteSize()const;
+
+private:
+	struct Item
+	{
+		const MeshGeometry* Geo;
+		UINT IndexCount;
+		UINT StartIndexLocation;
+		INT BaseVertexLocation;
+		// The range of the vertex buffer its indices span.
+		UINT MinIndex;
+		UINT VertexCount;
+		DirectX::XMFLOAT4X4 World;
+		DirectX::XMFLOAT4X4 TexTransform;
+		UINT MaterialId;
+	};
+
+	// An item in world space, with indices from 0.
+	struct BakedItem
+	{
+		std::vector<BYTE> Vertices;
+		std::vector<std::uint16_t> Indices;
+		DirectX::BoundingBox Bounds;
+		UINT MaterialId;
+		int CellX;
+		int CellZ;
+	};
+
+	void Bake(const Item& item, BakedItem& baked)const;
+
+	VertexLayout mLayout;
+	float mChunkSize;
+
+	std::vector<Item> mItems;
+
+	std::vector<BYTE> mVertices;
+	std::vector<std::uint16_t> mIndices;
+	std::vector<Chunk> mChunks;
+
+	UINT64 mSourceByteSize = 0;
+};
+
+#endif // STATICBATCHER_H
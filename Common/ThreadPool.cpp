@@ -0,0 +1,125 @@
+//***************************************************************************************
+// ThreadPool.cpp
+//***************************************************************************************
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(UINT threadCount)
+	: mNextRange(0), mRangesDone(0)
+{
+	if(threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if(threadCount == 0)
+		threadCount = 1;
+
+	// Thread 0 is whoever calls ParallelFor.
+	for(UINT i = 1; i < threadCount; ++i)
+	{
+		mWorkers.emplace_back(&ThreadPool::WorkerMain, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWorkReady.notify_all();
+
+	for(auto& worker : mWorkers)
+	{
+		worker.join();
+	}
+}
+
+UINT ThreadPool::ThreadCount()const
+{
+	return (UINT)mWorkers.size() + 1;
+}
+
+void ThreadPool::ParallelFor(UINT count, UINT grainSize,
+	const std::function<void(UINT, UINT, UINT)>& func)
+{
+	if(count == 0)
+		return;
+
+	grainSize = grainSize > 0 ? grainSize : 1;
+	const UINT rangeCount = (count + grainSize - 1) / grainSize;
+
+	// Not worth waking anyone up.
+	if(mWorkers.empty() || rangeCount == 1)
+	{
+		for(UINT begin = 0; begin < count; begin += grainSize)
+		{
+			func(begin, begin + grainSize < count ? begin + grainSize : count, 0);
+		}
+		return;
+	}
+
+	Job job;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJob.Func = &func;
+		mJob.Count = count;
+		mJob.GrainSize = grainSize;
+		mJob.RangeCount = rangeCount;
+		mJob.Generation++;
+		job = mJob;
+
+		mRangesDone = 0;
+		mNextRange = (UINT64)job.Generation << 32;
+	}
+	mWorkReady.notify_all();
+
+	RunRanges(job, 0);
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mWorkDone.wait(lock, [&]() { return mRangesDone == job.RangeCount; });
+}
+
+void ThreadPool::WorkerMain(UINT threadIndex)
+{
+	UINT seenGeneration = 0;
+	for(;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWorkReady.wait(lock, [&]() { return mQuit || mJob.Generation != seenGeneration; });
+			if(mQuit)
+				return;
+
+			job = mJob;
+			seenGeneration = job.Generation;
+		}
+
+		RunRanges(job, threadIndex);
+	}
+}
+
+void ThreadPool::RunRanges(const Job& job, UINT threadIndex)
+{
+	UINT64 next = mNextRange.load();
+	for(;;)
+	{
+		// Stop when the job is used up, or when it is no longer the current one.
+		if( (UINT)(next >> 32) != job.Generation || (UINT)next >= job.RangeCount )
+			return;
+
+		if( !mNextRange.compare_exchange_weak(next, next + 1) )
+			continue;
+
+		UINT begin = (UINT)next * job.GrainSize;
+		UINT end = begin + job.GrainSize < job.Count ? begin + job.GrainSize : job.Count;
+		(*job.Func)(begin, end, threadIndex);
+
+		if( mRangesDone.fetch_add(1) + 1 == job.RangeCount )
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mWorkDone.notify_all();
+		}
+
+		next = mNextRange.load();
+	}
+}
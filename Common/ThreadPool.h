@@ -0,0 +1,69 @@
+//***************************************************************************************
+// ThreadPool.h
+//
+// A fixed set of worker threads for data-parallel loops.
+//***************************************************************************************
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <Windows.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	// threadCount counts the calling thread, which also works during
+	// ParallelFor.  0 means one thread per hardware thread.
+	explicit ThreadPool(UINT threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool& rhs) = delete;
+	ThreadPool& operator=(const ThreadPool& rhs) = delete;
+
+	UINT ThreadCount()const;
+
+	// Splits [0, count) into ranges of at most grainSize and calls
+	// func(begin, end, threadIndex) for each range, spread over the pool.
+	// threadIndex is in [0, ThreadCount()) and stays the same for the
+	// whole range, so it can index per-thread scratch memory.  Blocks
+	// until every range is done.  Not reentrant.
+	void ParallelFor(UINT count, UINT grainSize,
+		const std::function<void(UINT begin, UINT end, UINT threadIndex)>& func);
+
+private:
+	struct Job
+	{
+		const std::function<void(UINT, UINT, UINT)>* Func = nullptr;
+		UINT Count = 0;
+		UINT GrainSize = 1;
+		UINT RangeCount = 0;
+		UINT Generation = 0;
+	};
+
+	void WorkerMain(UINT threadIndex);
+	void RunRanges(const Job& job, UINT threadIndex);
+
+	std::vector<std::thread> mWorkers;
+
+	std::mutex mMutex;
+	std::condition_variable mWorkReady;
+	std::condition_variable mWorkDone;
+
+	// The current job, guarded by mMutex.  Workers take a copy when they wake.
+	Job mJob;
+	bool mQuit = false;
+
+	// (generation << 32) | next range to hand out.  Tagging the counter with
+	// the generation keeps a worker that wakes up late from taking a range
+	// of the following job with the previous job's parameters.
+	std::atomic<UINT64> mNextRange;
+	std::atomic<UINT> mRangesDone;
+};
+
+#endif // THREADPOOL_H
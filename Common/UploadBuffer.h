@@ -118,6 +118,19 @@ public:
         memcpy(&mMappedData[elementIndex * mElementByteSize], &data, sizeof(T));
     }
 
+    // Direct access to the mapped memory, for code that fills elements in
+    // place instead of building a T and copying it.  The memory is write-combined
+    // and read by the GPU, so only write to it.
+    BYTE* MappedData()
+    {
+        return mMappedData;
+    }
+
+    UINT ElementByteSize()const
+    {
+        return mElementByteSize;
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
@@ -140,6 +140,7 @@
 //#include "../../../Common/UploadBuffer.h"
 //#include "../../../Common/GeometryGenerator.h"
 //#include "StencilFrameResource.h"
+//#include "../../../Common/OcclusionCuller.h"
 //
 //using Microsoft::WRL::ComPtr;
 //using namespace DirectX;
@@ -175,6 +176,11 @@
 //	Material* Mat = nullptr;
 //	MeshGeometry* Geo = nullptr;
 //
+//	// World space bounds, for occlusion culling.  Only the skulls are tested;
+//	// Visible stays true for everything else.
+//	BoundingBox Bounds;
+//	bool Visible = true;
+//
 //    // Primitive topology.
 //    D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //
@@ -220,6 +226,7 @@
 //	void UpdateMaterialCBs(const GameTimer& gt);
 //	void UpdateMainPassCB(const GameTimer& gt);
 //	void UpdateReflectedPassCB(const GameTimer& gt);
+//	void UpdateOcclusion(const GameTimer& gt);
 //
 //	void LoadTextures();
 //    void BuildRootSignature();
@@ -231,6 +238,7 @@
 //    void BuildFrameResources();
 //    void BuildMaterials();
 //    void BuildRenderItems();
+//	void BuildOccluders();
 //    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
 //
 //	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
@@ -279,6 +287,16 @@
 //    float mPhi = 0.42f*XM_PI;
 //    float mRadius = 12.0f;
 //
+//	// The walls around the mirror, drawn into a CPU depth buffer each frame.
+//	// They mostly hide the reflected skull, which is only seen through the
+//	// mirror; from behind the walls are back faces and hide nothing.
+//	ThreadPool mThreadPool;
+//	OcclusionCuller mOcclusionCuller;
+//	std::vector<XMFLOAT3> mWallOccluderVertices;
+//	std::vector<UINT> mWallOccluderIndices;
+//	std::vector<OcclusionCuller::Occluder> mOccluders;
+//	bool mOcclusionCullingEnabled = true;
+//
 //    POINT mLastMousePos;
 //};
 //
@@ -336,9 +354,13 @@
 //	BuildSkullGeometry();
 //	BuildMaterials();
 //    BuildRenderItems();
+//	BuildOccluders();
 //    BuildFrameResources();
 //    BuildPSOs();
 //
+//	// A quarter of the demo's resolution in each direction is plenty.
+//	mOcclusionCuller.Initialize(&mThreadPool, 320, 180);
+//
 //    // Execute the initialization commands.
 //    ThrowIfFailed(mCommandList->Close());
 //    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
@@ -383,6 +405,7 @@
 //	UpdateMaterialCBs(gt);
 //	UpdateMainPassCB(gt);
 //	UpdateReflectedPassCB(gt);
+//	UpdateOcclusion(gt);
 //}
 //
 //void StencilApp::Draw(const GameTimer& gt)
@@ -540,6 +563,12 @@
 //	if(GetAsyncKeyState('S') & 0x8000)
 //		mSkullTranslation.y -= 1.0f*dt;
 //
+//	if(GetAsyncKeyState('1') & 0x8000)
+//		mOcclusionCullingEnabled = true;
+//
+//	if(GetAsyncKeyState('2') & 0x8000)
+//		mOcclusionCullingEnabled = false;
+//
 //	// Don't let user move below ground plane.
 //	mSkullTranslation.y = MathHelper::Max(mSkullTranslation.y, 0.0f);
 //
@@ -549,11 +578,14 @@
 //	XMMATRIX skullOffset = XMMatrixTranslation(mSkullTranslation.x, mSkullTranslation.y, mSkullTranslation.z);
 //	XMMATRIX skullWorld = skullRotate*skullScale*skullOffset;
 //	XMStoreFloat4x4(&mSkullRitem->World, skullWorld);
+//	const BoundingBox& skullBounds = mSkullRitem->Geo->DrawArgs["skull"].Bounds;
+//	skullBounds.Transform(mSkullRitem->Bounds, skullWorld);
 //
 //	// Update reflection world matrix.
 //	XMVECTOR mirrorPlane = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f); // xy plane
 //	XMMATRIX R = XMMatrixReflect(mirrorPlane);
 //	XMStoreFloat4x4(&mReflectedSkullRitem->World, skullWorld * R);
+//	skullBounds.Transform(mReflectedSkullRitem->Bounds, skullWorld * R);
 //
 //	// Update shadow world matrix.
 //    // 更新阴影的世界矩阵
@@ -563,6 +595,14 @@
 //	XMMATRIX shadowOffsetY = XMMatrixTranslation(0.0f, 0.001f, 0.0f);
 //	XMStoreFloat4x4(&mShadowedSkullRitem->World, skullWorld * S * shadowOffsetY);
 //
+//	// The shadow matrix leaves w != 1, which BoundingBox::Transform ignores,
+//	// so project the corners with the divide instead.
+//	XMFLOAT3 shadowCorners[BoundingBox::CORNER_COUNT];
+//	skullBounds.GetCorners(shadowCorners);
+//	for(auto& corner : shadowCorners)
+//		XMStoreFloat3(&corner, XMVector3TransformCoord(XMLoadFloat3(&corner), skullWorld * S * shadowOffsetY));
+//	BoundingBox::CreateFromPoints(mShadowedSkullRitem->Bounds, BoundingBox::CORNER_COUNT, shadowCorners, sizeof(XMFLOAT3));
+//
 //	mSkullRitem->NumFramesDirty = gNumFrameResources;
 //	mReflectedSkullRitem->NumFramesDirty = gNumFrameResources;
 //	mShadowedSkullRitem->NumFramesDirty = gNumFrameResources;
@@ -695,6 +735,30 @@
 //	currPassCB->CopyData(1, mReflectedPassCB);
 //}
 //
+//void StencilApp::UpdateOcclusion(const GameTimer& gt)
+//{
+//	// Draw the walls into the CPU depth buffer and test the three skulls
+//	// against it.  DrawRenderItems skips the ones found hidden.
+//	XMMATRIX viewProj = XMMatrixMultiply(XMLoadFloat4x4(&mView), XMLoadFloat4x4(&mProj));
+//	mOcclusionCuller.Render(viewProj, mOccluders.data(), (UINT)mOccluders.size());
+//
+//	RenderItem* skullRitems[] = { mSkullRitem, mReflectedSkullRitem, mShadowedSkullRitem };
+//	BoundingBox boxes[_countof(skullRitems)];
+//	BYTE visible[_countof(skullRitems)];
+//	for(UINT i = 0; i < _countof(skullRitems); ++i)
+//		boxes[i] = skullRitems[i]->Bounds;
+//	mOcclusionCuller.TestBoxes(boxes, _countof(skullRitems), visible);
+//
+//	for(UINT i = 0; i < _countof(skullRitems); ++i)
+//		skullRitems[i]->Visible = visible[i] || !mOcclusionCullingEnabled;
+//
+//	std::wostringstream outs;
+//	outs.precision(3);
+//	outs << L"Stencil Demo    " << 100.0f*mOcclusionCuller.RejectedFraction() << L"% occluded in "
+//		<< mOcclusionCuller.RenderMs() + mOcclusionCuller.TestMs() << L" ms";
+//	mMainWndCaption = outs.str();
+//}
+//
 //void StencilApp::LoadTextures()
 //{
 //	auto bricksTex = std::make_unique<Texture>();
@@ -1031,6 +1095,7 @@
 //	submesh.IndexCount = (UINT)indices.size();
 //	submesh.StartIndexLocation = 0;
 //	submesh.BaseVertexLocation = 0;
+//	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 //
 //	geo->DrawArgs["skull"] = submesh;
 //
@@ -1345,6 +1410,29 @@
 //	mAllRitems.push_back(std::move(mirrorRitem));
 //}
 //
+//void StencilApp::BuildOccluders()
+//{
+//	// The three wall quads of BuildRoomGeometry, pulled back a little from
+//	// the mirror's edges so that they never cover a pixel of the mirror.
+//	mWallOccluderVertices =
+//	{
+//		XMFLOAT3(-3.5f, 0.0f, 0.0f), XMFLOAT3(-3.5f, 4.1f, 0.0f), XMFLOAT3(-2.6f, 4.1f, 0.0f), XMFLOAT3(-2.6f, 0.0f, 0.0f),
+//		XMFLOAT3(2.6f, 0.0f, 0.0f), XMFLOAT3(2.6f, 4.1f, 0.0f), XMFLOAT3(7.5f, 4.1f, 0.0f), XMFLOAT3(7.5f, 0.0f, 0.0f),
+//		XMFLOAT3(-3.5f, 4.1f, 0.0f), XMFLOAT3(-3.5f, 6.0f, 0.0f), XMFLOAT3(7.5f, 6.0f, 0.0f), XMFLOAT3(7.5f, 4.1f, 0.0f)
+//	};
+//	for(UINT quad = 0; quad < 3; ++quad)
+//	{
+//		UINT i = 4 * quad;
+//		mWallOccluderIndices.insert(mWallOccluderIndices.end(), { i, i + 1, i + 2, i, i + 2, i + 3 });
+//	}
+//
+//	OcclusionCuller::Occluder wallOccluder;
+//	wallOccluder.Vertices = mWallOccluderVertices.data();
+//	wallOccluder.Indices = mWallOccluderIndices.data();
+//	wallOccluder.IndexCount = (UINT)mWallOccluderIndices.size();
+//	mOccluders.push_back(wallOccluder);
+//}
+//
 //void StencilApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 //{
 //    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
@@ -1358,6 +1446,10 @@
 //    {
 //        auto ri = ritems[i];
 //
+//		// Hidden behind the walls this frame.
+//		if(!ri->Visible)
+//			continue;
+//
 //        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
 //        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
 //        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
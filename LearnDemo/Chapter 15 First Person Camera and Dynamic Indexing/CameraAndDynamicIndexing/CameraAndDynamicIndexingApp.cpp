@@ -7,6 +7,7 @@
 //#include "../../../Common/UploadBuffer.h"
 //#include "../../../Common/GeometryGenerator.h"
 //#include "../../../Common/Camera.h"
+//#include "../../../Common/RenderItemCuller.h"
 //#include "CADIFrameResource.h"
 //
 //using Microsoft::WRL::ComPtr;
@@ -74,6 +75,7 @@
 //
 //    void OnKeyboardInput(const GameTimer& gt);
 //	void AnimateMaterials(const GameTimer& gt);
+//	void CullRenderItems(const GameTimer& gt);
 //	void UpdateObjectCBs(const GameTimer& gt);
 //	void UpdateMaterialBuffer(const GameTimer& gt);
 //	void UpdateMainPassCB(const GameTimer& gt);
@@ -117,6 +119,9 @@
 //	// Render items divided by PSO.
 //	std::vector<RenderItem*> mOpaqueRitems;
 //
+//	// The opaque items in front of the camera this frame.
+//	RenderItemCuller<RenderItem> mRitemCuller;
+//
 //    PassConstants mMainPassCB;
 //
 //	Camera mCamera;
@@ -219,6 +224,7 @@
 //    }
 //
 //	AnimateMaterials(gt);
+//	CullRenderItems(gt);
 //	UpdateObjectCBs(gt);
 //	UpdateMaterialBuffer(gt);
 //	UpdateMainPassCB(gt);
@@ -268,7 +274,7 @@
 //    // The root signature knows how many descriptors are expected in the table.
 //	mCommandList->SetGraphicsRootDescriptorTable(3, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 //
-//    DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
+//    DrawRenderItems(mCommandList.Get(), mRitemCuller.Visible(0));
 //
 //    // Indicate a state transition on the resource usage.
 //	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -347,11 +353,30 @@
 //	
 //}
 //
+//void CameraAndDynamicIndexingApp::CullRenderItems(const GameTimer& gt)
+//{
+//	mRitemCuller.Cull(mCamera.GetView(), mCamera.GetProj(), &mOpaqueRitems, 1);
+//
+//	std::wostringstream outs;
+//	outs << L"Camera and Dynamic Indexing Demo    " << mRitemCuller.DrawsAvoided() << L" of "
+//		<< mRitemCuller.ItemsTested() << L" draws culled";
+//	mMainWndCaption = outs.str();
+//}
+//
 //void CameraAndDynamicIndexingApp::UpdateObjectCBs(const GameTimer& gt)
 //{
 //	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
 //	for(auto& e : mAllRitems)
 //	{
+//		// Leave items that are not drawn this frame for when they are.  They
+//		// must then be written to every frame resource again, since this one
+//		// is now behind.
+//		if(e->NumFramesDirty > 0 && !mRitemCuller.IsVisible(e->ObjCBIndex))
+//		{
+//			e->NumFramesDirty = gNumFrameResources;
+//			continue;
+//		}
+//
 //		// Only update the cbuffer data if the constants have changed.  
 //		// This needs to be tracked per frame resource.
 //		if(e->NumFramesDirty > 0)
@@ -0,0 +1,748 @@
+#include "CullingBenchmark.h"
+#include "InstanceCuller.h"
+#include "InstanceBvh.h"
+#include "CullingCache.h"
+#include "InstancePacker.h"
+#include "../../../Common/GeometryGenerator.h"
+#include "../../../Common/OcclusionCuller.h"
+#include "../../../Common/BenchmarkTimer.h"
+#include <algorithm>
+#include <iomanip>
+
+using namespace DirectX;
+
+namespace
+{
+	// Bounds of the skull mesh.
+	BoundingBox SkullBounds()
+	{
+		return BoundingBox(XMFLOAT3(0.0f, 3.40f, 0.65f), XMFLOAT3(3.10f, 3.46f, 4.48f));
+	}
+
+	// instanceCount skulls spread through a cube centered on the origin, about
+	// one per 10x10x10 cell whatever the count.
+	std::vector<InstanceData> MakeInstances(UINT instanceCount)
+	{
+		const float halfSize = 5.0f * powf((float)instanceCount, 1.0f / 3.0f);
+
+		std::vector<InstanceData> instances(instanceCount);
+		for(UINT i = 0; i < instanceCount; ++i)
+		{
+			XMVECTOR axis = XMVectorSet(MathHelper::RandF(-1.0f, 1.0f), 1.0f, MathHelper::RandF(-1.0f, 1.0f), 0.0f);
+			// Uniform scale only: BoundingFrustum::Transform (the local space
+			// path) cannot handle anything else.
+			float scale = MathHelper::RandF(0.5f, 1.5f);
+			XMMATRIX world = XMMatrixMultiply(XMMatrixScaling(scale, scale, scale),
+				XMMatrixRotationAxis(axis, MathHelper::RandF(0.0f, XM_2PI)));
+			world.r[3] = XMVectorSet(MathHelper::RandF(-halfSize, halfSize), MathHelper::RandF(-halfSize, halfSize),
+				MathHelper::RandF(-halfSize, halfSize), 1.0f);
+
+			XMStoreFloat4x4(&instances[i].World, world);
+			instances[i].MaterialIndex = i % 5;
+		}
+
+		return instances;
+	}
+
+	// The demo's frustum (in view space) and a camera at eye looking at target.
+	// The default is at the origin looking down +z, slightly turned so it
+	// isn't axis aligned.
+	void MakeCamera(BoundingFrustum& viewFrustum, XMMATRIX& view,
+		FXMVECTOR eye = XMVectorSet(0.0f, 2.0f, 0.0f, 1.0f), FXMVECTOR target = XMVectorSet(0.3f, 1.8f, 1.0f, 1.0f))
+	{
+		BoundingFrustum::CreateFromMatrix(viewFrustum,
+			XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, 1280.0f / 720.0f, 1.0f, 1000.0f));
+		view = XMMatrixLookAtLH(eye, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	}
+
+	// World space frustum planes of a camera.
+	void GetWorldPlanes(const BoundingFrustum& viewFrustum, FXMMATRIX view, XMFLOAT4 planes[6])
+	{
+		BoundingFrustum worldFrustum;
+		viewFrustum.Transform(worldFrustum, XMMatrixInverse(nullptr, view));
+		InstanceCuller::GetFrustumPlanes(worldFrustum, planes);
+	}
+
+	// What UpdateInstanceData wrote to the instance buffer for an instance
+	// before it was packed.
+	void WriteFullInstance(const InstanceData& instance, InstanceData& data)
+	{
+		XMMATRIX world = XMLoadFloat4x4(&instance.World);
+		XMMATRIX texTransform = XMLoadFloat4x4(&instance.TexTransform);
+		XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
+		XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
+		data.MaterialIndex = instance.MaterialIndex;
+	}
+
+	// Whether what Default.hlsl computes from a packed instance (world
+	// position, normal, texture coordinates and material) matches what it
+	// computed from the full instance data.
+	bool SameAsFull(const InstanceData& instance, const PackedInstanceData& packed,
+		const InstanceTexTransform& texTransform)
+	{
+		const XMVECTOR posL = XMVectorSet(1.5f, -2.0f, 0.5f, 1.0f);
+		const XMVECTOR normalL = XMVector3Normalize(XMVectorSet(0.3f, 0.8f, -0.5f, 0.0f));
+		const XMVECTOR texC = XMVectorSet(0.25f, 0.75f, 1.0f, 0.0f);
+
+		XMMATRIX world = XMLoadFloat4x4(&instance.World);
+		XMVECTOR fullPos = XMVector3Transform(posL, world);
+		XMVECTOR fullNormal = XMVector3TransformNormal(normalL, world);
+		XMVECTOR fullTexC = XMVector4Transform(XMVectorSet(0.25f, 0.75f, 0.0f, 1.0f),
+			XMLoadFloat4x4(&instance.TexTransform));
+
+		XMVECTOR rows[3];
+		for(int i = 0; i < 3; ++i)
+		{
+			rows[i] = XMLoadFloat4(&packed.World[i]);
+		}
+		XMVECTOR packedPos = XMVectorSet(XMVectorGetX(XMVector4Dot(rows[0], posL)),
+			XMVectorGetX(XMVector4Dot(rows[1], posL)), XMVectorGetX(XMVector4Dot(rows[2], posL)), 0.0f);
+		XMVECTOR packedNormal = XMVectorSet(XMVectorGetX(XMVector3Dot(rows[0], normalL)),
+			XMVectorGetX(XMVector3Dot(rows[1], normalL)), XMVectorGetX(XMVector3Dot(rows[2], normalL)), 0.0f);
+		XMVECTOR packedTexC = texC;
+		if(InstancePacker::GetFlags(packed) & InstancePacker::TexTransformFlag)
+		{
+			packedTexC = XMVectorSet(
+				XMVectorGetX(XMVector3Dot(XMLoadFloat3(&texTransform.TexTransform[0]), texC)),
+				XMVectorGetX(XMVector3Dot(XMLoadFloat3(&texTransform.TexTransform[1]), texC)), 0.0f, 0.0f);
+		}
+
+		const XMVECTOR epsilon = XMVectorReplicate(1e-3f);
+		return XMVector3NearEqual(fullPos, packedPos, epsilon) &&
+			XMVector3NearEqual(fullNormal, packedNormal, epsilon) &&
+			XMVector2NearEqual(fullTexC, packedTexC, epsilon) &&
+			InstancePacker::GetMaterialIndex(packed) == instance.MaterialIndex;
+	}
+
+	// What InstancingAndCullingApp::UpdateInstanceData does per instance.
+	UINT CullLocalSpace(const BoundingFrustum& viewFrustum, FXMMATRIX view, const BoundingBox& localBounds,
+		const std::vector<InstanceData>& instances, UINT* visibleIndices)
+	{
+		XMMATRIX invView = XMMatrixInverse(nullptr, view);
+
+		UINT visibleCount = 0;
+		for(UINT i = 0; i < (UINT)instances.size(); ++i)
+		{
+			XMMATRIX world = XMLoadFloat4x4(&instances[i].World);
+			XMMATRIX invWorld = XMMatrixInverse(nullptr, world);
+			XMMATRIX viewToLocal = XMMatrixMultiply(invView, invWorld);
+
+			BoundingFrustum localSpaceFrustum;
+			viewFrustum.Transform(localSpaceFrustum, viewToLocal);
+
+			if(localSpaceFrustum.Contains(localBounds) != DirectX::DISJOINT)
+				visibleIndices[visibleCount++] = i;
+		}
+
+		return visibleCount;
+	}
+
+	// The hills of LandAndWavesApp.
+	float HillsHeight(float x, float z)
+	{
+		return 0.3f*(z*sinf(0.1f*x) + x*cosf(0.1f*z));
+	}
+
+	// Positions and indices of a mesh, the way OcclusionCuller wants them.
+	struct OccluderMesh
+	{
+		std::vector<XMFLOAT3> Vertices;
+		std::vector<UINT> Indices;
+	};
+
+	OccluderMesh ToOccluderMesh(const GeometryGenerator::MeshData& mesh)
+	{
+		OccluderMesh occluderMesh;
+		for(const auto& vertex : mesh.Vertices)
+		{
+			occluderMesh.Vertices.push_back(vertex.Position);
+		}
+		occluderMesh.Indices.assign(mesh.Indices32.begin(), mesh.Indices32.end());
+		return occluderMesh;
+	}
+}
+
+void CullingBenchmark::FrustumCulling(std::ostream& out)
+{
+	const UINT instanceCounts[] = { 10000, 100000, 1000000 };
+	const BoundingBox skullBounds = SkullBounds();
+
+	BoundingFrustum viewFrustum;
+	XMMATRIX view;
+	MakeCamera(viewFrustum, view);
+
+	XMFLOAT4 planes[6];
+	GetWorldPlanes(viewFrustum, view, planes);
+
+	out << "Frustum culling, ms per frame (local space Contains per instance vs world AABB blocks of 8)\n";
+	out << std::setw(10) << "instances" << std::setw(10) << "visible" << std::setw(10) << "culler"
+		<< std::setw(8) << "missed" << std::setw(12) << "local ms" << std::setw(12) << "culler ms"
+		<< std::setw(10) << "speedup" << std::setw(12) << "ns/inst" << "\n";
+
+	for(UINT instanceCount : instanceCounts)
+	{
+		std::vector<InstanceData> instances = MakeInstances(instanceCount);
+		std::vector<UINT> localVisible(instanceCount);
+		std::vector<UINT> cullerVisible(instanceCount);
+
+		UINT localCount = 0;
+		double localMs = BenchmarkTimer::TimeMs([&]()
+		{
+			localCount = CullLocalSpace(viewFrustum, view, skullBounds, instances, localVisible.data());
+		});
+
+		InstanceCuller culler;
+		culler.Build(skullBounds, instances.data(), instanceCount);
+
+		// Best of a few runs; the kernel is too quick to time once.
+		UINT cullerCount = 0;
+		double cullerMs = BenchmarkTimer::BestTimeMs(20, [&]()
+		{
+			cullerCount = culler.Cull(planes, cullerVisible.data());
+		});
+
+		// Instances the local space test keeps that the culler drops (must be 0).
+		UINT missed = 0;
+		UINT c = 0;
+		for(UINT v = 0; v < localCount; ++v)
+		{
+			while(c < cullerCount && cullerVisible[c] < localVisible[v])
+				++c;
+			if(c == cullerCount || cullerVisible[c] != localVisible[v])
+				++missed;
+		}
+
+		out << std::fixed << std::setprecision(3)
+			<< std::setw(10) << instanceCount
+			<< std::setw(10) << localCount
+			<< std::setw(10) << cullerCount
+			<< std::setw(8) << missed
+			<< std::setw(12) << localMs
+			<< std::setw(12) << cullerMs
+			<< std::setw(9) << std::setprecision(1) << localMs / cullerMs << "x"
+			<< std::setw(12) << std::setprecision(2) << cullerMs * 1.0e6 / instanceCount << "\n";
+	}
+
+	out << std::endl;
+}
+
+void CullingBenchmark::HierarchicalCulling(std::ostream& out)
+{
+	const UINT instanceCounts[] = { 10000, 100000, 1000000 };
+	const BoundingBox skullBounds = SkullBounds();
+
+	struct CameraSetup
+	{
+		const char* Name;
+		XMFLOAT3 Eye;      // In units of the scene's half size.
+		XMFLOAT3 Target;
+	};
+	const CameraSetup cameras[] =
+	{
+		{ "center",  XMFLOAT3(0.0f, 0.01f, 0.0f),  XMFLOAT3(0.3f, -0.01f, 1.0f) },
+		{ "corner",  XMFLOAT3(-1.5f, 1.2f, -1.5f), XMFLOAT3(0.0f, 0.0f, 0.0f) },
+		{ "outward", XMFLOAT3(0.2f, 0.1f, 0.9f),   XMFLOAT3(0.3f, 0.1f, 2.0f) },
+		{ "down",    XMFLOAT3(0.1f, 1.2f, 0.0f),   XMFLOAT3(0.1f, 0.0f, 0.05f) },
+	};
+
+	out << "BVH frustum culling, ms per frame (flat = InstanceCuller over every instance)\n";
+	out << std::setw(10) << "instances" << std::setw(10) << "camera" << std::setw(10) << "visible"
+		<< std::setw(8) << "same" << std::setw(11) << "flat ms" << std::setw(11) << "bvh ms"
+		<< std::setw(10) << "speedup" << std::setw(10) << "nodes" << std::setw(10) << "tested" << "\n";
+
+	for(UINT instanceCount : instanceCounts)
+	{
+		const float halfSize = 5.0f * powf((float)instanceCount, 1.0f / 3.0f);
+
+		std::vector<InstanceData> instances = MakeInstances(instanceCount);
+		std::vector<UINT> flatVisible(instanceCount);
+		std::vector<UINT> bvhVisible(instanceCount);
+
+		InstanceCuller culler;
+		culler.Build(skullBounds, instances.data(), instanceCount);
+
+		InstanceBvh bvh;
+		double buildMs = BenchmarkTimer::TimeMs([&]() { bvh.Build(culler); });
+		double refitMs = BenchmarkTimer::BestTimeMs(5, [&]() { bvh.Refit(culler); });
+
+		for(const CameraSetup& camera : cameras)
+		{
+			BoundingFrustum viewFrustum;
+			XMMATRIX view;
+			MakeCamera(viewFrustum, view, XMVectorScale(XMLoadFloat3(&camera.Eye), halfSize),
+				XMVectorScale(XMLoadFloat3(&camera.Target), halfSize));
+
+			XMFLOAT4 planes[6];
+			GetWorldPlanes(viewFrustum, view, planes);
+
+			UINT flatCount = 0;
+			double flatMs = BenchmarkTimer::BestTimeMs(10, [&]()
+			{
+				flatCount = culler.Cull(planes, flatVisible.data());
+			});
+
+			UINT bvhCount = 0;
+			double bvhMs = BenchmarkTimer::BestTimeMs(10, [&]()
+			{
+				bvhCount = bvh.Cull(planes, bvhVisible.data());
+			});
+
+			// Both must keep exactly the same instances.
+			std::sort(bvhVisible.begin(), bvhVisible.begin() + bvhCount);
+			bool same = flatCount == bvhCount &&
+				std::equal(flatVisible.begin(), flatVisible.begin() + flatCount, bvhVisible.begin());
+
+			out << std::fixed << std::setprecision(3)
+				<< std::setw(10) << instanceCount
+				<< std::setw(10) << camera.Name
+				<< std::setw(10) << bvhCount
+				<< std::setw(8) << (same ? "yes" : "NO")
+				<< std::setw(11) << flatMs
+				<< std::setw(11) << bvhMs
+				<< std::setw(9) << std::setprecision(1) << flatMs / bvhMs << "x"
+				<< std::setw(10) << bvh.NodesTested()
+				<< std::setw(10) << bvh.InstancesTested() << "\n";
+		}
+
+		out << std::fixed << std::setprecision(1)
+			<< "          " << bvh.NodeCount() << " nodes, depth " << bvh.Depth()
+			<< ", build " << buildMs << " ms, refit " << refitMs << " ms\n";
+	}
+
+	out << std::endl;
+}
+
+void CullingBenchmark::ParallelCulling(std::ostream& out)
+{
+	const UINT instanceCount = 1000000;
+	const BoundingBox skullBounds = SkullBounds();
+
+	std::vector<InstanceData> instances = MakeInstances(instanceCount);
+	InstanceCuller culler;
+	culler.Build(skullBounds, instances.data(), instanceCount);
+
+	// Stand in for the mapped instance upload buffers.  No instance has a
+	// TexTransform, so the TexTransform buffers are never written.
+	std::vector<PackedInstanceData> serialBuffer(instanceCount);
+	std::vector<PackedInstanceData> parallelBuffer(instanceCount);
+	std::vector<InstanceTexTransform> texTransformBuffer(instanceCount);
+	std::vector<UINT> visible(instanceCount);
+
+	std::vector<UINT> threadCounts;
+	const UINT hardwareThreads = MathHelper::Max(1u, std::thread::hardware_concurrency());
+	for(UINT n = 1; n < hardwareThreads; n *= 2)
+	{
+		threadCounts.push_back(n);
+	}
+	threadCounts.push_back(hardwareThreads);
+
+	const float halfSize = 5.0f * powf((float)instanceCount, 1.0f / 3.0f);
+	struct CameraSetup
+	{
+		const char* Name;
+		XMFLOAT3 Eye;
+		XMFLOAT3 Target;
+	};
+	const CameraSetup cameras[] =
+	{
+		{ "center", XMFLOAT3(0.0f, 0.01f, 0.0f),  XMFLOAT3(0.3f, -0.01f, 1.0f) },
+		{ "corner", XMFLOAT3(-1.5f, 1.2f, -1.5f), XMFLOAT3(0.0f, 0.0f, 0.0f) },
+	};
+
+	out << "Parallel culling + instance buffer writes, " << instanceCount << " instances, ms per frame\n";
+	out << std::setw(8) << "camera" << std::setw(10) << "visible" << std::setw(10) << "serial";
+	for(UINT threadCount : threadCounts)
+	{
+		out << std::setw(9) << threadCount << "T";
+	}
+	out << std::setw(12) << "speedup" << std::setw(8) << "same" << "\n";
+
+	for(const CameraSetup& camera : cameras)
+	{
+		BoundingFrustum viewFrustum;
+		XMMATRIX view;
+		MakeCamera(viewFrustum, view, XMVectorScale(XMLoadFloat3(&camera.Eye), halfSize),
+			XMVectorScale(XMLoadFloat3(&camera.Target), halfSize));
+
+		XMFLOAT4 planes[6];
+		GetWorldPlanes(viewFrustum, view, planes);
+
+		// The serial path: cull, then write each visible instance.
+		UINT serialCount = 0;
+		double serialMs = BenchmarkTimer::BestTimeMs(5, [&]()
+		{
+			serialCount = culler.Cull(planes, visible.data());
+			InstancePacker::Pack(instances.data(), visible.data(), serialCount,
+				serialBuffer.data(), texTransformBuffer.data());
+		});
+
+		out << std::setw(8) << camera.Name << std::setw(10) << serialCount
+			<< std::fixed << std::setprecision(3) << std::setw(10) << serialMs;
+
+		bool same = true;
+		double lastMs = 0.0;
+		for(UINT threadCount : threadCounts)
+		{
+			ThreadPool threadPool(threadCount);
+
+			UINT parallelCount = 0;
+			double ms = BenchmarkTimer::BestTimeMs(5, [&]()
+			{
+				parallelCount = culler.Cull(&threadPool, planes, [&](const UINT* indices, UINT count, UINT firstSlot)
+				{
+					InstancePacker::Pack(instances.data(), indices, count,
+						parallelBuffer.data() + firstSlot, texTransformBuffer.data() + firstSlot);
+				});
+			});
+			lastMs = ms;
+
+			// Every thread count must write exactly what the serial path does.
+			same = same && parallelCount == serialCount &&
+				memcmp(parallelBuffer.data(), serialBuffer.data(), serialCount*sizeof(PackedInstanceData)) == 0;
+
+			out << std::setw(10) << ms;
+		}
+
+		out << std::setw(11) << std::setprecision(1) << serialMs / lastMs << "x"
+			<< std::setw(8) << (same ? "yes" : "NO") << "\n";
+	}
+
+	out << std::endl;
+}
+
+void CullingBenchmark::TemporalCulling(std::ostream& out)
+{
+	const UINT instanceCounts[] = { 100000, 1000000 };
+	const UINT frameCount = 120;
+	const BoundingBox skullBounds = SkullBounds();
+
+	// Per frame camera motion.
+	struct CameraPath
+	{
+		const char* Name;
+		float Speed;      // Units per frame along the look direction.
+		float TurnRate;   // Radians per frame about the up axis.
+	};
+	const CameraPath paths[] =
+	{
+		{ "still", 0.0f, 0.0f },
+		{ "pan",   0.0f, 0.001f },
+		{ "walk",  0.2f, 0.0f },
+		{ "turn",  0.0f, 0.035f },
+	};
+
+	out << "Temporally coherent culling, ms per frame over " << frameCount << " frames (bvh = InstanceBvh::Cull every frame)\n";
+	out << std::setw(10) << "instances" << std::setw(8) << "path" << std::setw(10) << "visible"
+		<< std::setw(9) << "bvh ms" << std::setw(10) << "cache ms" << std::setw(10) << "retested"
+		<< std::setw(10) << "reused" << std::setw(11) << "unchanged" << std::setw(6) << "same" << "\n";
+
+	for(UINT instanceCount : instanceCounts)
+	{
+		std::vector<InstanceData> instances = MakeInstances(instanceCount);
+		std::vector<UINT> bvhVisible(instanceCount);
+		std::vector<UINT> cacheVisible(instanceCount);
+
+		InstanceCuller culler;
+		culler.Build(skullBounds, instances.data(), instanceCount);
+		InstanceBvh bvh;
+		bvh.Build(culler);
+
+		const float halfSize = 5.0f * powf((float)instanceCount, 1.0f / 3.0f);
+
+		for(const CameraPath& path : paths)
+		{
+			CullingCache cache;
+			cache.Reset(&bvh);
+
+			BoundingFrustum viewFrustum;
+			XMMATRIX view;
+			MakeCamera(viewFrustum, view);
+
+			XMVECTOR eye = XMVectorSet(0.0f, 0.01f * halfSize, -0.5f * halfSize, 1.0f);
+			float yaw = 0.3f;
+
+			double bvhMs = 0.0;
+			double cacheMs = 0.0;
+			double retested = 0.0;
+			double reused = 0.0;
+			double visible = 0.0;
+			UINT unchangedFrames = 0;
+			bool same = true;
+
+			for(UINT frame = 0; frame < frameCount; ++frame)
+			{
+				XMVECTOR look = XMVectorSet(sinf(yaw), 0.0f, cosf(yaw), 0.0f);
+				view = XMMatrixLookAtLH(eye, XMVectorAdd(eye, look), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+				XMMATRIX invView = XMMatrixInverse(nullptr, view);
+
+				UINT bvhCount = 0;
+				bvhMs += BenchmarkTimer::TimeMs([&]()
+				{
+					BoundingFrustum worldFrustum;
+					viewFrustum.Transform(worldFrustum, invView);
+					XMFLOAT4 planes[6];
+					InstanceCuller::GetFrustumPlanes(worldFrustum, planes);
+					bvhCount = bvh.Cull(planes, bvhVisible.data());
+				});
+
+				UINT cacheCount = 0;
+				cacheMs += BenchmarkTimer::TimeMs([&]()
+				{
+					cacheCount = cache.Cull(viewFrustum, invView, cacheVisible.data());
+				});
+
+				// Same tree order, so the lists must match exactly.
+				same = same && cacheCount == bvhCount &&
+					std::equal(bvhVisible.begin(), bvhVisible.begin() + bvhCount, cacheVisible.begin());
+
+				retested += cache.NodesRetested() + cache.InstancesRetested();
+				reused += cache.NodesReused() + cache.InstancesReused();
+				visible += cacheCount;
+				if(!cache.VisibleChanged())
+					++unchangedFrames;
+
+				eye = XMVectorAdd(eye, XMVectorScale(look, path.Speed));
+				yaw += path.TurnRate;
+			}
+
+			out << std::fixed << std::setprecision(3)
+				<< std::setw(10) << instanceCount
+				<< std::setw(8) << path.Name
+				<< std::setw(10) << (UINT)(visible / frameCount)
+				<< std::setw(9) << bvhMs / frameCount
+				<< std::setw(10) << cacheMs / frameCount
+				<< std::setw(10) << (UINT)(retested / frameCount)
+				<< std::setw(10) << (UINT)(reused / frameCount)
+				<< std::setw(11) << unchangedFrames
+				<< std::setw(6) << (same ? "yes" : "NO") << "\n";
+		}
+	}
+
+	out << std::endl;
+}
+
+void CullingBenchmark::OcclusionCulling(std::ostream& out)
+{
+	const UINT instanceCount = 100000;
+	const UINT wallCount = 16;
+	const float terrainSize = 400.0f;
+	const BoundingBox skullBounds = SkullBounds();
+
+	std::vector<UINT> threadCounts;
+	const UINT hardwareThreads = MathHelper::Max(std::thread::hardware_concurrency(), 1u);
+	for(UINT n = 1; n < hardwareThreads; n *= 2)
+	{
+		threadCounts.push_back(n);
+	}
+	threadCounts.push_back(hardwareThreads);
+
+	// Occluders: the hills, sunk a little so the coarse mesh stays under the
+	// real terrain, and some walls standing on them.
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid(terrainSize, terrainSize, 64, 64);
+	for(auto& vertex : grid.Vertices)
+	{
+		vertex.Position.y = HillsHeight(vertex.Position.x, vertex.Position.z) - 0.5f;
+	}
+	const OccluderMesh hills = ToOccluderMesh(grid);
+	const OccluderMesh wall = ToOccluderMesh(geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0));
+
+	std::vector<OcclusionCuller::Occluder> occluders(1 + wallCount);
+	occluders[0].Vertices = hills.Vertices.data();
+	occluders[0].Indices = hills.Indices.data();
+	occluders[0].IndexCount = (UINT)hills.Indices.size();
+	for(UINT w = 1; w <= wallCount; ++w)
+	{
+		// The first wall stands right in front of the "wall" camera.
+		float x = w == 1 ? 20.0f : MathHelper::RandF(-180.0f, 180.0f);
+		float z = w == 1 ? -160.0f : MathHelper::RandF(-180.0f, 180.0f);
+		float yaw = w == 1 ? 0.0f : MathHelper::RandF(0.0f, XM_PI);
+		XMMATRIX world = XMMatrixScaling(40.0f, 15.0f, 1.0f) * XMMatrixRotationY(yaw) *
+			XMMatrixTranslation(x, HillsHeight(x, z) + 6.0f, z);
+
+		occluders[w].Vertices = wall.Vertices.data();
+		occluders[w].Indices = wall.Indices.data();
+		occluders[w].IndexCount = (UINT)wall.Indices.size();
+		XMStoreFloat4x4(&occluders[w].World, world);
+	}
+
+	// Skulls standing on the hills.
+	std::vector<InstanceData> instances(instanceCount);
+	for(UINT i = 0; i < instanceCount; ++i)
+	{
+		float scale = MathHelper::RandF(0.3f, 0.6f);
+		float x = MathHelper::RandF(-0.48f*terrainSize, 0.48f*terrainSize);
+		float z = MathHelper::RandF(-0.48f*terrainSize, 0.48f*terrainSize);
+		XMMATRIX world = XMMatrixScaling(scale, scale, scale) * XMMatrixRotationY(MathHelper::RandF(0.0f, XM_2PI)) *
+			XMMatrixTranslation(x, HillsHeight(x, z), z);
+
+		XMStoreFloat4x4(&instances[i].World, world);
+		instances[i].MaterialIndex = i % 5;
+	}
+
+	InstanceCuller culler;
+	culler.Build(skullBounds, instances.data(), instanceCount);
+
+	struct CameraSetup
+	{
+		const char* Name;
+		XMFLOAT3 Eye;
+		XMFLOAT3 Target;
+	};
+	const CameraSetup cameras[] =
+	{
+		{ "valley", XMFLOAT3(20.0f, 3.0f, -190.0f), XMFLOAT3(20.0f, 3.0f, 0.0f) },
+		{ "wall",   XMFLOAT3(20.0f, 3.0f, -175.0f), XMFLOAT3(20.0f, 3.0f, 0.0f) },
+		{ "above",  XMFLOAT3(0.0f, 150.0f, -250.0f), XMFLOAT3(0.0f, 0.0f, 0.0f) },
+	};
+
+	out << "Occlusion culling " << instanceCount << " skulls on the hills behind " << wallCount
+		<< " walls (" << occluders.size() << " occluders), after frustum culling, ms per frame\n";
+	out << std::setw(8) << "camera" << std::setw(9) << "threads" << std::setw(10) << "frustum"
+		<< std::setw(10) << "occluded" << std::setw(9) << "percent" << std::setw(11) << "triangles"
+		<< std::setw(11) << "render ms" << std::setw(9) << "test ms" << std::setw(6) << "same" << "\n";
+
+	std::vector<UINT> visible(instanceCount);
+	std::vector<BoundingBox> boxes(instanceCount);
+	std::vector<BYTE> firstResult(instanceCount);
+	std::vector<BYTE> result(instanceCount);
+
+	for(const CameraSetup& camera : cameras)
+	{
+		XMVECTOR eye = XMLoadFloat3(&camera.Eye);
+		XMVECTOR target = XMLoadFloat3(&camera.Target);
+		eye = XMVectorSetY(eye, XMVectorGetY(eye) + HillsHeight(camera.Eye.x, camera.Eye.z));
+		target = XMVectorSetY(target, XMVectorGetY(target) + HillsHeight(camera.Target.x, camera.Target.z));
+
+		BoundingFrustum viewFrustum;
+		XMMATRIX view;
+		MakeCamera(viewFrustum, view, eye, target);
+		XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, 1280.0f / 720.0f, 1.0f, 1000.0f);
+
+		XMFLOAT4 planes[6];
+		GetWorldPlanes(viewFrustum, view, planes);
+
+		// Only what survives the frustum goes on to the occlusion test.
+		const UINT frustumCount = culler.Cull(planes, visible.data());
+		for(UINT v = 0; v < frustumCount; ++v)
+		{
+			culler.GetInstanceBounds(visible[v], boxes[v]);
+		}
+
+		for(UINT t = 0; t < (UINT)threadCounts.size(); ++t)
+		{
+			ThreadPool threadPool(threadCounts[t]);
+			OcclusionCuller occlusionCuller;
+			occlusionCuller.Initialize(&threadPool, 320, 180);
+
+			double renderMs = DBL_MAX;
+			double testMs = DBL_MAX;
+			for(UINT run = 0; run < 5; ++run)
+			{
+				occlusionCuller.Render(XMMatrixMultiply(view, proj), occluders.data(), (UINT)occluders.size());
+				occlusionCuller.TestBoxes(boxes.data(), frustumCount, result.data());
+				renderMs = MathHelper::Min(renderMs, occlusionCuller.RenderMs());
+				testMs = MathHelper::Min(testMs, occlusionCuller.TestMs());
+			}
+
+			// Every thread count must reject the same objects.
+			if(t == 0)
+				firstResult = result;
+			bool same = memcmp(result.data(), firstResult.data(), frustumCount) == 0;
+
+			out << std::setw(8) << camera.Name << std::setw(9) << threadCounts[t]
+				<< std::setw(10) << frustumCount << std::setw(10) << occlusionCuller.ObjectsRejected()
+				<< std::fixed << std::setprecision(1) << std::setw(8) << 100.0f*occlusionCuller.RejectedFraction() << "%"
+				<< std::setw(11) << occlusionCuller.TrianglesDrawn()
+				<< std::setprecision(3) << std::setw(11) << renderMs << std::setw(9) << testMs
+				<< std::setw(6) << (same ? "yes" : "NO") << "\n";
+		}
+	}
+
+	out << std::endl;
+}
+
+void CullingBenchmark::InstancePacking(std::ostream& out)
+{
+	const UINT instanceCount = 100000;
+
+	std::vector<InstanceData> instances = MakeInstances(instanceCount);
+	std::vector<UINT> indices(instanceCount);
+	for(UINT i = 0; i < instanceCount; ++i)
+	{
+		indices[i] = i;
+	}
+
+	// Stand in for the mapped instance upload buffers.
+	std::vector<InstanceData> fullBuffer(instanceCount);
+	std::vector<PackedInstanceData> packedBuffer(instanceCount);
+	std::vector<InstanceTexTransform> texTransformBuffer(instanceCount);
+
+	out << "Instance buffer writes, " << instanceCount << " instances, every instance written\n";
+	out << std::setw(24) << "format" << std::setw(12) << "tex xforms" << std::setw(14) << "bytes/inst"
+		<< std::setw(12) << "MB/frame" << std::setw(8) << "ms" << std::setw(6) << "same" << "\n";
+
+	double fullMs = BenchmarkTimer::BestTimeMs(5, [&]()
+	{
+		for(UINT i = 0; i < instanceCount; ++i)
+		{
+			WriteFullInstance(instances[i], fullBuffer[i]);
+		}
+	});
+	const double fullBytes = (double)instanceCount*sizeof(InstanceData);
+	out << std::setw(24) << "full 4x4 + 4x4" << std::setw(12) << instanceCount
+		<< std::fixed << std::setprecision(1) << std::setw(14) << (double)sizeof(InstanceData)
+		<< std::setprecision(2) << std::setw(12) << fullBytes / (1024.0*1024.0)
+		<< std::setprecision(3) << std::setw(8) << fullMs << std::setw(6) << "-" << "\n";
+
+	// Every texTransformEvery-th instance gets a TexTransform (0 for none).
+	// The demo scales every instance's texture coordinates by 2.
+	struct PackCase
+	{
+		const char* Name;
+		UINT TexTransformEvery;
+	};
+	const PackCase cases[] =
+	{
+		{ "packed, no tex xforms", 0 },
+		{ "packed, 1 in 10", 10 },
+		{ "packed, all (demo)", 1 },
+	};
+
+	for(const PackCase& packCase : cases)
+	{
+		for(UINT i = 0; i < instanceCount; ++i)
+		{
+			XMMATRIX texTransform = XMMatrixIdentity();
+			if(packCase.TexTransformEvery != 0 && i % packCase.TexTransformEvery == 0)
+			{
+				texTransform = XMMatrixScaling(2.0f, 2.0f, 1.0f);
+				if(packCase.TexTransformEvery > 1)
+					texTransform = XMMatrixMultiply(texTransform, XMMatrixTranslation(0.5f, 0.25f, 0.0f));
+			}
+			XMStoreFloat4x4(&instances[i].TexTransform, texTransform);
+		}
+
+		UINT texTransformCount = 0;
+		double ms = BenchmarkTimer::BestTimeMs(5, [&]()
+		{
+			texTransformCount = InstancePacker::Pack(instances.data(), indices.data(), instanceCount,
+				packedBuffer.data(), texTransformBuffer.data());
+		});
+
+		bool same = true;
+		for(UINT i = 0; i < instanceCount && same; ++i)
+		{
+			same = SameAsFull(instances[i], packedBuffer[i], texTransformBuffer[i]);
+		}
+
+		const double bytes = (double)instanceCount*sizeof(PackedInstanceData) +
+			(double)texTransformCount*sizeof(InstanceTexTransform);
+		out << std::setw(24) << packCase.Name << std::setw(12) << texTransformCount
+			<< std::setprecision(1) << std::setw(14) << bytes / instanceCount
+			<< std::setprecision(2) << std::setw(12) << bytes / (1024.0*1024.0)
+			<< std::setprecision(3) << std::setw(8) << ms << std::setw(6) << (same ? "yes" : "NO") << "\n";
+	}
+
+	out << std::endl;
+}
@@ -0,0 +1,54 @@
+#ifndef CULLINGBENCHMARK_H
+#define CULLINGBENCHMARK_H
+
+#include "IACFrameResource.h"
+
+///<summary>
+/// Headless timings for instance culling.  The scenes are skulls (the
+/// bounds of Models/skull.txt) at random positions, rotations and scales,
+/// seen by the demo's camera frustum.  Nothing here needs a device, e.g.:
+///
+///    std::ofstream fout("CullingBenchmark.txt");
+///    CullingBenchmark::FrustumCulling(fout);
+///</summary>
+class CullingBenchmark
+{
+public:
+	// Culling 10k, 100k and 1M instances the way UpdateInstanceData does
+	// (frustum moved into each instance's local space) against
+	// InstanceCuller, with the number of instances each keeps.
+	static void FrustumCulling(std::ostream& out);
+
+	// InstanceBvh against the flat InstanceCuller for 10k to 1M instances
+	// seen from the middle of the scene, from outside a corner, looking out
+	// of the scene and looking down on it: cull time, nodes and instances
+	// tested, and a check that both keep the same instances.  Also the
+	// build and refit times.
+	static void HierarchicalCulling(std::ostream& out);
+
+	// 1M instances culled and written to an instance buffer serially, and
+	// with InstanceCuller's parallel cull on 1, 2, 4, ... threads, checking
+	// that every thread count writes the same buffer.
+	static void ParallelCulling(std::ostream& out);
+
+	// CullingCache against culling the InstanceBvh from scratch, with the
+	// camera still, panning slowly, walking forward and turning quickly:
+	// cull time, results tested again and reused per frame, frames whose
+	// visible list didn't change, and a check that both give the same list.
+	static void TemporalCulling(std::ostream& out);
+
+	// OcclusionCuller on 1, 2, 4, ... threads with 100k skulls scattered
+	// over the LandAndWaves hills among walls, seen from down in a valley,
+	// from right behind a wall and from above: how many of the instances
+	// left by frustum culling it rejects, the time to draw the occluders and
+	// to test the boxes, and a check that every thread count agrees.
+	static void OcclusionCulling(std::ostream& out);
+
+	// Instance buffer bytes written and time taken for 100k instances, with
+	// the full InstanceData against PackedInstanceData, with no instances,
+	// one in ten and all of them carrying a TexTransform, and a check that
+	// the packed data gives the shader the same results.
+	static void InstancePacking(std::ostream& out);
+};
+
+#endif // CULLINGBENCHMARK_H
@@ -0,0 +1,317 @@
+#include "CullingCache.h"
+
+using namespace DirectX;
+
+void CullingCache::Reset(const InstanceBvh* bvh)
+{
+	mBvh = bvh;
+
+	const UINT nodeCount = bvh->NodeCount();
+	mNodeEntries.assign(nodeCount, Entry());
+	mNodeParents.assign(nodeCount, 0);
+
+	UINT instanceCount = 0;
+	if(nodeCount > 0)
+		instanceCount = bvh->GetNode(0).Count;
+	mInstanceEntries.assign(instanceCount, Entry());
+	mInstanceLeaves.assign(instanceCount, 0);
+
+	for(UINT n = 0; n < nodeCount; ++n)
+	{
+		const InstanceBvh::Node& node = bvh->GetNode(n);
+		if(node.Child != 0)
+		{
+			mNodeParents[node.Child] = n;
+			mNodeParents[node.Child + 1] = n;
+		}
+		else
+		{
+			for(UINT i = node.First; i < node.First + node.Count; ++i)
+			{
+				mInstanceLeaves[bvh->GetListedInstance(i)] = n;
+			}
+		}
+	}
+
+	if(nodeCount > 0)
+	{
+		const XMFLOAT3& extents = bvh->GetNode(0).Extents;
+		mRebaseDistance = 0.01f * XMVectorGetX(XMVector3Length(XMLoadFloat3(&extents)));
+	}
+
+	mLastVisible.clear();
+	mVisibleChanged = true;
+	mInstancesDirty = true;
+	mHasReference = false;
+	mGeneration++;
+}
+
+void CullingCache::MarkInstanceDirty(UINT i)
+{
+	mInstancesDirty = true;
+	mInstanceEntries[i].State = Unknown;
+
+	UINT n = mInstanceLeaves[i];
+	for(;;)
+	{
+		mNodeEntries[n].State = Unknown;
+		if(n == 0)
+			break;
+		n = mNodeParents[n];
+	}
+}
+
+void CullingCache::SetRebaseDistance(float distance)
+{
+	mRebaseDistance = distance;
+}
+
+void CullingCache::Rebase(const BoundingFrustum& viewFrustum, FXMVECTOR eye, FXMVECTOR orientation)
+{
+	mGeneration++;
+
+	mReferenceFrustum = viewFrustum;
+	XMStoreFloat3(&mReferenceEye, eye);
+	XMStoreFloat4(&mReferenceOrientation, orientation);
+	mHasReference = true;
+
+	mEyeDrift = 0.0f;
+	mAngleDrift = 0.0f;
+}
+
+CullingCache::EntryState CullingCache::TestBox(const BoundingBox& box, const XMFLOAT4 planes[6],
+	UINT& planeMask, Entry& entry)const
+{
+	const UINT testedMask = planeMask;
+
+	EntryState state = Inside;
+	float margin = MathHelper::Infinity;
+	for(UINT p = 0; p < 6; ++p)
+	{
+		if( (testedMask & (1u << p)) == 0 )
+			continue;
+
+		// The same test (and order of operations) as InstanceCuller::Cull.
+		const XMFLOAT4& plane = planes[p];
+		float dist = plane.x*box.Center.x + plane.w;
+		dist = plane.y*box.Center.y + dist;
+		dist = plane.z*box.Center.z + dist;
+
+		float radius = fabsf(plane.x)*box.Extents.x;
+		radius = fabsf(plane.y)*box.Extents.y + radius;
+		radius = fabsf(plane.z)*box.Extents.z + radius;
+
+		if(dist > radius)
+		{
+			state = Outside;
+			margin = dist - radius;
+			break;
+		}
+
+		if(dist < -radius)
+		{
+			planeMask &= ~(1u << p);
+			margin = MathHelper::Min(margin, -radius - dist);
+		}
+		else
+		{
+			state = Straddling;
+		}
+	}
+
+	entry.State = state;
+	entry.PlaneMask = (BYTE)testedMask;
+	entry.Generation = mGeneration;
+
+	// Only Outside and Inside results are ever reused.
+	if(state != Straddling)
+	{
+		XMVECTOR toBox = XMVectorSubtract(XMLoadFloat3(&box.Center), XMLoadFloat3(&mReferenceEye));
+		entry.Reach = XMVectorGetX(XMVector3Length(toBox)) + XMVectorGetX(XMVector3Length(XMLoadFloat3(&box.Extents)));
+		entry.Margin = margin - Drift(entry.Reach);
+	}
+
+	return state;
+}
+
+float CullingCache::Drift(float reach)const
+{
+	const float angleSlack = 1.0e-5f;
+	return mEyeDrift + reach * (mAngleDrift + angleSlack);
+}
+
+bool CullingCache::Reuse(const Entry& entry, UINT planeMask)const
+{
+	if(entry.Generation != mGeneration)
+		return false;
+
+	if(entry.State == Outside)
+		return Drift(entry.Reach) < entry.Margin;
+
+	// An Inside result only covers the planes it was tested against.
+	if(entry.State == Inside && (planeMask & ~entry.PlaneMask) == 0)
+		return Drift(entry.Reach) < entry.Margin;
+
+	return false;
+}
+
+UINT CullingCache::Cull(const BoundingFrustum& viewFrustum, FXMMATRIX invView, UINT* visibleIndices)
+{
+	mNodesRetested = 0;
+	mNodesReused = 0;
+	mInstancesRetested = 0;
+	mInstancesReused = 0;
+
+	// Nothing moved: last frame's list stands.
+	XMFLOAT4X4 invViewValue;
+	XMStoreFloat4x4(&invViewValue, invView);
+	if( !mInstancesDirty && mHasReference &&
+		memcmp(&invViewValue, &mLastInvView, sizeof(XMFLOAT4X4)) == 0 &&
+		memcmp(&viewFrustum, &mReferenceFrustum, sizeof(BoundingFrustum)) == 0 )
+	{
+		memcpy(visibleIndices, mLastVisible.data(), mLastVisible.size()*sizeof(UINT));
+		mVisibleChanged = false;
+		return (UINT)mLastVisible.size();
+	}
+	mLastInvView = invViewValue;
+	mInstancesDirty = false;
+
+	BoundingFrustum worldFrustum;
+	viewFrustum.Transform(worldFrustum, invView);
+	XMFLOAT4 planes[6];
+	InstanceCuller::GetFrustumPlanes(worldFrustum, planes);
+
+	XMVECTOR eye = invView.r[3];
+	XMVECTOR orientation = XMQuaternionRotationMatrix(invView);
+
+	// A new projection invalidates every margin.
+	bool sameProjection = mHasReference &&
+		viewFrustum.RightSlope == mReferenceFrustum.RightSlope && viewFrustum.LeftSlope == mReferenceFrustum.LeftSlope &&
+		viewFrustum.TopSlope == mReferenceFrustum.TopSlope && viewFrustum.BottomSlope == mReferenceFrustum.BottomSlope &&
+		viewFrustum.Near == mReferenceFrustum.Near && viewFrustum.Far == mReferenceFrustum.Far;
+
+	if(!sameProjection)
+	{
+		Rebase(viewFrustum, eye, orientation);
+	}
+	else
+	{
+		// The rotation between the cameras, from the vector part of the
+		// relative quaternion (acos of the dot product loses small angles).
+		XMVECTOR relative = XMQuaternionMultiply(XMQuaternionConjugate(XMLoadFloat4(&mReferenceOrientation)), orientation);
+		float sinHalfAngle = XMVectorGetX(XMVector3Length(relative));
+		mEyeDrift = XMVectorGetX(XMVector3Length(XMVectorSubtract(eye, XMLoadFloat3(&mReferenceEye))));
+		mAngleDrift = 2.0f * asinf(MathHelper::Min(sinHalfAngle, 1.0f));
+
+		// Measured at the far side of the whole hierarchy.
+		const InstanceBvh::Node& root = mBvh->GetNode(0);
+		float rootReach = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&root.Center), XMLoadFloat3(&mReferenceEye)))) +
+			XMVectorGetX(XMVector3Length(XMLoadFloat3(&root.Extents)));
+		if(mEyeDrift + rootReach * mAngleDrift > mRebaseDistance)
+			Rebase(viewFrustum, eye, orientation);
+	}
+
+	UINT visibleCount = 0;
+	if(!mInstanceEntries.empty())
+	{
+		// Stack entries are (node index << 6) | plane mask, as in InstanceBvh::Cull.
+		const UINT allPlanes = 0x3F;
+		mStack.clear();
+		mStack.push_back(allPlanes);
+
+		while(!mStack.empty())
+		{
+			UINT stackEntry = mStack.back();
+			mStack.pop_back();
+
+			const UINT n = stackEntry >> 6;
+			UINT planeMask = stackEntry & allPlanes;
+			const InstanceBvh::Node& node = mBvh->GetNode(n);
+			Entry& entry = mNodeEntries[n];
+
+			EntryState state;
+			if(Reuse(entry, planeMask))
+			{
+				++mNodesReused;
+				state = entry.State;
+			}
+			else
+			{
+				++mNodesRetested;
+				state = TestBox(BoundingBox(node.Center, node.Extents), planes, planeMask, entry);
+			}
+
+			if(state == Outside)
+				continue;
+
+			if(state == Inside)
+			{
+				for(UINT i = node.First; i < node.First + node.Count; ++i)
+				{
+					visibleIndices[visibleCount++] = mBvh->GetListedInstance(i);
+				}
+			}
+			else if(node.Child == 0)
+			{
+				for(UINT i = node.First; i < node.First + node.Count; ++i)
+				{
+					const UINT index = mBvh->GetListedInstance(i);
+					Entry& instanceEntry = mInstanceEntries[index];
+
+					EntryState instanceState;
+					if(Reuse(instanceEntry, planeMask))
+					{
+						++mInstancesReused;
+						instanceState = instanceEntry.State;
+					}
+					else
+					{
+						++mInstancesRetested;
+						UINT instanceMask = planeMask;
+						instanceState = TestBox(mBvh->GetInstanceBounds(index), planes, instanceMask, instanceEntry);
+					}
+
+					if(instanceState != Outside)
+						visibleIndices[visibleCount++] = index;
+				}
+			}
+			else
+			{
+				mStack.push_back(((node.Child + 1) << 6) | planeMask);
+				mStack.push_back((node.Child << 6) | planeMask);
+			}
+		}
+	}
+
+	mVisibleChanged = visibleCount != mLastVisible.size() ||
+		memcmp(visibleIndices, mLastVisible.data(), visibleCount*sizeof(UINT)) != 0;
+	if(mVisibleChanged)
+		mLastVisible.assign(visibleIndices, visibleIndices + visibleCount);
+
+	return visibleCount;
+}
+
+bool CullingCache::VisibleChanged()const
+{
+	return mVisibleChanged;
+}
+
+UINT CullingCache::NodesRetested()const
+{
+	return mNodesRetested;
+}
+
+UINT CullingCache::NodesReused()const
+{
+	return mNodesReused;
+}
+
+UINT CullingCache::InstancesRetested()const
+{
+	return mInstancesRetested;
+}
+
+UINT CullingCache::InstancesReused()const
+{
+	return mInstancesReused;
+}
@@ -0,0 +1,126 @@
+#ifndef CULLINGCACHE_H
+#define CULLINGCACHE_H
+
+#include "InstanceBvh.h"
+
+///<summary>
+/// Frame to frame coherent culling over an InstanceBvh.
+///
+/// Every node and instance remembers whether it was last found outside the
+/// frustum or entirely inside it, and by how much (its margin).  Moving the
+/// eye by d and turning the camera by an angle a moves a frustum plane by
+/// at most d + r*a at distance r from the eye, so while the camera has
+/// drifted less than that margin from where the result was computed, the
+/// result still holds and the subtree below is neither visited nor tested.
+/// Nodes that cut the frustum, and results that may have gone stale, are
+/// tested again.  If neither the camera nor any instance moved at all, the
+/// last frame's list is handed back without walking the tree.
+///
+/// Drift is measured from a reference camera.  When it grows past the
+/// rebase distance everything is thrown away and the current camera
+/// becomes the reference, as it does when the projection changes.
+///
+/// The visible list comes out in the same (tree) order as
+/// InstanceBvh::Cull, and VisibleChanged says whether it differs from the
+/// last frame's, so the instance buffer need not be rewritten when not.
+///</summary>
+class CullingCache
+{
+public:
+	// Forgets everything.  Call whenever the hierarchy is (re)built.
+	void Reset(const InstanceBvh* bvh);
+
+	// Instance i moved.  Update the culler and refit the hierarchy, then
+	// call this so the instance and the nodes above it are tested again.
+	void MarkInstanceDirty(UINT i);
+
+	// Camera drift before rebasing.  Defaults to 1% of the size of the
+	// whole hierarchy.
+	void SetRebaseDistance(float distance);
+
+	// viewFrustum is the camera frustum in view space, invView takes view
+	// space to world space.  Writes the visible instances and returns how many.
+	UINT Cull(const DirectX::BoundingFrustum& viewFrustum, DirectX::FXMMATRIX invView, UINT* visibleIndices);
+
+	// Whether the last Cull's visible list differs from the one before.
+	bool VisibleChanged()const;
+
+	// Results tested again and results reused in the last Cull.
+	UINT NodesRetested()const;
+	UINT NodesReused()const;
+	UINT InstancesRetested()const;
+	UINT InstancesReused()const;
+
+private:
+	enum EntryState : BYTE
+	{
+		Unknown,
+		Outside,
+		Inside,
+		Straddling
+	};
+
+	// The last result for a node or an instance.  Margin has the camera
+	// drift at the time of the test already taken off; Reach is the
+	// distance from the reference eye to the far side of the box.
+	struct Entry
+	{
+		float Margin = 0.0f;
+		float Reach = 0.0f;
+		UINT Generation = 0;     // Only valid if it matches mGeneration.
+		EntryState State = Unknown;
+		BYTE PlaneMask = 0;      // Planes tested for an Inside result.
+	};
+
+	// Tests the box against the planes in planeMask, clearing the bits of
+	// those it is entirely inside, and records the result in entry.
+	EntryState TestBox(const DirectX::BoundingBox& box, const DirectX::XMFLOAT4 planes[6],
+		UINT& planeMask, Entry& entry)const;
+
+	// Whether a previous Outside or Inside (tested against at least the
+	// planes in planeMask) result still holds.
+	bool Reuse(const Entry& entry, UINT planeMask)const;
+
+	// How far a plane may have moved at distance reach from the reference
+	// eye, with some slack for the rounding in the camera's orientation.
+	float Drift(float reach)const;
+
+	void Rebase(const DirectX::BoundingFrustum& viewFrustum, DirectX::FXMVECTOR eye, DirectX::FXMVECTOR orientation);
+
+	const InstanceBvh* mBvh = nullptr;
+
+	std::vector<Entry> mNodeEntries;
+	std::vector<Entry> mInstanceEntries;
+
+	// To find the nodes above a moved instance.
+	std::vector<UINT> mNodeParents;
+	std::vector<UINT> mInstanceLeaves;
+
+	std::vector<UINT> mStack;
+	std::vector<UINT> mLastVisible;
+	bool mVisibleChanged = true;
+
+	// Rebasing bumps the generation, which throws away every entry at once.
+	UINT mGeneration = 1;
+
+	// Set by MarkInstanceDirty; until then an unmoved camera gets last
+	// frame's list without any traversal.
+	bool mInstancesDirty = true;
+	DirectX::XMFLOAT4X4 mLastInvView;
+
+	// Reference camera, and how far the current one is from it.
+	bool mHasReference = false;
+	DirectX::BoundingFrustum mReferenceFrustum;
+	DirectX::XMFLOAT3 mReferenceEye;
+	DirectX::XMFLOAT4 mReferenceOrientation;
+	float mEyeDrift = 0.0f;
+	float mAngleDrift = 0.0f;
+	float mRebaseDistance = 0.0f;
+
+	UINT mNodesRetested = 0;
+	UINT mNodesReused = 0;
+	UINT mInstancesRetested = 0;
+	UINT mInstancesReused = 0;
+};
+
+#endif // CULLINGCACHE_H
@@ -8,7 +8,8 @@ IACFrameResource::IACFrameResource(ID3D12Device* device, UINT passCount, UINT ma
 
     PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
     MaterialBuffer = std::make_unique<UploadBuffer<MaterialData>>(device, materialCount, false);
-	InstanceBuffer = std::make_unique<UploadBuffer<InstanceData>>(device, maxInstanceCount, false);
+	InstanceBuffer = std::make_unique<UploadBuffer<PackedInstanceData>>(device, maxInstanceCount, false);
+	InstanceTexTransformBuffer = std::make_unique<UploadBuffer<InstanceTexTransform>>(device, maxInstanceCount, false);
 }
 
 IACFrameResource::~IACFrameResource()
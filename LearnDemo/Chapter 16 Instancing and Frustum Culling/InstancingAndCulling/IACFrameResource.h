@@ -14,6 +14,24 @@ struct InstanceData
 	UINT InstancePad2;
 };
 
+// What the instance buffer holds for an instance, packed from its
+// InstanceData by InstancePacker: the first three columns of World as
+// rows (the fourth is always 0, 0, 0, 1), and the material index in the
+// low 16 bits of MaterialAndFlags with InstancePacker flags in the high 16.
+struct PackedInstanceData
+{
+	DirectX::XMFLOAT4 World[3];
+	UINT MaterialAndFlags;
+};
+
+// The 2D part of an instance's TexTransform, as rows: (u', v') is
+// TexTransform[i] dotted with (u, v, 1).  Only written for instances whose
+// TexTransform isn't the identity.
+struct InstanceTexTransform
+{
+	DirectX::XMFLOAT3 TexTransform[2];
+};
+
 struct PassConstants
 {
     DirectX::XMFLOAT4X4 View = MathHelper::Identity4x4();
@@ -101,7 +119,11 @@ public:
     // ʵҪõ峣ݻࡣ磬Ҫڲʹʵ»1000
     // 壬ͱ봴һ1000Ϣĳʵ󣬽蹹
     // ܴ洢1000ʵݵĽṹ  
-    std::unique_ptr<UploadBuffer<InstanceData>> InstanceBuffer = nullptr;
+    std::unique_ptr<UploadBuffer<PackedInstanceData>> InstanceBuffer = nullptr;
+
+	// Same slots as InstanceBuffer, but only the instances with the
+	// InstancePacker::TexTransformFlag set are written (and read).
+	std::unique_ptr<UploadBuffer<InstanceTexTransform>> InstanceTexTransformBuffer = nullptr;
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
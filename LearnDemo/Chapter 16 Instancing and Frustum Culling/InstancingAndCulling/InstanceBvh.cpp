@@ -0,0 +1,347 @@
+#include "InstanceBvh.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+namespace
+{
+	const UINT BinCount = 16;
+	const UINT MaxLeafSize = 16;
+
+	// Cost of testing a node relative to testing an instance.
+	const float NodeTestCost = 2.0f;
+
+	struct Aabb
+	{
+		XMVECTOR Min = XMVectorReplicate(+MathHelper::Infinity);
+		XMVECTOR Max = XMVectorReplicate(-MathHelper::Infinity);
+
+		void Grow(FXMVECTOR p)
+		{
+			Min = XMVectorMin(Min, p);
+			Max = XMVectorMax(Max, p);
+		}
+
+		void Grow(const BoundingBox& box)
+		{
+			XMVECTOR center = XMLoadFloat3(&box.Center);
+			XMVECTOR extents = XMLoadFloat3(&box.Extents);
+			Min = XMVectorMin(Min, XMVectorSubtract(center, extents));
+			Max = XMVectorMax(Max, XMVectorAdd(center, extents));
+		}
+
+		void Grow(const Aabb& box)
+		{
+			Min = XMVectorMin(Min, box.Min);
+			Max = XMVectorMax(Max, box.Max);
+		}
+
+		// Half the surface area, which is all SAH needs.
+		float HalfArea()const
+		{
+			XMFLOAT3 d;
+			XMStoreFloat3(&d, XMVectorSubtract(Max, Min));
+			return d.x*d.y + d.y*d.z + d.z*d.x;
+		}
+	};
+
+	void ToCenterExtents(const Aabb& box, XMFLOAT3& center, XMFLOAT3& extents)
+	{
+		XMStoreFloat3(&center, XMVectorScale(XMVectorAdd(box.Min, box.Max), 0.5f));
+		XMStoreFloat3(&extents, XMVectorScale(XMVectorSubtract(box.Max, box.Min), 0.5f));
+	}
+
+	float Component(const XMFLOAT3& v, UINT axis)
+	{
+		return (&v.x)[axis];
+	}
+}
+
+void InstanceBvh::Build(const InstanceCuller& culler)
+{
+	const UINT instanceCount = culler.InstanceCount();
+
+	mBounds.resize(instanceCount);
+	mIndices.resize(instanceCount);
+	for(UINT i = 0; i < instanceCount; ++i)
+	{
+		culler.GetInstanceBounds(i, mBounds[i]);
+		mIndices[i] = i;
+	}
+
+	mNodes.clear();
+	mNodes.reserve(2*MathHelper::Max(instanceCount, 1u));
+	mNodes.push_back(Node());
+	mDepth = 0;
+
+	if(instanceCount > 0)
+		BuildNode(0, 0, instanceCount, 1);
+}
+
+void InstanceBvh::BuildNode(UINT nodeIndex, UINT first, UINT count, UINT depth)
+{
+	mDepth = MathHelper::Max(mDepth, depth);
+
+	Aabb bounds;
+	Aabb centroidBounds;
+	for(UINT i = first; i < first + count; ++i)
+	{
+		const BoundingBox& box = mBounds[mIndices[i]];
+		bounds.Grow(box);
+		centroidBounds.Grow(XMLoadFloat3(&box.Center));
+	}
+
+	Node& node = mNodes[nodeIndex];
+	ToCenterExtents(bounds, node.Center, node.Extents);
+	node.First = first;
+	node.Count = count;
+	node.Child = 0;
+
+	if(count <= 2)
+		return;
+
+	// Bin the centroids along each axis and find the cheapest split between
+	// bins: cost ~ (instances left * area left) + (instances right * area right).
+	float bestCost = MathHelper::Infinity;
+	UINT bestAxis = 0;
+	UINT bestSplit = 0;
+	for(UINT axis = 0; axis < 3; ++axis)
+	{
+		const float lo = XMVectorGetByIndex(centroidBounds.Min, axis);
+		const float hi = XMVectorGetByIndex(centroidBounds.Max, axis);
+		if(hi <= lo)
+			continue;
+
+		const float binScale = BinCount / (hi - lo);
+
+		Aabb binBounds[BinCount];
+		UINT binCounts[BinCount] = { 0 };
+		for(UINT i = first; i < first + count; ++i)
+		{
+			const BoundingBox& box = mBounds[mIndices[i]];
+			UINT bin = MathHelper::Min((UINT)((Component(box.Center, axis) - lo) * binScale), BinCount - 1);
+			binBounds[bin].Grow(box);
+			binCounts[bin]++;
+		}
+
+		// Right-to-left sweep for the right side costs, then left-to-right.
+		float rightCost[BinCount];
+		Aabb right;
+		UINT rightCount = 0;
+		for(UINT b = BinCount - 1; b > 0; --b)
+		{
+			right.Grow(binBounds[b]);
+			rightCount += binCounts[b];
+			rightCost[b] = rightCount > 0 ? rightCount * right.HalfArea() : 0.0f;
+		}
+
+		Aabb left;
+		UINT leftCount = 0;
+		for(UINT split = 1; split < BinCount; ++split)
+		{
+			left.Grow(binBounds[split - 1]);
+			leftCount += binCounts[split - 1];
+			if(leftCount == 0 || leftCount == count)
+				continue;
+
+			float cost = leftCount * left.HalfArea() + rightCost[split];
+			if(cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	UINT* begin = mIndices.data() + first;
+	UINT* end = begin + count;
+	UINT* middle = nullptr;
+
+	if(bestSplit != 0)
+	{
+		// A small node that is no more expensive as a leaf stays one.
+		if(count <= MaxLeafSize && NodeTestCost * bounds.HalfArea() + bestCost >= count * bounds.HalfArea())
+			return;
+
+		const float lo = XMVectorGetByIndex(centroidBounds.Min, bestAxis);
+		const float binScale = BinCount / (XMVectorGetByIndex(centroidBounds.Max, bestAxis) - lo);
+		middle = std::partition(begin, end, [&](UINT index)
+		{
+			UINT bin = MathHelper::Min((UINT)((Component(mBounds[index].Center, bestAxis) - lo) * binScale), BinCount - 1);
+			return bin < bestSplit;
+		});
+	}
+	else
+	{
+		// All centroids in one spot; split in half if too many for a leaf.
+		if(count <= MaxLeafSize)
+			return;
+		middle = begin + count / 2;
+	}
+
+	const UINT leftCount = (UINT)(middle - begin);
+	const UINT child = (UINT)mNodes.size();
+	mNodes.push_back(Node());
+	mNodes.push_back(Node());
+	mNodes[nodeIndex].Child = child;
+
+	BuildNode(child, first, leftCount, depth + 1);
+	BuildNode(child + 1, first + leftCount, count - leftCount, depth + 1);
+}
+
+void InstanceBvh::Refit(const InstanceCuller& culler)
+{
+	assert(culler.InstanceCount() == mBounds.size());
+
+	for(UINT i = 0; i < (UINT)mBounds.size(); ++i)
+	{
+		culler.GetInstanceBounds(i, mBounds[i]);
+	}
+
+	// Children always come after their parent, so walking backwards
+	// finishes both children before their parent.
+	for(UINT n = (UINT)mNodes.size(); n-- > 0; )
+	{
+		Node& node = mNodes[n];
+		if(node.Count == 0)
+			continue;
+
+		Aabb bounds;
+		if(node.Child == 0)
+		{
+			for(UINT i = node.First; i < node.First + node.Count; ++i)
+			{
+				bounds.Grow(mBounds[mIndices[i]]);
+			}
+		}
+		else
+		{
+			for(UINT c = node.Child; c < node.Child + 2; ++c)
+			{
+				bounds.Grow(BoundingBox(mNodes[c].Center, mNodes[c].Extents));
+			}
+		}
+
+		ToCenterExtents(bounds, node.Center, node.Extents);
+	}
+}
+
+bool InstanceBvh::TestBox(const XMFLOAT3& center, const XMFLOAT3& extents, const XMFLOAT4 planes[6], UINT& planeMask)
+{
+	for(UINT p = 0; p < 6; ++p)
+	{
+		if( (planeMask & (1u << p)) == 0 )
+			continue;
+
+		// The same test (and order of operations) as InstanceCuller::Cull.
+		const XMFLOAT4& plane = planes[p];
+		float dist = plane.x*center.x + plane.w;
+		dist = plane.y*center.y + dist;
+		dist = plane.z*center.z + dist;
+
+		float radius = fabsf(plane.x)*extents.x;
+		radius = fabsf(plane.y)*extents.y + radius;
+		radius = fabsf(plane.z)*extents.z + radius;
+
+		if(dist > radius)
+			return false;
+
+		// Entirely inside this plane: nothing below needs to test it.
+		if(dist < -radius)
+			planeMask &= ~(1u << p);
+	}
+
+	return true;
+}
+
+UINT InstanceBvh::Cull(const XMFLOAT4 planes[6], UINT* visibleIndices)
+{
+	mNodesTested = 0;
+	mInstancesTested = 0;
+
+	if(mIndices.empty())
+		return 0;
+
+	// Stack entries are (node index << 6) | plane mask.
+	const UINT allPlanes = 0x3F;
+	mStack.clear();
+	mStack.push_back(allPlanes);
+
+	UINT visibleCount = 0;
+	while(!mStack.empty())
+	{
+		UINT entry = mStack.back();
+		mStack.pop_back();
+
+		const Node& node = mNodes[entry >> 6];
+		UINT planeMask = entry & allPlanes;
+
+		++mNodesTested;
+		if(!TestBox(node.Center, node.Extents, planes, planeMask))
+			continue;
+
+		if(planeMask == 0)
+		{
+			// The whole subtree is inside the frustum.
+			memcpy(visibleIndices + visibleCount, &mIndices[node.First], node.Count*sizeof(UINT));
+			visibleCount += node.Count;
+		}
+		else if(node.Child == 0)
+		{
+			for(UINT i = node.First; i < node.First + node.Count; ++i)
+			{
+				const UINT index = mIndices[i];
+				const BoundingBox& box = mBounds[index];
+
+				UINT instanceMask = planeMask;
+				++mInstancesTested;
+				if(TestBox(box.Center, box.Extents, planes, instanceMask))
+					visibleIndices[visibleCount++] = index;
+			}
+		}
+		else
+		{
+			// Second child first, so the first is visited first.
+			mStack.push_back(((node.Child + 1) << 6) | planeMask);
+			mStack.push_back((node.Child << 6) | planeMask);
+		}
+	}
+
+	return visibleCount;
+}
+
+UINT InstanceBvh::NodeCount()const
+{
+	return (UINT)mNodes.size();
+}
+
+UINT InstanceBvh::Depth()const
+{
+	return mDepth;
+}
+
+UINT InstanceBvh::NodesTested()const
+{
+	return mNodesTested;
+}
+
+UINT InstanceBvh::InstancesTested()const
+{
+	return mInstancesTested;
+}
+
+const InstanceBvh::Node& InstanceBvh::GetNode(UINT i)const
+{
+	return mNodes[i];
+}
+
+UINT InstanceBvh::GetListedInstance(UINT i)const
+{
+	return mIndices[i];
+}
+
+const BoundingBox& InstanceBvh::GetInstanceBounds(UINT instance)const
+{
+	return mBounds[instance];
+}
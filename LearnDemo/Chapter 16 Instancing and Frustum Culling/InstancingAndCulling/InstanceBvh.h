@@ -0,0 +1,73 @@
+#ifndef INSTANCEBVH_H
+#define INSTANCEBVH_H
+
+#include "InstanceCuller.h"
+
+///<summary>
+/// Bounding volume hierarchy over the world space instance bounds of an
+/// InstanceCuller, for culling large instance counts without visiting
+/// every instance.
+///
+/// Built top down with a binned surface area heuristic.  Every node covers
+/// a contiguous range of the instance index list, so a node found entirely
+/// inside the frustum copies its range out without testing anything below
+/// it.  Traversal also carries a mask of the planes the node's parent was
+/// not yet inside, so children only test those.
+///
+/// When instances move, update the culler and call Refit, which keeps the
+/// tree and recomputes its bounds (culling slowly gets worse the further
+/// instances move from where the tree was built; Build again then).
+///</summary>
+class InstanceBvh
+{
+public:
+	void Build(const InstanceCuller& culler);
+	void Refit(const InstanceCuller& culler);
+
+	// Same output as InstanceCuller::Cull (the same instances are kept), in
+	// tree order instead of ascending order.
+	UINT Cull(const DirectX::XMFLOAT4 planes[6], UINT* visibleIndices);
+
+	UINT NodeCount()const;
+	UINT Depth()const;
+
+	// Nodes and instances whose bounds were tested in the last Cull.
+	UINT NodesTested()const;
+	UINT InstancesTested()const;
+
+	// The tree, for code that walks it itself (CullingCache).  Node 0 is the
+	// root, and children always come after their parent.
+	struct Node
+	{
+		DirectX::XMFLOAT3 Center;
+		UINT First = 0;         // Instances GetListedInstance(First .. First + Count - 1).
+		DirectX::XMFLOAT3 Extents;
+		UINT Count = 0;
+		UINT Child = 0;         // Children at Child and Child+1; 0 for a leaf.
+	};
+
+	const Node& GetNode(UINT i)const;
+	UINT GetListedInstance(UINT i)const;
+	const DirectX::BoundingBox& GetInstanceBounds(UINT instance)const;
+
+private:
+	void BuildNode(UINT nodeIndex, UINT first, UINT count, UINT depth);
+
+	// Bit i set: plane i may cut the box.  Returns false if the box is
+	// outside a plane; otherwise clears the bits of planes it is inside.
+	static bool TestBox(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents,
+		const DirectX::XMFLOAT4 planes[6], UINT& planeMask);
+
+	std::vector<Node> mNodes;
+	std::vector<UINT> mIndices;
+
+	// World bounds of the instances, by instance index.
+	std::vector<DirectX::BoundingBox> mBounds;
+
+	std::vector<UINT> mStack;
+	UINT mDepth = 0;
+	UINT mNodesTested = 0;
+	UINT mInstancesTested = 0;
+};
+
+#endif // INSTANCEBVH_H
@@ -0,0 +1,187 @@
+#include "InstanceCuller.h"
+
+using namespace DirectX;
+
+void InstanceCuller::Build(const BoundingBox& localBounds, const InstanceData* instances, UINT instanceCount)
+{
+	mLocalBounds = localBounds;
+	mInstanceCount = instanceCount;
+
+	// Unused lanes of the last block stay empty boxes at the origin; Cull
+	// never reports them.
+	BoxBlock empty;
+	memset(&empty, 0, sizeof(BoxBlock));
+	mBlocks.assign((instanceCount + 7) / 8, empty);
+
+	for(UINT i = 0; i < instanceCount; ++i)
+	{
+		SetInstanceWorld(i, instances[i].World);
+	}
+}
+
+void InstanceCuller::SetInstanceWorld(UINT i, const XMFLOAT4X4& world)
+{
+	XMMATRIX W = XMLoadFloat4x4(&world);
+
+	// The AABB of a transformed box: the center is transformed, and each
+	// world axis extent is the sum of the local extents along it.
+	XMVECTOR center = XMVector3Transform(XMLoadFloat3(&mLocalBounds.Center), W);
+	XMVECTOR extents = XMLoadFloat3(&mLocalBounds.Extents);
+	XMVECTOR worldExtents = XMVectorMultiply(XMVectorSplatX(extents), XMVectorAbs(W.r[0]));
+	worldExtents = XMVectorMultiplyAdd(XMVectorSplatY(extents), XMVectorAbs(W.r[1]), worldExtents);
+	worldExtents = XMVectorMultiplyAdd(XMVectorSplatZ(extents), XMVectorAbs(W.r[2]), worldExtents);
+
+	XMFLOAT3 c, e;
+	XMStoreFloat3(&c, center);
+	XMStoreFloat3(&e, worldExtents);
+
+	BoxBlock& block = mBlocks[i / 8];
+	const UINT half = (i % 8) / 4;
+	const UINT lane = i % 4;
+	(&block.CenterX[half].x)[lane] = c.x;
+	(&block.CenterY[half].x)[lane] = c.y;
+	(&block.CenterZ[half].x)[lane] = c.z;
+	(&block.ExtentX[half].x)[lane] = e.x;
+	(&block.ExtentY[half].x)[lane] = e.y;
+	(&block.ExtentZ[half].x)[lane] = e.z;
+}
+
+UINT InstanceCuller::InstanceCount()const
+{
+	return mInstanceCount;
+}
+
+void InstanceCuller::GetInstanceBounds(UINT i, BoundingBox& bounds)const
+{
+	const BoxBlock& block = mBlocks[i / 8];
+	const UINT half = (i % 8) / 4;
+	const UINT lane = i % 4;
+	bounds.Center = XMFLOAT3((&block.CenterX[half].x)[lane], (&block.CenterY[half].x)[lane], (&block.CenterZ[half].x)[lane]);
+	bounds.Extents = XMFLOAT3((&block.ExtentX[half].x)[lane], (&block.ExtentY[half].x)[lane], (&block.ExtentZ[half].x)[lane]);
+}
+
+void InstanceCuller::GetFrustumPlanes(const BoundingFrustum& worldFrustum, XMFLOAT4 planes[6])
+{
+	XMVECTOR P[6];
+	worldFrustum.GetPlanes(&P[0], &P[1], &P[2], &P[3], &P[4], &P[5]);
+
+	for(int i = 0; i < 6; ++i)
+	{
+		XMStoreFloat4(&planes[i], XMPlaneNormalize(P[i]));
+	}
+}
+
+UINT InstanceCuller::Cull(const XMFLOAT4 planes[6], UINT* visibleIndices)const
+{
+	return CullBlocks(planes, 0, (UINT)mBlocks.size(), visibleIndices);
+}
+
+UINT InstanceCuller::Cull(ThreadPool* threadPool, const XMFLOAT4 planes[6], const VisibleRangeFunc& writeRange)
+{
+	const UINT blockCount = (UINT)mBlocks.size();
+	const UINT chunkCount = (blockCount + BlocksPerChunk - 1) / BlocksPerChunk;
+
+	mScratch.resize((size_t)blockCount * 8);
+	mChunkCounts.resize(chunkCount);
+	mChunkOffsets.resize(chunkCount);
+
+	// Chunks are a fixed size, so the split (and the output) is the same
+	// whatever the thread count.  Each chunk compacts into its own part of
+	// the scratch list.
+	threadPool->ParallelFor(chunkCount, 1, [&](UINT begin, UINT end, UINT threadIndex)
+	{
+		for(UINT c = begin; c < end; ++c)
+		{
+			const UINT firstBlock = c * BlocksPerChunk;
+			const UINT chunkBlocks = MathHelper::Min(BlocksPerChunk, blockCount - firstBlock);
+			mChunkCounts[c] = CullBlocks(planes, firstBlock, chunkBlocks, &mScratch[(size_t)firstBlock * 8]);
+		}
+	});
+
+	// Exclusive prefix sum: where each chunk's visible instances start.
+	UINT visibleCount = 0;
+	for(UINT c = 0; c < chunkCount; ++c)
+	{
+		mChunkOffsets[c] = visibleCount;
+		visibleCount += mChunkCounts[c];
+	}
+
+	threadPool->ParallelFor(chunkCount, 1, [&](UINT begin, UINT end, UINT threadIndex)
+	{
+		for(UINT c = begin; c < end; ++c)
+		{
+			if(mChunkCounts[c] > 0)
+				writeRange(&mScratch[(size_t)c * BlocksPerChunk * 8], mChunkCounts[c], mChunkOffsets[c]);
+		}
+	});
+
+	return visibleCount;
+}
+
+UINT InstanceCuller::CullBlocks(const XMFLOAT4 planes[6], UINT firstBlock, UINT blockCount, UINT* visibleIndices)const
+{
+	// Each plane component splatted across a register, and the absolute
+	// values of the normal for the box radius.
+	XMVECTOR N[6][3], absN[6][3], D[6];
+	for(int p = 0; p < 6; ++p)
+	{
+		XMVECTOR plane = XMLoadFloat4(&planes[p]);
+		N[p][0] = XMVectorSplatX(plane);
+		N[p][1] = XMVectorSplatY(plane);
+		N[p][2] = XMVectorSplatZ(plane);
+		D[p] = XMVectorSplatW(plane);
+		for(int c = 0; c < 3; ++c)
+		{
+			absN[p][c] = XMVectorAbs(N[p][c]);
+		}
+	}
+
+	UINT visibleCount = 0;
+	for(UINT b = firstBlock; b < firstBlock + blockCount; ++b)
+	{
+		const BoxBlock& block = mBlocks[b];
+
+		for(UINT h = 0; h < 2; ++h)
+		{
+			const UINT first = 8*b + 4*h;
+			if(first >= mInstanceCount)
+				break;
+
+			XMVECTOR cx = XMLoadFloat4(&block.CenterX[h]);
+			XMVECTOR cy = XMLoadFloat4(&block.CenterY[h]);
+			XMVECTOR cz = XMLoadFloat4(&block.CenterZ[h]);
+			XMVECTOR ex = XMLoadFloat4(&block.ExtentX[h]);
+			XMVECTOR ey = XMLoadFloat4(&block.ExtentY[h]);
+			XMVECTOR ez = XMLoadFloat4(&block.ExtentZ[h]);
+
+			// A box is outside a plane when its center is further in front
+			// of it than the box's projected radius.
+			XMVECTOR outside = XMVectorFalseInt();
+			for(int p = 0; p < 6; ++p)
+			{
+				XMVECTOR dist = XMVectorMultiplyAdd(N[p][0], cx, D[p]);
+				dist = XMVectorMultiplyAdd(N[p][1], cy, dist);
+				dist = XMVectorMultiplyAdd(N[p][2], cz, dist);
+
+				XMVECTOR radius = XMVectorMultiply(absN[p][0], ex);
+				radius = XMVectorMultiplyAdd(absN[p][1], ey, radius);
+				radius = XMVectorMultiplyAdd(absN[p][2], ez, radius);
+
+				outside = XMVectorOrInt(outside, XMVectorGreater(dist, radius));
+			}
+
+			uint32_t mask[4];
+			XMStoreInt4(mask, outside);
+
+			// Append every lane and only advance past the visible ones.
+			const UINT laneCount = MathHelper::Min(4u, mInstanceCount - first);
+			for(UINT j = 0; j < laneCount; ++j)
+			{
+				visibleIndices[visibleCount] = first + j;
+				visibleCount += ~mask[j] & 1;
+			}
+		}
+	}
+
+	return visibleCount;
+}
@@ -0,0 +1,82 @@
+#ifndef INSTANCECULLER_H
+#define INSTANCECULLER_H
+
+#include "IACFrameResource.h"
+#include "../../../Common/ThreadPool.h"
+
+///<summary>
+/// Frustum culling for the instances of one RenderItem.
+///
+/// Instead of moving the frustum into each instance's local space, every
+/// instance's bounds are turned into a world space AABB once, in Build,
+/// and stored structure-of-arrays in blocks of eight (centers and extents).
+/// Cull tests a block at a time against the six world space frustum planes
+/// and writes the indices of the boxes not entirely outside one of them.
+///
+/// The AABB of a rotated box is looser than the box, so a few more
+/// instances pass than with BoundingFrustum::Contains in local space; none
+/// that intersect the frustum are dropped.
+///</summary>
+class InstanceCuller
+{
+public:
+	// localBounds are the mesh bounds every instance shares.
+	void Build(const DirectX::BoundingBox& localBounds, const InstanceData* instances, UINT instanceCount);
+
+	// Call when instance i moves.
+	void SetInstanceWorld(UINT i, const DirectX::XMFLOAT4X4& world);
+
+	UINT InstanceCount()const;
+	void GetInstanceBounds(UINT i, DirectX::BoundingBox& bounds)const;
+
+	// The six planes of a world space frustum, normalized, pointing out of it.
+	static void GetFrustumPlanes(const DirectX::BoundingFrustum& worldFrustum, DirectX::XMFLOAT4 planes[6]);
+
+	// Writes the (ascending) indices of the instances that may be visible to
+	// visibleIndices, which needs room for InstanceCount() of them, and
+	// returns how many there are.
+	UINT Cull(const DirectX::XMFLOAT4 planes[6], UINT* visibleIndices)const;
+
+	// Called with a run of visibleIndices (ascending) and the position of the
+	// first of them in the whole visible list.
+	typedef std::function<void(const UINT* visibleIndices, UINT count, UINT firstSlot)> VisibleRangeFunc;
+
+	// Cull on a thread pool.  Fixed size chunks of instances are culled in
+	// parallel into per-chunk lists, a prefix sum over the chunk counts gives
+	// each chunk its place in the visible list, and then writeRange is called
+	// in parallel for every chunk with visible instances, e.g. to write their
+	// instance data straight into the mapped instance buffer.  The visible
+	// list is the same, in the same (ascending) order, as the serial Cull.
+	// Returns the number of visible instances.
+	UINT Cull(ThreadPool* threadPool, const DirectX::XMFLOAT4 planes[6], const VisibleRangeFunc& writeRange);
+
+private:
+	// Eight world space AABBs, structure-of-arrays.
+	struct BoxBlock
+	{
+		DirectX::XMFLOAT4 CenterX[2];
+		DirectX::XMFLOAT4 CenterY[2];
+		DirectX::XMFLOAT4 CenterZ[2];
+		DirectX::XMFLOAT4 ExtentX[2];
+		DirectX::XMFLOAT4 ExtentY[2];
+		DirectX::XMFLOAT4 ExtentZ[2];
+	};
+
+	// Culls blocks [firstBlock, firstBlock + blockCount).
+	UINT CullBlocks(const DirectX::XMFLOAT4 planes[6], UINT firstBlock, UINT blockCount, UINT* visibleIndices)const;
+
+	// 512 instances per chunk of the parallel cull.
+	static const UINT BlocksPerChunk = 64;
+
+	DirectX::BoundingBox mLocalBounds;
+	std::vector<BoxBlock> mBlocks;
+	UINT mInstanceCount = 0;
+
+	// Parallel cull: per-chunk visible lists (at the chunk's own instance
+	// offset), their counts and their offsets in the visible list.
+	std::vector<UINT> mScratch;
+	std::vector<UINT> mChunkCounts;
+	std::vector<UINT> mChunkOffsets;
+};
+
+#endif // INSTANCECULLER_H
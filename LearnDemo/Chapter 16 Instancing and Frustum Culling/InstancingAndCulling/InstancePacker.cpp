@@ -0,0 +1,58 @@
+#include "InstancePacker.h"
+
+using namespace DirectX;
+
+UINT InstancePacker::Pack(const InstanceData* instances, const UINT* indices, UINT count,
+	PackedInstanceData* packed, InstanceTexTransform* texTransforms)
+{
+	// (_11, _21, _12, _22) and (_41, _42) of an identity TexTransform.
+	const XMVECTOR identityScale = XMVectorSet(1.0f, 0.0f, 0.0f, 1.0f);
+	const XMVECTOR zero = XMVectorZero();
+
+	UINT texTransformCount = 0;
+	for(UINT i = 0; i < count; ++i)
+	{
+		const InstanceData& instance = instances[indices[i]];
+		PackedInstanceData& dest = packed[i];
+
+		// The shaders multiply by the rows of the transpose, so the columns of
+		// World are stored, all but the constant fourth one.
+		XMMATRIX world = XMMatrixTranspose(XMLoadFloat4x4(&instance.World));
+		XMStoreFloat4(&dest.World[0], world.r[0]);
+		XMStoreFloat4(&dest.World[1], world.r[1]);
+		XMStoreFloat4(&dest.World[2], world.r[2]);
+
+		// Texture coordinates are (u, v, 0, 1), so only the 2x2 upper left
+		// block and the first two entries of the last row matter.
+		const XMFLOAT4X4& t = instance.TexTransform;
+		XMVECTOR row0 = XMLoadFloat2(reinterpret_cast<const XMFLOAT2*>(&t._11));
+		XMVECTOR row1 = XMLoadFloat2(reinterpret_cast<const XMFLOAT2*>(&t._21));
+		XMVECTOR offset = XMLoadFloat2(reinterpret_cast<const XMFLOAT2*>(&t._41));
+		XMVECTOR scale = XMVectorMergeXY(row0, row1);
+
+		UINT flags = 0;
+		if(!XMVector4Equal(scale, identityScale) || !XMVector2Equal(offset, zero))
+		{
+			// (_11, _21, _41) and (_12, _22, _42).
+			XMStoreFloat3(&texTransforms[i].TexTransform[0], XMVectorPermute<0, 1, 4, 5>(scale, offset));
+			XMStoreFloat3(&texTransforms[i].TexTransform[1], XMVectorPermute<2, 3, 5, 4>(scale, offset));
+			flags |= TexTransformFlag;
+			++texTransformCount;
+		}
+
+		assert(instance.MaterialIndex <= MaxMaterialIndex);
+		dest.MaterialAndFlags = instance.MaterialIndex | (flags << 16);
+	}
+
+	return texTransformCount;
+}
+
+UINT InstancePacker::GetMaterialIndex(const PackedInstanceData& packed)
+{
+	return packed.MaterialAndFlags & 0xffff;
+}
+
+UINT InstancePacker::GetFlags(const PackedInstanceData& packed)
+{
+	return packed.MaterialAndFlags >> 16;
+}
@@ -0,0 +1,37 @@
+#ifndef INSTANCEPACKER_H
+#define INSTANCEPACKER_H
+
+#include "IACFrameResource.h"
+
+///<summary>
+/// Packs InstanceData into the instance buffer's PackedInstanceData.
+///
+/// A full InstanceData is 144 bytes, but World is always affine, most
+/// instances use no TexTransform, and material indices are small.  Packed,
+/// an instance is 52 bytes: World as a 3x4 matrix and the material index
+/// and flags in one UINT.  An instance's TexTransform goes to a separate
+/// buffer, 24 bytes more, only when it isn't the identity, and the
+/// TexTransformFlag tells the vertex shader to read it.
+///</summary>
+class InstancePacker
+{
+public:
+	// Flags in the high 16 bits of PackedInstanceData::MaterialAndFlags.
+	// Shaders/Default.hlsl defines the same ones.
+	static const UINT TexTransformFlag = 0x1;
+
+	// Material indices go in the low 16 bits.
+	static const UINT MaxMaterialIndex = 0xffff;
+
+	// Packs instances[indices[i]] into packed[i], and its TexTransform into
+	// texTransforms[i] when that isn't the identity, for i < count.  Returns
+	// how many TexTransforms were written.  Safe to call from many threads
+	// on different ranges.
+	static UINT Pack(const InstanceData* instances, const UINT* indices, UINT count,
+		PackedInstanceData* packed, InstanceTexTransform* texTransforms);
+
+	static UINT GetMaterialIndex(const PackedInstanceData& packed);
+	static UINT GetFlags(const PackedInstanceData& packed);
+};
+
+#endif // INSTANCEPACKER_H
@@ -10,6 +10,8 @@
 //#include "../../../Common/GeometryGenerator.h"
 //#include "../../../Common/Camera.h"
 //#include "IACFrameResource.h"
+//#include "CullingCache.h"
+//#include "InstancePacker.h"
 //
 //using Microsoft::WRL::ComPtr;
 //using namespace DirectX;
@@ -52,6 +54,16 @@
 //	BoundingBox Bounds;
 //	std::vector<InstanceData> Instances;
 //
+//	// World space bounds of the instances, and a hierarchy over them, for
+//	// culling.  If instances move, update Culler, refit Bvh and mark them
+//	// dirty in Cache.
+//	InstanceCuller Culler;
+//	InstanceBvh Bvh;
+//	CullingCache Cache;
+//
+//	// Frame resources whose instance buffer still holds an old visible list.
+//	int InstanceFramesDirty = gNumFrameResources;
+//
 //    // DrawIndexedInstanced parameters.
 //    UINT IndexCount = 0;
 //	UINT InstanceCount = 0;
@@ -129,6 +141,13 @@
 //
 //	BoundingFrustum mCamFrustum;
 //
+//	// Indices of the instances that pass culling this frame.
+//	std::vector<UINT> mVisibleInstances;
+//
+//	// Above this many visible instances, write them in parallel.
+//	static const UINT ParallelCullThreshold = 4096;
+//	ThreadPool mThreadPool;
+//
 //    PassConstants mMainPassCB;
 //
 //	Camera mCamera;
@@ -355,7 +374,19 @@
 //		mFrustumCullingEnabled = true;
 //
 //	if(GetAsyncKeyState('2') & 0x8000)
+//	{
+//		// From now on the instance buffers hold every instance rather than
+//		// the caches' lists, so the caches start over when culling is back.
+//		if(mFrustumCullingEnabled)
+//		{
+//			for(auto& e : mAllRitems)
+//			{
+//				e->Cache.Reset(&e->Bvh);
+//				e->InstanceFramesDirty = gNumFrameResources;
+//			}
+//		}
 //		mFrustumCullingEnabled = false;
+//	}
 //
 //	mCamera.UpdateViewMatrix();
 //}
@@ -370,39 +401,62 @@
 //	XMMATRIX view = mCamera.GetView();
 //	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
 //
-//	auto currInstanceBuffer = mCurrFrameResource->InstanceBuffer.get();
+//	// Transform the camera frustum from view space to world space once, and
+//	// test the instances' world space bounds against it.
+//	BoundingFrustum worldSpaceFrustum;
+//	mCamFrustum.Transform(worldSpaceFrustum, invView);
+//
+//	XMFLOAT4 frustumPlanes[6];
+//	InstanceCuller::GetFrustumPlanes(worldSpaceFrustum, frustumPlanes);
+//
+//	auto instanceBuffer = reinterpret_cast<PackedInstanceData*>(mCurrFrameResource->InstanceBuffer->MappedData());
+//	auto texTransformBuffer = reinterpret_cast<InstanceTexTransform*>(
+//		mCurrFrameResource->InstanceTexTransformBuffer->MappedData());
 //	for(auto& e : mAllRitems)
 //	{
 //		const auto& instanceData = e->Instances;
 //
-//		int visibleInstanceCount = 0;
-//
-//		for(UINT i = 0; i < (UINT)instanceData.size(); ++i)
+//		// Write the instance data to structured buffer for the visible objects.
+//		// Called from the worker threads, each with its own part of the buffer.
+//		auto writeVisible = [&](const UINT* visibleIndices, UINT count, UINT firstSlot)
 //		{
-//			XMMATRIX world = XMLoadFloat4x4(&instanceData[i].World);
-//			XMMATRIX texTransform = XMLoadFloat4x4(&instanceData[i].TexTransform);
-//
-//			XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
-//
-//			// View space to the object's local space.
-//			XMMATRIX viewToLocal = XMMatrixMultiply(invView, invWorld);
-// 
-//			// Transform the camera frustum from view space to the object's local space.
-//			BoundingFrustum localSpaceFrustum;
-//			mCamFrustum.Transform(localSpaceFrustum, viewToLocal);
+//			InstancePacker::Pack(instanceData.data(), visibleIndices, count,
+//				instanceBuffer + firstSlot, texTransformBuffer + firstSlot);
+//		};
 //
-//			// Perform the box/frustum intersection test in local space.
-//			if((localSpaceFrustum.Contains(e->Bounds) != DirectX::DISJOINT) || (mFrustumCullingEnabled==false))
+//		UINT visibleInstanceCount = 0;
+//		if(mFrustumCullingEnabled)
+//		{
+//			// Last frame's results mostly still hold, so only what may have
+//			// changed is tested again.  A frame resource's buffer only needs
+//			// rewriting when the visible list changed since it was written.
+//			visibleInstanceCount = e->Cache.Cull(mCamFrustum, invView, mVisibleInstances.data());
+//			if(e->Cache.VisibleChanged())
+//				e->InstanceFramesDirty = gNumFrameResources;
+//
+//			if(e->InstanceFramesDirty > 0)
 //			{
-//				InstanceData data;
-//				XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
-//				XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
-//				data.MaterialIndex = instanceData[i].MaterialIndex;
-//
-//				// Write the instance data to structured buffer for the visible objects.
-//				currInstanceBuffer->CopyData(visibleInstanceCount++, data);
+//				// Many visible: write them on every thread.
+//				if(visibleInstanceCount < ParallelCullThreshold)
+//				{
+//					writeVisible(mVisibleInstances.data(), visibleInstanceCount, 0);
+//				}
+//				else
+//				{
+//					mThreadPool.ParallelFor(visibleInstanceCount, 512, [&](UINT begin, UINT end, UINT threadIndex)
+//					{
+//						writeVisible(mVisibleInstances.data() + begin, end - begin, begin);
+//					});
+//				}
+//				e->InstanceFramesDirty--;
 //			}
 //		}
+//		else
+//		{
+//			for(UINT i = 0; i < (UINT)instanceData.size(); ++i)
+//				mVisibleInstances[visibleInstanceCount++] = i;
+//			writeVisible(mVisibleInstances.data(), visibleInstanceCount, 0);
+//		}
 //
 //		e->InstanceCount = visibleInstanceCount;
 //
@@ -543,18 +597,19 @@
 //	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 7, 0, 0);
 //
 //    // Root parameter can be a table, root descriptor or root constants.
-//    CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+//    CD3DX12_ROOT_PARAMETER slotRootParameter[5];
 //
 //	// Perfomance TIP: Order from most frequent to least frequent.
 //    slotRootParameter[0].InitAsShaderResourceView(0, 1);
 //    slotRootParameter[1].InitAsShaderResourceView(1, 1);
 //    slotRootParameter[2].InitAsConstantBufferView(0);
 //	slotRootParameter[3].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
+//	slotRootParameter[4].InitAsShaderResourceView(2, 1);
 //
 //	auto staticSamplers = GetStaticSamplers();
 //
 //    // A root signature is an array of root parameters.
-//	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+//	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(5, slotRootParameter,
 //		(UINT)staticSamplers.size(), staticSamplers.data(),
 //		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 //
@@ -941,6 +996,11 @@
 //	}
 //
 //
+//	skullRitem->Culler.Build(skullRitem->Bounds, skullRitem->Instances.data(), mInstanceCount);
+//	skullRitem->Bvh.Build(skullRitem->Culler);
+//	skullRitem->Cache.Reset(&skullRitem->Bvh);
+//	mVisibleInstances.resize(mInstanceCount);
+//
 //	mAllRitems.push_back(std::move(skullRitem));
 //	
 //	// All the render items are opaque.
@@ -963,6 +1023,8 @@
 //		// the heap and set as a root descriptor.
 //		auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
 //		mCommandList->SetGraphicsRootShaderResourceView(0, instanceBuffer->GetGPUVirtualAddress());
+//		auto texTransformBuffer = mCurrFrameResource->InstanceTexTransformBuffer->Resource();
+//		mCommandList->SetGraphicsRootShaderResourceView(4, texTransformBuffer->GetGPUVirtualAddress());
 //
 //        cmdList->DrawIndexedInstanced(ri->IndexCount, ri->InstanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
 //    }
@@ -103,14 +103,23 @@
 // Ľṹ뺯
 #include "LightingUtil.hlsl"
 
+// Flags in the high 16 bits of MaterialAndFlags, as in InstancePacker.
+#define INSTANCE_TEX_TRANSFORM 0x1
+
+// PackedInstanceData: the first three columns of the world matrix as rows
+// (the fourth column is always 0, 0, 0, 1), and the material index in the
+// low 16 bits of MaterialAndFlags.
 struct InstanceData
 {
-	float4x4 World;
-	float4x4 TexTransform;
-	uint     MaterialIndex;
-	uint     InstPad0;
-	uint     InstPad1;
-	uint     InstPad2;
+	row_major float3x4 World;
+	uint               MaterialAndFlags;
+};
+
+// The 2D part of the instance's texture transform, read only for instances
+// with INSTANCE_TEX_TRANSFORM set.
+struct InstanceTexTransform
+{
+	row_major float2x3 TexTransform;
 };
 
 struct MaterialData
@@ -137,6 +146,7 @@ Texture2D gDiffuseMap[7] : register(t0);
 // t1t6Ĵspace0
 StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
 StructuredBuffer<MaterialData> gMaterialData : register(t1, space1);
+StructuredBuffer<InstanceTexTransform> gInstanceTexTransforms : register(t2, space1);
 
 SamplerState gsamPointWrap        : register(s0);
 SamplerState gsamPointClamp       : register(s1);
@@ -202,9 +212,9 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 	// Fetch the instance data.
     // ȡʵ
 	InstanceData instData = gInstanceData[instanceID];
-	float4x4 world = instData.World;
-	float4x4 texTransform = instData.TexTransform;
-	uint matIndex = instData.MaterialIndex;
+	float3x4 world = instData.World;
+	uint matIndex = instData.MaterialAndFlags & 0xffff;
+	uint instFlags = instData.MaterialAndFlags >> 16;
 
 	vout.MatIndex = matIndex;
 	
@@ -214,12 +224,12 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 	
     // Transform to world space.
     // 任ռ
-    float4 posW = mul(float4(vin.PosL, 1.0f), world);
+    float4 posW = float4(mul(world, float4(vin.PosL, 1.0f)), 1.0f);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
     // ҪִеǵȱţҪʹתþм
-    vout.NormalW = mul(vin.NormalL, (float3x3)world);
+    vout.NormalW = mul((float3x3)world, vin.NormalL);
 
     // Transform to homogeneous clip space.
     // Ѷ任βüռ
@@ -227,8 +237,10 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 	
 	// Output vertex attributes for interpolation across triangle.
     // Ϊ˶νвֵ
-	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), texTransform);
-	vout.TexC = mul(texC, matData.MatTransform).xy;
+	float2 texC = vin.TexC;
+	if(instFlags & INSTANCE_TEX_TRANSFORM)
+		texC = mul(gInstanceTexTransforms[instanceID].TexTransform, float3(texC, 1.0f));
+	vout.TexC = mul(float4(texC, 0.0f, 1.0f), matData.MatTransform).xy;
 	
     return vout;
 }
@@ -8,6 +8,7 @@
 //#include "../../../Common/GeometryGenerator.h"
 //#include "../../../Common/Camera.h"
 //#include "PickingFrameResource.h"
+//#include "PickingBvh.h"
 //
 //using Microsoft::WRL::ComPtr;
 //using namespace DirectX;
@@ -55,6 +56,10 @@
 //    UINT IndexCount = 0;
 //    UINT StartIndexLocation = 0;
 //    int BaseVertexLocation = 0;
+//
+//	// Triangle BVH of the submesh drawn, for picking; null if the item
+//	// can't be picked.
+//	const MeshBvh* Bvh = nullptr;
 //};
 //
 //enum class RenderLayer : int
@@ -98,6 +103,7 @@
 //    void BuildFrameResources();
 //    void BuildMaterials();
 //    void BuildRenderItems();
+//	void BuildPickingBvh();
 //    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
 //	void Pick(int sx, int sy);
 //
@@ -131,6 +137,12 @@
 //
 //	RenderItem* mPickedRitem = nullptr;
 //
+//	// Triangle BVHs by submesh, and the two-level BVH over the pickable
+//	// items, whose instances are indices into mPickableRitems.
+//	std::unordered_map<std::string, std::unique_ptr<MeshBvh>> mMeshBvhs;
+//	SceneBvh mPickingBvh;
+//	std::vector<RenderItem*> mPickableRitems;
+//
 //    PassConstants mMainPassCB;
 //
 //	Camera mCamera;
@@ -651,6 +663,10 @@
 //
 //	geo->DrawArgs["car"] = submesh;
 //
+//	auto carBvh = std::make_unique<MeshBvh>();
+//	carBvh->Build(*geo, submesh);
+//	mMeshBvhs["car"] = std::move(carBvh);
+//
 //	mGeometries[geo->Name] = std::move(geo);
 //}
 //
@@ -760,6 +776,7 @@
 //	carRitem->IndexCount = carRitem->Geo->DrawArgs["car"].IndexCount;
 //	carRitem->StartIndexLocation = carRitem->Geo->DrawArgs["car"].StartIndexLocation;
 //	carRitem->BaseVertexLocation = carRitem->Geo->DrawArgs["car"].BaseVertexLocation;
+//	carRitem->Bvh = mMeshBvhs["car"].get();
 //	mRitemLayer[(int)RenderLayer::Opaque].push_back(carRitem.get());
 //
 //	auto pickedRitem = std::make_unique<RenderItem>();
@@ -783,6 +800,30 @@
 //
 //	mAllRitems.push_back(std::move(carRitem));
 //	mAllRitems.push_back(std::move(pickedRitem));
+//
+//	BuildPickingBvh();
+//}
+//
+//void PickingApp::BuildPickingBvh()
+//{
+//	// A real app might keep a separate "picking list" of objects that can be
+//	// selected; here it is the visible opaque items with a BVH.  Nothing
+//	// moves, so the tree is built once.
+//	std::vector<SceneBvh::Instance> instances;
+//	mPickableRitems.clear();
+//	for(auto ri : mRitemLayer[(int)RenderLayer::Opaque])
+//	{
+//		if(ri->Visible == false || ri->Bvh == nullptr)
+//			continue;
+//
+//		SceneBvh::Instance instance;
+//		instance.Mesh = ri->Bvh;
+//		instance.World = ri->World;
+//		instances.push_back(instance);
+//		mPickableRitems.push_back(ri);
+//	}
+//
+//	mPickingBvh.Build(instances);
 //}
 //
 //void PickingApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
@@ -883,82 +924,31 @@
 //	XMMATRIX V = mCamera.GetView();
 //	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(V), V);
 //
+//	// Tranform ray to world space.  The BVH moves it into each item's local
+//	// space itself, and the direction need not be unit length.
+//	rayOrigin = XMVector3TransformCoord(rayOrigin, invView);
+//	rayDir = XMVector3TransformNormal(rayDir, invView);
+//
 //	// Assume nothing is picked to start, so the picked render-item is invisible.
 //	mPickedRitem->Visible = false;
 //
-//	// Check if we picked an opaque render item.  A real app might keep a separate "picking list"
-//	// of objects that can be selected.   
-//	for(auto ri : mRitemLayer[(int)RenderLayer::Opaque])
+//	// Only the items whose bounds the ray passes through, and in them only
+//	// the triangles in the BVH nodes it passes through, are tested, nearest
+//	// first, stopping once no node left is nearer than the nearest hit.
+//	RayHit hit;
+//	if(mPickingBvh.IntersectNearest(rayOrigin, rayDir, MathHelper::Infinity, hit))
 //	{
-//		auto geo = ri->Geo;
+//		RenderItem* ri = mPickableRitems[hit.Instance];
 //
-//		// Skip invisible render-items.
-//		if(ri->Visible == false)
-//			continue;
+//		mPickedRitem->Visible = true;
+//		mPickedRitem->IndexCount = 3;
+//		mPickedRitem->BaseVertexLocation = ri->BaseVertexLocation;
 //
-//		XMMATRIX W = XMLoadFloat4x4(&ri->World);
-//		XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(W), W);
+//		// Picked render item needs same world matrix as object picked.
+//		mPickedRitem->World = ri->World;
+//		mPickedRitem->NumFramesDirty = gNumFrameResources;
 //
-//		// Tranform ray to vi space of Mesh.
-//		XMMATRIX toLocal = XMMatrixMultiply(invView, invWorld);
-//
-//		rayOrigin = XMVector3TransformCoord(rayOrigin, toLocal);
-//		rayDir = XMVector3TransformNormal(rayDir, toLocal);
-//
-//		// Make the ray direction unit length for the intersection tests.
-//		rayDir = XMVector3Normalize(rayDir);
-//
-//		// If we hit the bounding box of the Mesh, then we might have picked a Mesh triangle,
-//		// so do the ray/triangle tests.
-//		//
-//		// If we did not hit the bounding box, then it is impossible that we hit 
-//		// the Mesh, so do not waste effort doing ray/triangle tests.
-//		float tmin = 0.0f;
-//		if(ri->Bounds.Intersects(rayOrigin, rayDir, tmin))
-//		{
-//			// NOTE: For the demo, we know what to cast the vertex/index data to.  If we were mixing
-//			// formats, some metadata would be needed to figure out what to cast it to.
-//			auto vertices = (Vertex*)geo->VertexBufferCPU->GetBufferPointer();
-//			auto indices = (std::uint32_t*)geo->IndexBufferCPU->GetBufferPointer();
-//			UINT triCount = ri->IndexCount / 3;
-//
-//			// Find the nearest ray/triangle intersection.
-//			tmin = MathHelper::Infinity;
-//			for(UINT i = 0; i < triCount; ++i)
-//			{
-//				// Indices for this triangle.
-//				UINT i0 = indices[i * 3 + 0];
-//				UINT i1 = indices[i * 3 + 1];
-//				UINT i2 = indices[i * 3 + 2];
-//
-//				// Vertices for this triangle.
-//				XMVECTOR v0 = XMLoadFloat3(&vertices[i0].Pos);
-//				XMVECTOR v1 = XMLoadFloat3(&vertices[i1].Pos);
-//				XMVECTOR v2 = XMLoadFloat3(&vertices[i2].Pos);
-//
-//				// We have to iterate over all the triangles in order to find the nearest intersection.
-//				float t = 0.0f;
-//				if(TriangleTests::Intersects(rayOrigin, rayDir, v0, v1, v2, t))
-//				{
-//					if(t < tmin)
-//					{
-//						// This is the new nearest picked triangle.
-//						tmin = t;
-//						UINT pickedTriangle = i;
-//
-//						mPickedRitem->Visible = true;
-//						mPickedRitem->IndexCount = 3;
-//						mPickedRitem->BaseVertexLocation = 0;
-//
-//						// Picked render item needs same world matrix as object picked.
-//						mPickedRitem->World = ri->World;
-//						mPickedRitem->NumFramesDirty = gNumFrameResources;
-//
-//						// Offset to the picked triangle in the mesh index buffer.
-//						mPickedRitem->StartIndexLocation = 3 * pickedTriangle;
-//					}
-//				}
-//			}
-//		}
+//		// Offset to the picked triangle in the mesh index buffer.
+//		mPickedRitem->StartIndexLocation = ri->StartIndexLocation + 3*hit.Triangle;
 //	}
 //}
\ No newline at end of file
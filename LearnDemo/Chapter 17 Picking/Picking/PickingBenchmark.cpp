@@ -0,0 +1,582 @@
+#include "PickingBenchmark.h"
+#include "RayQuery.h"
+#include "../../../Common/BenchmarkTimer.h"
+#include <fstream>
+#include <iomanip>
+#include <thread>
+
+using namespace DirectX;
+
+namespace
+{
+	// Positions and indices of a model in the demos' text format.
+	struct Model
+	{
+		std::vector<XMFLOAT3> Positions;
+		std::vector<std::uint32_t> Indices;
+	};
+
+	bool LoadModel(const std::string& fileName, Model& model)
+	{
+		std::ifstream fin(fileName);
+		if(!fin)
+			return false;
+
+		UINT vcount = 0;
+		UINT tcount = 0;
+		std::string ignore;
+
+		fin >> ignore >> vcount;
+		fin >> ignore >> tcount;
+		fin >> ignore >> ignore >> ignore >> ignore;
+
+		model.Positions.resize(vcount);
+		for(UINT i = 0; i < vcount; ++i)
+		{
+			XMFLOAT3 normal;
+			fin >> model.Positions[i].x >> model.Positions[i].y >> model.Positions[i].z;
+			fin >> normal.x >> normal.y >> normal.z;
+		}
+
+		fin >> ignore;
+		fin >> ignore;
+		fin >> ignore;
+
+		model.Indices.resize(3*tcount);
+		for(UINT i = 0; i < 3*tcount; ++i)
+		{
+			fin >> model.Indices[i];
+		}
+
+		return !fin.fail();
+	}
+
+	struct TestRay
+	{
+		XMFLOAT3 Origin;
+		XMFLOAT3 Dir;
+	};
+
+	// rayCount rays from a sphere twice the size of the box toward random
+	// points inside it, so most of them hit something.
+	std::vector<TestRay> MakeRays(const BoundingBox& box, UINT rayCount)
+	{
+		const float radius = 2.0f*XMVectorGetX(XMVector3Length(XMLoadFloat3(&box.Extents)));
+		XMVECTOR center = XMLoadFloat3(&box.Center);
+
+		std::vector<TestRay> rays(rayCount);
+		for(auto& ray : rays)
+		{
+			XMVECTOR origin = XMVectorMultiplyAdd(MathHelper::RandUnitVec3(), XMVectorReplicate(radius), center);
+			XMVECTOR target = XMVectorAdd(center, XMVectorMultiply(XMLoadFloat3(&box.Extents),
+				XMVectorSet(MathHelper::RandF(-0.8f, 0.8f), MathHelper::RandF(-0.8f, 0.8f), MathHelper::RandF(-0.8f, 0.8f), 0.0f)));
+			XMStoreFloat3(&ray.Origin, origin);
+			XMStoreFloat3(&ray.Dir, XMVector3Normalize(XMVectorSubtract(target, origin)));
+		}
+		return rays;
+	}
+
+	// The loop PickingApp::Pick ran over a mesh's triangles.  Returns the
+	// number of hits, and the nearest in tMin.
+	UINT BruteForcePick(const Model& model, FXMVECTOR origin, FXMVECTOR dir, float& tMin)
+	{
+		UINT hitCount = 0;
+		tMin = MathHelper::Infinity;
+		const UINT triCount = (UINT)model.Indices.size() / 3;
+		for(UINT i = 0; i < triCount; ++i)
+		{
+			XMVECTOR v0 = XMLoadFloat3(&model.Positions[model.Indices[i*3 + 0]]);
+			XMVECTOR v1 = XMLoadFloat3(&model.Positions[model.Indices[i*3 + 1]]);
+			XMVECTOR v2 = XMLoadFloat3(&model.Positions[model.Indices[i*3 + 2]]);
+
+			float t = 0.0f;
+			if(TriangleTests::Intersects(origin, dir, v0, v1, v2, t))
+			{
+				++hitCount;
+				tMin = MathHelper::Min(tMin, t);
+			}
+		}
+		return hitCount;
+	}
+
+	bool SameDistance(float a, float b)
+	{
+		if(a == MathHelper::Infinity || b == MathHelper::Infinity)
+			return a == b;
+		return fabsf(a - b) <= 1e-3f*MathHelper::Max(1.0f, fabsf(a));
+	}
+
+	// Whether a hit's barycentrics put it on an edge of its triangle.
+	bool OnEdge(const RayHit& hit)
+	{
+		const float epsilon = 1e-3f;
+		return hit.U <= epsilon || hit.V <= epsilon || hit.U + hit.V >= 1.0f - epsilon;
+	}
+
+	// Whether two queries of the same ray found the same hit.  A ray through
+	// an edge shared by two triangles may report either one, so different
+	// ids are only accepted there, at the same distance.
+	bool SameHit(const RayHit& a, const RayHit& b)
+	{
+		if(!SameDistance(a.T, b.T))
+			return false;
+		if(a.T == MathHelper::Infinity)
+			return true;
+		if(a.Triangle != b.Triangle || a.Instance != b.Instance)
+			return OnEdge(a) && OnEdge(b);
+
+		const float epsilon = 1e-3f;
+		return fabsf(a.U - b.U) <= epsilon && fabsf(a.V - b.V) <= epsilon;
+	}
+
+	double RaysPerSecond(UINT rayCount, double ms)
+	{
+		return rayCount / (ms / 1000.0);
+	}
+
+	// A width x height grid of rays from a camera looking at the box from
+	// the front and a little above, framing it, in scanline order.
+	std::vector<RayQuery::Ray> MakeCameraRays(const BoundingBox& box, UINT width, UINT height)
+	{
+		const float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&box.Extents)));
+		XMVECTOR center = XMLoadFloat3(&box.Center);
+		XMVECTOR eye = XMVectorAdd(center, XMVectorSet(0.0f, 0.5f*radius, -2.5f*radius, 0.0f));
+
+		XMVECTOR forward = XMVector3Normalize(XMVectorSubtract(center, eye));
+		XMVECTOR right = XMVector3Normalize(XMVector3Cross(XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), forward));
+		XMVECTOR up = XMVector3Cross(forward, right);
+		const float tanHalfFov = 0.45f;
+
+		std::vector<RayQuery::Ray> rays(width*height);
+		for(UINT y = 0; y < height; ++y)
+		{
+			for(UINT x = 0; x < width; ++x)
+			{
+				float sx = (2.0f*(x + 0.5f) / width - 1.0f) * tanHalfFov;
+				float sy = (1.0f - 2.0f*(y + 0.5f) / height) * tanHalfFov;
+				XMVECTOR dir = XMVectorAdd(forward, XMVectorAdd(XMVectorScale(right, sx), XMVectorScale(up, sy)));
+
+				RayQuery::Ray& ray = rays[y*width + x];
+				XMStoreFloat3(&ray.Origin, eye);
+				XMStoreFloat3(&ray.Dir, XMVector3Normalize(dir));
+			}
+		}
+		return rays;
+	}
+
+	// samplesPerPoint ambient occlusion rays from each of pointCount random
+	// points on the model's surface, over the hemisphere of the triangle's
+	// normal and a quarter of the model's size long, as an AO bake casts.
+	std::vector<RayQuery::Ray> MakeOcclusionRays(const Model& model, const BoundingBox& box, UINT pointCount, UINT samplesPerPoint)
+	{
+		const float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&box.Extents)));
+		const UINT triCount = (UINT)model.Indices.size() / 3;
+
+		std::vector<RayQuery::Ray> rays(pointCount*samplesPerPoint);
+		for(UINT p = 0; p < pointCount; ++p)
+		{
+			UINT tri = (UINT)MathHelper::Rand(0, (int)triCount - 1);
+			XMVECTOR v0 = XMLoadFloat3(&model.Positions[model.Indices[tri*3 + 0]]);
+			XMVECTOR v1 = XMLoadFloat3(&model.Positions[model.Indices[tri*3 + 1]]);
+			XMVECTOR v2 = XMLoadFloat3(&model.Positions[model.Indices[tri*3 + 2]]);
+			XMVECTOR normal = XMVector3Normalize(XMVector3Cross(XMVectorSubtract(v1, v0), XMVectorSubtract(v2, v0)));
+
+			float u = MathHelper::RandF();
+			float v = MathHelper::RandF();
+			if(u + v > 1.0f)
+			{
+				u = 1.0f - u;
+				v = 1.0f - v;
+			}
+			XMVECTOR point = XMVectorAdd(v0, XMVectorAdd(XMVectorScale(XMVectorSubtract(v1, v0), u), XMVectorScale(XMVectorSubtract(v2, v0), v)));
+
+			// Off the surface a little so the ray does not hit its own triangle.
+			XMVECTOR origin = XMVectorAdd(point, XMVectorScale(normal, 1e-3f*radius));
+			for(UINT s = 0; s < samplesPerPoint; ++s)
+			{
+				RayQuery::Ray& ray = rays[p*samplesPerPoint + s];
+				XMStoreFloat3(&ray.Origin, origin);
+				XMStoreFloat3(&ray.Dir, MathHelper::RandHemisphereUnitVec3(normal));
+				ray.TMax = 0.25f*radius;
+			}
+		}
+		return rays;
+	}
+}
+
+void PickingBenchmark::MeshPicking(std::ostream& out, const std::string& modelDir)
+{
+	const char* modelNames[] = { "car", "skull" };
+	const UINT rayCount = 10000;
+	const UINT bruteRayCount = 500;
+
+	out << "Mesh picking, rays per second\n";
+	out << std::setw(7) << "mesh" << std::setw(8) << "tris" << std::setw(8) << "nodes" << std::setw(7) << "depth"
+		<< std::setw(10) << "build ms" << std::setw(12) << "all tris" << std::setw(12) << "nearest"
+		<< std::setw(10) << "speedup" << std::setw(12) << "any" << std::setw(12) << "all" << std::setw(6) << "same" << "\n";
+
+	for(const char* name : modelNames)
+	{
+		Model model;
+		if(!LoadModel(modelDir + name + ".txt", model))
+		{
+			out << std::setw(7) << name << "  could not load " << modelDir << name << ".txt\n";
+			continue;
+		}
+
+		MeshBvh bvh;
+		double buildMs = BenchmarkTimer::BestTimeMs(3, [&]()
+		{
+			bvh.Build(model.Positions.data(), sizeof(XMFLOAT3), model.Indices.data(), DXGI_FORMAT_R32_UINT,
+				(UINT)model.Indices.size());
+		});
+
+		std::vector<TestRay> rays = MakeRays(bvh.GetBounds(), rayCount);
+
+		std::vector<float> bruteT(bruteRayCount);
+		std::vector<UINT> bruteHits(bruteRayCount);
+		double bruteMs = BenchmarkTimer::TimeMs([&]()
+		{
+			for(UINT r = 0; r < bruteRayCount; ++r)
+			{
+				bruteHits[r] = BruteForcePick(model, XMLoadFloat3(&rays[r].Origin), XMLoadFloat3(&rays[r].Dir), bruteT[r]);
+			}
+		});
+
+		std::vector<RayHit> nearest(rayCount);
+		std::vector<BYTE> nearestFound(rayCount);
+		double nearestMs = BenchmarkTimer::BestTimeMs(3, [&]()
+		{
+			for(UINT r = 0; r < rayCount; ++r)
+			{
+				nearest[r] = RayHit();
+				nearestFound[r] = bvh.IntersectNearest(XMLoadFloat3(&rays[r].Origin), XMLoadFloat3(&rays[r].Dir),
+					MathHelper::Infinity, nearest[r]);
+			}
+		});
+
+		std::vector<BYTE> anyFound(rayCount);
+		double anyMs = BenchmarkTimer::BestTimeMs(3, [&]()
+		{
+			for(UINT r = 0; r < rayCount; ++r)
+			{
+				anyFound[r] = bvh.IntersectAny(XMLoadFloat3(&rays[r].Origin), XMLoadFloat3(&rays[r].Dir), MathHelper::Infinity);
+			}
+		});
+
+		std::vector<UINT> allCounts(rayCount);
+		std::vector<RayHit> hits;
+		double allMs = BenchmarkTimer::BestTimeMs(3, [&]()
+		{
+			for(UINT r = 0; r < rayCount; ++r)
+			{
+				hits.clear();
+				bvh.IntersectAll(XMLoadFloat3(&rays[r].Origin), XMLoadFloat3(&rays[r].Dir), MathHelper::Infinity, hits);
+				allCounts[r] = (UINT)hits.size();
+			}
+		});
+
+		// Rays grazing an edge can hit one triangle by one test and its
+		// neighbor by the other, so hit counts may differ by one there.
+		bool same = true;
+		for(UINT r = 0; r < bruteRayCount; ++r)
+		{
+			same = same && SameDistance(nearest[r].T, bruteT[r]) &&
+				(nearestFound[r] != 0) == (bruteHits[r] > 0) && (anyFound[r] != 0) == (bruteHits[r] > 0) &&
+				(UINT)abs((int)allCounts[r] - (int)bruteHits[r]) <= 1;
+		}
+
+		const double bruteRate = RaysPerSecond(bruteRayCount, bruteMs);
+		const double nearestRate = RaysPerSecond(rayCount, nearestMs);
+		out << std::setw(7) << name << std::setw(8) << bvh.TriangleCount() << std::setw(8) << bvh.NodeCount()
+			<< std::setw(7) << bvh.Depth() << std::fixed << std::setprecision(2) << std::setw(10) << buildMs
+			<< std::setprecision(0) << std::setw(12) << bruteRate << std::setw(12) << nearestRate
+			<< std::setprecision(1) << std::setw(9) << nearestRate / bruteRate << "x"
+			<< std::setprecision(0) << std::setw(12) << RaysPerSecond(rayCount, anyMs)
+			<< std::setw(12) << RaysPerSecond(rayCount, allMs) << std::setw(6) << (same ? "yes" : "NO") << "\n";
+		out.unsetf(std::ios::fixed);
+	}
+
+	out << std::endl;
+}
+
+void PickingBenchmark::ScenePicking(std::ostream& out, const std::string& modelDir)
+{
+	const char* modelNames[] = { "car", "skull" };
+	const float modelScales[] = { 1.0f, 0.3f };
+	MeshBvh meshes[2];
+	for(UINT m = 0; m < 2; ++m)
+	{
+		Model model;
+		if(!LoadModel(modelDir + modelNames[m] + ".txt", model))
+		{
+			out << "Scene picking: could not load " << modelDir << modelNames[m] << ".txt\n\n";
+			return;
+		}
+		meshes[m].Build(model.Positions.data(), sizeof(XMFLOAT3), model.Indices.data(), DXGI_FORMAT_R32_UINT,
+			(UINT)model.Indices.size());
+	}
+
+	const UINT instanceCounts[] = { 1000, 10000 };
+	const UINT rayCount = 10000;
+
+	out << "Scene picking, rays per second\n";
+	out << std::setw(10) << "instances" << std::setw(10) << "build ms" << std::setw(8) << "nodes" << std::setw(7) << "depth"
+		<< std::setw(12) << "loop" << std::setw(12) << "nearest" << std::setw(10) << "speedup"
+		<< std::setw(12) << "any" << std::setw(12) << "all" << std::setw(6) << "same" << "\n";
+
+	for(UINT instanceCount : instanceCounts)
+	{
+		// About 10 units per instance, like a parking lot.
+		const float halfSize = 5.0f*sqrtf((float)instanceCount);
+
+		std::vector<SceneBvh::Instance> instances(instanceCount);
+		for(auto& instance : instances)
+		{
+			UINT m = rand() % 2;
+			instance.Mesh = &meshes[m];
+			XMMATRIX world = XMMatrixScaling(modelScales[m], modelScales[m], modelScales[m]) *
+				XMMatrixRotationY(MathHelper::RandF(0.0f, XM_2PI)) *
+				XMMatrixTranslation(MathHelper::RandF(-halfSize, halfSize), 1.0f, MathHelper::RandF(-halfSize, halfSize));
+			XMStoreFloat4x4(&instance.World, world);
+		}
+
+		SceneBvh scene;
+		double buildMs = BenchmarkTimer::BestTimeMs(3, [&]()
+		{
+			scene.Build(instances);
+		});
+
+		// From a camera above the lot down to random points on it.
+		std::vector<TestRay> rays(rayCount);
+		for(auto& ray : rays)
+		{
+			XMVECTOR origin = XMVectorSet(MathHelper::RandF(-halfSize, halfSize), 40.0f, MathHelper::RandF(-halfSize, halfSize), 1.0f);
+			XMVECTOR target = XMVectorSet(MathHelper::RandF(-halfSize, halfSize), 0.0f, MathHelper::RandF(-halfSize, halfSize), 1.0f);
+			XMStoreFloat3(&ray.Origin, origin);
+			XMStoreFloat3(&ray.Dir, XMVector3Normalize(XMVectorSubtract(target, origin)));
+		}
+
+		// Every instance's bounds and then its MeshBvh, as a Pick loop over
+		// the render items with the triangle loop replaced.
+		std::vector<BoundingBox> worldBounds(instanceCount);
+		std::vector<XMFLOAT4X4> invWorlds(instanceCount);
+		for(UINT i = 0; i < instanceCount; ++i)
+		{
+			XMMATRIX world = XMLoadFloat4x4(&instances[i].World);
+			instances[i].Mesh->GetBounds().Transform(worldBounds[i], world);
+			XMStoreFloat4x4(&invWorlds[i], XMMatrixInverse(nullptr, world));
+		}
+
+		const UINT loopRayCount = rayCount / 10;
+		std::vector<RayHit> loopHits(loopRayCount);
+		double loopMs = BenchmarkTimer::TimeMs([&]()
+		{
+			for(UINT r = 0; r < loopRayCount; ++r)
+			{
+				XMVECTOR origin = XMLoadFloat3(&rays[r].Origin);
+				XMVECTOR dir = XMLoadFloat3(&rays[r].Dir);
+				RayHit& nearest = loopHits[r];
+				nearest = RayHit();
+				for(UINT i = 0; i < instanceCount; ++i)
+				{
+					float tBox = 0.0f;
+					if(!worldBounds[i].Intersects(origin, dir, tBox))
+						continue;
+
+					XMMATRIX toLocal = XMLoadFloat4x4(&invWorlds[i]);
+					RayHit hit;
+					if(instances[i].Mesh->IntersectNearest(XMVector3TransformCoord(origin, toLocal),
+						XMVector3TransformNormal(dir, toLocal), nearest.T, hit))
+					{
+						nearest = hit;
+						nearest.Instance = i;
+					}
+				}
+			}
+		});
+
+		std::vector<RayHit> nearest(rayCount);
+		double nearestMs = BenchmarkTimer::BestTimeMs(3, [&]()
+		{
+			for(UINT r = 0; r < rayCount; ++r)
+			{
+				nearest[r] = RayHit();
+				scene.IntersectNearest(XMLoadFloat3(&rays[r].Origin), XMLoadFloat3(&rays[r].Dir), MathHelper::Infinity, nearest[r]);
+			}
+		});
+
+		UINT anyCount = 0;
+		double anyMs = BenchmarkTimer::BestTimeMs(3, [&]()
+		{
+			anyCount = 0;
+			for(UINT r = 0; r < rayCount; ++r)
+			{
+				anyCount += scene.IntersectAny(XMLoadFloat3(&rays[r].Origin), XMLoadFloat3(&rays[r].Dir), MathHelper::Infinity) ? 1 : 0;
+			}
+		});
+
+		std::vector<RayHit> hits;
+		bool allNearestSame = true;
+		double allMs = BenchmarkTimer::BestTimeMs(3, [&]()
+		{
+			for(UINT r = 0; r < rayCount; ++r)
+			{
+				hits.clear();
+				scene.IntersectAll(XMLoadFloat3(&rays[r].Origin), XMLoadFloat3(&rays[r].Dir), MathHelper::Infinity, hits);
+				allNearestSame = allNearestSame && (hits.empty() ? nearest[r].T == MathHelper::Infinity :
+					SameDistance(hits[0].T, nearest[r].T));
+			}
+		});
+
+		UINT hitCount = 0;
+		bool same = allNearestSame;
+		for(UINT r = 0; r < rayCount; ++r)
+		{
+			hitCount += nearest[r].T < MathHelper::Infinity ? 1 : 0;
+			if(r < loopRayCount)
+				same = same && SameDistance(nearest[r].T, loopHits[r].T);
+		}
+		same = same && anyCount == hitCount;
+
+		const double loopRate = RaysPerSecond(loopRayCount, loopMs);
+		const double nearestRate = RaysPerSecond(rayCount, nearestMs);
+		out << std::setw(10) << instanceCount << std::fixed << std::setprecision(2) << std::setw(10) << buildMs
+			<< std::setw(8) << scene.NodeCount() << std::setw(7) << scene.Depth()
+			<< std::setprecision(0) << std::setw(12) << loopRate << std::setw(12) << nearestRate
+			<< std::setprecision(1) << std::setw(9) << nearestRate / loopRate << "x"
+			<< std::setprecision(0) << std::setw(12) << RaysPerSecond(rayCount, anyMs)
+			<< std::setw(12) << RaysPerSecond(rayCount, allMs) << std::setw(6) << (same ? "yes" : "NO") << "\n";
+		out.unsetf(std::ios::fixed);
+	}
+
+	out << std::endl;
+}
+
+void PickingBenchmark::BatchRayQueries(std::ostream& out, const std::string& modelDir)
+{
+	const char* modelNames[] = { "car", "skull" };
+
+	std::vector<UINT> threadCounts;
+	const UINT hardwareThreads = MathHelper::Max(1u, std::thread::hardware_concurrency());
+	for(UINT n = 1; n < hardwareThreads; n *= 2)
+	{
+		threadCounts.push_back(n);
+	}
+	threadCounts.push_back(hardwareThreads);
+
+	out << "Batch ray queries, millions of rays per second\n";
+	out << std::setw(7) << "mesh" << std::setw(9) << "rays" << std::setw(9) << "query" << std::setw(8) << "count"
+		<< std::setw(8) << "hit %" << std::setw(9) << "single";
+	for(UINT threadCount : threadCounts)
+	{
+		out << std::setw(8) << threadCount << "T";
+	}
+	out << std::setw(10) << "speedup" << std::setw(6) << "same" << "\n";
+
+	for(const char* name : modelNames)
+	{
+		Model model;
+		if(!LoadModel(modelDir + name + ".txt", model))
+		{
+			out << std::setw(7) << name << "  could not load " << modelDir << name << ".txt\n";
+			continue;
+		}
+
+		MeshBvh bvh;
+		bvh.Build(model.Positions.data(), sizeof(XMFLOAT3), model.Indices.data(), DXGI_FORMAT_R32_UINT,
+			(UINT)model.Indices.size());
+
+		struct RaySet
+		{
+			const char* Name;
+			bool Occlusion;
+			std::vector<RayQuery::Ray> Rays;
+		};
+		RaySet raySets[3];
+		raySets[0] = { "camera", false, MakeCameraRays(bvh.GetBounds(), 256, 256) };
+		raySets[1] = { "random", false, {} };
+		raySets[2] = { "ao", true, MakeOcclusionRays(model, bvh.GetBounds(), 16384, 4) };
+
+		// Same rays as MeshPicking, for a packet of rays that share nothing.
+		std::vector<TestRay> testRays = MakeRays(bvh.GetBounds(), 65536);
+		for(const TestRay& testRay : testRays)
+		{
+			RayQuery::Ray ray;
+			ray.Origin = testRay.Origin;
+			ray.Dir = testRay.Dir;
+			raySets[1].Rays.push_back(ray);
+		}
+
+		for(const RaySet& raySet : raySets)
+		{
+			const std::vector<RayQuery::Ray>& rays = raySet.Rays;
+			const UINT rayCount = (UINT)rays.size();
+
+			// The single ray queries, one after another.
+			std::vector<RayHit> singleHits(rayCount);
+			std::vector<BYTE> singleAny(rayCount);
+			double singleMs = BenchmarkTimer::BestTimeMs(3, [&]()
+			{
+				for(UINT r = 0; r < rayCount; ++r)
+				{
+					XMVECTOR origin = XMLoadFloat3(&rays[r].Origin);
+					XMVECTOR dir = XMLoadFloat3(&rays[r].Dir);
+					if(raySet.Occlusion)
+					{
+						singleAny[r] = bvh.IntersectAny(origin, dir, rays[r].TMax);
+					}
+					else
+					{
+						singleHits[r] = RayHit();
+						bvh.IntersectNearest(origin, dir, rays[r].TMax, singleHits[r]);
+					}
+				}
+			});
+
+			UINT hitCount = 0;
+			for(UINT r = 0; r < rayCount; ++r)
+			{
+				hitCount += (raySet.Occlusion ? singleAny[r] != 0 : singleHits[r].T < MathHelper::Infinity) ? 1 : 0;
+			}
+
+			out << std::setw(7) << name << std::setw(9) << raySet.Name << std::setw(9) << (raySet.Occlusion ? "any" : "nearest")
+				<< std::setw(8) << rayCount << std::fixed << std::setprecision(1) << std::setw(8) << 100.0 * hitCount / rayCount
+				<< std::setprecision(2) << std::setw(9) << RaysPerSecond(rayCount, singleMs) / 1.0e6;
+
+			bool same = true;
+			double lastMs = 0.0;
+			for(UINT threadCount : threadCounts)
+			{
+				ThreadPool threadPool(threadCount);
+
+				std::vector<RayHit> hits(rayCount);
+				std::vector<BYTE> any(rayCount);
+				double ms = BenchmarkTimer::BestTimeMs(3, [&]()
+				{
+					if(raySet.Occlusion)
+						RayQuery::IntersectAny(bvh, rays.data(), rayCount, any.data(), &threadPool);
+					else
+						RayQuery::IntersectNearest(bvh, rays.data(), rayCount, hits.data(), &threadPool);
+				});
+				lastMs = ms;
+
+				for(UINT r = 0; r < rayCount; ++r)
+				{
+					if(raySet.Occlusion)
+						same = same && any[r] == singleAny[r];
+					else
+						same = same && SameHit(hits[r], singleHits[r]);
+				}
+
+				out << std::setw(9) << RaysPerSecond(rayCount, ms) / 1.0e6;
+			}
+
+			out << std::setprecision(1) << std::setw(9) << singleMs / lastMs << "x"
+				<< std::setw(6) << (same ? "yes" : "NO") << "\n";
+			out.unsetf(std::ios::fixed);
+		}
+	}
+
+	out << std::endl;
+}
@@ -0,0 +1,37 @@
+#ifndef PICKINGBENCHMARK_H
+#define PICKINGBENCHMARK_H
+
+#include "PickingBvh.h"
+#include <ostream>
+
+///<summary>
+/// Headless timings for ray picking against Models/car.txt and
+/// Models/skull.txt.  Nothing here needs a device, e.g.:
+///
+///    std::ofstream fout("PickingBenchmark.txt");
+///    PickingBenchmark::MeshPicking(fout, "Models/");
+///</summary>
+class PickingBenchmark
+{
+public:
+	// MeshBvh over each model: build time, nodes and depth, and rays per
+	// second for nearest, any and all hits against testing every triangle
+	// with TriangleTests::Intersects as PickingApp::Pick did, with a check
+	// that both find the same nearest hit and the same number of hits.
+	static void MeshPicking(std::ostream& out, const std::string& modelDir);
+
+	// 1k and 10k cars and skulls scattered over a lot, picked from above:
+	// SceneBvh build time and rays per second for nearest, any and all hits
+	// against looping over every instance's bounds and MeshBvh, with a check
+	// that both find the same nearest hit.
+	static void ScenePicking(std::ostream& out, const std::string& modelDir);
+
+	// RayQuery over each model, in millions of rays per second: a grid of
+	// camera rays and random rays for nearest hits, and short AO rays off
+	// the surface for any hit.  A loop of single ray MeshBvh queries against
+	// packets on 1, 2, 4, ... threads up to the hardware thread count, with
+	// a check that they find the same hits.
+	static void BatchRayQueries(std::ostream& out, const std::string& modelDir);
+};
+
+#endif // PICKINGBENCHMARK_H
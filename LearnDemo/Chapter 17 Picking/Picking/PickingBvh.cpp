@@ -0,0 +1,645 @@
+#include "PickingBvh.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+namespace
+{
+	const UINT BinCount = 16;
+	const UINT MaxDepth = 60;
+
+	// Cost of visiting a node relative to testing a primitive.
+	const float NodeTestCost = 1.0f;
+
+	struct PrimBox
+	{
+		XMFLOAT3 Min;
+		XMFLOAT3 Max;
+		XMFLOAT3 Centroid;
+	};
+
+	struct Aabb
+	{
+		XMFLOAT3 Min = XMFLOAT3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
+		XMFLOAT3 Max = XMFLOAT3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
+
+		void Grow(const XMFLOAT3& p)
+		{
+			Min = XMFLOAT3(MathHelper::Min(Min.x, p.x), MathHelper::Min(Min.y, p.y), MathHelper::Min(Min.z, p.z));
+			Max = XMFLOAT3(MathHelper::Max(Max.x, p.x), MathHelper::Max(Max.y, p.y), MathHelper::Max(Max.z, p.z));
+		}
+
+		void Grow(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax)
+		{
+			Grow(boxMin);
+			Grow(boxMax);
+		}
+
+		// Half the surface area, which is all SAH needs.
+		float HalfArea()const
+		{
+			float dx = Max.x - Min.x;
+			float dy = Max.y - Min.y;
+			float dz = Max.z - Min.z;
+			return dx*dy + dy*dz + dz*dx;
+		}
+	};
+
+	float Component(const XMFLOAT3& v, UINT axis)
+	{
+		return (&v.x)[axis];
+	}
+
+	///<summary>
+	/// Binned SAH build over primitive bounds, shared by both levels.  order
+	/// ends up with the primitives in tree order, so each leaf covers a
+	/// contiguous range of it.
+	///</summary>
+	class BvhBuilder
+	{
+	public:
+		BvhBuilder(const std::vector<PrimBox>& prims, UINT maxLeafSize,
+			std::vector<BvhNode>& nodes, std::vector<UINT>& order)
+			: mPrims(prims), mMaxLeafSize(maxLeafSize), mNodes(nodes), mOrder(order)
+		{
+		}
+
+		// Returns the depth of the tree.
+		UINT Build()
+		{
+			const UINT primCount = (UINT)mPrims.size();
+			mOrder.resize(primCount);
+			for(UINT i = 0; i < primCount; ++i)
+				mOrder[i] = i;
+
+			mNodes.clear();
+			mNodes.reserve(2*MathHelper::Max(primCount, 1u));
+			mNodes.push_back(BvhNode());
+			mDepth = 0;
+
+			if(primCount > 0)
+				BuildNode(0, 0, primCount, 1);
+			else
+				mNodes[0].Min = mNodes[0].Max = XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+			return mDepth;
+		}
+
+	private:
+		void BuildNode(UINT nodeIndex, UINT first, UINT count, UINT depth)
+		{
+			mDepth = MathHelper::Max(mDepth, depth);
+
+			Aabb bounds;
+			Aabb centroidBounds;
+			for(UINT i = first; i < first + count; ++i)
+			{
+				const PrimBox& prim = mPrims[mOrder[i]];
+				bounds.Grow(prim.Min, prim.Max);
+				centroidBounds.Grow(prim.Centroid);
+			}
+
+			BvhNode& node = mNodes[nodeIndex];
+			node.Min = bounds.Min;
+			node.Max = bounds.Max;
+			node.First = first;
+			node.Count = count;
+
+			if(count == 1 || depth >= MaxDepth)
+				return;
+
+			// Bin the centroids along each axis and find the cheapest split between
+			// bins: cost ~ (prims left * area left) + (prims right * area right).
+			float bestCost = MathHelper::Infinity;
+			UINT bestAxis = 0;
+			UINT bestSplit = 0;
+			for(UINT axis = 0; axis < 3; ++axis)
+			{
+				const float lo = Component(centroidBounds.Min, axis);
+				const float hi = Component(centroidBounds.Max, axis);
+				if(hi <= lo)
+					continue;
+
+				const float binScale = BinCount / (hi - lo);
+
+				Aabb binBounds[BinCount];
+				UINT binCounts[BinCount] = { 0 };
+				for(UINT i = first; i < first + count; ++i)
+				{
+					const PrimBox& prim = mPrims[mOrder[i]];
+					UINT bin = MathHelper::Min((UINT)((Component(prim.Centroid, axis) - lo) * binScale), BinCount - 1);
+					binBounds[bin].Grow(prim.Min, prim.Max);
+					binCounts[bin]++;
+				}
+
+				float rightCost[BinCount];
+				Aabb right;
+				UINT rightCount = 0;
+				for(UINT b = BinCount - 1; b > 0; --b)
+				{
+					right.Grow(binBounds[b].Min, binBounds[b].Max);
+					rightCount += binCounts[b];
+					rightCost[b] = rightCount > 0 ? rightCount * right.HalfArea() : 0.0f;
+				}
+
+				Aabb left;
+				UINT leftCount = 0;
+				for(UINT split = 1; split < BinCount; ++split)
+				{
+					left.Grow(binBounds[split - 1].Min, binBounds[split - 1].Max);
+					leftCount += binCounts[split - 1];
+					if(leftCount == 0 || leftCount == count)
+						continue;
+
+					float cost = leftCount * left.HalfArea() + rightCost[split];
+					if(cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = split;
+					}
+				}
+			}
+
+			UINT* begin = mOrder.data() + first;
+			UINT* end = begin + count;
+			UINT* middle = nullptr;
+
+			if(bestSplit != 0)
+			{
+				// A small node that is no more expensive as a leaf stays one.
+				if(count <= mMaxLeafSize && NodeTestCost * bounds.HalfArea() + bestCost >= count * bounds.HalfArea())
+					return;
+
+				const float lo = Component(centroidBounds.Min, bestAxis);
+				const float binScale = BinCount / (Component(centroidBounds.Max, bestAxis) - lo);
+				middle = std::partition(begin, end, [&](UINT prim)
+				{
+					UINT bin = MathHelper::Min((UINT)((Component(mPrims[prim].Centroid, bestAxis) - lo) * binScale), BinCount - 1);
+					return bin < bestSplit;
+				});
+			}
+			else
+			{
+				// All centroids in one spot; split in half if too many for a leaf.
+				if(count <= mMaxLeafSize)
+					return;
+				middle = begin + count / 2;
+			}
+
+			const UINT leftCount = (UINT)(middle - begin);
+			const UINT child = (UINT)mNodes.size();
+			mNodes.push_back(BvhNode());
+			mNodes.push_back(BvhNode());
+			mNodes[nodeIndex].First = child;
+			mNodes[nodeIndex].Count = 0;
+
+			BuildNode(child, first, leftCount, depth + 1);
+			BuildNode(child + 1, first + leftCount, count - leftCount, depth + 1);
+		}
+
+		const std::vector<PrimBox>& mPrims;
+		const UINT mMaxLeafSize;
+		std::vector<BvhNode>& mNodes;
+		std::vector<UINT>& mOrder;
+		UINT mDepth = 0;
+	};
+
+	// A ray with the reciprocal of its direction, for the slab test.
+	struct Ray
+	{
+		XMFLOAT3 Origin;
+		XMFLOAT3 Dir;
+		XMFLOAT3 InvDir;
+
+		Ray(FXMVECTOR origin, FXMVECTOR dir)
+		{
+			XMStoreFloat3(&Origin, origin);
+			XMStoreFloat3(&Dir, dir);
+
+			// Axis-parallel rays get a huge reciprocal rather than an infinite
+			// one, which would give 0*inf = NaN on a slab edge.
+			const float tiny = 1e-20f;
+			InvDir.x = 1.0f / (fabsf(Dir.x) > tiny ? Dir.x : tiny);
+			InvDir.y = 1.0f / (fabsf(Dir.y) > tiny ? Dir.y : tiny);
+			InvDir.z = 1.0f / (fabsf(Dir.z) > tiny ? Dir.z : tiny);
+		}
+	};
+
+	// Entry distance of the ray into the node's box, if it enters before tMax.
+	bool IntersectNode(const BvhNode& node, const Ray& ray, float tMax, float& tEnter)
+	{
+		float tx0 = (node.Min.x - ray.Origin.x) * ray.InvDir.x;
+		float tx1 = (node.Max.x - ray.Origin.x) * ray.InvDir.x;
+		float ty0 = (node.Min.y - ray.Origin.y) * ray.InvDir.y;
+		float ty1 = (node.Max.y - ray.Origin.y) * ray.InvDir.y;
+		float tz0 = (node.Min.z - ray.Origin.z) * ray.InvDir.z;
+		float tz1 = (node.Max.z - ray.Origin.z) * ray.InvDir.z;
+
+		float tNear = MathHelper::Max(MathHelper::Max(MathHelper::Min(tx0, tx1), MathHelper::Min(ty0, ty1)), MathHelper::Max(MathHelper::Min(tz0, tz1), 0.0f));
+		float tFar = MathHelper::Min(MathHelper::Min(MathHelper::Max(tx0, tx1), MathHelper::Max(ty0, ty1)), MathHelper::Min(MathHelper::Max(tz0, tz1), tMax));
+
+		tEnter = tNear;
+		return tNear <= tFar;
+	}
+
+	// Moller-Trumbore, both sides.
+	bool IntersectTriangle(const MeshBvh::Triangle& tri, const Ray& ray, float tMax, RayHit& hit)
+	{
+		const XMFLOAT3& d = ray.Dir;
+		const XMFLOAT3& e1 = tri.Edge1;
+		const XMFLOAT3& e2 = tri.Edge2;
+
+		XMFLOAT3 p(d.y*e2.z - d.z*e2.y, d.z*e2.x - d.x*e2.z, d.x*e2.y - d.y*e2.x);
+		float det = e1.x*p.x + e1.y*p.y + e1.z*p.z;
+		if(fabsf(det) < 1e-12f)
+			return false;
+		float invDet = 1.0f / det;
+
+		XMFLOAT3 s(ray.Origin.x - tri.V0.x, ray.Origin.y - tri.V0.y, ray.Origin.z - tri.V0.z);
+		float u = (s.x*p.x + s.y*p.y + s.z*p.z) * invDet;
+		if(u < 0.0f || u > 1.0f)
+			return false;
+
+		XMFLOAT3 q(s.y*e1.z - s.z*e1.y, s.z*e1.x - s.x*e1.z, s.x*e1.y - s.y*e1.x);
+		float v = (d.x*q.x + d.y*q.y + d.z*q.z) * invDet;
+		if(v < 0.0f || u + v > 1.0f)
+			return false;
+
+		float t = (e2.x*q.x + e2.y*q.y + e2.z*q.z) * invDet;
+		if(t < 0.0f || t > tMax)
+			return false;
+
+		hit.T = t;
+		hit.Triangle = tri.Id;
+		hit.U = u;
+		hit.V = v;
+		return true;
+	}
+
+	// Visits the leaves the ray enters before tMax, nearer child first.
+	// leaf(first, count, tMax) tests a leaf's primitives; it may lower tMax,
+	// and returns false to end the traversal.
+	template<typename LeafFunc>
+	void Traverse(const std::vector<BvhNode>& nodes, const Ray& ray, float& tMax, LeafFunc leaf)
+	{
+		struct StackEntry
+		{
+			UINT Node;
+			float TEnter;
+		};
+		StackEntry stack[MaxDepth + 1];
+		UINT stackSize = 0;
+
+		float tEnter = 0.0f;
+		if(!IntersectNode(nodes[0], ray, tMax, tEnter))
+			return;
+
+		UINT nodeIndex = 0;
+		while(true)
+		{
+			const BvhNode& node = nodes[nodeIndex];
+			if(node.Count > 0)
+			{
+				if(!leaf(node.First, node.Count, tMax))
+					return;
+			}
+			else
+			{
+				float t0 = 0.0f;
+				float t1 = 0.0f;
+				bool hit0 = IntersectNode(nodes[node.First], ray, tMax, t0);
+				bool hit1 = IntersectNode(nodes[node.First + 1], ray, tMax, t1);
+				if(hit0 && hit1)
+				{
+					if(t1 < t0)
+					{
+						stack[stackSize++] = { node.First, t0 };
+						nodeIndex = node.First + 1;
+					}
+					else
+					{
+						stack[stackSize++] = { node.First + 1, t1 };
+						nodeIndex = node.First;
+					}
+					continue;
+				}
+				if(hit0 || hit1)
+				{
+					nodeIndex = hit0 ? node.First : node.First + 1;
+					continue;
+				}
+			}
+
+			// Next node still nearer than the nearest hit so far.
+			do
+			{
+				if(stackSize == 0)
+					return;
+				--stackSize;
+			} while(stack[stackSize].TEnter > tMax);
+			nodeIndex = stack[stackSize].Node;
+		}
+	}
+
+	XMFLOAT3 ReadPosition(const BYTE* vertices, UINT vertexStride, INT vertex)
+	{
+		return *reinterpret_cast<const XMFLOAT3*>(vertices + (size_t)vertex * vertexStride);
+	}
+}
+
+//
+// MeshBvh
+//
+
+void MeshBvh::Build(const void* vertices, UINT vertexStride, const void* indices, DXGI_FORMAT indexFormat,
+	UINT indexCount, UINT startIndexLocation, INT baseVertexLocation)
+{
+	const BYTE* vertexBytes = static_cast<const BYTE*>(vertices);
+	const UINT triangleCount = indexCount / 3;
+
+	std::vector<Triangle> triangles(triangleCount);
+	std::vector<PrimBox> prims(triangleCount);
+	Aabb meshBounds;
+	for(UINT i = 0; i < triangleCount; ++i)
+	{
+		XMFLOAT3 v[3];
+		for(UINT k = 0; k < 3; ++k)
+		{
+			UINT index = indexFormat == DXGI_FORMAT_R16_UINT ?
+				static_cast<const std::uint16_t*>(indices)[startIndexLocation + 3*i + k] :
+				static_cast<const std::uint32_t*>(indices)[startIndexLocation + 3*i + k];
+			v[k] = ReadPosition(vertexBytes, vertexStride, baseVertexLocation + (INT)index);
+		}
+
+		Triangle& tri = triangles[i];
+		tri.V0 = v[0];
+		tri.Edge1 = XMFLOAT3(v[1].x - v[0].x, v[1].y - v[0].y, v[1].z - v[0].z);
+		tri.Edge2 = XMFLOAT3(v[2].x - v[0].x, v[2].y - v[0].y, v[2].z - v[0].z);
+		tri.Id = i;
+
+		Aabb box;
+		box.Grow(v[0]);
+		box.Grow(v[1]);
+		box.Grow(v[2]);
+		prims[i].Min = box.Min;
+		prims[i].Max = box.Max;
+		prims[i].Centroid = XMFLOAT3((box.Min.x + box.Max.x)*0.5f, (box.Min.y + box.Max.y)*0.5f, (box.Min.z + box.Max.z)*0.5f);
+		meshBounds.Grow(box.Min, box.Max);
+	}
+
+	std::vector<UINT> order;
+	BvhBuilder builder(prims, 4, mNodes, order);
+	mDepth = builder.Build();
+
+	mTriangles.resize(triangleCount);
+	for(UINT i = 0; i < triangleCount; ++i)
+	{
+		mTriangles[i] = triangles[order[i]];
+	}
+
+	if(triangleCount > 0)
+	{
+		XMStoreFloat3(&mBounds.Center, XMVectorScale(XMVectorAdd(XMLoadFloat3(&meshBounds.Min), XMLoadFloat3(&meshBounds.Max)), 0.5f));
+		XMStoreFloat3(&mBounds.Extents, XMVectorScale(XMVectorSubtract(XMLoadFloat3(&meshBounds.Max), XMLoadFloat3(&meshBounds.Min)), 0.5f));
+	}
+	else
+	{
+		mBounds = BoundingBox();
+	}
+}
+
+void MeshBvh::Build(const MeshGeometry& geo, const SubmeshGeometry& submesh)
+{
+	Build(geo.VertexBufferCPU->GetBufferPointer(), geo.VertexByteStride, geo.IndexBufferCPU->GetBufferPointer(),
+		geo.IndexFormat, submesh.IndexCount, submesh.StartIndexLocation, submesh.BaseVertexLocation);
+}
+
+bool MeshBvh::IntersectNearest(FXMVECTOR origin, FXMVECTOR dir, float tMax, RayHit& hit)const
+{
+	if(mTriangles.empty())
+		return false;
+
+	Ray ray(origin, dir);
+	bool found = false;
+	Traverse(mNodes, ray, tMax, [&](UINT first, UINT count, float& t)
+	{
+		for(UINT i = first; i < first + count; ++i)
+		{
+			if(IntersectTriangle(mTriangles[i], ray, t, hit))
+			{
+				t = hit.T;
+				found = true;
+			}
+		}
+		return true;
+	});
+	return found;
+}
+
+bool MeshBvh::IntersectAny(FXMVECTOR origin, FXMVECTOR dir, float tMax)const
+{
+	if(mTriangles.empty())
+		return false;
+
+	Ray ray(origin, dir);
+	bool found = false;
+	Traverse(mNodes, ray, tMax, [&](UINT first, UINT count, float& t)
+	{
+		RayHit hit;
+		for(UINT i = first; i < first + count && !found; ++i)
+		{
+			found = IntersectTriangle(mTriangles[i], ray, t, hit);
+		}
+		return !found;
+	});
+	return found;
+}
+
+void MeshBvh::IntersectAll(FXMVECTOR origin, FXMVECTOR dir, float tMax, std::vector<RayHit>& hits)const
+{
+	if(mTriangles.empty())
+		return;
+
+	Ray ray(origin, dir);
+	Traverse(mNodes, ray, tMax, [&](UINT first, UINT count, float& t)
+	{
+		RayHit hit;
+		for(UINT i = first; i < first + count; ++i)
+		{
+			if(IntersectTriangle(mTriangles[i], ray, t, hit))
+				hits.push_back(hit);
+		}
+		return true;
+	});
+}
+
+const BoundingBox& MeshBvh::GetBounds()const
+{
+	return mBounds;
+}
+
+UINT MeshBvh::TriangleCount()const
+{
+	return (UINT)mTriangles.size();
+}
+
+UINT MeshBvh::NodeCount()const
+{
+	return (UINT)mNodes.size();
+}
+
+UINT MeshBvh::Depth()const
+{
+	return mDepth;
+}
+
+const BvhNode& MeshBvh::GetNode(UINT i)const
+{
+	return mNodes[i];
+}
+
+const MeshBvh::Triangle& MeshBvh::GetTriangle(UINT i)const
+{
+	return mTriangles[i];
+}
+
+//
+// SceneBvh
+//
+
+void SceneBvh::Build(const std::vector<Instance>& instances)
+{
+	const UINT instanceCount = (UINT)instances.size();
+
+	std::vector<PrimBox> prims(instanceCount);
+	for(UINT i = 0; i < instanceCount; ++i)
+	{
+		BoundingBox worldBounds;
+		instances[i].Mesh->GetBounds().Transform(worldBounds, XMLoadFloat4x4(&instances[i].World));
+
+		const XMFLOAT3& c = worldBounds.Center;
+		const XMFLOAT3& e = worldBounds.Extents;
+		prims[i].Min = XMFLOAT3(c.x - e.x, c.y - e.y, c.z - e.z);
+		prims[i].Max = XMFLOAT3(c.x + e.x, c.y + e.y, c.z + e.z);
+		prims[i].Centroid = c;
+	}
+
+	std::vector<UINT> order;
+	BvhBuilder builder(prims, 2, mNodes, order);
+	mDepth = builder.Build();
+
+	mInstances.resize(instanceCount);
+	for(UINT i = 0; i < instanceCount; ++i)
+	{
+		const Instance& instance = instances[order[i]];
+		XMMATRIX world = XMLoadFloat4x4(&instance.World);
+
+		InstanceData& data = mInstances[i];
+		data.Mesh = instance.Mesh;
+		XMStoreFloat4x4(&data.InvWorld, XMMatrixInverse(nullptr, world));
+		data.Id = order[i];
+	}
+}
+
+bool SceneBvh::IntersectNearest(FXMVECTOR origin, FXMVECTOR dir, float tMax, RayHit& hit)const
+{
+	if(mInstances.empty())
+		return false;
+
+	Ray ray(origin, dir);
+	bool found = false;
+	Traverse(mNodes, ray, tMax, [&](UINT first, UINT count, float& t)
+	{
+		for(UINT i = first; i < first + count; ++i)
+		{
+			const InstanceData& instance = mInstances[i];
+			XMMATRIX toLocal = XMLoadFloat4x4(&instance.InvWorld);
+			XMVECTOR localOrigin = XMVector3TransformCoord(XMLoadFloat3(&ray.Origin), toLocal);
+			XMVECTOR localDir = XMVector3TransformNormal(XMLoadFloat3(&ray.Dir), toLocal);
+
+			if(instance.Mesh->IntersectNearest(localOrigin, localDir, t, hit))
+			{
+				hit.Instance = instance.Id;
+				t = hit.T;
+				found = true;
+			}
+		}
+		return true;
+	});
+	return found;
+}
+
+bool SceneBvh::IntersectAny(FXMVECTOR origin, FXMVECTOR dir, float tMax)const
+{
+	if(mInstances.empty())
+		return false;
+
+	Ray ray(origin, dir);
+	bool found = false;
+	Traverse(mNodes, ray, tMax, [&](UINT first, UINT count, float& t)
+	{
+		for(UINT i = first; i < first + count && !found; ++i)
+		{
+			const InstanceData& instance = mInstances[i];
+			XMMATRIX toLocal = XMLoadFloat4x4(&instance.InvWorld);
+			found = instance.Mesh->IntersectAny(XMVector3TransformCoord(XMLoadFloat3(&ray.Origin), toLocal),
+				XMVector3TransformNormal(XMLoadFloat3(&ray.Dir), toLocal), t);
+		}
+		return !found;
+	});
+	return found;
+}
+
+void SceneBvh::IntersectAll(FXMVECTOR origin, FXMVECTOR dir, float tMax, std::vector<RayHit>& hits)const
+{
+	if(mInstances.empty())
+		return;
+
+	Ray ray(origin, dir);
+	const size_t firstHit = hits.size();
+	Traverse(mNodes, ray, tMax, [&](UINT first, UINT count, float& t)
+	{
+		for(UINT i = first; i < first + count; ++i)
+		{
+			const InstanceData& instance = mInstances[i];
+			XMMATRIX toLocal = XMLoadFloat4x4(&instance.InvWorld);
+
+			const size_t instanceFirstHit = hits.size();
+			instance.Mesh->IntersectAll(XMVector3TransformCoord(XMLoadFloat3(&ray.Origin), toLocal),
+				XMVector3TransformNormal(XMLoadFloat3(&ray.Dir), toLocal), t, hits);
+			for(size_t h = instanceFirstHit; h < hits.size(); ++h)
+			{
+				hits[h].Instance = instance.Id;
+			}
+		}
+		return true;
+	});
+
+	std::sort(hits.begin() + firstHit, hits.end(), [](const RayHit& a, const RayHit& b) { return a.T < b.T; });
+}
+
+UINT SceneBvh::InstanceCount()const
+{
+	return (UINT)mInstances.size();
+}
+
+UINT SceneBvh::NodeCount()const
+{
+	return (UINT)mNodes.size();
+}
+
+UINT SceneBvh::Depth()const
+{
+	return mDepth;
+}
+
+const BvhNode& SceneBvh::GetNode(UINT i)const
+{
+	return mNodes[i];
+}
+
+const SceneBvh::InstanceData& SceneBvh::GetInstance(UINT i)const
+{
+	return mInstances[i];
+}
@@ -0,0 +1,134 @@
+#ifndef PICKINGBVH_H
+#define PICKINGBVH_H
+
+#include "../../../Common/d3dUtil.h"
+#include "../../../Common/MathHelper.h"
+
+///<summary>
+/// A node of a flattened bounding volume hierarchy, 32 bytes.  Node 0 is
+/// the root and children always come after their parent.
+///</summary>
+struct BvhNode
+{
+	DirectX::XMFLOAT3 Min;
+	UINT First = 0;     // Leaf: first primitive, in tree order.  Inner: left child; the right child is First+1.
+	DirectX::XMFLOAT3 Max;
+	UINT Count = 0;     // Primitives in a leaf; 0 for an inner node.
+};
+
+///<summary>
+/// Where a ray hit a triangle: at origin + T*dir, with barycentrics U and V
+/// (the weights of the triangle's second and third vertices).  Triangle
+/// counts from the first triangle of the mesh's index range, so its indices
+/// start at StartIndexLocation + 3*Triangle.
+///</summary>
+struct RayHit
+{
+	float T = MathHelper::Infinity;
+	UINT Triangle = 0;
+	float U = 0.0f;
+	float V = 0.0f;
+
+	// The SceneBvh instance hit, as its index in the list given to Build.
+	UINT Instance = 0;
+};
+
+///<summary>
+/// Triangle BVH over one submesh, in its local space, for picking without
+/// testing every triangle.  Built top down with a binned surface area
+/// heuristic into a flat node array; the triangles are copied in tree
+/// order as a vertex and two edges, ready for the ray test.
+///
+/// Rays need not have a unit length direction: T is in units of dir, so a
+/// ray moved to another space by an affine transform keeps its T.  Both
+/// sides of a triangle are hit, as with TriangleTests::Intersects.
+///</summary>
+class MeshBvh
+{
+public:
+	// A triangle in tree order, and its index in the mesh.
+	struct Triangle
+	{
+		DirectX::XMFLOAT3 V0;
+		DirectX::XMFLOAT3 Edge1;
+		DirectX::XMFLOAT3 Edge2;
+		UINT Id;
+	};
+
+	// Positions are float3s at the start of each vertexStride byte vertex.
+	void Build(const void* vertices, UINT vertexStride, const void* indices, DXGI_FORMAT indexFormat,
+		UINT indexCount, UINT startIndexLocation = 0, INT baseVertexLocation = 0);
+
+	// From the CPU copies of the geometry.
+	void Build(const MeshGeometry& geo, const SubmeshGeometry& submesh);
+
+	// Hits with T in [0, tMax].
+	bool IntersectNearest(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float tMax, RayHit& hit)const;
+	bool IntersectAny(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float tMax)const;
+
+	// Appends every hit, in no particular order.
+	void IntersectAll(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float tMax, std::vector<RayHit>& hits)const;
+
+	const DirectX::BoundingBox& GetBounds()const;
+	UINT TriangleCount()const;
+	UINT NodeCount()const;
+	UINT Depth()const;
+
+	// The tree, for code that walks it itself.
+	const BvhNode& GetNode(UINT i)const;
+	const Triangle& GetTriangle(UINT i)const;
+
+private:
+	std::vector<BvhNode> mNodes;
+	std::vector<Triangle> mTriangles;
+	DirectX::BoundingBox mBounds;
+	UINT mDepth = 0;
+};
+
+///<summary>
+/// Top level BVH over instances of MeshBvhs, each with its own world
+/// matrix.  A ray is tested against the instances' world bounds, and for
+/// the instances it reaches, moved into their local space and traced
+/// through their MeshBvh.  Build again when instances move.
+///</summary>
+class SceneBvh
+{
+public:
+	struct Instance
+	{
+		const MeshBvh* Mesh = nullptr;
+		DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	};
+
+	void Build(const std::vector<Instance>& instances);
+
+	// World space rays, hits with T in [0, tMax].
+	bool IntersectNearest(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float tMax, RayHit& hit)const;
+	bool IntersectAny(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float tMax)const;
+
+	// Every hit, nearest first.
+	void IntersectAll(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float tMax, std::vector<RayHit>& hits)const;
+
+	UINT InstanceCount()const;
+	UINT NodeCount()const;
+	UINT Depth()const;
+
+	// The tree, for code that walks it itself.  Leaves index the instances
+	// in tree order; Id is the instance's index in the list given to Build.
+	struct InstanceData
+	{
+		const MeshBvh* Mesh;
+		DirectX::XMFLOAT4X4 InvWorld;
+		UINT Id;
+	};
+
+	const BvhNode& GetNode(UINT i)const;
+	const InstanceData& GetInstance(UINT i)const;
+
+private:
+	std::vector<BvhNode> mNodes;
+	std::vector<InstanceData> mInstances;
+	UINT mDepth = 0;
+};
+
+#endif // PICKINGBVH_H
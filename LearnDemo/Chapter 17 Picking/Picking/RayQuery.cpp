@@ -0,0 +1,431 @@
+#include "RayQuery.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Deeper than any tree BvhBuilder makes (it stops at depth 60).
+	const UINT MaxStackSize = 64;
+
+	// Packets per range handed to a worker thread.
+	const UINT PacketGrainSize = 16;
+
+	///<summary>
+	/// Four rays, one per lane.  Unused lanes of the last packet, and lanes
+	/// that have finished an any-hit query, have TMax < 0 so that no node or
+	/// triangle test passes for them.
+	///</summary>
+	struct RayPacket
+	{
+		XMVECTOR Ox, Oy, Oz;
+		XMVECTOR Dx, Dy, Dz;
+		XMVECTOR InvDx, InvDy, InvDz;
+		XMVECTOR TMax;
+
+		// Axis-parallel rays get a huge reciprocal rather than an infinite
+		// one, as in the single ray test.
+		void SetInvDir()
+		{
+			const XMVECTOR tiny = XMVectorReplicate(1e-20f);
+			InvDx = XMVectorReciprocal(XMVectorSelect(tiny, Dx, XMVectorGreater(XMVectorAbs(Dx), tiny)));
+			InvDy = XMVectorReciprocal(XMVectorSelect(tiny, Dy, XMVectorGreater(XMVectorAbs(Dy), tiny)));
+			InvDz = XMVectorReciprocal(XMVectorSelect(tiny, Dz, XMVectorGreater(XMVectorAbs(Dz), tiny)));
+		}
+	};
+
+	// What the lanes of a nearest hit query have hit so far; T is the
+	// packet's TMax.
+	struct PacketHits
+	{
+		XMVECTOR Hit = XMVectorFalseInt();
+		XMVECTOR Triangle = XMVectorZero();
+		XMVECTOR U = XMVectorZero();
+		XMVECTOR V = XMVectorZero();
+		XMVECTOR Instance = XMVectorZero();
+	};
+
+	bool AnyLane(FXMVECTOR mask)
+	{
+		return !XMVector4EqualInt(mask, XMVectorFalseInt());
+	}
+
+	float MinLane(FXMVECTOR v)
+	{
+		XMVECTOR m = XMVectorMin(v, XMVectorSwizzle<2, 3, 0, 1>(v));
+		m = XMVectorMin(m, XMVectorSwizzle<1, 0, 3, 2>(m));
+		return XMVectorGetX(m);
+	}
+
+	void LoadPacket(const RayQuery::Ray* rays, UINT count, RayPacket& packet)
+	{
+		XMFLOAT4A o[3] = {};
+		XMFLOAT4A d[3] = { XMFLOAT4A(1.0f, 1.0f, 1.0f, 1.0f), XMFLOAT4A(1.0f, 1.0f, 1.0f, 1.0f), XMFLOAT4A(1.0f, 1.0f, 1.0f, 1.0f) };
+		XMFLOAT4A tMax(-1.0f, -1.0f, -1.0f, -1.0f);
+		for(UINT i = 0; i < count; ++i)
+		{
+			(&o[0].x)[i] = rays[i].Origin.x;
+			(&o[1].x)[i] = rays[i].Origin.y;
+			(&o[2].x)[i] = rays[i].Origin.z;
+			(&d[0].x)[i] = rays[i].Dir.x;
+			(&d[1].x)[i] = rays[i].Dir.y;
+			(&d[2].x)[i] = rays[i].Dir.z;
+			(&tMax.x)[i] = rays[i].TMax;
+		}
+
+		packet.Ox = XMLoadFloat4A(&o[0]);
+		packet.Oy = XMLoadFloat4A(&o[1]);
+		packet.Oz = XMLoadFloat4A(&o[2]);
+		packet.Dx = XMLoadFloat4A(&d[0]);
+		packet.Dy = XMLoadFloat4A(&d[1]);
+		packet.Dz = XMLoadFloat4A(&d[2]);
+		packet.TMax = XMLoadFloat4A(&tMax);
+		packet.SetInvDir();
+	}
+
+	// The packet in the space m takes points to, keeping its TMax.
+	void TransformPacket(const RayPacket& packet, const XMFLOAT4X4& m, RayPacket& result)
+	{
+		result.Ox = XMVectorAdd(XMVectorAdd(XMVectorMultiply(packet.Ox, XMVectorReplicate(m._11)), XMVectorMultiply(packet.Oy, XMVectorReplicate(m._21))),
+			XMVectorAdd(XMVectorMultiply(packet.Oz, XMVectorReplicate(m._31)), XMVectorReplicate(m._41)));
+		result.Oy = XMVectorAdd(XMVectorAdd(XMVectorMultiply(packet.Ox, XMVectorReplicate(m._12)), XMVectorMultiply(packet.Oy, XMVectorReplicate(m._22))),
+			XMVectorAdd(XMVectorMultiply(packet.Oz, XMVectorReplicate(m._32)), XMVectorReplicate(m._42)));
+		result.Oz = XMVectorAdd(XMVectorAdd(XMVectorMultiply(packet.Ox, XMVectorReplicate(m._13)), XMVectorMultiply(packet.Oy, XMVectorReplicate(m._23))),
+			XMVectorAdd(XMVectorMultiply(packet.Oz, XMVectorReplicate(m._33)), XMVectorReplicate(m._43)));
+
+		result.Dx = XMVectorAdd(XMVectorAdd(XMVectorMultiply(packet.Dx, XMVectorReplicate(m._11)), XMVectorMultiply(packet.Dy, XMVectorReplicate(m._21))),
+			XMVectorMultiply(packet.Dz, XMVectorReplicate(m._31)));
+		result.Dy = XMVectorAdd(XMVectorAdd(XMVectorMultiply(packet.Dx, XMVectorReplicate(m._12)), XMVectorMultiply(packet.Dy, XMVectorReplicate(m._22))),
+			XMVectorMultiply(packet.Dz, XMVectorReplicate(m._32)));
+		result.Dz = XMVectorAdd(XMVectorAdd(XMVectorMultiply(packet.Dx, XMVectorReplicate(m._13)), XMVectorMultiply(packet.Dy, XMVectorReplicate(m._23))),
+			XMVectorMultiply(packet.Dz, XMVectorReplicate(m._33)));
+
+		result.TMax = packet.TMax;
+		result.SetInvDir();
+	}
+
+	// The lanes whose rays enter the node's box before their TMax, and where.
+	XMVECTOR IntersectNode(const BvhNode& node, const RayPacket& packet, XMVECTOR& tEnter)
+	{
+		XMVECTOR tx0 = XMVectorMultiply(XMVectorSubtract(XMVectorReplicate(node.Min.x), packet.Ox), packet.InvDx);
+		XMVECTOR tx1 = XMVectorMultiply(XMVectorSubtract(XMVectorReplicate(node.Max.x), packet.Ox), packet.InvDx);
+		XMVECTOR ty0 = XMVectorMultiply(XMVectorSubtract(XMVectorReplicate(node.Min.y), packet.Oy), packet.InvDy);
+		XMVECTOR ty1 = XMVectorMultiply(XMVectorSubtract(XMVectorReplicate(node.Max.y), packet.Oy), packet.InvDy);
+		XMVECTOR tz0 = XMVectorMultiply(XMVectorSubtract(XMVectorReplicate(node.Min.z), packet.Oz), packet.InvDz);
+		XMVECTOR tz1 = XMVectorMultiply(XMVectorSubtract(XMVectorReplicate(node.Max.z), packet.Oz), packet.InvDz);
+
+		XMVECTOR tNear = XMVectorMax(XMVectorMax(XMVectorMin(tx0, tx1), XMVectorMin(ty0, ty1)),
+			XMVectorMax(XMVectorMin(tz0, tz1), XMVectorZero()));
+		XMVECTOR tFar = XMVectorMin(XMVectorMin(XMVectorMax(tx0, tx1), XMVectorMax(ty0, ty1)),
+			XMVectorMin(XMVectorMax(tz0, tz1), packet.TMax));
+
+		// Lanes that miss are beyond any TMax, MathHelper::Infinity included.
+		XMVECTOR hit = XMVectorLessOrEqual(tNear, tFar);
+		tEnter = XMVectorSelect(g_XMInfinity, tNear, hit);
+		return hit;
+	}
+
+	// Moller-Trumbore, both sides, for all four lanes.  Returns the lanes
+	// that hit the triangle within their TMax.
+	XMVECTOR IntersectTriangle(const MeshBvh::Triangle& tri, const RayPacket& packet, XMVECTOR& t, XMVECTOR& u, XMVECTOR& v)
+	{
+		const XMVECTOR e1x = XMVectorReplicate(tri.Edge1.x);
+		const XMVECTOR e1y = XMVectorReplicate(tri.Edge1.y);
+		const XMVECTOR e1z = XMVectorReplicate(tri.Edge1.z);
+		const XMVECTOR e2x = XMVectorReplicate(tri.Edge2.x);
+		const XMVECTOR e2y = XMVectorReplicate(tri.Edge2.y);
+		const XMVECTOR e2z = XMVectorReplicate(tri.Edge2.z);
+
+		XMVECTOR px = XMVectorSubtract(XMVectorMultiply(packet.Dy, e2z), XMVectorMultiply(packet.Dz, e2y));
+		XMVECTOR py = XMVectorSubtract(XMVectorMultiply(packet.Dz, e2x), XMVectorMultiply(packet.Dx, e2z));
+		XMVECTOR pz = XMVectorSubtract(XMVectorMultiply(packet.Dx, e2y), XMVectorMultiply(packet.Dy, e2x));
+		XMVECTOR det = XMVectorAdd(XMVectorAdd(XMVectorMultiply(e1x, px), XMVectorMultiply(e1y, py)), XMVectorMultiply(e1z, pz));
+		XMVECTOR invDet = XMVectorReciprocal(det);
+
+		XMVECTOR sx = XMVectorSubtract(packet.Ox, XMVectorReplicate(tri.V0.x));
+		XMVECTOR sy = XMVectorSubtract(packet.Oy, XMVectorReplicate(tri.V0.y));
+		XMVECTOR sz = XMVectorSubtract(packet.Oz, XMVectorReplicate(tri.V0.z));
+		u = XMVectorMultiply(XMVectorAdd(XMVectorAdd(XMVectorMultiply(sx, px), XMVectorMultiply(sy, py)), XMVectorMultiply(sz, pz)), invDet);
+
+		XMVECTOR qx = XMVectorSubtract(XMVectorMultiply(sy, e1z), XMVectorMultiply(sz, e1y));
+		XMVECTOR qy = XMVectorSubtract(XMVectorMultiply(sz, e1x), XMVectorMultiply(sx, e1z));
+		XMVECTOR qz = XMVectorSubtract(XMVectorMultiply(sx, e1y), XMVectorMultiply(sy, e1x));
+		v = XMVectorMultiply(XMVectorAdd(XMVectorAdd(XMVectorMultiply(packet.Dx, qx), XMVectorMultiply(packet.Dy, qy)), XMVectorMultiply(packet.Dz, qz)), invDet);
+		t = XMVectorMultiply(XMVectorAdd(XMVectorAdd(XMVectorMultiply(e2x, qx), XMVectorMultiply(e2y, qy)), XMVectorMultiply(e2z, qz)), invDet);
+
+		const XMVECTOR zero = XMVectorZero();
+		const XMVECTOR one = XMVectorSplatOne();
+		XMVECTOR hit = XMVectorGreaterOrEqual(XMVectorAbs(det), XMVectorReplicate(1e-12f));
+		hit = XMVectorAndInt(hit, XMVectorAndInt(XMVectorGreaterOrEqual(u, zero), XMVectorLessOrEqual(u, one)));
+		hit = XMVectorAndInt(hit, XMVectorAndInt(XMVectorGreaterOrEqual(v, zero), XMVectorLessOrEqual(XMVectorAdd(u, v), one)));
+		hit = XMVectorAndInt(hit, XMVectorAndInt(XMVectorGreaterOrEqual(t, zero), XMVectorLessOrEqual(t, packet.TMax)));
+		return hit;
+	}
+
+	// Visits the leaves any lane reaches before its TMax, the child nearest
+	// to the packet first.  leaf(first, count) tests a leaf's primitives and
+	// may lower the lanes' TMax; it returns false to end the traversal.
+	template<typename LeafFunc>
+	void Traverse(const BvhNode* nodes, const RayPacket& packet, LeafFunc leaf)
+	{
+		struct StackEntry
+		{
+			XMVECTOR TEnter;
+			UINT Node;
+		};
+		StackEntry stack[MaxStackSize];
+		UINT stackSize = 0;
+
+		XMVECTOR tEnter;
+		if(!AnyLane(IntersectNode(nodes[0], packet, tEnter)))
+			return;
+
+		UINT nodeIndex = 0;
+		while(true)
+		{
+			const BvhNode& node = nodes[nodeIndex];
+			if(node.Count > 0)
+			{
+				if(!leaf(node.First, node.Count))
+					return;
+			}
+			else
+			{
+				XMVECTOR t0;
+				XMVECTOR t1;
+				bool hit0 = AnyLane(IntersectNode(nodes[node.First], packet, t0));
+				bool hit1 = AnyLane(IntersectNode(nodes[node.First + 1], packet, t1));
+				if(hit0 && hit1)
+				{
+					if(MinLane(t1) < MinLane(t0))
+					{
+						stack[stackSize++] = { t0, node.First };
+						nodeIndex = node.First + 1;
+					}
+					else
+					{
+						stack[stackSize++] = { t1, node.First + 1 };
+						nodeIndex = node.First;
+					}
+					continue;
+				}
+				if(hit0 || hit1)
+				{
+					nodeIndex = hit0 ? node.First : node.First + 1;
+					continue;
+				}
+			}
+
+			// Next node some lane still reaches before its nearest hit.
+			do
+			{
+				if(stackSize == 0)
+					return;
+				--stackSize;
+			} while(XMVector4Greater(stack[stackSize].TEnter, packet.TMax));
+			nodeIndex = stack[stackSize].Node;
+		}
+	}
+
+	// Nearest hits in the mesh, lowering the packet's TMax to them.
+	// Returns the lanes that hit.
+	XMVECTOR TraceNearest(const MeshBvh& mesh, RayPacket& packet, PacketHits& hits)
+	{
+		// GetNode and GetTriangle return into the mesh's arrays.
+		const BvhNode* nodes = &mesh.GetNode(0);
+		const MeshBvh::Triangle* triangles = &mesh.GetTriangle(0);
+
+		XMVECTOR found = XMVectorFalseInt();
+		Traverse(nodes, packet, [&](UINT first, UINT count)
+		{
+			for(UINT i = first; i < first + count; ++i)
+			{
+				XMVECTOR t, u, v;
+				XMVECTOR hit = IntersectTriangle(triangles[i], packet, t, u, v);
+				if(!AnyLane(hit))
+					continue;
+
+				packet.TMax = XMVectorSelect(packet.TMax, t, hit);
+				hits.U = XMVectorSelect(hits.U, u, hit);
+				hits.V = XMVectorSelect(hits.V, v, hit);
+				hits.Triangle = XMVectorSelect(hits.Triangle, XMVectorReplicateInt(triangles[i].Id), hit);
+				found = XMVectorOrInt(found, hit);
+			}
+			return true;
+		});
+		return found;
+	}
+
+	// Lanes that hit anything in the mesh get TMax = -1, which retires them.
+	// Returns the lanes that hit.
+	XMVECTOR TraceAny(const MeshBvh& mesh, RayPacket& packet)
+	{
+		const BvhNode* nodes = &mesh.GetNode(0);
+		const MeshBvh::Triangle* triangles = &mesh.GetTriangle(0);
+		const XMVECTOR retired = XMVectorReplicate(-1.0f);
+
+		XMVECTOR found = XMVectorFalseInt();
+		Traverse(nodes, packet, [&](UINT first, UINT count)
+		{
+			for(UINT i = first; i < first + count; ++i)
+			{
+				XMVECTOR t, u, v;
+				XMVECTOR hit = IntersectTriangle(triangles[i], packet, t, u, v);
+				if(!AnyLane(hit))
+					continue;
+
+				packet.TMax = XMVectorSelect(packet.TMax, retired, hit);
+				found = XMVectorOrInt(found, hit);
+				if(XMVector4Less(packet.TMax, XMVectorZero()))
+					return false;
+			}
+			return true;
+		});
+		return found;
+	}
+
+	void StoreNearest(const RayPacket& packet, const PacketHits& hits, UINT count, RayHit* out)
+	{
+		XMFLOAT4A t, u, v;
+		XMUINT4 triangle, instance;
+		XMStoreFloat4A(&t, XMVectorSelect(XMVectorReplicate(MathHelper::Infinity), packet.TMax, hits.Hit));
+		XMStoreFloat4A(&u, hits.U);
+		XMStoreFloat4A(&v, hits.V);
+		// The ids are integer lanes: XMStoreInt4 keeps their bits, where
+		// XMStoreUInt4 would convert them from float.
+		XMStoreInt4(&triangle.x, hits.Triangle);
+		XMStoreInt4(&instance.x, hits.Instance);
+
+		for(UINT i = 0; i < count; ++i)
+		{
+			out[i].T = (&t.x)[i];
+			out[i].Triangle = (&triangle.x)[i];
+			out[i].U = (&u.x)[i];
+			out[i].V = (&v.x)[i];
+			out[i].Instance = (&instance.x)[i];
+		}
+	}
+
+	void StoreAny(FXMVECTOR found, UINT count, BYTE* out)
+	{
+		XMUINT4 mask;
+		XMStoreInt4(&mask.x, found);
+		for(UINT i = 0; i < count; ++i)
+		{
+			out[i] = (&mask.x)[i] != 0 ? 1 : 0;
+		}
+	}
+}
+
+void RayQuery::IntersectNearest(const MeshBvh& mesh, const Ray* rays, UINT rayCount, RayHit* hits, ThreadPool* threadPool)
+{
+	ForEachPacket(rayCount, threadPool, [&](UINT firstRay, UINT count)
+	{
+		RayPacket packet;
+		LoadPacket(rays + firstRay, count, packet);
+
+		PacketHits packetHits;
+		if(mesh.TriangleCount() > 0)
+			packetHits.Hit = TraceNearest(mesh, packet, packetHits);
+		StoreNearest(packet, packetHits, count, hits + firstRay);
+	});
+}
+
+void RayQuery::IntersectNearest(const SceneBvh& scene, const Ray* rays, UINT rayCount, RayHit* hits, ThreadPool* threadPool)
+{
+	ForEachPacket(rayCount, threadPool, [&](UINT firstRay, UINT count)
+	{
+		RayPacket packet;
+		LoadPacket(rays + firstRay, count, packet);
+
+		PacketHits packetHits;
+		if(scene.InstanceCount() > 0)
+		{
+			Traverse(&scene.GetNode(0), packet, [&](UINT first, UINT instanceCount)
+			{
+				for(UINT i = first; i < first + instanceCount; ++i)
+				{
+					const SceneBvh::InstanceData& instance = scene.GetInstance(i);
+					if(instance.Mesh->TriangleCount() == 0)
+						continue;
+
+					RayPacket local;
+					TransformPacket(packet, instance.InvWorld, local);
+					XMVECTOR hit = TraceNearest(*instance.Mesh, local, packetHits);
+
+					packet.TMax = local.TMax;
+					packetHits.Instance = XMVectorSelect(packetHits.Instance, XMVectorReplicateInt(instance.Id), hit);
+					packetHits.Hit = XMVectorOrInt(packetHits.Hit, hit);
+				}
+				return true;
+			});
+		}
+		StoreNearest(packet, packetHits, count, hits + firstRay);
+	});
+}
+
+void RayQuery::IntersectAny(const MeshBvh& mesh, const Ray* rays, UINT rayCount, BYTE* hit, ThreadPool* threadPool)
+{
+	ForEachPacket(rayCount, threadPool, [&](UINT firstRay, UINT count)
+	{
+		RayPacket packet;
+		LoadPacket(rays + firstRay, count, packet);
+
+		XMVECTOR found = XMVectorFalseInt();
+		if(mesh.TriangleCount() > 0)
+			found = TraceAny(mesh, packet);
+		StoreAny(found, count, hit + firstRay);
+	});
+}
+
+void RayQuery::IntersectAny(const SceneBvh& scene, const Ray* rays, UINT rayCount, BYTE* hit, ThreadPool* threadPool)
+{
+	ForEachPacket(rayCount, threadPool, [&](UINT firstRay, UINT count)
+	{
+		RayPacket packet;
+		LoadPacket(rays + firstRay, count, packet);
+
+		XMVECTOR found = XMVectorFalseInt();
+		if(scene.InstanceCount() > 0)
+		{
+			Traverse(&scene.GetNode(0), packet, [&](UINT first, UINT instanceCount)
+			{
+				for(UINT i = first; i < first + instanceCount; ++i)
+				{
+					const SceneBvh::InstanceData& instance = scene.GetInstance(i);
+					if(instance.Mesh->TriangleCount() == 0)
+						continue;
+
+					RayPacket local;
+					TransformPacket(packet, instance.InvWorld, local);
+					found = XMVectorOrInt(found, TraceAny(*instance.Mesh, local));
+
+					packet.TMax = local.TMax;
+					if(XMVector4Less(packet.TMax, XMVectorZero()))
+						return false;
+				}
+				return true;
+			});
+		}
+		StoreAny(found, count, hit + firstRay);
+	});
+}
+
+void RayQuery::ForEachPacket(UINT rayCount, ThreadPool* threadPool,
+	const std::function<void(UINT firstRay, UINT count)>& func)
+{
+	const UINT packetCount = (rayCount + PacketSize - 1) / PacketSize;
+	auto runPackets = [&](UINT begin, UINT end, UINT)
+	{
+		for(UINT p = begin; p < end; ++p)
+		{
+			const UINT firstRay = p * PacketSize;
+			const UINT remaining = rayCount - firstRay;
+			func(firstRay, remaining < PacketSize ? remaining : PacketSize);
+		}
+	};
+
+	if(threadPool != nullptr && threadPool->ThreadCount() > 1 && packetCount > PacketGrainSize)
+		threadPool->ParallelFor(packetCount, PacketGrainSize, runPackets);
+	else
+		runPackets(0, packetCount, 0);
+}
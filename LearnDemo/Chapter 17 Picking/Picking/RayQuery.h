@@ -0,0 +1,55 @@
+#ifndef RAYQUERY_H
+#define RAYQUERY_H
+
+#include "PickingBvh.h"
+#include "../../../Common/ThreadPool.h"
+
+///<summary>
+/// Batched ray queries against a MeshBvh or SceneBvh, for the many rays of
+/// line-of-sight checks, decal placement or AO baking rather than a single
+/// pick.  The rays are taken four at a time as a packet, one per XMVECTOR
+/// lane, and each packet walks the tree once: a node is entered if any
+/// active lane's ray reaches it, and each triangle of a leaf is tested
+/// against all four rays at once.  Rays that start near each other and
+/// point the same way (a grid of camera rays, the AO rays of one texel)
+/// visit mostly the same nodes and get the most out of a packet; rays
+/// scattered every which way are no faster than MeshBvh's own queries.
+///
+/// Hits are the same as the single ray queries of MeshBvh and SceneBvh give,
+/// T in [0, TMax] and both sides of a triangle.  With a thread pool the
+/// packets are spread over its threads; the calls block until every ray is
+/// done and must not be made from inside a ParallelFor on the same pool.
+///</summary>
+class RayQuery
+{
+public:
+	// As for MeshBvh, Dir need not be unit length and T is in units of Dir.
+	struct Ray
+	{
+		DirectX::XMFLOAT3 Origin;
+		DirectX::XMFLOAT3 Dir;
+		float TMax = MathHelper::Infinity;
+	};
+
+	static const UINT PacketSize = 4;
+
+	// hits[i] is the nearest hit of rays[i], with T = Infinity on a miss.
+	static void IntersectNearest(const MeshBvh& mesh, const Ray* rays, UINT rayCount, RayHit* hits,
+		ThreadPool* threadPool = nullptr);
+	static void IntersectNearest(const SceneBvh& scene, const Ray* rays, UINT rayCount, RayHit* hits,
+		ThreadPool* threadPool = nullptr);
+
+	// hit[i] is 1 if rays[i] hits anything, else 0.  Each lane stops at its
+	// first hit, so this is cheaper than IntersectNearest for occlusion.
+	static void IntersectAny(const MeshBvh& mesh, const Ray* rays, UINT rayCount, BYTE* hit,
+		ThreadPool* threadPool = nullptr);
+	static void IntersectAny(const SceneBvh& scene, const Ray* rays, UINT rayCount, BYTE* hit,
+		ThreadPool* threadPool = nullptr);
+
+private:
+	// Calls func(firstRay, count) for each packet, count <= PacketSize.
+	static void ForEachPacket(UINT rayCount, ThreadPool* threadPool,
+		const std::function<void(UINT firstRay, UINT count)>& func);
+};
+
+#endif // RAYQUERY_H
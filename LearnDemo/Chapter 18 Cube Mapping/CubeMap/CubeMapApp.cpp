@@ -22,6 +22,7 @@
 //#include "../../../Common/UploadBuffer.h"
 //#include "../../../Common/GeometryGenerator.h"
 //#include "../../../Common/Camera.h"
+//#include "../../../Common/RenderItemCuller.h"
 //#include "CMFrameResource.h"
 //
 //using Microsoft::WRL::ComPtr;
@@ -96,6 +97,7 @@
 //
 //    void OnKeyboardInput(const GameTimer& gt);
 //	void AnimateMaterials(const GameTimer& gt);
+//	void CullRenderItems(const GameTimer& gt);
 //	void UpdateObjectCBs(const GameTimer& gt);
 //	void UpdateMaterialBuffer(const GameTimer& gt);
 //	void UpdateMainPassCB(const GameTimer& gt);
@@ -140,6 +142,9 @@
 //	// Render items divided by PSO.
 //	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 //
+//	// The opaque items in front of the camera this frame.
+//	RenderItemCuller<RenderItem> mRitemCuller;
+//
 //	UINT mSkyTexHeapIndex = 0;
 //
 //    PassConstants mMainPassCB;
@@ -243,6 +248,7 @@
 //    }
 //
 //	AnimateMaterials(gt);
+//	CullRenderItems(gt);
 //	UpdateObjectCBs(gt);
 //	UpdateMaterialBuffer(gt);
 //	UpdateMainPassCB(gt);
@@ -302,7 +308,7 @@
 //    // The root signature knows how many descriptors are expected in the table.
 //	mCommandList->SetGraphicsRootDescriptorTable(4, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 //
-//    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+//    DrawRenderItems(mCommandList.Get(), mRitemCuller.Visible((int)RenderLayer::Opaque));
 //    // Ⱦ
 //	mCommandList->SetPipelineState(mPSOs["sky"].Get());
 //	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Sky]);
@@ -384,11 +390,32 @@
 //	
 //}
 //
+//void CubeMapApp::CullRenderItems(const GameTimer& gt)
+//{
+//	// The sky is drawn around the eye, so it is never culled.
+//	mRitemCuller.Cull(mCamera.GetView(), mCamera.GetProj(), mRitemLayer, (UINT)RenderLayer::Count,
+//		1u << (int)RenderLayer::Opaque);
+//
+//	std::wostringstream outs;
+//	outs << L"Cube Map Demo    " << mRitemCuller.DrawsAvoided() << L" of "
+//		<< mRitemCuller.ItemsTested() << L" draws culled";
+//	mMainWndCaption = outs.str();
+//}
+//
 //void CubeMapApp::UpdateObjectCBs(const GameTimer& gt)
 //{
 //	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
 //	for(auto& e : mAllRitems)
 //	{
+//		// Leave items that are not drawn this frame for when they are.  They
+//		// must then be written to every frame resource again, since this one
+//		// is now behind.
+//		if(e->NumFramesDirty > 0 && !mRitemCuller.IsVisible(e->ObjCBIndex))
+//		{
+//			e->NumFramesDirty = gNumFrameResources;
+//			continue;
+//		}
+//
 //		// Only update the cbuffer data if the constants have changed.  
 //		// This needs to be tracked per frame resource.
 //		if(e->NumFramesDirty > 0)
@@ -167,6 +167,7 @@
 //#include "../../../Common/UploadBuffer.h"
 //#include "../../../Common/GeometryGenerator.h"
 //#include "../../../Common/Camera.h"
+//#include "../../../Common/RenderItemCuller.h"
 //#include "NormalFrameResource.h"
 //
 //using Microsoft::WRL::ComPtr;
@@ -241,6 +242,7 @@
 //
 //    void OnKeyboardInput(const GameTimer& gt);
 //	void AnimateMaterials(const GameTimer& gt);
+//	void CullRenderItems(const GameTimer& gt);
 //	void UpdateObjectCBs(const GameTimer& gt);
 //	void UpdateMaterialBuffer(const GameTimer& gt);
 //	void UpdateMainPassCB(const GameTimer& gt);
@@ -284,6 +286,9 @@
 //	// Render items divided by PSO.
 //	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 //
+//	// The opaque items in front of the camera this frame.
+//	RenderItemCuller<RenderItem> mRitemCuller;
+//
 //	UINT mSkyTexHeapIndex = 0;
 //
 //    PassConstants mMainPassCB;
@@ -388,6 +393,7 @@
 //    }
 //
 //	AnimateMaterials(gt);
+//	CullRenderItems(gt);
 //	UpdateObjectCBs(gt);
 //	UpdateMaterialBuffer(gt);
 //	UpdateMainPassCB(gt);
@@ -446,7 +452,7 @@
 //    // The root signature knows how many descriptors are expected in the table.
 //	mCommandList->SetGraphicsRootDescriptorTable(4, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 //
-//    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+//    DrawRenderItems(mCommandList.Get(), mRitemCuller.Visible((int)RenderLayer::Opaque));
 //
 //	mCommandList->SetPipelineState(mPSOs["sky"].Get());
 //	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Sky]);
@@ -528,11 +534,32 @@
 //	
 //}
 //
+//void NormalMapApp::CullRenderItems(const GameTimer& gt)
+//{
+//	// The sky is drawn around the eye, so it is never culled.
+//	mRitemCuller.Cull(mCamera.GetView(), mCamera.GetProj(), mRitemLayer, (UINT)RenderLayer::Count,
+//		1u << (int)RenderLayer::Opaque);
+//
+//	std::wostringstream outs;
+//	outs << L"Normal Map Demo    " << mRitemCuller.DrawsAvoided() << L" of "
+//		<< mRitemCuller.ItemsTested() << L" draws culled";
+//	mMainWndCaption = outs.str();
+//}
+//
 //void NormalMapApp::UpdateObjectCBs(const GameTimer& gt)
 //{
 //	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
 //	for(auto& e : mAllRitems)
 //	{
+//		// Leave items that are not drawn this frame for when they are.  They
+//		// must then be written to every frame resource again, since this one
+//		// is now behind.
+//		if(e->NumFramesDirty > 0 && !mRitemCuller.IsVisible(e->ObjCBIndex))
+//		{
+//			e->NumFramesDirty = gNumFrameResources;
+//			continue;
+//		}
+//
 //		// Only update the cbuffer data if the constants have changed.  
 //		// This needs to be tracked per frame resource.
 //		if(e->NumFramesDirty > 0)
@@ -117,6 +117,7 @@
 //#include "../../../Common/Camera.h"
 //#include "ShadowFrameResource.h"
 //#include "ShadowMap.h"
+//#include "../../../Common/OcclusionCuller.h"
 //
 //using Microsoft::WRL::ComPtr;
 //using namespace DirectX;
@@ -150,6 +151,9 @@
 //	Material* Mat = nullptr;
 //	MeshGeometry* Geo = nullptr;
 //
+//	// World space bounds, for occlusion culling.
+//	BoundingBox Bounds;
+//
 //    // Primitive topology.
 //    D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //
@@ -194,6 +198,7 @@
 //    void UpdateShadowTransform(const GameTimer& gt);
 //	void UpdateMainPassCB(const GameTimer& gt);
 //    void UpdateShadowPassCB(const GameTimer& gt);
+//	void UpdateOcclusion(const GameTimer& gt);
 //
 //	void LoadTextures();
 //    void BuildRootSignature();
@@ -205,6 +210,7 @@
 //    void BuildFrameResources();
 //    void BuildMaterials();
 //    void BuildRenderItems();
+//	void BuildOccluders();
 //    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
 //    void DrawSceneToShadowMap();
 //
@@ -266,6 +272,20 @@
 //    };
 //    XMFLOAT3 mRotatedLightDirections[3];
 //
+//	// Low-poly stand-ins for the box and the columns, drawn into a CPU depth
+//	// buffer each frame to find the opaque items hidden behind them.
+//	ThreadPool mThreadPool;
+//	OcclusionCuller mOcclusionCuller;
+//	std::vector<XMFLOAT3> mBoxOccluderVertices;
+//	std::vector<UINT> mBoxOccluderIndices;
+//	std::vector<XMFLOAT3> mColumnOccluderVertices;
+//	std::vector<UINT> mColumnOccluderIndices;
+//	std::vector<OcclusionCuller::Occluder> mOccluders;
+//	std::vector<BoundingBox> mOcclusionBoxes;
+//	std::vector<BYTE> mOcclusionVisible;
+//	std::vector<RenderItem*> mVisibleOpaqueRitems;
+//	bool mOcclusionCullingEnabled = true;
+//
 //    POINT mLastMousePos;
 //};
 //
@@ -333,9 +353,13 @@
 //    BuildSkullGeometry();
 //	BuildMaterials();
 //    BuildRenderItems();
+//	BuildOccluders();
 //    BuildFrameResources();
 //    BuildPSOs();
 //
+//	// A quarter of the demo's resolution in each direction is plenty.
+//	mOcclusionCuller.Initialize(&mThreadPool, 320, 180);
+//
 //    // Execute the initialization commands.
 //    ThrowIfFailed(mCommandList->Close());
 //    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
@@ -413,6 +437,7 @@
 //    UpdateShadowTransform(gt);
 //	UpdateMainPassCB(gt);
 //    UpdateShadowPassCB(gt);
+//	UpdateOcclusion(gt);
 //}
 //
 //void ShadowMapApp::Draw(const GameTimer& gt)
@@ -474,7 +499,7 @@
 //    mCommandList->SetGraphicsRootDescriptorTable(3, skyTexDescriptor);
 //
 //    mCommandList->SetPipelineState(mPSOs["opaque"].Get());
-//    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+//    DrawRenderItems(mCommandList.Get(), mVisibleOpaqueRitems);
 //
 //    mCommandList->SetPipelineState(mPSOs["debug"].Get());
 //    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Debug]);
@@ -551,6 +576,12 @@
 //	if(GetAsyncKeyState('D') & 0x8000)
 //		mCamera.Strafe(10.0f*dt);
 //
+//	if(GetAsyncKeyState('1') & 0x8000)
+//		mOcclusionCullingEnabled = true;
+//
+//	if(GetAsyncKeyState('2') & 0x8000)
+//		mOcclusionCullingEnabled = false;
+//
 //	mCamera.UpdateViewMatrix();
 //}
 // 
@@ -723,6 +754,37 @@
 //    currPassCB->CopyData(1, mShadowPassCB);
 //}
 //
+//void ShadowMapApp::UpdateOcclusion(const GameTimer& gt)
+//{
+//	// Draw the occluders into the CPU depth buffer and test the opaque items
+//	// against it.  Only the main pass skips what is hidden: an item the
+//	// camera can't see may still cast a shadow onto one it can.
+//	XMMATRIX viewProj = XMMatrixMultiply(mCamera.GetView(), mCamera.GetProj());
+//	mOcclusionCuller.Render(viewProj, mOccluders.data(), (UINT)mOccluders.size());
+//
+//	const auto& opaqueRitems = mRitemLayer[(int)RenderLayer::Opaque];
+//	mOcclusionBoxes.resize(opaqueRitems.size());
+//	mOcclusionVisible.resize(opaqueRitems.size());
+//	for(size_t i = 0; i < opaqueRitems.size(); ++i)
+//	{
+//		mOcclusionBoxes[i] = opaqueRitems[i]->Bounds;
+//	}
+//	mOcclusionCuller.TestBoxes(mOcclusionBoxes.data(), (UINT)mOcclusionBoxes.size(), mOcclusionVisible.data());
+//
+//	mVisibleOpaqueRitems.clear();
+//	for(size_t i = 0; i < opaqueRitems.size(); ++i)
+//	{
+//		if(mOcclusionVisible[i] || !mOcclusionCullingEnabled)
+//			mVisibleOpaqueRitems.push_back(opaqueRitems[i]);
+//	}
+//
+//	std::wostringstream outs;
+//	outs.precision(3);
+//	outs << L"Shadow Map Demo    " << 100.0f*mOcclusionCuller.RejectedFraction() << L"% occluded in "
+//		<< mOcclusionCuller.RenderMs() + mOcclusionCuller.TestMs() << L" ms";
+//	mMainWndCaption = outs.str();
+//}
+//
 //void ShadowMapApp::LoadTextures()
 //{
 //	std::vector<std::string> texNames = 
@@ -1054,6 +1116,15 @@
 //	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 //	geo->IndexBufferByteSize = ibByteSize;
 //
+//	BoundingBox::CreateFromPoints(boxSubmesh.Bounds, box.Vertices.size(),
+//		&box.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
+//	BoundingBox::CreateFromPoints(gridSubmesh.Bounds, grid.Vertices.size(),
+//		&grid.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
+//	BoundingBox::CreateFromPoints(sphereSubmesh.Bounds, sphere.Vertices.size(),
+//		&sphere.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
+//	BoundingBox::CreateFromPoints(cylinderSubmesh.Bounds, cylinder.Vertices.size(),
+//		&cylinder.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
+//
 //	geo->DrawArgs["box"] = boxSubmesh;
 //	geo->DrawArgs["grid"] = gridSubmesh;
 //	geo->DrawArgs["sphere"] = sphereSubmesh;
@@ -1378,6 +1449,7 @@
 //	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
 //	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
 //	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+//	boxRitem->Geo->DrawArgs["box"].Bounds.Transform(boxRitem->Bounds, XMLoadFloat4x4(&boxRitem->World));
 //
 //	mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
 //	mAllRitems.push_back(std::move(boxRitem));
@@ -1392,6 +1464,7 @@
 //    skullRitem->IndexCount = skullRitem->Geo->DrawArgs["skull"].IndexCount;
 //    skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs["skull"].StartIndexLocation;
 //    skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs["skull"].BaseVertexLocation;
+//    skullRitem->Geo->DrawArgs["skull"].Bounds.Transform(skullRitem->Bounds, XMLoadFloat4x4(&skullRitem->World));
 //
 //    mRitemLayer[(int)RenderLayer::Opaque].push_back(skullRitem.get());
 //    mAllRitems.push_back(std::move(skullRitem));
@@ -1406,6 +1479,7 @@
 //    gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
 //    gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
 //    gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+//    gridRitem->Geo->DrawArgs["grid"].Bounds.Transform(gridRitem->Bounds, XMLoadFloat4x4(&gridRitem->World));
 //
 //	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
 //	mAllRitems.push_back(std::move(gridRitem));
@@ -1434,6 +1508,7 @@
 //		leftCylRitem->IndexCount = leftCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
 //		leftCylRitem->StartIndexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
 //		leftCylRitem->BaseVertexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+//		leftCylRitem->Geo->DrawArgs["cylinder"].Bounds.Transform(leftCylRitem->Bounds, XMLoadFloat4x4(&leftCylRitem->World));
 //
 //		XMStoreFloat4x4(&rightCylRitem->World, leftCylWorld);
 //		XMStoreFloat4x4(&rightCylRitem->TexTransform, brickTexTransform);
@@ -1444,6 +1519,7 @@
 //		rightCylRitem->IndexCount = rightCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
 //		rightCylRitem->StartIndexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
 //		rightCylRitem->BaseVertexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+//		rightCylRitem->Geo->DrawArgs["cylinder"].Bounds.Transform(rightCylRitem->Bounds, XMLoadFloat4x4(&rightCylRitem->World));
 //
 //		XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
 //		leftSphereRitem->TexTransform = MathHelper::Identity4x4();
@@ -1454,6 +1530,7 @@
 //		leftSphereRitem->IndexCount = leftSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
 //		leftSphereRitem->StartIndexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 //		leftSphereRitem->BaseVertexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+//		leftSphereRitem->Geo->DrawArgs["sphere"].Bounds.Transform(leftSphereRitem->Bounds, XMLoadFloat4x4(&leftSphereRitem->World));
 //
 //		XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
 //		rightSphereRitem->TexTransform = MathHelper::Identity4x4();
@@ -1464,6 +1541,7 @@
 //		rightSphereRitem->IndexCount = rightSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
 //		rightSphereRitem->StartIndexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 //		rightSphereRitem->BaseVertexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+//		rightSphereRitem->Geo->DrawArgs["sphere"].Bounds.Transform(rightSphereRitem->Bounds, XMLoadFloat4x4(&rightSphereRitem->World));
 //
 //		mRitemLayer[(int)RenderLayer::Opaque].push_back(leftCylRitem.get());
 //		mRitemLayer[(int)RenderLayer::Opaque].push_back(rightCylRitem.get());
@@ -1477,6 +1555,45 @@
 //	}
 //}
 //
+//void ShadowMapApp::BuildOccluders()
+//{
+//	// Fewer triangles than what is drawn, and a little inside it, so an
+//	// occluder never covers more than the real object: the box without
+//	// subdivisions, and 8-sided columns.
+//	GeometryGenerator geoGen;
+//	GeometryGenerator::MeshData box = geoGen.CreateBox(0.98f, 0.98f, 0.98f, 0);
+//	GeometryGenerator::MeshData column = geoGen.CreateCylinder(0.45f, 0.27f, 2.95f, 8, 1);
+//
+//	for(const auto& vertex : box.Vertices)
+//		mBoxOccluderVertices.push_back(vertex.Position);
+//	mBoxOccluderIndices.assign(box.Indices32.begin(), box.Indices32.end());
+//
+//	for(const auto& vertex : column.Vertices)
+//		mColumnOccluderVertices.push_back(vertex.Position);
+//	mColumnOccluderIndices.assign(column.Indices32.begin(), column.Indices32.end());
+//
+//	OcclusionCuller::Occluder boxOccluder;
+//	boxOccluder.Vertices = mBoxOccluderVertices.data();
+//	boxOccluder.Indices = mBoxOccluderIndices.data();
+//	boxOccluder.IndexCount = (UINT)mBoxOccluderIndices.size();
+//	XMStoreFloat4x4(&boxOccluder.World, XMMatrixScaling(2.0f, 1.0f, 2.0f)*XMMatrixTranslation(0.0f, 0.5f, 0.0f));
+//	mOccluders.push_back(boxOccluder);
+//
+//	// Where BuildRenderItems puts the columns.
+//	for(int i = 0; i < 5; ++i)
+//	{
+//		for(float x : { -5.0f, 5.0f })
+//		{
+//			OcclusionCuller::Occluder columnOccluder;
+//			columnOccluder.Vertices = mColumnOccluderVertices.data();
+//			columnOccluder.Indices = mColumnOccluderIndices.data();
+//			columnOccluder.IndexCount = (UINT)mColumnOccluderIndices.size();
+//			XMStoreFloat4x4(&columnOccluder.World, XMMatrixTranslation(x, 1.5f, -10.0f + i*5.0f));
+//			mOccluders.push_back(columnOccluder);
+//		}
+//	}
+//}
+//
 //void ShadowMapApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 //{
 //    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
@@ -10,6 +10,7 @@
 #include "../../../Common/UploadBuffer.h"
 #include "../../../Common/GeometryGenerator.h"
 #include "../../../Common/Camera.h"
+#include "../../../Common/RenderItemCuller.h"
 #include "SsaoFrameResource.h"
 #include "SsaoShadowMap.h"
 #include "Ssao.h"
@@ -85,6 +86,7 @@ private:
 
     void OnKeyboardInput(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
+	void CullRenderItems(const GameTimer& gt);
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMaterialBuffer(const GameTimer& gt);
     void UpdateShadowTransform(const GameTimer& gt);
@@ -139,6 +141,10 @@ private:
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
+	// The opaque items in front of the camera this frame.  The shadow map
+	// pass still draws them all, so their constants are always written.
+	RenderItemCuller<RenderItem> mRitemCuller;
+
 	UINT mSkyTexHeapIndex = 0;
     UINT mShadowMapHeapIndex = 0;
     UINT mSsaoHeapIndexStart = 0;
@@ -331,6 +337,7 @@ void SsaoApp::Update(const GameTimer& gt)
     }
 
 	AnimateMaterials(gt);
+	CullRenderItems(gt);
 	UpdateObjectCBs(gt);
 	UpdateMaterialBuffer(gt);
     UpdateShadowTransform(gt);
@@ -436,7 +443,7 @@ void SsaoApp::Draw(const GameTimer& gt)
     mCommandList->SetGraphicsRootDescriptorTable(3, skyTexDescriptor);
 
     mCommandList->SetPipelineState(mPSOs["opaque"].Get());
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+    DrawRenderItems(mCommandList.Get(), mRitemCuller.Visible((int)RenderLayer::Opaque));
 
     mCommandList->SetPipelineState(mPSOs["debug"].Get());
     DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Debug]);
@@ -521,6 +528,19 @@ void SsaoApp::AnimateMaterials(const GameTimer& gt)
 	
 }
 
+void SsaoApp::CullRenderItems(const GameTimer& gt)
+{
+	// The sky is drawn around the eye and the debug quad in screen space,
+	// so neither is culled.
+	mRitemCuller.Cull(mCamera.GetView(), mCamera.GetProj(), mRitemLayer, (UINT)RenderLayer::Count,
+		1u << (int)RenderLayer::Opaque);
+
+	std::wostringstream outs;
+	outs << L"Ssao Demo    " << mRitemCuller.DrawsAvoided() << L" of "
+		<< mRitemCuller.ItemsTested() << L" draws culled";
+	mMainWndCaption = outs.str();
+}
+
 void SsaoApp::UpdateObjectCBs(const GameTimer& gt)
 {
 	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
@@ -1723,7 +1743,7 @@ void SsaoApp::DrawNormalsAndDepth()
 
     mCommandList->SetPipelineState(mPSOs["drawNormals"].Get());
 
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+    DrawRenderItems(mCommandList.Get(), mRitemCuller.Visible((int)RenderLayer::Opaque));
 
     // Change back to GENERIC_READ so we can read the texture in a shader.
     mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(normalMap,
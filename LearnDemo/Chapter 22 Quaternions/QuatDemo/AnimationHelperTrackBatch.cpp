@@ -0,0 +1,318 @@
+//***************************************************************************************
+// AnimationHelperTrackBatch.cpp
+//***************************************************************************************
+
+#include "AnimationHelperTrackBatch.h"
+#include "../../../Common/MathHelper.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Slerp of four quaternions stored structure-of-arrays (q[0] holds the
+	// four x's, ...), each lane with its own t.  Takes the short way round,
+	// like XMQuaternionSlerp.
+	void SlerpLanes(const XMVECTOR q0[4], const XMVECTOR q1[4], FXMVECTOR t, XMVECTOR result[4])
+	{
+		const XMVECTOR zero = XMVectorZero();
+		const XMVECTOR one = XMVectorSplatOne();
+
+		XMVECTOR cosOmega = XMVectorMultiply(q0[0], q1[0]);
+		cosOmega = XMVectorMultiplyAdd(q0[1], q1[1], cosOmega);
+		cosOmega = XMVectorMultiplyAdd(q0[2], q1[2], cosOmega);
+		cosOmega = XMVectorMultiplyAdd(q0[3], q1[3], cosOmega);
+
+		XMVECTOR sign = XMVectorSelect(one, XMVectorNegate(one), XMVectorLess(cosOmega, zero));
+		cosOmega = XMVectorMin(XMVectorAbs(cosOmega), one);
+
+		XMVECTOR omega = XMVectorACos(cosOmega);
+		XMVECTOR invSinOmega = XMVectorReciprocal(XMVectorSin(omega));
+		XMVECTOR w0 = XMVectorMultiply(XMVectorSin(XMVectorMultiply(XMVectorSubtract(one, t), omega)), invSinOmega);
+		XMVECTOR w1 = XMVectorMultiply(XMVectorSin(XMVectorMultiply(t, omega)), invSinOmega);
+
+		// Nearly the same rotation: sin(omega) is too small to divide by, lerp instead.
+		XMVECTOR nearlyEqual = XMVectorGreater(cosOmega, XMVectorReplicate(1.0f - 1.0e-5f));
+		w0 = XMVectorSelect(w0, XMVectorSubtract(one, t), nearlyEqual);
+		w1 = XMVectorSelect(w1, t, nearlyEqual);
+		w1 = XMVectorMultiply(w1, sign);
+
+		for(int i = 0; i < 4; ++i)
+		{
+			result[i] = XMVectorMultiplyAdd(q0[i], w0, XMVectorMultiply(q1[i], w1));
+		}
+	}
+}
+
+void AnimationHelperTrackBatch::Build(const std::vector<AnimationHelperBoneAnimation>& tracks)
+{
+	mSegments.clear();
+	mFirstSegment.resize(tracks.size());
+	mSegmentCount.resize(tracks.size());
+	mCursors.assign(tracks.size(), 0);
+	mEndTime = 0.0f;
+
+	for(UINT i = 0; i < tracks.size(); ++i)
+	{
+		const AnimationHelperBoneAnimation& track = tracks[i];
+		const std::vector<AnimationHelperKeyframe>& keys = track.Keyframes;
+		assert(!keys.empty());
+
+		mEndTime = MathHelper::Max(mEndTime, track.GetEndTime());
+
+		// A single key still gets one (constant) segment.
+		const UINT segmentCount = MathHelper::Max((UINT)keys.size() - 1, 1u);
+		mFirstSegment[i] = (UINT)mSegments.size();
+		mSegmentCount[i] = segmentCount;
+
+		for(UINT k = 0; k < segmentCount; ++k)
+		{
+			const AnimationHelperKeyframe& key0 = keys[k];
+			const AnimationHelperKeyframe& key1 = keys[MathHelper::Min(k + 1, (UINT)keys.size() - 1)];
+
+			XMVECTOR P0, P1, P2, P3, Q1, A, B, C;
+			SetupSegment(track, k, P0, P1, P2, P3, Q1, A, B, C);
+
+			float duration = key1.TimePos - key0.TimePos;
+			float invDuration = duration > 0.0f ? 1.0f / duration : 0.0f;
+
+			// The last segment runs on forever so later times clamp to its end.
+			float endTime = k + 1 < segmentCount ? key1.TimePos : FLT_MAX;
+
+			Segment segment;
+			XMStoreFloat4(&segment.Rows[0], XMVectorSetW(P0, key0.TimePos));
+			XMStoreFloat4(&segment.Rows[1], XMVectorSetW(P1, invDuration));
+			XMStoreFloat4(&segment.Rows[2], XMVectorSetW(P2, endTime));
+			XMStoreFloat4(&segment.Rows[3], XMVectorSetW(P3, 0.0f));
+			XMStoreFloat4(&segment.Rows[4], Q1);
+			XMStoreFloat4(&segment.Rows[5], A);
+			XMStoreFloat4(&segment.Rows[6], B);
+			XMStoreFloat4(&segment.Rows[7], C);
+			segment.Rows[8] = XMFLOAT4(key0.Scale.x, key0.Scale.y, key0.Scale.z, 0.0f);
+			segment.Rows[9] = XMFLOAT4(key1.Scale.x, key1.Scale.y, key1.Scale.z, 0.0f);
+			mSegments.push_back(segment);
+		}
+	}
+
+	// Lanes past the last track read a segment holding the identity.
+	Segment identity;
+	for(int r = 0; r < 10; ++r)
+	{
+		identity.Rows[r] = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+	for(int r = 4; r < 8; ++r)
+	{
+		identity.Rows[r].w = 1.0f;
+	}
+	identity.Rows[2].w = FLT_MAX;
+	identity.Rows[8] = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.0f);
+	identity.Rows[9] = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.0f);
+	mSegments.push_back(identity);
+}
+
+UINT AnimationHelperTrackBatch::TrackCount()const
+{
+	return (UINT)mFirstSegment.size();
+}
+
+float AnimationHelperTrackBatch::GetEndTime()const
+{
+	return mEndTime;
+}
+
+UINT AnimationHelperTrackBatch::FindSegment(UINT track, float t)
+{
+	const Segment* segments = &mSegments[mFirstSegment[track]];
+	const UINT count = mSegmentCount[track];
+	UINT s = mCursors[track];
+
+	// Still in the same segment, or moved on to the next one.
+	if( t >= segments[s].Rows[0].w && t < segments[s].Rows[2].w )
+		return s;
+	if( s + 1 < count && t >= segments[s+1].Rows[0].w && t < segments[s+1].Rows[2].w )
+		return mCursors[track] = s + 1;
+
+	// Otherwise the last segment starting at or before t (the first if none does).
+	UINT lo = 0;
+	UINT hi = count - 1;
+	while(lo < hi)
+	{
+		UINT mid = (lo + hi + 1) / 2;
+		if(segments[mid].Rows[0].w <= t)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return mCursors[track] = lo;
+}
+
+void AnimationHelperTrackBatch::Evaluate(float t, XMFLOAT4X4* worlds)
+{
+	const UINT trackCount = TrackCount();
+	const Segment* padding = &mSegments.back();
+
+	const XMVECTOR time = XMVectorReplicate(t);
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR one = XMVectorSplatOne();
+	const XMVECTOR two = XMVectorReplicate(2.0f);
+	const XMVECTOR half = XMVectorReplicate(0.5f);
+
+	for(UINT base = 0; base < trackCount; base += 8)
+	{
+		const Segment* segments[8];
+		for(UINT j = 0; j < 8; ++j)
+		{
+			UINT track = base + j;
+			segments[j] = track < trackCount ? &mSegments[mFirstSegment[track] + FindSegment(track, t)] : padding;
+		}
+
+		// Two halves of four lanes.  soa[h][r].r[c] is component c of row r
+		// of the segments of lanes 4h..4h+3.
+		XMMATRIX soa[2][10];
+		for(UINT h = 0; h < 2; ++h)
+		{
+			for(UINT r = 0; r < 10; ++r)
+			{
+				XMMATRIX rows(
+					XMLoadFloat4(&segments[4*h + 0]->Rows[r]),
+					XMLoadFloat4(&segments[4*h + 1]->Rows[r]),
+					XMLoadFloat4(&segments[4*h + 2]->Rows[r]),
+					XMLoadFloat4(&segments[4*h + 3]->Rows[r]));
+				soa[h][r] = XMMatrixTranspose(rows);
+			}
+		}
+
+		for(UINT h = 0; h < 2; ++h)
+		{
+			const XMMATRIX* seg = soa[h];
+
+			// Fraction of the way through each lane's segment.
+			XMVECTOR s = XMVectorSaturate(XMVectorMultiply(XMVectorSubtract(time, seg[0].r[3]), seg[1].r[3]));
+			XMVECTOR s2 = XMVectorMultiply(s, s);
+			XMVECTOR s3 = XMVectorMultiply(s2, s);
+
+			// Catmull-Rom basis weights of P0..P3.
+			XMVECTOR w0 = XMVectorMultiply(half, XMVectorSubtract(XMVectorSubtract(XMVectorMultiply(two, s2), s3), s));
+			XMVECTOR w1 = XMVectorMultiply(half, XMVectorAdd(XMVectorSubtract(XMVectorScale(s3, 3.0f), XMVectorScale(s2, 5.0f)), two));
+			XMVECTOR w2 = XMVectorMultiply(half, XMVectorAdd(XMVectorAdd(XMVectorScale(s3, -3.0f), XMVectorScale(s2, 4.0f)), s));
+			XMVECTOR w3 = XMVectorMultiply(half, XMVectorSubtract(s3, s2));
+
+			XMVECTOR P[3];
+			for(int c = 0; c < 3; ++c)
+			{
+				P[c] = XMVectorMultiply(w0, seg[0].r[c]);
+				P[c] = XMVectorMultiplyAdd(w1, seg[1].r[c], P[c]);
+				P[c] = XMVectorMultiplyAdd(w2, seg[2].r[c], P[c]);
+				P[c] = XMVectorMultiplyAdd(w3, seg[3].r[c], P[c]);
+			}
+
+			// Squad: slerp(slerp(Q1, C, s), slerp(A, B, s), 2s(1-s)).
+			XMVECTOR outer[4], inner[4], Q[4];
+			SlerpLanes(seg[4].r, seg[7].r, s, outer);
+			SlerpLanes(seg[5].r, seg[6].r, s, inner);
+			SlerpLanes(outer, inner, XMVectorMultiply(XMVectorMultiply(two, s), XMVectorSubtract(one, s)), Q);
+
+			XMVECTOR lengthSq = XMVectorMultiply(Q[0], Q[0]);
+			for(int c = 1; c < 4; ++c)
+			{
+				lengthSq = XMVectorMultiplyAdd(Q[c], Q[c], lengthSq);
+			}
+			XMVECTOR invLength = XMVectorReciprocalSqrt(lengthSq);
+			XMVECTOR x = XMVectorMultiply(Q[0], invLength);
+			XMVECTOR y = XMVectorMultiply(Q[1], invLength);
+			XMVECTOR z = XMVectorMultiply(Q[2], invLength);
+			XMVECTOR w = XMVectorMultiply(Q[3], invLength);
+
+			XMVECTOR Sx = XMVectorLerpV(seg[8].r[0], seg[9].r[0], s);
+			XMVECTOR Sy = XMVectorLerpV(seg[8].r[1], seg[9].r[1], s);
+			XMVECTOR Sz = XMVectorLerpV(seg[8].r[2], seg[9].r[2], s);
+
+			// Rows of scale * rotation * translation, as XMMatrixAffineTransformation builds them.
+			XMVECTOR xx = XMVectorMultiply(x, x), yy = XMVectorMultiply(y, y), zz = XMVectorMultiply(z, z);
+			XMVECTOR xy = XMVectorMultiply(x, y), xz = XMVectorMultiply(x, z), yz = XMVectorMultiply(y, z);
+			XMVECTOR wx = XMVectorMultiply(w, x), wy = XMVectorMultiply(w, y), wz = XMVectorMultiply(w, z);
+
+			XMMATRIX row0(
+				XMVectorMultiply(Sx, XMVectorSubtract(one, XMVectorMultiply(two, XMVectorAdd(yy, zz)))),
+				XMVectorMultiply(Sx, XMVectorMultiply(two, XMVectorAdd(xy, wz))),
+				XMVectorMultiply(Sx, XMVectorMultiply(two, XMVectorSubtract(xz, wy))),
+				zero);
+			XMMATRIX row1(
+				XMVectorMultiply(Sy, XMVectorMultiply(two, XMVectorSubtract(xy, wz))),
+				XMVectorMultiply(Sy, XMVectorSubtract(one, XMVectorMultiply(two, XMVectorAdd(xx, zz)))),
+				XMVectorMultiply(Sy, XMVectorMultiply(two, XMVectorAdd(yz, wx))),
+				zero);
+			XMMATRIX row2(
+				XMVectorMultiply(Sz, XMVectorMultiply(two, XMVectorAdd(xz, wy))),
+				XMVectorMultiply(Sz, XMVectorMultiply(two, XMVectorSubtract(yz, wx))),
+				XMVectorMultiply(Sz, XMVectorSubtract(one, XMVectorMultiply(two, XMVectorAdd(xx, yy)))),
+				zero);
+			XMMATRIX row3(P[0], P[1], P[2], one);
+
+			// Back to one matrix per lane.
+			row0 = XMMatrixTranspose(row0);
+			row1 = XMMatrixTranspose(row1);
+			row2 = XMMatrixTranspose(row2);
+			row3 = XMMatrixTranspose(row3);
+
+			for(UINT j = 0; j < 4; ++j)
+			{
+				UINT track = base + 4*h + j;
+				if(track < trackCount)
+					XMStoreFloat4x4(&worlds[track], XMMATRIX(row0.r[j], row1.r[j], row2.r[j], row3.r[j]));
+			}
+		}
+	}
+}
+
+void AnimationHelperTrackBatch::InterpolateSpline(const AnimationHelperBoneAnimation& track, float t, XMFLOAT4X4& M)
+{
+	const std::vector<AnimationHelperKeyframe>& keys = track.Keyframes;
+	const UINT keyCount = (UINT)keys.size();
+
+	// Segment k runs from key k to key k+1.
+	UINT k = 0;
+	while(k + 2 < keyCount && t >= keys[k+1].TimePos)
+	{
+		++k;
+	}
+
+	const AnimationHelperKeyframe& key0 = keys[k];
+	const AnimationHelperKeyframe& key1 = keys[MathHelper::Min(k + 1, keyCount - 1)];
+	float duration = key1.TimePos - key0.TimePos;
+	float s = duration > 0.0f ? MathHelper::Clamp((t - key0.TimePos) / duration, 0.0f, 1.0f) : 0.0f;
+
+	XMVECTOR P0, P1, P2, P3, Q1, A, B, C;
+	SetupSegment(track, k, P0, P1, P2, P3, Q1, A, B, C);
+
+	XMVECTOR P = XMVectorCatmullRom(P0, P1, P2, P3, s);
+	XMVECTOR Q = XMQuaternionNormalize(XMQuaternionSquad(Q1, A, B, C, s));
+	XMVECTOR S = XMVectorLerp(XMLoadFloat3(&key0.Scale), XMLoadFloat3(&key1.Scale), s);
+
+	XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+}
+
+void AnimationHelperTrackBatch::SetupSegment(const AnimationHelperBoneAnimation& track, UINT key,
+	XMVECTOR& P0, XMVECTOR& P1, XMVECTOR& P2, XMVECTOR& P3,
+	XMVECTOR& Q1, XMVECTOR& A, XMVECTOR& B, XMVECTOR& C)
+{
+	const std::vector<AnimationHelperKeyframe>& keys = track.Keyframes;
+	const UINT last = (UINT)keys.size() - 1;
+
+	const AnimationHelperKeyframe& key1 = keys[key];
+	const AnimationHelperKeyframe& key2 = keys[MathHelper::Min(key + 1, last)];
+
+	// Past either end of the track, extend the path in a straight line.
+	P1 = XMLoadFloat3(&key1.Translation);
+	P2 = XMLoadFloat3(&key2.Translation);
+	P0 = key > 0 ? XMLoadFloat3(&keys[key-1].Translation) : XMVectorSubtract(XMVectorScale(P1, 2.0f), P2);
+	P3 = key + 2 <= last ? XMLoadFloat3(&keys[key+2].Translation) : XMVectorSubtract(XMVectorScale(P2, 2.0f), P1);
+
+	XMVECTOR Q0 = XMLoadFloat4(&keys[key > 0 ? key - 1 : key].RotationQuat);
+	XMVECTOR Q2 = XMLoadFloat4(&key2.RotationQuat);
+	XMVECTOR Q3 = XMLoadFloat4(&keys[MathHelper::Min(key + 2, last)].RotationQuat);
+	Q1 = XMLoadFloat4(&key1.RotationQuat);
+
+	XMQuaternionSquadSetup(&A, &B, &C, Q0, Q1, Q2, Q3);
+}
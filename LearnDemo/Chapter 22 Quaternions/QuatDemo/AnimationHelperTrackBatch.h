@@ -0,0 +1,68 @@
+//***************************************************************************************
+// AnimationHelperTrackBatch.h
+//
+// Evaluates many keyframed rigid objects at once.
+//***************************************************************************************
+
+#ifndef ANIMATION_HELPER_TRACK_BATCH_H
+#define ANIMATION_HELPER_TRACK_BATCH_H
+
+#include "AnimationHelper.h"
+
+///<summary>
+/// Evaluates many AnimationHelperBoneAnimation tracks (doors, props,
+/// cameras on keyframed paths) at the same time value.  Positions follow
+/// a Catmull-Rom spline through the keys and rotations a squad spline, so
+/// motion is smooth through the keys instead of turning sharply there as
+/// with Interpolate's lerp/slerp; scale is lerped.
+///
+/// The spline control data of every segment is worked out once in Build.
+/// Evaluate then finds each track's segment (remembering the last one, so
+/// playback moving forward finds it straight away), gathers eight tracks'
+/// segments into structure-of-arrays registers (two four-lane vectors per
+/// channel), evaluates them together and writes the matrices out.
+///</summary>
+class AnimationHelperTrackBatch
+{
+public:
+	void Build(const std::vector<AnimationHelperBoneAnimation>& tracks);
+
+	UINT TrackCount()const;
+	float GetEndTime()const;
+
+	// Writes the world matrix of every track at time t to worlds[0..TrackCount()).
+	// Times outside a track are clamped to its first or last key, like Interpolate.
+	void Evaluate(float t, DirectX::XMFLOAT4X4* worlds);
+
+	// The same splines one track at a time, with the DirectXMath functions
+	// (XMVectorCatmullRom, XMQuaternionSquad): what the batch is checked against.
+	static void InterpolateSpline(const AnimationHelperBoneAnimation& track, float t, DirectX::XMFLOAT4X4& M);
+
+private:
+	// Control data of one key segment, as float4 rows so four segments can
+	// be turned into structure-of-arrays registers with a 4x4 transpose:
+	//   P0 T0 | P1 InvDuration | P2 T1 | P3 - | Q1 | A | B | C | S0 - | S1 -
+	// P0..P3 are the Catmull-Rom points and Q1, A, B, C the squad
+	// quaternions of the segment from time T0 to T1.
+	struct Segment
+	{
+		DirectX::XMFLOAT4 Rows[10];
+	};
+
+	UINT FindSegment(UINT track, float t);
+
+	static void SetupSegment(const AnimationHelperBoneAnimation& track, UINT key,
+		DirectX::XMVECTOR& P0, DirectX::XMVECTOR& P1, DirectX::XMVECTOR& P2, DirectX::XMVECTOR& P3,
+		DirectX::XMVECTOR& Q1, DirectX::XMVECTOR& A, DirectX::XMVECTOR& B, DirectX::XMVECTOR& C);
+
+	std::vector<Segment> mSegments;
+
+	// Per track: first segment, segment count, and the last segment used.
+	std::vector<UINT> mFirstSegment;
+	std::vector<UINT> mSegmentCount;
+	std::vector<UINT> mCursors;
+
+	float mEndTime = 0.0f;
+};
+
+#endif // ANIMATION_HELPER_TRACK_BATCH_H
@@ -0,0 +1,135 @@
+#include "QuatBenchmark.h"
+#include "AnimationHelperTrackBatch.h"
+#include "../../../Common/BenchmarkTimer.h"
+#include <iomanip>
+
+using namespace DirectX;
+
+namespace
+{
+	// A prop on a random path: 5 to 12 keys about a second apart.
+	AnimationHelperBoneAnimation MakeTrack()
+	{
+		AnimationHelperBoneAnimation anim;
+		anim.Keyframes.resize(5 + rand() % 8);
+
+		float t = 0.0f;
+		for(auto& key : anim.Keyframes)
+		{
+			key.TimePos = t;
+			key.Translation = XMFLOAT3(MathHelper::RandF(-10.0f, 10.0f), MathHelper::RandF(0.0f, 5.0f), MathHelper::RandF(-10.0f, 10.0f));
+
+			float s = MathHelper::RandF(0.5f, 2.0f);
+			key.Scale = XMFLOAT3(s, s, s);
+
+			XMVECTOR axis = XMVectorSet(MathHelper::RandF(-1.0f, 1.0f), 1.0f, MathHelper::RandF(-1.0f, 1.0f), 0.0f);
+			XMStoreFloat4(&key.RotationQuat, XMQuaternionRotationAxis(axis, MathHelper::RandF(-XM_PI, XM_PI)));
+
+			t += MathHelper::RandF(0.5f, 1.5f);
+		}
+
+		return anim;
+	}
+}
+
+void QuatBenchmark::TrackEvaluation(std::ostream& out)
+{
+	const UINT trackCounts[] = { 8, 64, 512, 4096, 32768 };
+	const UINT samplesPerSize = 1 << 20;
+
+	out << "Rigid track evaluation, ns per track (one time value per frame, 60Hz playback)\n";
+	out << std::setw(8) << "tracks" << std::setw(12) << "slerp" << std::setw(12) << "spline"
+		<< std::setw(12) << "batch" << std::setw(10) << "speedup" << std::setw(12) << "max err" << "\n";
+
+	for(UINT trackCount : trackCounts)
+	{
+		std::vector<AnimationHelperBoneAnimation> tracks(trackCount);
+		for(auto& track : tracks)
+		{
+			track = MakeTrack();
+		}
+
+		AnimationHelperTrackBatch batch;
+		batch.Build(tracks);
+
+		const UINT frameCount = MathHelper::Max(samplesPerSize / trackCount, 8u);
+		const float duration = batch.GetEndTime();
+		const float dt = 1.0f / 60.0f;
+
+		std::vector<XMFLOAT4X4> worlds(trackCount);
+		std::vector<XMFLOAT4X4> reference(trackCount);
+
+		// Sum a matrix element so the compiler cannot drop the work.
+		float sink = 0.0f;
+
+		double slerpMs = BenchmarkTimer::TimeMs([&]()
+		{
+			float t = 0.0f;
+			for(UINT frame = 0; frame < frameCount; ++frame)
+			{
+				for(UINT i = 0; i < trackCount; ++i)
+				{
+					tracks[i].Interpolate(t, worlds[i]);
+				}
+				sink += worlds[0]._41;
+				t = (t + dt > duration) ? 0.0f : t + dt;
+			}
+		});
+
+		double splineMs = BenchmarkTimer::TimeMs([&]()
+		{
+			float t = 0.0f;
+			for(UINT frame = 0; frame < frameCount; ++frame)
+			{
+				for(UINT i = 0; i < trackCount; ++i)
+				{
+					AnimationHelperTrackBatch::InterpolateSpline(tracks[i], t, worlds[i]);
+				}
+				sink += worlds[0]._41;
+				t = (t + dt > duration) ? 0.0f : t + dt;
+			}
+		});
+
+		double batchMs = BenchmarkTimer::TimeMs([&]()
+		{
+			float t = 0.0f;
+			for(UINT frame = 0; frame < frameCount; ++frame)
+			{
+				batch.Evaluate(t, worlds.data());
+				sink += worlds[0]._41;
+				t = (t + dt > duration) ? 0.0f : t + dt;
+			}
+		});
+
+		// Compare against the reference at a spread of times, including
+		// before the first key and after the last one.
+		float maxError = 0.0f;
+		for(float t = -0.5f; t < duration + 0.5f; t += 0.173f)
+		{
+			batch.Evaluate(t, worlds.data());
+			for(UINT i = 0; i < trackCount; ++i)
+			{
+				AnimationHelperTrackBatch::InterpolateSpline(tracks[i], t, reference[i]);
+				for(int r = 0; r < 4; ++r)
+				{
+					for(int c = 0; c < 4; ++c)
+					{
+						maxError = MathHelper::Max(maxError, fabsf(worlds[i].m[r][c] - reference[i].m[r][c]));
+					}
+				}
+			}
+		}
+
+		const double toNs = 1.0e6 / ((double)frameCount * trackCount);
+		BenchmarkTimer::DoNotOptimize(sink);
+		out << std::fixed << std::setprecision(1)
+			<< std::setw(8) << trackCount
+			<< std::setw(12) << slerpMs*toNs
+			<< std::setw(12) << splineMs*toNs
+			<< std::setw(12) << batchMs*toNs
+			<< std::setw(9) << splineMs/batchMs << "x"
+			<< std::setw(12) << std::setprecision(6) << maxError << "\n";
+	}
+
+	out << std::endl;
+}
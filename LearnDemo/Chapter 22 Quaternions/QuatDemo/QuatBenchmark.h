@@ -0,0 +1,23 @@
+#ifndef QUATBENCHMARK_H
+#define QUATBENCHMARK_H
+
+#include "AnimationHelper.h"
+
+///<summary>
+/// Headless timings for keyframed rigid object animation.  Nothing here
+/// needs a device, e.g.:
+///
+///    std::ofstream fout("QuatBenchmark.txt");
+///    QuatBenchmark::TrackEvaluation(fout);
+///</summary>
+class QuatBenchmark
+{
+public:
+	// Per-track cost of evaluating 8 to 32768 random tracks at one time value:
+	// AnimationHelperBoneAnimation::Interpolate (lerp/slerp), the scalar
+	// Catmull-Rom/squad reference and AnimationHelperTrackBatch, with the
+	// largest difference between the batch and the reference.
+	static void TrackEvaluation(std::ostream& out);
+};
+
+#endif // QUATBENCHMARK_H
@@ -0,0 +1,1489 @@
+#include "AnimBenchmark.h"
+#include "LoadM3d.h"
+#include "PoseBlender.h"
+#include "AnimationBatch.h"
+#include "PoseCache.h"
+#include "CpuSkinner.h"
+#include "SubsetPalettes.h"
+#include "AnimationLod.h"
+#include "VertexAnimationBaker.h"
+#include "../../../Common/BenchmarkTimer.h"
+#include <iomanip>
+
+using namespace DirectX;
+
+namespace
+{
+	// A single bone track with keyCount keys spaced roughly 1/60s apart.  The
+	// spacing is jittered so binary search cannot get lucky on uniform data.
+	BoneAnimation MakeTrack(UINT keyCount)
+	{
+		BoneAnimation anim;
+		anim.Keyframes.resize(keyCount);
+
+		float t = 0.0f;
+		for(UINT i = 0; i < keyCount; ++i)
+		{
+			Keyframe& key = anim.Keyframes[i];
+			key.TimePos = t;
+			key.Translation = XMFLOAT3(MathHelper::RandF(), MathHelper::RandF(), MathHelper::RandF());
+
+			XMVECTOR axis = XMVectorSet(MathHelper::RandF(-1.0f, 1.0f), 1.0f, MathHelper::RandF(-1.0f, 1.0f), 0.0f);
+			XMStoreFloat4(&key.RotationQuat, XMQuaternionRotationAxis(axis, MathHelper::RandF(0.0f, XM_PI)));
+
+			t += MathHelper::RandF(0.5f, 1.5f) / 60.0f;
+		}
+
+		return anim;
+	}
+
+	// A synthetic skeleton in parent-first order.  Deep rigs hang most bones
+	// off the previous one (long chains, like tails or ropes); wide ones give
+	// every bone up to eight children (like a face).
+	std::vector<int> MakeHierarchy(UINT boneCount, bool wide)
+	{
+		std::vector<int> hierarchy(boneCount);
+		hierarchy[0] = -1;
+		for(UINT i = 1; i < boneCount; ++i)
+		{
+			if(wide)
+				hierarchy[i] = (i - 1) / 8;
+			else
+				hierarchy[i] = MathHelper::RandF() < 0.8f ? i - 1 : MathHelper::Rand(0, i - 1);
+		}
+		return hierarchy;
+	}
+
+	// A small random rigid transform, so long chains stay finite.
+	XMFLOAT4X4 MakeBoneTransform()
+	{
+		XMVECTOR axis = XMVectorSet(MathHelper::RandF(-1.0f, 1.0f), 1.0f, MathHelper::RandF(-1.0f, 1.0f), 0.0f);
+		XMMATRIX R = XMMatrixRotationAxis(axis, MathHelper::RandF(-0.2f, 0.2f));
+		XMMATRIX T = XMMatrixTranslation(MathHelper::RandF(-0.1f, 0.1f), 0.1f, MathHelper::RandF(-0.1f, 0.1f));
+
+		XMFLOAT4X4 M;
+		XMStoreFloat4x4(&M, R*T);
+		return M;
+	}
+
+	// The lookup BoneAnimation::Interpolate used to do: scan from the first
+	// key every call.
+	void LinearScanInterpolate(const BoneAnimation& anim, float t, XMFLOAT4X4& M)
+	{
+		const auto& keys = anim.Keyframes;
+		if( t <= keys.front().TimePos || t >= keys.back().TimePos )
+		{
+			anim.Interpolate(t, M);
+			return;
+		}
+
+		for(UINT i = 0; i < keys.size()-1; ++i)
+		{
+			if( t >= keys[i].TimePos && t <= keys[i+1].TimePos )
+			{
+				float lerpPercent = (t - keys[i].TimePos) / (keys[i+1].TimePos - keys[i].TimePos);
+
+				XMVECTOR S = XMVectorLerp(XMLoadFloat3(&keys[i].Scale), XMLoadFloat3(&keys[i+1].Scale), lerpPercent);
+				XMVECTOR P = XMVectorLerp(XMLoadFloat3(&keys[i].Translation), XMLoadFloat3(&keys[i+1].Translation), lerpPercent);
+				XMVECTOR Q = XMQuaternionSlerp(XMLoadFloat4(&keys[i].RotationQuat), XMLoadFloat4(&keys[i+1].RotationQuat), lerpPercent);
+
+				XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+				XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+				break;
+			}
+		}
+	}
+}
+
+void AnimBenchmark::KeyframeLookup(std::ostream& out)
+{
+	const UINT keyCounts[] = { 16, 64, 256, 1024, 4096, 16384 };
+	const UINT numSamples = 200000;
+
+	out << "Keyframe lookup, ns per bone sample (" << numSamples << " samples of looping playback at 60Hz)\n";
+	out << std::setw(8) << "keys" << std::setw(12) << "linear" << std::setw(12) << "binary"
+		<< std::setw(12) << "cursor" << std::setw(12) << "uniform" << "\n";
+
+	for(UINT keyCount : keyCounts)
+	{
+		BoneAnimation anim = MakeTrack(keyCount);
+		BoneAnimation uniformAnim = anim;
+		uniformAnim.ResampleUniform(60.0f);
+
+		const float duration = anim.GetEndTime();
+		const float dt = 1.0f / 60.0f;
+
+		// Sum a matrix element so the compiler cannot drop the work.
+		float sink = 0.0f;
+		XMFLOAT4X4 M;
+
+		double linearMs = BenchmarkTimer::TimeMs([&]()
+		{
+			float t = 0.0f;
+			for(UINT i = 0; i < numSamples; ++i)
+			{
+				LinearScanInterpolate(anim, t, M);
+				sink += M._41;
+				t = (t + dt > duration) ? 0.0f : t + dt;
+			}
+		});
+
+		double binaryMs = BenchmarkTimer::TimeMs([&]()
+		{
+			float t = 0.0f;
+			for(UINT i = 0; i < numSamples; ++i)
+			{
+				anim.Interpolate(t, M);
+				sink += M._41;
+				t = (t + dt > duration) ? 0.0f : t + dt;
+			}
+		});
+
+		double cursorMs = BenchmarkTimer::TimeMs([&]()
+		{
+			float t = 0.0f;
+			UINT keyIndex = 0;
+			for(UINT i = 0; i < numSamples; ++i)
+			{
+				anim.Interpolate(t, M, keyIndex);
+				sink += M._41;
+				t = (t + dt > duration) ? 0.0f : t + dt;
+			}
+		});
+
+		double uniformMs = BenchmarkTimer::TimeMs([&]()
+		{
+			float t = 0.0f;
+			for(UINT i = 0; i < numSamples; ++i)
+			{
+				uniformAnim.Interpolate(t, M);
+				sink += M._41;
+				t = (t + dt > duration) ? 0.0f : t + dt;
+			}
+		});
+
+		const double toNs = 1.0e6 / numSamples;
+		BenchmarkTimer::DoNotOptimize(sink);
+		out << std::fixed << std::setprecision(1)
+			<< std::setw(8) << keyCount
+			<< std::setw(12) << linearMs*toNs
+			<< std::setw(12) << binaryMs*toNs
+			<< std::setw(12) << cursorMs*toNs
+			<< std::setw(12) << uniformMs*toNs << "\n";
+	}
+
+	out << std::endl;
+}
+
+void AnimBenchmark::BatchInterpolation(std::ostream& out, const std::string& m3dFilename, const std::string& clipName)
+{
+	std::vector<M3DLoader::SkinnedVertex> vertices;
+	std::vector<USHORT> indices;
+	std::vector<M3DLoader::Subset> subsets;
+	std::vector<M3DLoader::M3dMaterial> mats;
+	SkinnedData skinInfo;
+
+	M3DLoader m3dLoader;
+	if( !m3dLoader.LoadM3d(m3dFilename, vertices, indices, subsets, mats, skinInfo) )
+	{
+		out << "Could not load " << m3dFilename << "\n" << std::endl;
+		return;
+	}
+
+	const UINT numSamples = 20000;
+	const float dt = 1.0f / 60.0f;
+
+	const AnimationClip* clip = skinInfo.GetClip(clipName);
+	if(clip == nullptr)
+	{
+		out << "No clip named " << clipName << "\n" << std::endl;
+		return;
+	}
+
+	out << "Batch interpolation, " << m3dFilename << " (" << skinInfo.BoneCount() << " bones), ns per pose\n";
+	out << std::setw(12) << "clip" << std::setw(12) << "per-bone" << std::setw(12) << "nlerp"
+		<< std::setw(12) << "corrected" << std::setw(14) << "nlerp err" << std::setw(14) << "corr. err"
+		<< std::setw(12) << "packed KB" << "\n";
+
+	PackedAnimationClip packed;
+	packed.Build(*clip, 60.0f);
+
+	const UINT numBones = packed.BoneCount();
+	const float duration = clip->GetClipEndTime();
+
+	std::vector<XMFLOAT4X4> reference(numBones);
+	std::vector<XMFLOAT4X4> transforms(numBones);
+
+	float sink = 0.0f;
+
+	double perBoneMs = BenchmarkTimer::TimeMs([&]()
+	{
+		float t = 0.0f;
+		for(UINT i = 0; i < numSamples; ++i)
+		{
+			clip->Interpolate(t, reference);
+			sink += reference[numBones-1]._41;
+			t = (t + dt > duration) ? 0.0f : t + dt;
+		}
+	});
+
+	double nlerpMs = BenchmarkTimer::TimeMs([&]()
+	{
+		float t = 0.0f;
+		for(UINT i = 0; i < numSamples; ++i)
+		{
+			packed.Interpolate(t, transforms.data(), false);
+			sink += transforms[numBones-1]._41;
+			t = (t + dt > duration) ? 0.0f : t + dt;
+		}
+	});
+
+	double correctedMs = BenchmarkTimer::TimeMs([&]()
+	{
+		float t = 0.0f;
+		for(UINT i = 0; i < numSamples; ++i)
+		{
+			packed.Interpolate(t, transforms.data(), true);
+			sink += transforms[numBones-1]._41;
+			t = (t + dt > duration) ? 0.0f : t + dt;
+		}
+	});
+
+	// Compare against the per-bone path off the key times, where the
+	// rotation blends differ the most.
+	float maxError[2] = { 0.0f, 0.0f };
+	for(float t = 0.0f; t <= duration; t += dt * 0.37f)
+	{
+		clip->Interpolate(t, reference);
+		for(int corrected = 0; corrected < 2; ++corrected)
+		{
+			packed.Interpolate(t, transforms.data(), corrected != 0);
+			for(UINT b = 0; b < numBones; ++b)
+			{
+				for(int r = 0; r < 4; ++r)
+				{
+					for(int c = 0; c < 4; ++c)
+					{
+						float d = fabsf(reference[b].m[r][c] - transforms[b].m[r][c]);
+						maxError[corrected] = MathHelper::Max(maxError[corrected], d);
+					}
+				}
+			}
+		}
+	}
+
+	const double toNs = 1.0e6 / numSamples;
+	BenchmarkTimer::DoNotOptimize(sink);
+	out << std::fixed << std::setprecision(1)
+		<< std::setw(12) << clipName.c_str()
+		<< std::setw(12) << perBoneMs*toNs
+		<< std::setw(12) << nlerpMs*toNs
+		<< std::setw(12) << correctedMs*toNs
+		<< std::scientific << std::setprecision(2)
+		<< std::setw(14) << maxError[0]
+		<< std::setw(14) << maxError[1]
+		<< std::fixed << std::setprecision(1)
+		<< std::setw(12) << packed.ByteSize() / 1024.0 << "\n";
+
+	out << std::endl;
+}
+
+void AnimBenchmark::ClipCompression(std::ostream& out, const std::string& m3dFilename, const std::string& clipName)
+{
+	std::vector<M3DLoader::SkinnedVertex> vertices;
+	std::vector<USHORT> indices;
+	std::vector<M3DLoader::Subset> subsets;
+	std::vector<M3DLoader::M3dMaterial> mats;
+	SkinnedData skinInfo;
+
+	M3DLoader m3dLoader;
+	if( !m3dLoader.LoadM3d(m3dFilename, vertices, indices, subsets, mats, skinInfo) )
+	{
+		out << "Could not load " << m3dFilename << "\n" << std::endl;
+		return;
+	}
+
+	const AnimationClip* clip = skinInfo.GetClip(clipName);
+	if(clip == nullptr)
+	{
+		out << "No clip named " << clipName << "\n" << std::endl;
+		return;
+	}
+
+	const UINT numSamples = 20000;
+	const float dt = 1.0f / 60.0f;
+	const UINT numBones = (UINT)clip->BoneAnimations.size();
+	const float duration = clip->GetClipEndTime();
+
+	std::vector<XMFLOAT4X4> transforms(numBones);
+	float sink = 0.0f;
+
+	double sourceMs = BenchmarkTimer::TimeMs([&]()
+	{
+		float t = 0.0f;
+		for(UINT i = 0; i < numSamples; ++i)
+		{
+			clip->Interpolate(t, transforms);
+			sink += transforms[numBones-1]._41;
+			t = (t + dt > duration) ? 0.0f : t + dt;
+		}
+	});
+
+	const double toNs = 1.0e6 / numSamples;
+
+	out << "Clip compression, " << m3dFilename << " clip " << clipName << " (" << numBones << " bones)\n";
+	out << "Uncompressed sampling: " << std::fixed << std::setprecision(1) << sourceMs*toNs << " ns per pose\n";
+	out << std::setw(10) << "tolerance" << std::setw(10) << "keys" << std::setw(10) << "kept"
+		<< std::setw(12) << "bytes" << std::setw(12) << "packed" << std::setw(8) << "ratio"
+		<< std::setw(12) << "T err" << std::setw(12) << "R err(deg)" << std::setw(12) << "S err"
+		<< std::setw(12) << "ns/pose" << "\n";
+
+	// Translation tolerance in model units, rotation tolerance in radians.
+	const float tolerances[] = { 0.0001f, 0.001f, 0.005f, 0.01f };
+	for(float tolerance : tolerances)
+	{
+		ClipCompressionSettings settings;
+		settings.TranslationTolerance = tolerance;
+		settings.RotationTolerance = tolerance;
+		settings.ScaleTolerance = tolerance;
+
+		CompressedAnimationClip compressed;
+		compressed.Build(*clip, settings);
+		const ClipCompressionStats& stats = compressed.GetStats();
+
+		double compressedMs = BenchmarkTimer::TimeMs([&]()
+		{
+			float t = 0.0f;
+			for(UINT i = 0; i < numSamples; ++i)
+			{
+				compressed.Interpolate(t, transforms.data());
+				sink += transforms[numBones-1]._41;
+				t = (t + dt > duration) ? 0.0f : t + dt;
+			}
+		});
+
+		BenchmarkTimer::DoNotOptimize(sink);
+		out << std::setw(10) << std::setprecision(4) << tolerance
+			<< std::setw(10) << stats.SourceKeyCount*3
+			<< std::setw(10) << stats.StoredKeyCount
+			<< std::setw(12) << stats.SourceBytes
+			<< std::setw(12) << stats.CompressedBytes
+			<< std::setw(8) << std::setprecision(1) << stats.CompressionRatio()
+			<< std::scientific << std::setprecision(2)
+			<< std::setw(12) << stats.MaxTranslationError
+			<< std::setw(12) << XMConvertToDegrees(stats.MaxRotationError)
+			<< std::setw(12) << stats.MaxScaleError
+			<< std::fixed << std::setprecision(1)
+			<< std::setw(12) << compressedMs*toNs << "\n";
+	}
+
+	out << "(keys counts translation, rotation and scale keys separately)\n" << std::endl;
+}
+
+void AnimBenchmark::PoseBlending(std::ostream& out, const std::string& m3dFilename, const std::string& clipName)
+{
+	std::vector<M3DLoader::SkinnedVertex> vertices;
+	std::vector<USHORT> indices;
+	std::vector<M3DLoader::Subset> subsets;
+	std::vector<M3DLoader::M3dMaterial> mats;
+	SkinnedData skinInfo;
+
+	M3DLoader m3dLoader;
+	if( !m3dLoader.LoadM3d(m3dFilename, vertices, indices, subsets, mats, skinInfo) )
+	{
+		out << "Could not load " << m3dFilename << "\n" << std::endl;
+		return;
+	}
+
+	if(skinInfo.GetClip(clipName) == nullptr)
+	{
+		out << "No clip named " << clipName << "\n" << std::endl;
+		return;
+	}
+
+	const UINT numBones = skinInfo.BoneCount();
+	const UINT numSamples = 10000;
+	const float dt = 1.0f / 60.0f;
+	const float duration = skinInfo.GetClipEndTime(clipName);
+
+	std::vector<float> halfMask(numBones, 0.0f);
+	for(UINT i = numBones/2; i < numBones; ++i)
+	{
+		halfMask[i] = 1.0f;
+	}
+
+	PoseBlender blender;
+	blender.Initialize(&skinInfo);
+
+	std::vector<XMFLOAT4X4> finalTransforms(numBones);
+	float sink = 0.0f;
+
+	out << "Pose blending, " << m3dFilename << " (" << numBones << " bones), ns per blended pose\n";
+	out << std::setw(8) << "layers" << std::setw(16) << "N palettes" << std::setw(16) << "PoseBlender" << "\n";
+
+	const UINT layerCounts[] = { 1, 2, 4, 8 };
+	for(UINT layerCount : layerCounts)
+	{
+		PoseBlendLayer layers[8];
+		for(UINT i = 0; i < layerCount; ++i)
+		{
+			layers[i].ClipName = clipName;
+			layers[i].Weight = 1.0f / (i + 1);
+			layers[i].BoneMask = (i % 2 == 1) ? &halfMask : nullptr;
+		}
+
+		// What blending cost before: one full palette per input clip.
+		double palettesMs = BenchmarkTimer::TimeMs([&]()
+		{
+			float t = 0.0f;
+			for(UINT n = 0; n < numSamples; ++n)
+			{
+				for(UINT i = 0; i < layerCount; ++i)
+				{
+					float layerTime = fmodf(t + i*0.1f, duration);
+					skinInfo.GetFinalTransforms(clipName, layerTime, finalTransforms);
+					sink += finalTransforms[numBones-1]._41;
+				}
+				t = (t + dt > duration) ? 0.0f : t + dt;
+			}
+		});
+
+		double blenderMs = BenchmarkTimer::TimeMs([&]()
+		{
+			float t = 0.0f;
+			for(UINT n = 0; n < numSamples; ++n)
+			{
+				for(UINT i = 0; i < layerCount; ++i)
+				{
+					layers[i].TimePos = fmodf(t + i*0.1f, duration);
+				}
+				blender.GetFinalTransforms(layers, layerCount, finalTransforms);
+				sink += finalTransforms[numBones-1]._41;
+				t = (t + dt > duration) ? 0.0f : t + dt;
+			}
+		});
+
+		const double toNs = 1.0e6 / numSamples;
+		BenchmarkTimer::DoNotOptimize(sink);
+		out << std::fixed << std::setprecision(1)
+			<< std::setw(8) << layerCount
+			<< std::setw(16) << palettesMs*toNs
+			<< std::setw(16) << blenderMs*toNs << "\n";
+	}
+
+	out << std::endl;
+}
+
+void AnimBenchmark::MultiCharacter(std::ostream& out, const std::string& m3dFilename, const std::string& clipName)
+{
+	std::vector<M3DLoader::SkinnedVertex> vertices;
+	std::vector<USHORT> indices;
+	std::vector<M3DLoader::Subset> subsets;
+	std::vector<M3DLoader::M3dMaterial> mats;
+	SkinnedData skinInfo;
+
+	M3DLoader m3dLoader;
+	if( !m3dLoader.LoadM3d(m3dFilename, vertices, indices, subsets, mats, skinInfo) )
+	{
+		out << "Could not load " << m3dFilename << "\n" << std::endl;
+		return;
+	}
+
+	if(skinInfo.GetClip(clipName) == nullptr)
+	{
+		out << "No clip named " << clipName << "\n" << std::endl;
+		return;
+	}
+
+	// Same layout as an UploadBuffer<SkinnedConstants> (96 bones, 256 byte aligned).
+	const UINT paletteStride = d3dUtil::CalcConstantBufferByteSize(96*sizeof(XMFLOAT4X4));
+	const UINT characterCounts[] = { 1, 10, 100, 250, 500, 1000 };
+	const UINT maxCharacters = 1000;
+	const UINT numFrames = 60;
+	const float dt = 1.0f / 60.0f;
+
+	std::vector<BYTE> palettes((size_t)paletteStride * maxCharacters);
+
+	std::vector<UINT> threadCounts;
+	const UINT hardwareThreads = MathHelper::Max(1u, std::thread::hardware_concurrency());
+	for(UINT n = 1; n < hardwareThreads; n *= 2)
+	{
+		threadCounts.push_back(n);
+	}
+	threadCounts.push_back(hardwareThreads);
+
+	out << "Multi-character update, " << m3dFilename << " (" << skinInfo.BoneCount() << " bones), ms per frame\n";
+	out << std::setw(12) << "characters";
+	for(UINT threadCount : threadCounts)
+	{
+		out << std::setw(9) << threadCount << "T";
+	}
+	out << std::setw(12) << "speedup" << "\n";
+
+	for(UINT characterCount : characterCounts)
+	{
+		out << std::setw(12) << characterCount;
+
+		double singleThreadMs = 0.0;
+		double lastMs = 0.0;
+		for(UINT threadCount : threadCounts)
+		{
+			ThreadPool threadPool(threadCount);
+			AnimationBatch batch;
+			batch.Initialize(&threadPool, skinInfo.BoneCount());
+
+			std::vector<AnimatedCharacter> characters(characterCount);
+			for(UINT i = 0; i < characterCount; ++i)
+			{
+				characters[i].SkinnedInfo = &skinInfo;
+				characters[i].ClipName = clipName;
+				characters[i].TimePos = MathHelper::RandF(0.0f, skinInfo.GetClipEndTime(clipName));
+			}
+
+			double ms = BenchmarkTimer::TimeMs([&]()
+			{
+				for(UINT frame = 0; frame < numFrames; ++frame)
+				{
+					batch.Update(characters.data(), characterCount, dt, palettes.data(), paletteStride);
+				}
+			}) / numFrames;
+
+			if(threadCount == 1)
+				singleThreadMs = ms;
+			lastMs = ms;
+
+			out << std::fixed << std::setprecision(3) << std::setw(10) << ms;
+		}
+
+		out << std::setw(11) << std::setprecision(1) << singleThreadMs / lastMs << "x\n";
+	}
+
+	out << std::endl;
+}
+
+void AnimBenchmark::PoseCaching(std::ostream& out, const std::string& m3dFilename, const std::string& clipName)
+{
+	std::vector<M3DLoader::SkinnedVertex> vertices;
+	std::vector<USHORT> indices;
+	std::vector<M3DLoader::Subset> subsets;
+	std::vector<M3DLoader::M3dMaterial> mats;
+	SkinnedData skinInfo;
+
+	M3DLoader m3dLoader;
+	if( !m3dLoader.LoadM3d(m3dFilename, vertices, indices, subsets, mats, skinInfo) )
+	{
+		out << "Could not load " << m3dFilename << "\n" << std::endl;
+		return;
+	}
+
+	if(skinInfo.GetClip(clipName) == nullptr)
+	{
+		out << "No clip named " << clipName << "\n" << std::endl;
+		return;
+	}
+
+	const UINT numBones = skinInfo.BoneCount();
+	const UINT numCharacters = 1000;
+	const UINT numFrames = 60;
+	const UINT capacity = 64;
+	const float dt = 1.0f / 60.0f;
+	const float duration = skinInfo.GetClipEndTime(clipName);
+
+	std::vector<float> startTimes(numCharacters);
+	for(UINT i = 0; i < numCharacters; ++i)
+	{
+		startTimes[i] = MathHelper::RandF(0.0f, duration);
+	}
+
+	std::vector<XMFLOAT4X4> finalTransforms(numBones);
+	std::vector<XMFLOAT4X4> exact(numBones);
+	float sink = 0.0f;
+
+	double uncachedMs = BenchmarkTimer::TimeMs([&]()
+	{
+		for(UINT frame = 0; frame < numFrames; ++frame)
+		{
+			for(UINT i = 0; i < numCharacters; ++i)
+			{
+				float t = fmodf(startTimes[i] + frame*dt, duration);
+				skinInfo.GetFinalTransforms(clipName, t, finalTransforms);
+				sink += finalTransforms[numBones-1]._41;
+			}
+		}
+	}) / numFrames;
+
+	out << "Pose cache, " << m3dFilename << ", " << numCharacters << " characters at random phases, "
+		<< capacity << " entries\n";
+	out << "Uncached: " << std::fixed << std::setprecision(3) << uncachedMs << " ms per frame\n";
+	out << std::setw(10) << "quantum" << std::setw(10) << "ms/frame" << std::setw(10) << "hit rate"
+		<< std::setw(12) << "evictions" << std::setw(12) << "memory KB" << std::setw(12) << "max error" << "\n";
+
+	const float quanta[] = { 1.0f/240.0f, 1.0f/120.0f, 1.0f/60.0f, 1.0f/30.0f, 1.0f/15.0f };
+	for(float quantum : quanta)
+	{
+		PoseCache cache;
+		cache.Initialize(capacity, numBones, quantum);
+		UINT clip = cache.GetClipHandle(&skinInfo, clipName);
+
+		double cachedMs = BenchmarkTimer::TimeMs([&]()
+		{
+			for(UINT frame = 0; frame < numFrames; ++frame)
+			{
+				for(UINT i = 0; i < numCharacters; ++i)
+				{
+					float t = fmodf(startTimes[i] + frame*dt, duration);
+					const XMFLOAT4X4* palette = cache.GetFinalTransforms(clip, t);
+					sink += palette[numBones-1]._41;
+				}
+			}
+		}) / numFrames;
+
+		// The price of sharing: how far a snapped palette is from the exact one.
+		float maxError = 0.0f;
+		for(UINT i = 0; i < numCharacters; i += 10)
+		{
+			skinInfo.GetFinalTransforms(clipName, startTimes[i], exact);
+			const XMFLOAT4X4* palette = cache.GetFinalTransforms(clip, startTimes[i]);
+			for(UINT b = 0; b < numBones; ++b)
+			{
+				for(int r = 0; r < 4; ++r)
+				{
+					for(int c = 0; c < 4; ++c)
+					{
+						maxError = MathHelper::Max(maxError, fabsf(exact[b].m[r][c] - palette[b].m[r][c]));
+					}
+				}
+			}
+		}
+
+		BenchmarkTimer::DoNotOptimize(sink);
+		out << std::setw(10) << std::setprecision(4) << quantum
+			<< std::setw(10) << std::setprecision(3) << cachedMs
+			<< std::setw(9) << std::setprecision(1) << cache.HitRate()*100.0f << "%"
+			<< std::setw(12) << cache.Evictions()
+			<< std::setw(12) << cache.MemoryUse() / 1024
+			<< std::setw(12) << std::setprecision(4) << maxError << "\n";
+	}
+
+	out << std::endl;
+}
+
+void AnimBenchmark::DualQuaternionSkinning(std::ostream& out, const std::string& m3dFilename, const std::string& clipName)
+{
+	std::vector<M3DLoader::SkinnedVertex> vertices;
+	std::vector<USHORT> indices;
+	std::vector<M3DLoader::Subset> subsets;
+	std::vector<M3DLoader::M3dMaterial> mats;
+	SkinnedData skinInfo;
+
+	M3DLoader m3dLoader;
+	if( !m3dLoader.LoadM3d(m3dFilename, vertices, indices, subsets, mats, skinInfo) )
+	{
+		out << "Could not load " << m3dFilename << "\n" << std::endl;
+		return;
+	}
+
+	if(skinInfo.GetClip(clipName) == nullptr)
+	{
+		out << "No clip named " << clipName << "\n" << std::endl;
+		return;
+	}
+
+	const UINT numBones = skinInfo.BoneCount();
+	const UINT numVertices = (UINT)vertices.size();
+	const UINT numPoses = 1000;
+	const UINT numSkinPasses = 20;
+	const float duration = skinInfo.GetClipEndTime(clipName);
+
+	std::vector<XMFLOAT4X4> scratch(numBones);
+	std::vector<XMFLOAT4X4> finalTransforms(numBones);
+	std::vector<DualQuaternion> finalDualQuats(numBones);
+	std::vector<CpuSkinnedVertex> linearOutput(numVertices);
+	std::vector<CpuSkinnedVertex> dualQuatOutput(numVertices);
+	float sink = 0.0f;
+
+	double matrixPaletteMs = BenchmarkTimer::TimeMs([&]()
+	{
+		for(UINT i = 0; i < numPoses; ++i)
+		{
+			skinInfo.GetFinalTransforms(clipName, duration*i/numPoses, scratch.data(), finalTransforms.data());
+			sink += finalTransforms[numBones-1]._41;
+		}
+	});
+
+	double dualQuatPaletteMs = BenchmarkTimer::TimeMs([&]()
+	{
+		for(UINT i = 0; i < numPoses; ++i)
+		{
+			skinInfo.GetFinalDualQuaternions(clipName, duration*i/numPoses, scratch.data(), finalDualQuats.data());
+			sink += finalDualQuats[numBones-1].Dual.x;
+		}
+	});
+
+	// Skinning throughput for a pose in the middle of the clip.
+	skinInfo.GetFinalTransforms(clipName, 0.5f*duration, scratch.data(), finalTransforms.data());
+	skinInfo.GetFinalDualQuaternions(clipName, 0.5f*duration, scratch.data(), finalDualQuats.data());
+
+	double linearMs = BenchmarkTimer::TimeMs([&]()
+	{
+		for(UINT pass = 0; pass < numSkinPasses; ++pass)
+		{
+			CpuSkinner::SkinLinear(vertices.data(), numVertices, finalTransforms.data(), linearOutput.data());
+			sink += linearOutput[pass % numVertices].Pos.x;
+		}
+	}) / numSkinPasses;
+
+	double dualQuatMs = BenchmarkTimer::TimeMs([&]()
+	{
+		for(UINT pass = 0; pass < numSkinPasses; ++pass)
+		{
+			CpuSkinner::SkinDualQuaternion(vertices.data(), numVertices, finalDualQuats.data(), dualQuatOutput.data());
+			sink += dualQuatOutput[pass % numVertices].Pos.x;
+		}
+	}) / numSkinPasses;
+
+	// Compare the two paths over the whole clip.  A vertex bound to a single
+	// bone sees the same rigid transform either way; blended vertices are
+	// where the two methods are meant to differ.
+	float paletteError = 0.0f;
+	float rigidError = 0.0f;
+	float blendedError = 0.0f;
+	float normalError = 0.0f;
+	UINT rigidCount = 0;
+	for(UINT i = 0; i < numVertices; ++i)
+	{
+		if(vertices[i].BoneWeights.x >= 0.999f)
+			++rigidCount;
+	}
+
+	const UINT numChecks = 20;
+	for(UINT k = 0; k < numChecks; ++k)
+	{
+		float t = duration*k/numChecks;
+		skinInfo.GetFinalTransforms(clipName, t, scratch.data(), finalTransforms.data());
+		skinInfo.GetFinalDualQuaternions(clipName, t, scratch.data(), finalDualQuats.data());
+
+		for(UINT b = 0; b < numBones; ++b)
+		{
+			XMFLOAT4X4 M;
+			XMStoreFloat4x4(&M, XMMatrixTranspose(finalDualQuats[b].ToMatrix()));
+			for(int r = 0; r < 4; ++r)
+			{
+				for(int c = 0; c < 4; ++c)
+				{
+					paletteError = MathHelper::Max(paletteError, fabsf(M.m[r][c] - finalTransforms[b].m[r][c]));
+				}
+			}
+		}
+
+		CpuSkinner::SkinLinear(vertices.data(), numVertices, finalTransforms.data(), linearOutput.data());
+		CpuSkinner::SkinDualQuaternion(vertices.data(), numVertices, finalDualQuats.data(), dualQuatOutput.data());
+
+		for(UINT i = 0; i < numVertices; ++i)
+		{
+			XMVECTOR diff = XMVectorSubtract(XMLoadFloat3(&linearOutput[i].Pos), XMLoadFloat3(&dualQuatOutput[i].Pos));
+			float error = XMVectorGetX(XMVector3Length(diff));
+
+			if(vertices[i].BoneWeights.x >= 0.999f)
+			{
+				rigidError = MathHelper::Max(rigidError, error);
+
+				diff = XMVectorSubtract(XMLoadFloat3(&linearOutput[i].Normal), XMLoadFloat3(&dualQuatOutput[i].Normal));
+				normalError = MathHelper::Max(normalError, XMVectorGetX(XMVector3Length(diff)));
+			}
+			else
+			{
+				blendedError = MathHelper::Max(blendedError, error);
+			}
+		}
+	}
+
+	const UINT matrixBytes = numBones*sizeof(XMFLOAT4X4);
+	const UINT dualQuatBytes = numBones*sizeof(DualQuaternion);
+
+	out << "Dual quaternion skinning, " << m3dFilename << " (" << numBones << " bones, "
+		<< numVertices << " vertices, " << rigidCount << " bound to one bone)\n";
+	out << std::setw(16) << "palette" << std::setw(14) << "bytes/char" << std::setw(14) << "cbuffer"
+		<< std::setw(14) << "us/palette" << std::setw(14) << "ms/skin" << std::setw(14) << "Mverts/s" << "\n";
+	out << std::setw(16) << "matrix"
+		<< std::setw(14) << matrixBytes
+		<< std::setw(14) << d3dUtil::CalcConstantBufferByteSize(96*sizeof(XMFLOAT4X4))
+		<< std::setw(14) << std::fixed << std::setprecision(2) << matrixPaletteMs*1000.0/numPoses
+		<< std::setw(14) << std::setprecision(3) << linearMs
+		<< std::setw(14) << std::setprecision(2) << numVertices / (linearMs*1000.0) << "\n";
+	out << std::setw(16) << "dual quaternion"
+		<< std::setw(14) << dualQuatBytes
+		<< std::setw(14) << d3dUtil::CalcConstantBufferByteSize(192*sizeof(XMFLOAT4))
+		<< std::setw(14) << std::setprecision(2) << dualQuatPaletteMs*1000.0/numPoses
+		<< std::setw(14) << std::setprecision(3) << dualQuatMs
+		<< std::setw(14) << std::setprecision(2) << numVertices / (dualQuatMs*1000.0) << "\n";
+
+	BenchmarkTimer::DoNotOptimize(sink);
+	out << std::setprecision(6)
+		<< "Max palette round trip error:        " << paletteError << "\n"
+		<< "Max position difference, one bone:   " << rigidError << "\n"
+		<< "Max normal difference, one bone:     " << normalError << "\n"
+		<< "Max position difference, blended:    " << blendedError << "\n" << std::endl;
+}
+
+void AnimBenchmark::CpuSkinning(std::ostream& out, const std::string& m3dFilename, const std::string& clipName)
+{
+	std::vector<M3DLoader::SkinnedVertex> vertices;
+	std::vector<USHORT> indices;
+	std::vector<M3DLoader::Subset> subsets;
+	std::vector<M3DLoader::M3dMaterial> mats;
+	SkinnedData skinInfo;
+
+	M3DLoader m3dLoader;
+	if( !m3dLoader.LoadM3d(m3dFilename, vertices, indices, subsets, mats, skinInfo) )
+	{
+		out << "Could not load " << m3dFilename << "\n" << std::endl;
+		return;
+	}
+
+	if(skinInfo.GetClip(clipName) == nullptr)
+	{
+		out << "No clip named " << clipName << "\n" << std::endl;
+		return;
+	}
+
+	const UINT numBones = skinInfo.BoneCount();
+	const UINT numVertices = (UINT)vertices.size();
+	const UINT numPasses = 50;
+	const float duration = skinInfo.GetClipEndTime(clipName);
+
+	std::vector<XMFLOAT4X4> scratch(numBones);
+	std::vector<XMFLOAT4X4> finalTransforms(numBones);
+	std::vector<CpuSkinnedVertex> reference(numVertices);
+	std::vector<CpuSkinnedVertex> output(numVertices);
+	float sink = 0.0f;
+
+	skinInfo.GetFinalTransforms(clipName, 0.5f*duration, scratch.data(), finalTransforms.data());
+
+	double referenceMs = BenchmarkTimer::TimeMs([&]()
+	{
+		for(UINT pass = 0; pass < numPasses; ++pass)
+		{
+			CpuSkinner::SkinLinear(vertices.data(), numVertices, finalTransforms.data(), reference.data());
+			sink += reference[pass % numVertices].Pos.x;
+		}
+	}) / numPasses;
+
+	BoundingBox referenceBounds;
+	BoundingBox::CreateFromPoints(referenceBounds, numVertices, &reference[0].Pos, sizeof(CpuSkinnedVertex));
+
+	std::vector<UINT> threadCounts;
+	const UINT hardwareThreads = MathHelper::Max(1u, std::thread::hardware_concurrency());
+	for(UINT n = 1; n < hardwareThreads; n *= 2)
+	{
+		threadCounts.push_back(n);
+	}
+	threadCounts.push_back(hardwareThreads);
+
+	out << "CPU skinning, " << m3dFilename << " (" << numVertices << " vertices, " << numBones << " bones)\n";
+	out << std::setw(12) << "threads" << std::setw(12) << "ms/mesh" << std::setw(12) << "Mverts/s"
+		<< std::setw(16) << "Mverts/s/core" << std::setw(14) << "max error" << std::setw(14) << "bounds error" << "\n";
+	out << std::setw(12) << "reference" << std::setw(12) << std::fixed << std::setprecision(3) << referenceMs
+		<< std::setw(12) << std::setprecision(2) << numVertices / (referenceMs*1000.0)
+		<< std::setw(16) << numVertices / (referenceMs*1000.0) << "\n";
+
+	for(UINT threadCount : threadCounts)
+	{
+		ThreadPool threadPool(threadCount);
+		CpuSkinner skinner;
+		skinner.Initialize(&threadPool);
+
+		BoundingBox bounds;
+		double ms = BenchmarkTimer::TimeMs([&]()
+		{
+			for(UINT pass = 0; pass < numPasses; ++pass)
+			{
+				skinner.Skin(vertices.data(), numVertices, finalTransforms.data(), output.data(), bounds);
+				sink += bounds.Extents.y;
+			}
+		}) / numPasses;
+
+		float maxError = 0.0f;
+		for(UINT i = 0; i < numVertices; ++i)
+		{
+			const float* a = &reference[i].Pos.x;
+			const float* b = &output[i].Pos.x;
+			for(int k = 0; k < 9; ++k)
+			{
+				maxError = MathHelper::Max(maxError, fabsf(a[k] - b[k]));
+			}
+		}
+
+		XMVECTOR boundsDiff = XMVectorAdd(
+			XMVectorAbs(XMVectorSubtract(XMLoadFloat3(&bounds.Center), XMLoadFloat3(&referenceBounds.Center))),
+			XMVectorAbs(XMVectorSubtract(XMLoadFloat3(&bounds.Extents), XMLoadFloat3(&referenceBounds.Extents))));
+		float boundsError = MathHelper::Max(XMVectorGetX(boundsDiff), 
+			MathHelper::Max(XMVectorGetY(boundsDiff), XMVectorGetZ(boundsDiff)));
+
+		double mvertsPerSec = numVertices / (ms*1000.0);
+		BenchmarkTimer::DoNotOptimize(sink);
+		out << std::setw(12) << threadCount
+			<< std::setw(12) << std::setprecision(3) << ms
+			<< std::setw(12) << std::setprecision(2) << mvertsPerSec
+			<< std::setw(16) << mvertsPerSec / threadCount
+			<< std::setw(14) << std::setprecision(6) << maxError
+			<< std::setw(14) << boundsError << "\n";
+	}
+
+	out << std::endl;
+}
+
+void AnimBenchmark::PaletteCompaction(std::ostream& out, const std::string& m3dFilename, const std::string& clipName)
+{
+	std::vector<M3DLoader::SkinnedVertex> vertices;
+	std::vector<USHORT> indices;
+	std::vector<M3DLoader::Subset> subsets;
+	std::vector<M3DLoader::M3dMaterial> mats;
+	SkinnedData skinInfo;
+
+	M3DLoader m3dLoader;
+	if( !m3dLoader.LoadM3d(m3dFilename, vertices, indices, subsets, mats, skinInfo) )
+	{
+		out << "Could not load " << m3dFilename << "\n" << std::endl;
+		return;
+	}
+
+	if(skinInfo.GetClip(clipName) == nullptr)
+	{
+		out << "No clip named " << clipName << "\n" << std::endl;
+		return;
+	}
+
+	const UINT numBones = skinInfo.BoneCount();
+	const UINT numVertices = (UINT)vertices.size();
+	const UINT numPoses = 1000;
+	const float duration = skinInfo.GetClipEndTime(clipName);
+
+	std::vector<M3DLoader::SkinnedVertex> perSubsetVertices = vertices;
+	std::vector<M3DLoader::SkinnedVertex> mergedVertices = vertices;
+
+	SubsetPalettes perSubset;
+	SubsetPalettes merged;
+	if( !perSubset.Build(perSubsetVertices, indices, subsets, numBones, false) ||
+		!merged.Build(mergedVertices, indices, subsets, numBones, true) )
+	{
+		out << "Could not build subset palettes for " << m3dFilename << "\n" << std::endl;
+		return;
+	}
+
+	out << "Palette compaction, " << m3dFilename << " (" << numBones << " bones, " << subsets.size() << " subsets)\n";
+	out << std::setw(10) << "subset" << std::setw(12) << "vertices" << std::setw(10) << "bones"
+		<< std::setw(16) << "merged palette" << "\n";
+	for(UINT s = 0; s < subsets.size(); ++s)
+	{
+		out << std::setw(10) << s
+			<< std::setw(12) << subsets[s].VertexCount
+			<< std::setw(10) << perSubset.GetPaletteBones(perSubset.GetPaletteIndex(s)).size()
+			<< std::setw(16) << merged.GetPaletteIndex(s) << "\n";
+	}
+
+	// Skin every subset with its compacted palette and compare against the
+	// full palette.
+	std::vector<XMFLOAT4X4> scratch(numBones);
+	std::vector<XMFLOAT4X4> finalTransforms(numBones);
+	std::vector<XMFLOAT4X4> palette(numBones);
+	std::vector<CpuSkinnedVertex> reference(numVertices);
+	std::vector<CpuSkinnedVertex> compacted(numVertices);
+
+	skinInfo.GetFinalTransforms(clipName, 0.5f*duration, scratch.data(), finalTransforms.data());
+	CpuSkinner::SkinLinear(vertices.data(), numVertices, finalTransforms.data(), reference.data());
+
+	float maxError[2] = { 0.0f, 0.0f };
+	const SubsetPalettes* layouts[2] = { &perSubset, &merged };
+	const std::vector<M3DLoader::SkinnedVertex>* layoutVertices[2] = { &perSubsetVertices, &mergedVertices };
+	for(int k = 0; k < 2; ++k)
+	{
+		for(UINT s = 0; s < subsets.size(); ++s)
+		{
+			layouts[k]->Gather(layouts[k]->GetPaletteIndex(s), finalTransforms.data(), palette.data());
+
+			const UINT start = subsets[s].VertexStart;
+			CpuSkinner::SkinLinear(&(*layoutVertices[k])[start], subsets[s].VertexCount, palette.data(), &compacted[start]);
+		}
+
+		for(UINT i = 0; i < numVertices; ++i)
+		{
+			const float* a = &reference[i].Pos.x;
+			const float* b = &compacted[i].Pos.x;
+			for(int c = 0; c < 9; ++c)
+			{
+				maxError[k] = MathHelper::Max(maxError[k], fabsf(a[c] - b[c]));
+			}
+		}
+	}
+
+	// Cost of gathering the palettes out of the full one.
+	float sink = 0.0f;
+	double gatherMs[2];
+	for(int k = 0; k < 2; ++k)
+	{
+		gatherMs[k] = BenchmarkTimer::TimeMs([&]()
+		{
+			for(UINT i = 0; i < numPoses; ++i)
+			{
+				for(UINT p = 0; p < layouts[k]->PaletteCount(); ++p)
+				{
+					layouts[k]->Gather(p, finalTransforms.data(), palette.data());
+					sink += palette[0]._11;
+				}
+			}
+		});
+	}
+
+	const UINT matrixBytes = sizeof(XMFLOAT4X4);
+	const UINT dualQuatBytes = sizeof(DualQuaternion);
+
+	out << "Palette bytes written per character per frame:\n";
+	out << std::setw(28) << "layout" << std::setw(10) << "palettes" << std::setw(10) << "bones"
+		<< std::setw(10) << "matrix" << std::setw(10) << "dual quat" << std::setw(14) << "gather us" << std::setw(12) << "max error" << "\n";
+	out << std::setw(28) << "SkinnedConstants copy" << std::setw(10) << 1 << std::setw(10) << 96
+		<< std::setw(10) << 96*matrixBytes << std::setw(10) << 96*dualQuatBytes << "\n";
+	out << std::setw(28) << "full skeleton" << std::setw(10) << 1 << std::setw(10) << numBones
+		<< std::setw(10) << numBones*matrixBytes << std::setw(10) << numBones*dualQuatBytes << "\n";
+
+	const char* names[2] = { "per subset", "merged subsets" };
+	for(int k = 0; k < 2; ++k)
+	{
+		UINT bones = layouts[k]->TotalPaletteBones();
+		BenchmarkTimer::DoNotOptimize(sink);
+		out << std::setw(28) << names[k]
+			<< std::setw(10) << layouts[k]->PaletteCount()
+			<< std::setw(10) << bones
+			<< std::setw(10) << bones*matrixBytes
+			<< std::setw(10) << bones*dualQuatBytes
+			<< std::setw(14) << std::fixed << std::setprecision(3) << gatherMs[k]*1000.0/numPoses
+			<< std::setw(12) << std::setprecision(6) << maxError[k] << "\n";
+	}
+
+	out << std::endl;
+}
+
+void AnimBenchmark::HierarchyEvaluation(std::ostream& out)
+{
+	const UINT boneCounts[] = { 64, 256, 1024, 4096, 16384 };
+	const UINT numPoses = 200;
+
+	const UINT hardwareThreads = MathHelper::Max(1u, std::thread::hardware_concurrency());
+	ThreadPool threadPool(hardwareThreads);
+
+	out << "Hierarchy evaluation, us per pose (" << hardwareThreads << " threads for the parallel pass)\n";
+	out << std::setw(8) << "shape" << std::setw(8) << "bones" << std::setw(8) << "levels"
+		<< std::setw(14) << "parent-first" << std::setw(14) << "shuffled" << std::setw(14) << "parallel"
+		<< std::setw(12) << "max error" << "\n";
+
+	std::unordered_map<std::string, AnimationClip> noClips;
+	float sink = 0.0f;
+
+	for(int wide = 0; wide < 2; ++wide)
+	{
+		for(UINT boneCount : boneCounts)
+		{
+			std::vector<int> hierarchy = MakeHierarchy(boneCount, wide != 0);
+			std::vector<XMFLOAT4X4> offsets(boneCount);
+			std::vector<XMFLOAT4X4> toParent(boneCount);
+			for(UINT i = 0; i < boneCount; ++i)
+			{
+				offsets[i] = MakeBoneTransform();
+				toParent[i] = MakeBoneTransform();
+			}
+
+			SkinnedData ordered;
+			ordered.Set(hierarchy, offsets, noClips);
+
+			// The same skeleton with the bones in random order (bone 0 stays the root).
+			std::vector<UINT> newIndex(boneCount);
+			for(UINT i = 0; i < boneCount; ++i)
+			{
+				newIndex[i] = i;
+			}
+			for(UINT i = boneCount - 1; i > 1; --i)
+			{
+				std::swap(newIndex[i], newIndex[MathHelper::Rand(1, i)]);
+			}
+
+			std::vector<int> shuffledHierarchy(boneCount);
+			std::vector<XMFLOAT4X4> shuffledOffsets(boneCount);
+			std::vector<XMFLOAT4X4> shuffledToParent(boneCount);
+			for(UINT i = 0; i < boneCount; ++i)
+			{
+				shuffledHierarchy[newIndex[i]] = hierarchy[i] >= 0 ? newIndex[hierarchy[i]] : -1;
+				shuffledOffsets[newIndex[i]] = offsets[i];
+				shuffledToParent[newIndex[i]] = toParent[i];
+			}
+
+			SkinnedData shuffled;
+			shuffled.Set(shuffledHierarchy, shuffledOffsets, noClips);
+
+			std::vector<XMFLOAT4X4> orderedFinal(boneCount);
+			std::vector<XMFLOAT4X4> shuffledFinal(boneCount);
+			std::vector<XMFLOAT4X4> parallelFinal(boneCount);
+
+			double orderedUs = BenchmarkTimer::TimeMs([&]()
+			{
+				for(UINT i = 0; i < numPoses; ++i)
+				{
+					ordered.ComputeFinalTransforms(toParent, orderedFinal);
+					sink += orderedFinal[boneCount-1]._41;
+				}
+			}) * 1000.0 / numPoses;
+
+			double shuffledUs = BenchmarkTimer::TimeMs([&]()
+			{
+				for(UINT i = 0; i < numPoses; ++i)
+				{
+					shuffled.ComputeFinalTransforms(shuffledToParent, shuffledFinal);
+					sink += shuffledFinal[boneCount-1]._41;
+				}
+			}) * 1000.0 / numPoses;
+
+			double parallelUs = BenchmarkTimer::TimeMs([&]()
+			{
+				for(UINT i = 0; i < numPoses; ++i)
+				{
+					shuffled.ComputeFinalTransforms(shuffledToParent, parallelFinal, &threadPool);
+					sink += parallelFinal[boneCount-1]._41;
+				}
+			}) * 1000.0 / numPoses;
+
+			float maxError = 0.0f;
+			for(UINT i = 0; i < boneCount; ++i)
+			{
+				for(int r = 0; r < 4; ++r)
+				{
+					for(int c = 0; c < 4; ++c)
+					{
+						float a = orderedFinal[i].m[r][c];
+						maxError = MathHelper::Max(maxError, fabsf(a - shuffledFinal[newIndex[i]].m[r][c]));
+						maxError = MathHelper::Max(maxError, fabsf(a - parallelFinal[newIndex[i]].m[r][c]));
+					}
+				}
+			}
+
+			BenchmarkTimer::DoNotOptimize(sink);
+			out << std::setw(8) << (wide ? "wide" : "deep")
+				<< std::setw(8) << boneCount
+				<< std::setw(8) << shuffled.LevelCount()
+				<< std::setw(14) << std::fixed << std::setprecision(2) << orderedUs
+				<< std::setw(14) << shuffledUs
+				<< std::setw(14) << parallelUs
+				<< std::setw(12) << std::setprecision(6) << maxError << "\n";
+		}
+	}
+
+	out << std::endl;
+}
+
+void AnimBenchmark::CrowdLod(std::ostream& out, const std::string& m3dFilename, const std::string& clipName)
+{
+	std::vector<M3DLoader::SkinnedVertex> vertices;
+	std::vector<USHORT> indices;
+	std::vector<M3DLoader::Subset> subsets;
+	std::vector<M3DLoader::M3dMaterial> mats;
+	SkinnedData skinInfo;
+
+	M3DLoader m3dLoader;
+	if( !m3dLoader.LoadM3d(m3dFilename, vertices, indices, subsets, mats, skinInfo) )
+	{
+		out << "Could not load " << m3dFilename << "\n" << std::endl;
+		return;
+	}
+
+	if(skinInfo.GetClip(clipName) == nullptr)
+	{
+		out << "No clip named " << clipName << "\n" << std::endl;
+		return;
+	}
+
+	const UINT numBones = skinInfo.BoneCount();
+	const UINT numVertices = (UINT)vertices.size();
+	const UINT numCharacters = 1000;
+	const UINT numFrames = 240;
+	const float dt = 1.0f / 60.0f;
+	const float duration = skinInfo.GetClipEndTime(clipName);
+	const float projScaleY = 1.0f / tanf(0.125f*MathHelper::Pi);   // 45 degree field of view
+	const float halfViewportHeight = 540.0f;                         // 1080p
+	const UINT paletteStride = numBones * sizeof(XMFLOAT4X4);
+
+	BoundingBox meshBounds;
+	BoundingBox::CreateFromPoints(meshBounds, numVertices, &vertices[0].Pos, sizeof(M3DLoader::SkinnedVertex));
+	const float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&meshBounds.Extents)));
+
+	// Camera at the origin looking down +z; the crowd fills the view from a
+	// couple of body lengths out to about 80 of them.
+	std::vector<BoundingSphere> bounds(numCharacters);
+	std::vector<float> startTimes(numCharacters);
+	for(UINT i = 0; i < numCharacters; ++i)
+	{
+		float z = MathHelper::RandF(2.0f*radius, 80.0f*radius);
+		float x = MathHelper::RandF(-0.4f*z, 0.4f*z);
+		bounds[i].Center = XMFLOAT3(x + meshBounds.Center.x, meshBounds.Center.y, z + meshBounds.Center.z);
+		bounds[i].Radius = radius;
+		startTimes[i] = MathHelper::RandF(0.0f, duration);
+	}
+
+	const UINT boneLodCount = skinInfo.BoneLodCount();
+	out << "Animation LOD, " << m3dFilename << ", " << numCharacters << " characters, " << numBones << " bones\n";
+	out << "Bones sampled per bone LOD:";
+	for(UINT lod = 0; lod < boneLodCount; ++lod)
+	{
+		out << " " << skinInfo.SampledBoneCount(lod);
+	}
+	out << "\n";
+
+	const std::vector<AnimationLodLevel> fullRate = { { 0.0f, 1, 0 } };
+	const std::vector<AnimationLodLevel> rateOnly =
+	{
+		{ 0.25f, 1, 0 },
+		{ 0.10f, 2, 0 },
+		{ 0.00f, 4, 0 }
+	};
+	const std::vector<AnimationLodLevel> levels =
+	{
+		{ 0.25f, 1, 0 },
+		{ 0.10f, 2, 1 },
+		{ 0.04f, 4, 2 },
+		{ 0.00f, 4, 3 }
+	};
+
+	struct Config
+	{
+		const char* Name;
+		const std::vector<AnimationLodLevel>* Levels;
+		UINT MaxBonesPerFrame;
+	};
+	const Config configs[] =
+	{
+		{ "full rate", &fullRate, 0 },
+		{ "rate only", &rateOnly, 0 },
+		{ "LOD", &levels, 0 },
+		{ "LOD+budget", &levels, 12000 },
+	};
+
+	ThreadPool threadPool(1);
+	std::vector<BYTE> palettes((size_t)paletteStride * numCharacters);
+	std::vector<BYTE> exactPalettes((size_t)paletteStride * numCharacters);
+	std::vector<CpuSkinnedVertex> exactVertices(numVertices);
+	std::vector<CpuSkinnedVertex> lodVertices(numVertices);
+	const XMVECTOR eyePos = XMVectorZero();
+
+	out << std::setw(12) << "config" << std::setw(12) << "bones/frm" << std::setw(10) << "worst"
+		<< std::setw(12) << "poses/frm" << std::setw(10) << "ms/frm" << std::setw(10) << "deferred"
+		<< std::setw(12) << "max error" << std::setw(12) << "max pixels" << std::setw(10) << "speedup" << "\n";
+
+	double fullRateMs = 0.0;
+	for(const Config& config : configs)
+	{
+		AnimationLod lod;
+		lod.Initialize(*config.Levels, config.MaxBonesPerFrame);
+
+		AnimationBatch batch;
+		batch.Initialize(&threadPool, numBones);
+
+		// A second crowd at full rate, in step with the first, as the reference.
+		AnimationLod exactLod;
+		exactLod.Initialize(fullRate, 0);
+		AnimationBatch exactBatch;
+		exactBatch.Initialize(&threadPool, numBones);
+
+		std::vector<AnimatedCharacter> characters(numCharacters);
+		for(UINT i = 0; i < numCharacters; ++i)
+		{
+			characters[i].SkinnedInfo = &skinInfo;
+			characters[i].ClipName = clipName;
+			characters[i].TimePos = startTimes[i];
+		}
+		std::vector<AnimatedCharacter> exactCharacters = characters;
+
+		UINT64 totalBones = 0;
+		UINT64 totalPoses = 0;
+		UINT64 totalDeferred = 0;
+		UINT worstBones = 0;
+		double ms = 0.0;
+		float maxError = 0.0f;
+		float maxPixelError = 0.0f;
+
+		for(UINT frame = 0; frame < numFrames; ++frame)
+		{
+			ms += BenchmarkTimer::TimeMs([&]()
+			{
+				lod.Select(characters.data(), numCharacters, bounds.data(), eyePos, projScaleY);
+				batch.Update(characters.data(), numCharacters, dt, palettes.data(), paletteStride);
+			});
+
+			totalBones += batch.BonesEvaluated();
+			totalPoses += batch.PosesEvaluated();
+			totalDeferred += lod.DeferredPoses();
+			// Every character is evaluated on the first frame, having no history.
+			if(frame > 0)
+				worstBones = MathHelper::Max(worstBones, batch.BonesEvaluated());
+
+			exactLod.Select(exactCharacters.data(), numCharacters, bounds.data(), eyePos, projScaleY);
+			exactBatch.Update(exactCharacters.data(), numCharacters, dt, exactPalettes.data(), paletteStride);
+
+			// Skin a sample of the crowd with both palettes every few frames.
+			if(frame % 8 != 7)
+				continue;
+
+			for(UINT i = frame % 50; i < numCharacters; i += 50)
+			{
+				CpuSkinner::SkinLinear(vertices.data(), numVertices,
+					reinterpret_cast<const XMFLOAT4X4*>(&exactPalettes[(size_t)i*paletteStride]), exactVertices.data());
+				CpuSkinner::SkinLinear(vertices.data(), numVertices,
+					reinterpret_cast<const XMFLOAT4X4*>(&palettes[(size_t)i*paletteStride]), lodVertices.data());
+
+				float error = 0.0f;
+				for(UINT v = 0; v < numVertices; ++v)
+				{
+					XMVECTOR diff = XMVectorSubtract(XMLoadFloat3(&exactVertices[v].Pos), XMLoadFloat3(&lodVertices[v].Pos));
+					error = MathHelper::Max(error, XMVectorGetX(XMVector3Length(diff)));
+				}
+
+				// What it looks like on screen at the character's distance.
+				maxError = MathHelper::Max(maxError, error);
+				maxPixelError = MathHelper::Max(maxPixelError, error * projScaleY / bounds[i].Center.z * halfViewportHeight);
+			}
+		}
+
+		ms /= numFrames;
+		if(config.Levels == &fullRate)
+			fullRateMs = ms;
+
+		out << std::setw(12) << config.Name
+			<< std::setw(12) << totalBones / numFrames
+			<< std::setw(10) << worstBones
+			<< std::setw(12) << totalPoses / numFrames
+			<< std::setw(10) << std::fixed << std::setprecision(3) << ms
+			<< std::setw(10) << totalDeferred / numFrames
+			<< std::setw(12) << std::setprecision(4) << maxError
+			<< std::setw(12) << std::setprecision(2) << maxPixelError
+			<< std::setw(9) << std::setprecision(1) << fullRateMs / ms << "x\n";
+
+		if(config.Levels != &fullRate && config.MaxBonesPerFrame == 0)
+		{
+			out << std::setw(12) << "" << "  characters per level:";
+			for(UINT l = 0; l < lod.LevelCount(); ++l)
+			{
+				out << " " << lod.CharactersAtLevel(l);
+			}
+			out << "\n";
+		}
+	}
+
+	out << "Max error is in model units (the mesh is " << std::setprecision(1) << 2.0f*meshBounds.Extents.y
+		<< " units tall), max pixels at 1080p.\n" << std::endl;
+}
+
+void AnimBenchmark::VertexAnimationBaking(std::ostream& out, const std::string& m3dFilename, const std::string& clipName)
+{
+	std::vector<M3DLoader::SkinnedVertex> vertices;
+	std::vector<USHORT> indices;
+	std::vector<M3DLoader::Subset> subsets;
+	std::vector<M3DLoader::M3dMaterial> mats;
+	SkinnedData skinInfo;
+
+	M3DLoader m3dLoader;
+	if( !m3dLoader.LoadM3d(m3dFilename, vertices, indices, subsets, mats, skinInfo) )
+	{
+		out << "Could not load " << m3dFilename << "\n" << std::endl;
+		return;
+	}
+
+	if(skinInfo.GetClip(clipName) == nullptr)
+	{
+		out << "No clip named " << clipName << "\n" << std::endl;
+		return;
+	}
+
+	const UINT numBones = skinInfo.BoneCount();
+	const UINT numVertices = (UINT)vertices.size();
+	const float duration = skinInfo.GetClipEndTime(clipName);
+	const UINT numSamples = 16;
+
+	std::vector<XMFLOAT4X4> scratch(numBones);
+	std::vector<XMFLOAT4X4> finalTransforms(numBones);
+	std::vector<CpuSkinnedVertex> exact(numVertices);
+
+	out << "Vertex animation baking, " << m3dFilename << " (" << numVertices << " vertices, "
+		<< numBones << " bones, " << duration << " s)\n";
+	out << std::setw(8) << "fps" << std::setw(10) << "bake ms" << std::setw(14) << "texture"
+		<< std::setw(10) << "KB" << std::setw(14) << "max pos err" << std::setw(14) << "max normal" << "\n";
+
+	size_t textureBytes30 = 0;
+	const float frameRates[] = { 15.0f, 30.0f, 60.0f };
+	for(float frameRate : frameRates)
+	{
+		VertexAnimationTexture vat;
+		bool baked = false;
+		double bakeMs = BenchmarkTimer::TimeMs([&]()
+		{
+			baked = VertexAnimationBaker::Bake(skinInfo, clipName, vertices, frameRate, vat);
+		});
+
+		if(!baked)
+		{
+			out << std::setw(8) << frameRate << "  does not fit in a texture\n";
+			continue;
+		}
+
+		if(frameRate == 30.0f)
+			textureBytes30 = vat.ByteSize();
+
+		// Sample between frames, where playback blends and the error is largest.
+		float maxPosError = 0.0f;
+		float minNormalCos = 1.0f;
+		for(UINT sample = 0; sample < numSamples; ++sample)
+		{
+			float t = (sample + 0.37f) * duration / numSamples;
+			skinInfo.GetFinalTransforms(clipName, t, scratch.data(), finalTransforms.data());
+			CpuSkinner::SkinLinear(vertices.data(), numVertices, finalTransforms.data(), exact.data());
+
+			for(UINT v = 0; v < numVertices; ++v)
+			{
+				XMFLOAT3 pos, normal;
+				VertexAnimationBaker::SampleVertex(vat, v, t, pos, normal);
+
+				XMVECTOR diff = XMVectorSubtract(XMLoadFloat3(&pos), XMLoadFloat3(&exact[v].Pos));
+				maxPosError = MathHelper::Max(maxPosError, XMVectorGetX(XMVector3Length(diff)));
+
+				XMVECTOR exactNormal = XMVector3Normalize(XMLoadFloat3(&exact[v].Normal));
+				minNormalCos = MathHelper::Min(minNormalCos, XMVectorGetX(XMVector3Dot(exactNormal, XMLoadFloat3(&normal))));
+			}
+		}
+
+		out << std::setw(8) << std::fixed << std::setprecision(0) << frameRate
+			<< std::setw(10) << std::setprecision(1) << bakeMs
+			<< std::setw(8) << vat.Width << " x " << std::setw(3) << vat.Height()
+			<< std::setw(10) << vat.ByteSize() / 1024
+			<< std::setw(14) << std::setprecision(4) << maxPosError
+			<< std::setw(11) << std::setprecision(2)
+			<< XMConvertToDegrees(acosf(MathHelper::Clamp(minNormalCos, -1.0f, 1.0f))) << " deg\n";
+	}
+
+	// A crowd on palettes uploads every character's palette every frame; a
+	// baked crowd uploads nothing per frame (or just its instance data, if
+	// the characters move) after the one texture.
+	const UINT crowdSizes[] = { 100, 1000, 10000 };
+	const double matrixPaletteBytes = numBones * sizeof(XMFLOAT4X4);
+	const double dualQuatPaletteBytes = numBones * sizeof(DualQuaternion);
+	const double instanceBytes = sizeof(XMFLOAT4X4) + sizeof(float);
+
+	out << "Upload per second at 60 Hz, against a " << textureBytes30 / 1024 << " KB texture baked at 30 fps\n";
+	out << std::setw(12) << "characters" << std::setw(14) << "matrix MB/s" << std::setw(14) << "dq MB/s"
+		<< std::setw(16) << "instance MB/s" << std::setw(18) << "break-even frames" << "\n";
+	for(UINT crowdSize : crowdSizes)
+	{
+		const double matrixPerFrame = crowdSize * matrixPaletteBytes;
+		out << std::setw(12) << crowdSize
+			<< std::setw(14) << std::setprecision(2) << matrixPerFrame * 60.0 / (1024.0*1024.0)
+			<< std::setw(14) << crowdSize * dualQuatPaletteBytes * 60.0 / (1024.0*1024.0)
+			<< std::setw(16) << crowdSize * instanceBytes * 60.0 / (1024.0*1024.0)
+			<< std::setw(18) << std::setprecision(1) << textureBytes30 / matrixPerFrame << "\n";
+	}
+
+	out << std::endl;
+}
@@ -0,0 +1,84 @@
+#ifndef ANIMBENCHMARK_H
+#define ANIMBENCHMARK_H
+
+#include "SkinnedData.h"
+
+///<summary>
+/// Headless timings for the CPU side of the skinned animation pipeline.
+/// Nothing here needs a device, so the results can be collected from a
+/// console/test harness or dumped to a text file from the demo, e.g.:
+///
+///    std::ofstream fout("AnimBenchmark.txt");
+///    AnimBenchmark::KeyframeLookup(fout);
+///</summary>
+class AnimBenchmark
+{
+public:
+	// Per-sample cost of BoneAnimation keyframe lookup for clips of increasing
+	// length: the original linear scan, binary search, a playback cursor and
+	// keys resampled to a uniform rate.
+	static void KeyframeLookup(std::ostream& out);
+
+	// Per-pose cost of sampling a clip of an .m3d rig bone by bone
+	// (AnimationClip::Interpolate) versus four bones at a time from a
+	// PackedAnimationClip, plus the largest matrix error of the packed path.
+	static void BatchInterpolation(std::ostream& out, const std::string& m3dFilename, const std::string& clipName);
+
+	// CompressedAnimationClip at a few error budgets: compression ratio, the
+	// measured joint space error, and per-pose sampling cost next to the
+	// uncompressed clip.
+	static void ClipCompression(std::ostream& out, const std::string& m3dFilename, const std::string& clipName);
+
+	// Cost of a 1/2/4/8-way PoseBlender blend of the clip (layers sampled at
+	// staggered times, every other one masked to half the skeleton) against
+	// computing a full palette per clip with GetFinalTransforms.
+	static void PoseBlending(std::ostream& out, const std::string& m3dFilename, const std::string& clipName);
+
+	// Frame time of an AnimationBatch update for 1 to 1000 characters on 1, 2,
+	// 4, ... threads, writing palettes laid out like the SkinnedCB.
+	static void MultiCharacter(std::ostream& out, const std::string& m3dFilename, const std::string& clipName);
+
+	// A crowd of 1000 characters at random phases through a PoseCache, for a
+	// few time quanta: frame time, hit rate, evictions, memory, and the
+	// largest palette error against exact evaluation.
+	static void PoseCaching(std::ostream& out, const std::string& m3dFilename, const std::string& clipName);
+
+	// Matrix versus dual quaternion palettes for the rig's mesh, skinned with
+	// CpuSkinner: palette cost and upload size, skinning throughput, and how
+	// far dual quaternion skinning lands from linear blend skinning (rigidly
+	// bound vertices must agree; blended ones differ by design).
+	static void DualQuaternionSkinning(std::ostream& out, const std::string& m3dFilename, const std::string& clipName);
+
+	// CpuSkinner::Skin throughput on 1, 2, 4, ... threads in vertices per
+	// second (total and per thread) next to the one-influence-at-a-time
+	// reference, with the largest difference from the reference and its
+	// bounding box.
+	static void CpuSkinning(std::ostream& out, const std::string& m3dFilename, const std::string& clipName);
+
+	// SubsetPalettes for the rig's mesh: bones per subset, the palette bytes
+	// written per character per frame with full, per-subset and merged
+	// palettes, and a check that skinning with the compacted palettes gives
+	// the same vertices.
+	static void PaletteCompaction(std::ostream& out, const std::string& m3dFilename, const std::string& clipName);
+
+	// The hierarchy pass (ComputeFinalTransforms) on synthetic rigs of 64 to
+	// 16384 bones, deep and wide: parent-first order, the same rig with its
+	// bones shuffled (evaluated level by level), and the level pass split
+	// across a ThreadPool.
+	static void HierarchyEvaluation(std::ostream& out);
+
+	// A crowd of 1000 characters spread from near the camera to far away,
+	// updated through an AnimationLod at full rate, with LOD, and with LOD
+	// plus a bone budget: bones evaluated per frame (average, and worst after
+	// the first frame), frame time, and the largest vertex error against full
+	// rate evaluation, in model units and in pixels.
+	static void CrowdLod(std::ostream& out, const std::string& m3dFilename, const std::string& clipName);
+
+	// VertexAnimationBaker at 15, 30 and 60 frames per second: bake time,
+	// texture size, and how far the played back vertices are from skinning
+	// with the exact palette between frames; then the texture size against
+	// the palette upload it saves a crowd.
+	static void VertexAnimationBaking(std::ostream& out, const std::string& m3dFilename, const std::string& clipName);
+};
+
+#endif // ANIMBENCHMARK_H
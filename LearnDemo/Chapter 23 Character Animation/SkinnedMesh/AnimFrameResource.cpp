@@ -1,6 +1,7 @@
 #include "AnimFrameResource.h"
 
-AnimFrameResource::AnimFrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT skinnedObjectCount, UINT materialCount)
+AnimFrameResource::AnimFrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT skinnedObjectCount, UINT materialCount,
+    bool dualQuatPalettes)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
@@ -10,7 +11,10 @@ AnimFrameResource::AnimFrameResource(ID3D12Device* device, UINT passCount, UINT
     SsaoCB = std::make_unique<UploadBuffer<SsaoConstants>>(device, 1, true);
 	MaterialBuffer = std::make_unique<UploadBuffer<MaterialData>>(device, materialCount, false);
     ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
-    SkinnedCB = std::make_unique<UploadBuffer<SkinnedConstants>>(device, skinnedObjectCount, true);
+    if(dualQuatPalettes)
+        SkinnedDualQuatCB = std::make_unique<UploadBuffer<SkinnedDualQuatConstants>>(device, skinnedObjectCount, true);
+    else
+        SkinnedCB = std::make_unique<UploadBuffer<SkinnedConstants>>(device, skinnedObjectCount, true);
 }
 
 AnimFrameResource::~AnimFrameResource()
@@ -19,6 +19,37 @@ struct SkinnedConstants
     DirectX::XMFLOAT4X4 BoneTransforms[96];
 };
 
+// Same bones as a dual quaternion palette (SKINNED_DQ): real part of bone i
+// in BoneDualQuats[2*i], dual part in BoneDualQuats[2*i+1].
+struct SkinnedDualQuatConstants
+{
+    DirectX::XMFLOAT4 BoneDualQuats[192];
+};
+
+// Layout of a baked VertexAnimationTexture (VERTEX_ANIMATION), bound where
+// the palette would be.
+struct VertexAnimationConstants
+{
+    UINT Width = 0;
+    UINT RowsPerFrame = 0;
+    UINT FrameCount = 0;
+    float FrameRate = 0.0f;
+    float Duration = 0.0f;
+    UINT VatPad0;
+    UINT VatPad1;
+    UINT VatPad2;
+};
+
+// One character of a vertex animated crowd.
+struct VertexAnimationInstance
+{
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+    float TimeOffset = 0.0f;
+    UINT InstPad0;
+    UINT InstPad1;
+    UINT InstPad2;
+};
+
 struct PassConstants
 {
     DirectX::XMFLOAT4X4 View = MathHelper::Identity4x4();
@@ -105,7 +136,9 @@ struct AnimFrameResource
 {
 public:
     
-    AnimFrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT skinnedObjectCount, UINT materialCount);
+    // With dualQuatPalettes the skinned objects get a SkinnedDualQuatCB instead of a SkinnedCB.
+    AnimFrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT skinnedObjectCount, UINT materialCount,
+        bool dualQuatPalettes = false);
     AnimFrameResource(const AnimFrameResource& rhs) = delete;
     AnimFrameResource& operator=(const AnimFrameResource& rhs) = delete;
     ~AnimFrameResource();
@@ -119,6 +152,7 @@ public:
     std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
     std::unique_ptr<UploadBuffer<SkinnedConstants>> SkinnedCB = nullptr;
+    std::unique_ptr<UploadBuffer<SkinnedDualQuatConstants>> SkinnedDualQuatCB = nullptr;
     std::unique_ptr<UploadBuffer<SsaoConstants>> SsaoCB = nullptr;
 	std::unique_ptr<UploadBuffer<MaterialData>> MaterialBuffer = nullptr;
 
@@ -0,0 +1,261 @@
+#include "AnimationBatch.h"
+
+using namespace DirectX;
+
+void AnimationBatch::Initialize(ThreadPool* threadPool, UINT maxBones)
+{
+	mThreadPool = threadPool;
+	mMaxBones = maxBones;
+
+	mScratch.resize(threadPool->ThreadCount());
+	for(auto& scratch : mScratch)
+	{
+		scratch.resize(maxBones);
+	}
+
+	mDualQuatScratch.resize(threadPool->ThreadCount());
+	for(auto& scratch : mDualQuatScratch)
+	{
+		scratch.resize(maxBones);
+	}
+
+	mThreadCounters.resize(threadPool->ThreadCount());
+}
+
+void AnimationBatch::SetPaletteFormat(PaletteFormat format)
+{
+	mPaletteFormat = format;
+}
+
+AnimationBatch::PaletteFormat AnimationBatch::GetPaletteFormat()const
+{
+	return mPaletteFormat;
+}
+
+void AnimationBatch::SetSubsetPalettes(const SubsetPalettes* subsetPalettes)
+{
+	mSubsetPalettes = subsetPalettes;
+}
+
+void AnimationBatch::Update(AnimatedCharacter* characters, UINT characterCount, float dt,
+	void* palettes, UINT paletteStride)
+{
+	BYTE* dest = static_cast<BYTE*>(palettes);
+
+	for(auto& counters : mThreadCounters)
+	{
+		counters.fill(0);
+	}
+
+	// A character is a few microseconds of work; hand them out a few at a
+	// time so threads don't fight over the range counter.
+	const UINT grainSize = 4;
+
+	mThreadPool->ParallelFor(characterCount, grainSize, [&](UINT begin, UINT end, UINT threadIndex)
+	{
+		XMFLOAT4X4* scratch = mScratch[threadIndex].data();
+		DualQuaternion* dualQuatScratch = mDualQuatScratch[threadIndex].data();
+		std::array<UINT, 3>& counters = mThreadCounters[threadIndex];
+
+		// Matrix palettes need the whole scratch, so extrapolated dual
+		// quaternion palettes go to the dual quaternion scratch and matrix
+		// ones to the (unused until then) scratch matrices.
+		XMFLOAT4* extrapolated = mPaletteFormat == PaletteFormat::DualQuaternion ?
+			reinterpret_cast<XMFLOAT4*>(dualQuatScratch) : reinterpret_cast<XMFLOAT4*>(scratch);
+
+		for(UINT i = begin; i < end; ++i)
+		{
+			AnimatedCharacter& character = characters[i];
+			const SkinnedData* skinInfo = character.SkinnedInfo;
+			assert(skinInfo->BoneCount() <= mMaxBones);
+
+			character.TimePos += dt;
+
+			// Loop animation
+			if(character.TimePos > skinInfo->GetClipEndTime(character.ClipName))
+			{
+				// Keep the history times relative to the new loop.
+				character.HistoryTimes[0] -= character.TimePos;
+				character.HistoryTimes[1] -= character.TimePos;
+				character.TimePos = 0.0f;
+			}
+
+			const bool evaluate = character.EvaluatePose || character.UpdateInterval <= 1 ||
+				character.HistoryCount == 0 || character.BoneLod != character.HistoryBoneLod;
+			if(evaluate)
+			{
+				counters[0] += skinInfo->SampledBoneCount(character.BoneLod);
+				counters[1]++;
+			}
+			else
+			{
+				counters[2]++;
+			}
+
+			// The full palette for this frame, when it isn't written straight
+			// to its destination.
+			const void* pose = nullptr;
+			if(character.UpdateInterval > 1)
+			{
+				pose = UpdateHistory(character, evaluate, scratch, extrapolated);
+			}
+			else
+			{
+				character.HistoryCount = 0;
+				character.FramesSinceEvaluate = 0;
+				if(mSubsetPalettes != nullptr)
+				{
+					void* full = mPaletteFormat == PaletteFormat::DualQuaternion ?
+						static_cast<void*>(dualQuatScratch) : static_cast<void*>(scratch);
+					EvaluateFullPalette(character, scratch, full);
+					pose = full;
+				}
+			}
+
+			if(mSubsetPalettes != nullptr)
+			{
+				// Gather each subset's bones from the full palette.
+				const UINT paletteCount = mSubsetPalettes->PaletteCount();
+				for(UINT p = 0; p < paletteCount; ++p)
+				{
+					BYTE* palette = dest + ((size_t)i*paletteCount + p)*paletteStride;
+					if(mPaletteFormat == PaletteFormat::DualQuaternion)
+					{
+						mSubsetPalettes->Gather(p, static_cast<const DualQuaternion*>(pose),
+							reinterpret_cast<DualQuaternion*>(palette));
+					}
+					else
+					{
+						mSubsetPalettes->Gather(p, static_cast<const XMFLOAT4X4*>(pose),
+							reinterpret_cast<XMFLOAT4X4*>(palette));
+					}
+				}
+				continue;
+			}
+
+			BYTE* palette = dest + (size_t)i*paletteStride;
+			if(pose != nullptr)
+			{
+				const size_t boneSize = mPaletteFormat == PaletteFormat::DualQuaternion ?
+					sizeof(DualQuaternion) : sizeof(XMFLOAT4X4);
+				memcpy(palette, pose, skinInfo->BoneCount()*boneSize);
+			}
+			else
+			{
+				EvaluateFullPalette(character, scratch, palette);
+			}
+		}
+	});
+
+	mBonesEvaluated = 0;
+	mPosesEvaluated = 0;
+	mPosesExtrapolated = 0;
+	for(const auto& counters : mThreadCounters)
+	{
+		mBonesEvaluated += counters[0];
+		mPosesEvaluated += counters[1];
+		mPosesExtrapolated += counters[2];
+	}
+}
+
+UINT AnimationBatch::BonesEvaluated()const
+{
+	return mBonesEvaluated;
+}
+
+UINT AnimationBatch::PosesEvaluated()const
+{
+	return mPosesEvaluated;
+}
+
+UINT AnimationBatch::PosesExtrapolated()const
+{
+	return mPosesExtrapolated;
+}
+
+void AnimationBatch::EvaluateFullPalette(const AnimatedCharacter& character, XMFLOAT4X4* scratch, void* palette)const
+{
+	const SkinnedData* skinInfo = character.SkinnedInfo;
+	if(mPaletteFormat == PaletteFormat::DualQuaternion)
+	{
+		skinInfo->GetFinalDualQuaternions(character.ClipName, character.TimePos, character.BoneLod,
+			scratch, static_cast<DualQuaternion*>(palette));
+	}
+	else
+	{
+		skinInfo->GetFinalTransforms(character.ClipName, character.TimePos, character.BoneLod,
+			scratch, static_cast<XMFLOAT4X4*>(palette));
+	}
+}
+
+const XMFLOAT4* AnimationBatch::UpdateHistory(AnimatedCharacter& character, bool evaluate,
+	XMFLOAT4X4* scratch, XMFLOAT4* extrapolated)const
+{
+	const UINT vectorsPerBone = mPaletteFormat == PaletteFormat::DualQuaternion ? 2 : 4;
+	const UINT paletteVectors = character.SkinnedInfo->BoneCount() * vectorsPerBone;
+
+	if(character.PoseHistory.size() != 2*paletteVectors)
+	{
+		character.PoseHistory.resize(2*paletteVectors);
+		character.HistoryCount = 0;
+	}
+
+	XMFLOAT4* history = character.PoseHistory.data();
+
+	if(evaluate)
+	{
+		if(character.BoneLod != character.HistoryBoneLod)
+			character.HistoryCount = 0;
+
+		// Drop the oldest palette.
+		if(character.HistoryCount == 2)
+		{
+			memcpy(history, history + paletteVectors, paletteVectors*sizeof(XMFLOAT4));
+			character.HistoryTimes[0] = character.HistoryTimes[1];
+			character.HistoryCount = 1;
+		}
+
+		XMFLOAT4* newest = history + character.HistoryCount*paletteVectors;
+		EvaluateFullPalette(character, scratch, newest);
+
+		character.HistoryTimes[character.HistoryCount] = character.TimePos;
+		character.HistoryCount++;
+		character.HistoryBoneLod = character.BoneLod;
+		character.FramesSinceEvaluate = 0;
+
+		return newest;
+	}
+
+	character.FramesSinceEvaluate++;
+
+	// Hold the pose until there are two to extrapolate from.
+	if(character.HistoryCount < 2)
+		return history;
+
+	// Extrapolate linearly from the last two palettes, at most one
+	// evaluation interval ahead.
+	float interval = character.HistoryTimes[1] - character.HistoryTimes[0];
+	float s = interval > 0.0f ? (character.TimePos - character.HistoryTimes[1]) / interval : 0.0f;
+	s = MathHelper::Clamp(s, 0.0f, 1.0f);
+
+	const XMFLOAT4* older = history;
+	const XMFLOAT4* newer = history + paletteVectors;
+	for(UINT i = 0; i < paletteVectors; i += vectorsPerBone)
+	{
+		// q and -q are the same rotation; extrapolate dual quaternions
+		// through the shorter arc.
+		XMVECTOR sign = XMVectorReplicate(1.0f);
+		if(mPaletteFormat == PaletteFormat::DualQuaternion &&
+			XMVectorGetX(XMVector4Dot(XMLoadFloat4(&older[i]), XMLoadFloat4(&newer[i]))) < 0.0f)
+			sign = XMVectorReplicate(-1.0f);
+
+		for(UINT j = i; j < i + vectorsPerBone; ++j)
+		{
+			XMVECTOR v0 = XMVectorMultiply(XMLoadFloat4(&older[j]), sign);
+			XMVECTOR v1 = XMLoadFloat4(&newer[j]);
+			XMStoreFloat4(&extrapolated[j], XMVectorLerp(v0, v1, 1.0f + s));
+		}
+	}
+
+	return extrapolated;
+}
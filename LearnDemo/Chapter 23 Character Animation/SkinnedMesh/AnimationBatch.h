@@ -0,0 +1,104 @@
+#ifndef ANIMATIONBATCH_H
+#define ANIMATIONBATCH_H
+
+#include "SkinnedData.h"
+#include "SubsetPalettes.h"
+#include "../../../Common/ThreadPool.h"
+
+///<summary>
+/// Playback state of one character animated by an AnimationBatch.
+///</summary>
+struct AnimatedCharacter
+{
+	const SkinnedData* SkinnedInfo = nullptr;
+	std::string ClipName;
+	float TimePos = 0.0f;
+
+	// Animation LOD, normally chosen by an AnimationLod each frame.  A
+	// character with an UpdateInterval above 1 keeps its last two evaluated
+	// palettes, and on frames where EvaluatePose is false its palette is
+	// extrapolated from them instead of sampled from the clip.
+	UINT BoneLod = 0;
+	UINT UpdateInterval = 1;
+	bool EvaluatePose = true;
+	UINT FramesSinceEvaluate = 0;
+
+	// Managed by AnimationBatch.  Two palettes, oldest first, as raw float4s
+	// (4 per bone for matrices, 2 per bone for dual quaternions).
+	std::vector<DirectX::XMFLOAT4> PoseHistory;
+	float HistoryTimes[2] = { 0.0f, 0.0f };
+	UINT HistoryCount = 0;
+	UINT HistoryBoneLod = 0;
+};
+
+///<summary>
+/// Updates many skinned characters at once.  Characters are split across a
+/// ThreadPool; each thread evaluates poses in its own scratch memory and
+/// writes the finished palettes straight to their destination (normally
+/// the frame's mapped SkinnedCB), so nothing is copied afterwards and
+/// nothing is allocated per frame.
+///</summary>
+class AnimationBatch
+{
+public:
+	enum class PaletteFormat
+	{
+		Matrix,          // SkinnedConstants
+		DualQuaternion   // SkinnedDualQuatConstants
+	};
+
+	// Allocates per-thread scratch for skeletons of up to maxBones bones.
+	void Initialize(ThreadPool* threadPool, UINT maxBones);
+
+	void SetPaletteFormat(PaletteFormat format);
+	PaletteFormat GetPaletteFormat()const;
+
+	// With subset palettes (all characters must share the mesh they were
+	// built for), each character writes subsetPalettes->PaletteCount()
+	// compacted palettes instead of one full one.  Null turns it off.
+	void SetSubsetPalettes(const SubsetPalettes* subsetPalettes);
+
+	// Advances every character by dt, looping its clip, and writes its
+	// final transforms to palettes + i*paletteStride (bytes) for character i.
+	// Each palette needs room for the character's BoneCount() matrices (or
+	// dual quaternions).  With subset palettes, palette p of character i
+	// goes to palettes + (i*PaletteCount() + p)*paletteStride.
+	//
+	// A pose is evaluated anyway (whatever EvaluatePose says) for a character
+	// with no history yet and one whose BoneLod changed.
+	void Update(AnimatedCharacter* characters, UINT characterCount, float dt,
+		void* palettes, UINT paletteStride);
+
+	// What the last Update did: bones sampled from clips, and poses
+	// evaluated and extrapolated.
+	UINT BonesEvaluated()const;
+	UINT PosesEvaluated()const;
+	UINT PosesExtrapolated()const;
+
+private:
+	// Full palette of the character at its BoneLod, in the current format.
+	void EvaluateFullPalette(const AnimatedCharacter& character, DirectX::XMFLOAT4X4* scratch, void* palette)const;
+
+	// Keeps the history of a character with an UpdateInterval above 1 and
+	// returns its full palette for this frame.
+	const DirectX::XMFLOAT4* UpdateHistory(AnimatedCharacter& character, bool evaluate,
+		DirectX::XMFLOAT4X4* scratch, DirectX::XMFLOAT4* extrapolated)const;
+
+	ThreadPool* mThreadPool = nullptr;
+	UINT mMaxBones = 0;
+	PaletteFormat mPaletteFormat = PaletteFormat::Matrix;
+	const SubsetPalettes* mSubsetPalettes = nullptr;
+
+	// mScratch[threadIndex] holds mMaxBones matrices, mDualQuatScratch[threadIndex]
+	// a full dual quaternion palette to gather subset palettes from.
+	std::vector<std::vector<DirectX::XMFLOAT4X4>> mScratch;
+	std::vector<std::vector<DualQuaternion>> mDualQuatScratch;
+
+	// Per thread: bones evaluated, poses evaluated, poses extrapolated.
+	std::vector<std::array<UINT, 3>> mThreadCounters;
+	UINT mBonesEvaluated = 0;
+	UINT mPosesEvaluated = 0;
+	UINT mPosesExtrapolated = 0;
+};
+
+#endif // ANIMATIONBATCH_H
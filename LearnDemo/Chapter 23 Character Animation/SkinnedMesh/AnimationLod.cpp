@@ -0,0 +1,117 @@
+#include "AnimationLod.h"
+
+using namespace DirectX;
+
+void AnimationLod::Initialize(const std::vector<AnimationLodLevel>& levels, UINT maxBonesPerFrame)
+{
+	assert(!levels.empty());
+
+	mLevels = levels;
+	mMaxBonesPerFrame = maxBonesPerFrame;
+	mFrame = 0;
+	mLevelCounts.assign(levels.size(), 0);
+}
+
+void AnimationLod::Select(AnimatedCharacter* characters, UINT characterCount, const BoundingSphere* bounds,
+	FXMVECTOR eyePos, float projScaleY)
+{
+	std::fill(mLevelCounts.begin(), mLevelCounts.end(), 0);
+	mOverdue.clear();
+	mOnTime.clear();
+	mScheduledBones = 0;
+	mDeferredPoses = 0;
+
+	const UINT lastLevel = (UINT)mLevels.size() - 1;
+
+	for(UINT i = 0; i < characterCount; ++i)
+	{
+		AnimatedCharacter& character = characters[i];
+
+		// Projected height over viewport height is 2r/(2d*tan(fovY/2)).
+		XMVECTOR center = XMLoadFloat3(&bounds[i].Center);
+		float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(center, eyePos)));
+		float screenHeight = bounds[i].Radius * projScaleY / MathHelper::Max(distance, bounds[i].Radius);
+
+		UINT level = 0;
+		while(level < lastLevel && screenHeight < mLevels[level].MinScreenHeight)
+		{
+			++level;
+		}
+		mLevelCounts[level]++;
+
+		const AnimationLodLevel& lod = mLevels[level];
+		const UINT boneLodCount = character.SkinnedInfo->BoneLodCount();
+		character.BoneLod = MathHelper::Min(lod.BoneLod, boneLodCount - 1);
+		character.UpdateInterval = MathHelper::Max(lod.UpdateInterval, 1u);
+		character.EvaluatePose = false;
+
+		// The batch evaluates these whatever we say, so they can't be deferred.
+		const bool mustEvaluate = character.UpdateInterval == 1 || character.HistoryCount == 0 ||
+			character.BoneLod != character.HistoryBoneLod;
+		if(mustEvaluate)
+		{
+			character.EvaluatePose = true;
+			mScheduledBones += character.SkinnedInfo->SampledBoneCount(character.BoneLod);
+		}
+		else if(character.FramesSinceEvaluate >= character.UpdateInterval)
+		{
+			mOverdue.push_back(i);
+		}
+		else if((mFrame + i) % character.UpdateInterval == 0)
+		{
+			mOnTime.push_back(i);
+		}
+	}
+
+	// Longest wait first; stable so ties keep index order and the schedule is
+	// the same from run to run.
+	std::stable_sort(mOverdue.begin(), mOverdue.end(), [&](UINT a, UINT b)
+	{
+		return characters[a].FramesSinceEvaluate > characters[b].FramesSinceEvaluate;
+	});
+
+	for(const std::vector<UINT>* due : { &mOverdue, &mOnTime })
+	{
+		for(UINT i : *due)
+		{
+			AnimatedCharacter& character = characters[i];
+			UINT bones = character.SkinnedInfo->SampledBoneCount(character.BoneLod);
+
+			if(mMaxBonesPerFrame > 0 && mScheduledBones + bones > mMaxBonesPerFrame)
+			{
+				mDeferredPoses++;
+				continue;
+			}
+
+			character.EvaluatePose = true;
+			mScheduledBones += bones;
+		}
+	}
+
+	mFrame++;
+}
+
+UINT AnimationLod::LevelCount()const
+{
+	return (UINT)mLevels.size();
+}
+
+const AnimationLodLevel& AnimationLod::GetLevel(UINT level)const
+{
+	return mLevels[level];
+}
+
+UINT AnimationLod::CharactersAtLevel(UINT level)const
+{
+	return mLevelCounts[level];
+}
+
+UINT AnimationLod::ScheduledBones()const
+{
+	return mScheduledBones;
+}
+
+UINT AnimationLod::DeferredPoses()const
+{
+	return mDeferredPoses;
+}
@@ -0,0 +1,68 @@
+#ifndef ANIMATIONLOD_H
+#define ANIMATIONLOD_H
+
+#include "AnimationBatch.h"
+
+///<summary>
+/// One step of an AnimationLod: characters at least MinScreenHeight tall
+/// (a fraction of the viewport height) evaluate their pose every
+/// UpdateInterval frames and skip the bones below BoneLod (see
+/// SkinnedData::SampledBoneCount).
+///</summary>
+struct AnimationLodLevel
+{
+	float MinScreenHeight = 0.0f;
+	UINT UpdateInterval = 1;
+	UINT BoneLod = 0;
+};
+
+///<summary>
+/// Picks an animation LOD for every character of an AnimationBatch from
+/// its size on screen, and decides which poses get evaluated this frame.
+///
+/// Characters on an interval of N are evaluated on every Nth frame, phased
+/// by their index so that 1/N of them come due each frame; in between the
+/// batch extrapolates their palettes.  Characters on an interval of 1 are
+/// always evaluated.  The rest share a budget of bones per frame: poses
+/// that don't fit are pushed to a later frame, and the ones that have
+/// waited longest go first.  Run Select before AnimationBatch::Update each
+/// frame.
+///</summary>
+class AnimationLod
+{
+public:
+	// Levels go from nearest (largest MinScreenHeight) to farthest; the last
+	// one takes everything smaller.  maxBonesPerFrame = 0 means no budget.
+	void Initialize(const std::vector<AnimationLodLevel>& levels, UINT maxBonesPerFrame);
+
+	// bounds[i] is the world space bounding sphere of characters[i].
+	// projScaleY is the proj(1,1) entry of the projection matrix, 1/tan(fovY/2).
+	void Select(AnimatedCharacter* characters, UINT characterCount, const DirectX::BoundingSphere* bounds,
+		DirectX::FXMVECTOR eyePos, float projScaleY);
+
+	UINT LevelCount()const;
+	const AnimationLodLevel& GetLevel(UINT level)const;
+
+	// For the last Select: characters at each level, bones scheduled for
+	// evaluation, and due poses pushed back by the budget.  The batch may
+	// evaluate a few more than scheduled (see AnimationBatch::Update), so
+	// AnimationBatch::BonesEvaluated is the real cost.
+	UINT CharactersAtLevel(UINT level)const;
+	UINT ScheduledBones()const;
+	UINT DeferredPoses()const;
+
+private:
+	std::vector<AnimationLodLevel> mLevels;
+	UINT mMaxBonesPerFrame = 0;
+	UINT64 mFrame = 0;
+
+	// Due characters on an interval above 1, overdue ones first.
+	std::vector<UINT> mOverdue;
+	std::vector<UINT> mOnTime;
+
+	std::vector<UINT> mLevelCounts;
+	UINT mScheduledBones = 0;
+	UINT mDeferredPoses = 0;
+};
+
+#endif // ANIMATIONLOD_H
@@ -0,0 +1,369 @@
+#include "CompressedAnimationClip.h"
+#include "SkinnedData.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+namespace
+{
+	// The three smallest components of a unit quaternion lie in [-1/sqrt(2), 1/sqrt(2)].
+	const float SmallestThreeRange = 0.707106781f;
+
+	void EncodeRotation(FXMVECTOR Q, USHORT code[3])
+	{
+		XMFLOAT4 q;
+		XMStoreFloat4(&q, XMQuaternionNormalize(Q));
+		const float c[4] = { q.x, q.y, q.z, q.w };
+
+		UINT largest = 0;
+		for(UINT i = 1; i < 4; ++i)
+		{
+			if( fabsf(c[i]) > fabsf(c[largest]) )
+				largest = i;
+		}
+
+		// q and -q are the same rotation; store the one whose largest component
+		// is positive so the decoder can rebuild it with a plain sqrt.
+		const float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+		UINT64 bits = largest;
+		for(UINT i = 0; i < 4; ++i)
+		{
+			if(i == largest)
+				continue;
+
+			float n = (c[i]*sign + SmallestThreeRange) / (2.0f*SmallestThreeRange);
+			bits = (bits << 15) | (UINT64)(MathHelper::Clamp(n, 0.0f, 1.0f)*32767.0f + 0.5f);
+		}
+
+		code[0] = (USHORT)(bits & 0xFFFF);
+		code[1] = (USHORT)((bits >> 16) & 0xFFFF);
+		code[2] = (USHORT)((bits >> 32) & 0xFFFF);
+	}
+
+	XMVECTOR DecodeRotation(const USHORT code[3])
+	{
+		UINT64 bits = (UINT64)code[0] | ((UINT64)code[1] << 16) | ((UINT64)code[2] << 32);
+		const UINT largest = (UINT)(bits >> 45) & 3;
+
+		float c[4];
+		float lengthSq = 0.0f;
+		for(int i = 3; i >= 0; --i)
+		{
+			if(i == (int)largest)
+				continue;
+
+			float n = (float)(bits & 0x7FFF) / 32767.0f;
+			bits >>= 15;
+
+			c[i] = n*2.0f*SmallestThreeRange - SmallestThreeRange;
+			lengthSq += c[i]*c[i];
+		}
+		c[largest] = sqrtf(MathHelper::Max(0.0f, 1.0f - lengthSq));
+
+		return XMVectorSet(c[0], c[1], c[2], c[3]);
+	}
+
+	void EncodeRange(FXMVECTOR V, const XMFLOAT3& rangeMin, const XMFLOAT3& rangeExtent, USHORT code[3])
+	{
+		XMFLOAT3 v;
+		XMStoreFloat3(&v, V);
+		const float value[3] = { v.x, v.y, v.z };
+		const float lo[3] = { rangeMin.x, rangeMin.y, rangeMin.z };
+		const float extent[3] = { rangeExtent.x, rangeExtent.y, rangeExtent.z };
+
+		for(UINT i = 0; i < 3; ++i)
+		{
+			float n = extent[i] > 0.0f ? (value[i] - lo[i]) / extent[i] : 0.0f;
+			code[i] = (USHORT)(MathHelper::Clamp(n, 0.0f, 1.0f)*65535.0f + 0.5f);
+		}
+	}
+
+	XMVECTOR DecodeRange(const USHORT code[3], const XMFLOAT3& rangeMin, const XMFLOAT3& rangeExtent)
+	{
+		XMVECTOR n = XMVectorSet(code[0], code[1], code[2], 0.0f) * (1.0f / 65535.0f);
+		return XMVectorMultiplyAdd(n, XMLoadFloat3(&rangeExtent), XMLoadFloat3(&rangeMin));
+	}
+
+	// Angle of the rotation that takes A to B.  Uses atan2 rather than acos of
+	// the dot product, which has no precision left for angles this small.
+	float RotationError(FXMVECTOR A, FXMVECTOR B)
+	{
+		XMVECTOR b = XMVectorGetX(XMQuaternionDot(A, B)) < 0.0f ? XMVectorNegate(B) : B;
+		float d = XMVectorGetX(XMVector4Length(A - b));
+		float s = XMVectorGetX(XMVector4Length(A + b));
+		return 4.0f * atan2f(d, s);
+	}
+
+	float TrackError(bool rotation, FXMVECTOR A, FXMVECTOR B)
+	{
+		return rotation ? RotationError(A, B) : XMVectorGetX(XMVector3Length(A - B));
+	}
+
+	XMVECTOR TrackLerp(bool rotation, FXMVECTOR A, FXMVECTOR B, float s)
+	{
+		return rotation ? XMQuaternionSlerp(A, B, s) : XMVectorLerp(A, B, s);
+	}
+
+	// Greedy key reduction: from the last kept key, extend the span as far as
+	// interpolating the (decoded) end points still reproduces every source key
+	// inside it.  Returns the indices of the keys to keep.
+	std::vector<UINT> ReduceKeys(bool rotation, float tolerance, const std::vector<float>& times,
+		const std::vector<XMFLOAT4>& source, const std::vector<XMFLOAT4>& decoded)
+	{
+		const UINT n = (UINT)source.size();
+
+		// A constant track needs one key.
+		bool constant = true;
+		for(UINT i = 0; i < n && constant; ++i)
+		{
+			constant = TrackError(rotation, XMLoadFloat4(&decoded[0]), XMLoadFloat4(&source[i])) <= tolerance;
+		}
+		if(constant)
+			return std::vector<UINT>(1, 0);
+
+		auto spanFits = [&](UINT a, UINT b)
+		{
+			XMVECTOR A = XMLoadFloat4(&decoded[a]);
+			XMVECTOR B = XMLoadFloat4(&decoded[b]);
+			float span = times[b] - times[a];
+			for(UINT i = a + 1; i < b; ++i)
+			{
+				float s = span > 0.0f ? (times[i] - times[a]) / span : 0.0f;
+				if( TrackError(rotation, TrackLerp(rotation, A, B, s), XMLoadFloat4(&source[i])) > tolerance )
+					return false;
+			}
+			return true;
+		};
+
+		std::vector<UINT> kept(1, 0);
+		UINT a = 0;
+		while(a < n - 1)
+		{
+			UINT b = a + 1;
+			while(b + 1 < n && spanFits(a, b + 1))
+			{
+				++b;
+			}
+
+			kept.push_back(b);
+			a = b;
+		}
+
+		return kept;
+	}
+}
+
+float ClipCompressionStats::CompressionRatio()const
+{
+	return CompressedBytes > 0 ? (float)SourceBytes / (float)CompressedBytes : 0.0f;
+}
+
+void CompressedAnimationClip::Build(const AnimationClip& clip, const ClipCompressionSettings& settings)
+{
+	mBoneCount = (UINT)clip.BoneAnimations.size();
+	mStartTime = clip.GetClipStartTime();
+	mEndTime = clip.GetClipEndTime();
+
+	const float duration = mEndTime - mStartTime;
+	mInvTimeStep = duration > 0.0f ? 65535.0f / duration : 0.0f;
+
+	mTracks.assign(mBoneCount*TrackTypeCount, Track());
+	mKeyTimes.clear();
+	mKeyValues.clear();
+	mStats = ClipCompressionStats();
+
+	const float tolerance[TrackTypeCount] =
+	{
+		settings.TranslationTolerance,
+		settings.RotationTolerance,
+		settings.ScaleTolerance
+	};
+
+	for(UINT bone = 0; bone < mBoneCount; ++bone)
+	{
+		const std::vector<Keyframe>& keys = clip.BoneAnimations[bone].Keyframes;
+		const UINT n = (UINT)keys.size();
+
+		mStats.SourceKeyCount += n;
+		mStats.SourceBytes += n*sizeof(Keyframe);
+
+		// Reduce against the times the sampler will actually see.
+		std::vector<USHORT> timeCodes(n);
+		std::vector<float> times(n);
+		for(UINT i = 0; i < n; ++i)
+		{
+			float u = MathHelper::Clamp((keys[i].TimePos - mStartTime) * mInvTimeStep, 0.0f, 65535.0f);
+			timeCodes[i] = (USHORT)(u + 0.5f);
+			times[i] = (float)timeCodes[i];
+		}
+
+		for(UINT type = 0; type < TrackTypeCount; ++type)
+		{
+			const bool rotation = (type == Rotation);
+
+			std::vector<XMFLOAT4> source(n);
+			for(UINT i = 0; i < n; ++i)
+			{
+				if(type == Translation)
+					source[i] = XMFLOAT4(keys[i].Translation.x, keys[i].Translation.y, keys[i].Translation.z, 0.0f);
+				else if(type == Scale)
+					source[i] = XMFLOAT4(keys[i].Scale.x, keys[i].Scale.y, keys[i].Scale.z, 0.0f);
+				else
+					XMStoreFloat4(&source[i], XMQuaternionNormalize(XMLoadFloat4(&keys[i].RotationQuat)));
+			}
+
+			Track& track = mTracks[bone*TrackTypeCount + type];
+			if(!rotation)
+			{
+				XMVECTOR lo = XMLoadFloat4(&source[0]);
+				XMVECTOR hi = lo;
+				for(UINT i = 1; i < n; ++i)
+				{
+					lo = XMVectorMin(lo, XMLoadFloat4(&source[i]));
+					hi = XMVectorMax(hi, XMLoadFloat4(&source[i]));
+				}
+				XMStoreFloat3(&track.RangeMin, lo);
+				XMStoreFloat3(&track.RangeExtent, hi - lo);
+			}
+
+			// Quantize every key up front so the reduction accounts for it.
+			std::vector<USHORT> codes(n*3);
+			std::vector<XMFLOAT4> decoded(n);
+			for(UINT i = 0; i < n; ++i)
+			{
+				XMVECTOR v = XMLoadFloat4(&source[i]);
+				if(rotation)
+				{
+					EncodeRotation(v, &codes[i*3]);
+					XMStoreFloat4(&decoded[i], DecodeRotation(&codes[i*3]));
+				}
+				else
+				{
+					EncodeRange(v, track.RangeMin, track.RangeExtent, &codes[i*3]);
+					XMStoreFloat4(&decoded[i], DecodeRange(&codes[i*3], track.RangeMin, track.RangeExtent));
+				}
+			}
+
+			std::vector<UINT> kept = ReduceKeys(rotation, tolerance[type], times, source, decoded);
+
+			track.FirstKey = (UINT)mKeyTimes.size();
+			track.KeyCount = (UINT)kept.size();
+			for(UINT i : kept)
+			{
+				mKeyTimes.push_back(timeCodes[i]);
+				mKeyValues.insert(mKeyValues.end(), &codes[i*3], &codes[i*3] + 3);
+			}
+		}
+	}
+
+	mStats.StoredKeyCount = (UINT)mKeyTimes.size();
+	mStats.CompressedBytes = ByteSize();
+
+	//
+	// Measure the joint space error at every source key and halfway between.
+	//
+
+	for(UINT bone = 0; bone < mBoneCount; ++bone)
+	{
+		const std::vector<Keyframe>& keys = clip.BoneAnimations[bone].Keyframes;
+		for(UINT i = 0; i < keys.size(); ++i)
+		{
+			const UINT next = MathHelper::Min(i + 1, (UINT)keys.size() - 1);
+			for(float s : { 0.0f, 0.5f })
+			{
+				float t = keys[i].TimePos + s*(keys[next].TimePos - keys[i].TimePos);
+
+				XMVECTOR P0 = XMVectorLerp(XMLoadFloat3(&keys[i].Translation), XMLoadFloat3(&keys[next].Translation), s);
+				XMVECTOR S0 = XMVectorLerp(XMLoadFloat3(&keys[i].Scale), XMLoadFloat3(&keys[next].Scale), s);
+				XMVECTOR Q0 = XMQuaternionSlerp(XMLoadFloat4(&keys[i].RotationQuat), XMLoadFloat4(&keys[next].RotationQuat), s);
+
+				XMVECTOR S, P, Q;
+				Interpolate(bone, t, S, P, Q);
+
+				mStats.MaxTranslationError = MathHelper::Max(mStats.MaxTranslationError, TrackError(false, P, P0));
+				mStats.MaxRotationError = MathHelper::Max(mStats.MaxRotationError, TrackError(true, Q, XMQuaternionNormalize(Q0)));
+				mStats.MaxScaleError = MathHelper::Max(mStats.MaxScaleError, TrackError(false, S, S0));
+			}
+		}
+	}
+}
+
+const ClipCompressionStats& CompressedAnimationClip::GetStats()const
+{
+	return mStats;
+}
+
+float CompressedAnimationClip::GetClipStartTime()const
+{
+	return mStartTime;
+}
+
+float CompressedAnimationClip::GetClipEndTime()const
+{
+	return mEndTime;
+}
+
+UINT CompressedAnimationClip::BoneCount()const
+{
+	return mBoneCount;
+}
+
+size_t CompressedAnimationClip::ByteSize()const
+{
+	return mTracks.size()*sizeof(Track) +
+		mKeyTimes.size()*sizeof(USHORT) +
+		mKeyValues.size()*sizeof(USHORT);
+}
+
+XMVECTOR CompressedAnimationClip::DecodeKey(const Track& track, TrackType type, UINT key)const
+{
+	const USHORT* code = &mKeyValues[key*3];
+	if(type == Rotation)
+		return DecodeRotation(code);
+
+	return DecodeRange(code, track.RangeMin, track.RangeExtent);
+}
+
+XMVECTOR CompressedAnimationClip::SampleTrack(const Track& track, TrackType type, float t)const
+{
+	const USHORT* first = &mKeyTimes[track.FirstKey];
+	const USHORT* last = first + track.KeyCount;
+
+	float u = (t - mStartTime) * mInvTimeStep;
+	if( track.KeyCount == 1 || u <= (float)first[0] )
+		return DecodeKey(track, type, track.FirstKey);
+	if( u >= (float)last[-1] )
+		return DecodeKey(track, type, track.FirstKey + track.KeyCount - 1);
+
+	// First key strictly after u; the segment starts one before it.
+	const USHORT* upper = std::upper_bound(first, last, u,
+		[](float value, USHORT key) { return value < (float)key; });
+	UINT i = (UINT)(upper - first) - 1;
+
+	float span = (float)(first[i+1] - first[i]);
+	float s = span > 0.0f ? (u - (float)first[i]) / span : 0.0f;
+
+	XMVECTOR A = DecodeKey(track, type, track.FirstKey + i);
+	XMVECTOR B = DecodeKey(track, type, track.FirstKey + i + 1);
+	return TrackLerp(type == Rotation, A, B, s);
+}
+
+void CompressedAnimationClip::Interpolate(UINT bone, float t, XMVECTOR& S, XMVECTOR& P, XMVECTOR& Q)const
+{
+	const Track* tracks = &mTracks[bone*TrackTypeCount];
+	P = SampleTrack(tracks[Translation], Translation, t);
+	Q = SampleTrack(tracks[Rotation], Rotation, t);
+	S = SampleTrack(tracks[Scale], Scale, t);
+}
+
+void CompressedAnimationClip::Interpolate(float t, XMFLOAT4X4* boneTransforms)const
+{
+	XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	for(UINT bone = 0; bone < mBoneCount; ++bone)
+	{
+		XMVECTOR S, P, Q;
+		Interpolate(bone, t, S, P, Q);
+		XMStoreFloat4x4(&boneTransforms[bone], XMMatrixAffineTransformation(S, zero, Q, P));
+	}
+}
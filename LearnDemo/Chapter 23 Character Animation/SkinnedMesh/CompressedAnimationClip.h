@@ -0,0 +1,112 @@
+#ifndef COMPRESSEDANIMATIONCLIP_H
+#define COMPRESSEDANIMATIONCLIP_H
+
+#include "../../../Common/d3dUtil.h"
+#include "../../../Common/MathHelper.h"
+
+struct AnimationClip;
+
+///<summary>
+/// Error budget for CompressedAnimationClip::Build.  A key is dropped when
+/// interpolating its neighbours reproduces it within the tolerance, with
+/// quantization error included.
+///</summary>
+struct ClipCompressionSettings
+{
+	float TranslationTolerance = 0.001f; // Distance, in bone space units.
+	float RotationTolerance = 0.001f;    // Angle, in radians.
+	float ScaleTolerance = 0.001f;
+};
+
+///<summary>
+/// What Build did to a clip.  The errors are measured in joint (bone local)
+/// space against the source clip, at every source key and halfway between.
+///</summary>
+struct ClipCompressionStats
+{
+	UINT SourceKeyCount = 0;    // Keyframes (full TRS) in the source clip.
+	UINT StoredKeyCount = 0;    // Translation + rotation + scale keys kept.
+	size_t SourceBytes = 0;
+	size_t CompressedBytes = 0;
+
+	float MaxTranslationError = 0.0f;
+	float MaxRotationError = 0.0f; // Radians.
+	float MaxScaleError = 0.0f;
+
+	float CompressionRatio()const;
+};
+
+///<summary>
+/// A compressed copy of an AnimationClip.
+///
+/// Translation, rotation and scale are separate tracks, and each track
+/// keeps only the keys that cannot be interpolated from their neighbours
+/// (a constant track keeps one).  Stored keys are 8 bytes:
+///  - a 16-bit time, relative to the clip's time range,
+///  - rotations as "smallest three": the largest component is dropped
+///    and rebuilt from the unit length, the other three get 15 bits and
+///    2 bits say which one was dropped (47 of 48 bits),
+///  - translations and scales as 16 bits per component, relative to the
+///    track's own min/max.
+///
+/// Sampling decodes on the fly and never allocates.
+///</summary>
+class CompressedAnimationClip
+{
+public:
+	void Build(const AnimationClip& clip, const ClipCompressionSettings& settings = ClipCompressionSettings());
+
+	const ClipCompressionStats& GetStats()const;
+
+	float GetClipStartTime()const;
+	float GetClipEndTime()const;
+
+	UINT BoneCount()const;
+	size_t ByteSize()const;
+
+	// Samples one bone in joint space.
+	void Interpolate(UINT bone, float t,
+		DirectX::XMVECTOR& S, DirectX::XMVECTOR& P, DirectX::XMVECTOR& Q)const;
+
+	// Writes the to-parent transform of every bone; boneTransforms must have
+	// room for BoneCount() matrices.
+	void Interpolate(float t, DirectX::XMFLOAT4X4* boneTransforms)const;
+
+private:
+	enum TrackType
+	{
+		Translation = 0,
+		Rotation,
+		Scale,
+		TrackTypeCount
+	};
+
+	struct Track
+	{
+		UINT FirstKey = 0;
+		UINT KeyCount = 0;
+
+		// Dequantization range (translation and scale tracks).
+		DirectX::XMFLOAT3 RangeMin = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3 RangeExtent = { 0.0f, 0.0f, 0.0f };
+	};
+
+	DirectX::XMVECTOR SampleTrack(const Track& track, TrackType type, float t)const;
+	DirectX::XMVECTOR DecodeKey(const Track& track, TrackType type, UINT key)const;
+
+	// mTracks[bone*TrackTypeCount + type]
+	std::vector<Track> mTracks;
+
+	// One time and three values per stored key, for all tracks back to back.
+	std::vector<USHORT> mKeyTimes;
+	std::vector<USHORT> mKeyValues;
+
+	UINT mBoneCount = 0;
+	float mStartTime = 0.0f;
+	float mEndTime = 0.0f;
+	float mInvTimeStep = 0.0f; // 16-bit key time units per second.
+
+	ClipCompressionStats mStats;
+};
+
+#endif // COMPRESSEDANIMATIONCLIP_H
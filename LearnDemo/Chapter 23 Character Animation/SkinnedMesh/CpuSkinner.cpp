@@ -0,0 +1,166 @@
+#include "CpuSkinner.h"
+
+using namespace DirectX;
+
+void CpuSkinner::Initialize(ThreadPool* threadPool)
+{
+	mThreadPool = threadPool;
+	mThreadBounds.resize(2*threadPool->ThreadCount());
+}
+
+void CpuSkinner::Skin(const M3DLoader::SkinnedVertex* vertices, UINT vertexCount,
+	const XMFLOAT4X4* finalTransforms, CpuSkinnedVertex* output, BoundingBox& bounds)
+{
+	const UINT threadCount = mThreadPool->ThreadCount();
+	for(UINT i = 0; i < threadCount; ++i)
+	{
+		mThreadBounds[2*i] = XMFLOAT4(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity, 0.0f);
+		mThreadBounds[2*i+1] = XMFLOAT4(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity, 0.0f);
+	}
+
+	// Big enough to amortize grabbing a range, small enough to balance.
+	const UINT grainSize = 1024;
+
+	mThreadPool->ParallelFor(vertexCount, grainSize, [&](UINT begin, UINT end, UINT threadIndex)
+	{
+		SkinRange(vertices, begin, end, finalTransforms, output,
+			mThreadBounds[2*threadIndex], mThreadBounds[2*threadIndex+1]);
+	});
+
+	XMVECTOR vMin = XMLoadFloat4(&mThreadBounds[0]);
+	XMVECTOR vMax = XMLoadFloat4(&mThreadBounds[1]);
+	for(UINT i = 1; i < threadCount; ++i)
+	{
+		vMin = XMVectorMin(vMin, XMLoadFloat4(&mThreadBounds[2*i]));
+		vMax = XMVectorMax(vMax, XMLoadFloat4(&mThreadBounds[2*i+1]));
+	}
+
+	if(vertexCount == 0)
+		vMin = vMax = XMVectorZero();
+
+	BoundingBox::CreateFromPoints(bounds, vMin, vMax);
+}
+
+void CpuSkinner::SkinRange(const M3DLoader::SkinnedVertex* vertices, UINT begin, UINT end,
+	const XMFLOAT4X4* finalTransforms, CpuSkinnedVertex* output,
+	XMFLOAT4& boundsMin, XMFLOAT4& boundsMax)
+{
+	XMVECTOR vMin = XMLoadFloat4(&boundsMin);
+	XMVECTOR vMax = XMLoadFloat4(&boundsMax);
+
+	for(UINT i = begin; i < end; ++i)
+	{
+		const M3DLoader::SkinnedVertex& v = vertices[i];
+
+		XMVECTOR w = XMLoadFloat3(&v.BoneWeights);
+		XMVECTOR w0 = XMVectorSplatX(w);
+		XMVECTOR w1 = XMVectorSplatY(w);
+		XMVECTOR w2 = XMVectorSplatZ(w);
+		XMVECTOR w3 = XMVectorSubtract(XMVectorSubtract(XMVectorSubtract(XMVectorSplatOne(), w0), w1), w2);
+
+		// Blend the first three rows of the (transposed) bone matrices; the
+		// fourth row is always 0 0 0 1.
+		const XMFLOAT4X4& M0 = finalTransforms[v.BoneIndices[0]];
+		const XMFLOAT4X4& M1 = finalTransforms[v.BoneIndices[1]];
+		const XMFLOAT4X4& M2 = finalTransforms[v.BoneIndices[2]];
+		const XMFLOAT4X4& M3 = finalTransforms[v.BoneIndices[3]];
+
+		XMMATRIX B;
+		for(int r = 0; r < 3; ++r)
+		{
+			XMVECTOR row = XMVectorMultiply(w0, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(M0.m[r])));
+			row = XMVectorMultiplyAdd(w1, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(M1.m[r])), row);
+			row = XMVectorMultiplyAdd(w2, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(M2.m[r])), row);
+			B.r[r] = XMVectorMultiplyAdd(w3, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(M3.m[r])), row);
+		}
+		B.r[3] = g_XMIdentityR3;
+		B = XMMatrixTranspose(B);
+
+		XMVECTOR pos = XMVector3Transform(XMLoadFloat3(&v.Pos), B);
+		XMVECTOR normal = XMVector3TransformNormal(XMLoadFloat3(&v.Normal), B);
+		XMVECTOR tangent = XMVector3TransformNormal(XMLoadFloat3(&v.TangentU), B);
+
+		vMin = XMVectorMin(vMin, pos);
+		vMax = XMVectorMax(vMax, pos);
+
+		XMStoreFloat3(&output[i].Pos, pos);
+		XMStoreFloat3(&output[i].Normal, normal);
+		XMStoreFloat3(&output[i].TangentU, tangent);
+	}
+
+	XMStoreFloat4(&boundsMin, vMin);
+	XMStoreFloat4(&boundsMax, vMax);
+}
+
+void CpuSkinner::SkinLinear(const M3DLoader::SkinnedVertex* vertices, UINT vertexCount,
+	const XMFLOAT4X4* finalTransforms, CpuSkinnedVertex* output)
+{
+	for(UINT i = 0; i < vertexCount; ++i)
+	{
+		const M3DLoader::SkinnedVertex& v = vertices[i];
+
+		float weights[4];
+		GetBoneWeights(v, weights);
+
+		XMVECTOR posL = XMLoadFloat3(&v.Pos);
+		XMVECTOR normalL = XMLoadFloat3(&v.Normal);
+		XMVECTOR tangentL = XMLoadFloat3(&v.TangentU);
+
+		XMVECTOR pos = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		XMVECTOR tangent = XMVectorZero();
+		for(int j = 0; j < 4; ++j)
+		{
+			// The palette is stored transposed for HLSL.
+			XMMATRIX M = XMMatrixTranspose(XMLoadFloat4x4(&finalTransforms[v.BoneIndices[j]]));
+			XMVECTOR w = XMVectorReplicate(weights[j]);
+
+			pos = XMVectorMultiplyAdd(w, XMVector3Transform(posL, M), pos);
+			normal = XMVectorMultiplyAdd(w, XMVector3TransformNormal(normalL, M), normal);
+			tangent = XMVectorMultiplyAdd(w, XMVector3TransformNormal(tangentL, M), tangent);
+		}
+
+		XMStoreFloat3(&output[i].Pos, pos);
+		XMStoreFloat3(&output[i].Normal, normal);
+		XMStoreFloat3(&output[i].TangentU, tangent);
+	}
+}
+
+void CpuSkinner::SkinDualQuaternion(const M3DLoader::SkinnedVertex* vertices, UINT vertexCount,
+	const DualQuaternion* finalDualQuats, CpuSkinnedVertex* output)
+{
+	for(UINT i = 0; i < vertexCount; ++i)
+	{
+		const M3DLoader::SkinnedVertex& v = vertices[i];
+
+		float weights[4];
+		GetBoneWeights(v, weights);
+
+		// Blend in the hemisphere of the first bone's rotation.
+		XMVECTOR real0 = XMLoadFloat4(&finalDualQuats[v.BoneIndices[0]].Real);
+
+		XMVECTOR real = XMVectorZero();
+		XMVECTOR dual = XMVectorZero();
+		for(int j = 0; j < 4; ++j)
+		{
+			const DualQuaternion& dq = finalDualQuats[v.BoneIndices[j]];
+			XMVECTOR r = XMLoadFloat4(&dq.Real);
+			XMVECTOR d = XMLoadFloat4(&dq.Dual);
+
+			float w = XMVectorGetX(XMVector4Dot(r, real0)) < 0.0f ? -weights[j] : weights[j];
+			real = XMVectorMultiplyAdd(XMVectorReplicate(w), r, real);
+			dual = XMVectorMultiplyAdd(XMVectorReplicate(w), d, dual);
+		}
+
+		XMVECTOR invLength = XMVectorReciprocalSqrt(XMVector4Dot(real, real));
+		real = XMVectorMultiply(real, invLength);
+		dual = XMVectorMultiply(dual, invLength);
+
+		XMVECTOR pos = XMVectorAdd(DualQuaternion::Rotate(XMLoadFloat3(&v.Pos), real),
+			DualQuaternion::Translation(real, dual));
+
+		XMStoreFloat3(&output[i].Pos, pos);
+		XMStoreFloat3(&output[i].Normal, DualQuaternion::Rotate(XMLoadFloat3(&v.Normal), real));
+		XMStoreFloat3(&output[i].TangentU, DualQuaternion::Rotate(XMLoadFloat3(&v.TangentU), real));
+	}
+}
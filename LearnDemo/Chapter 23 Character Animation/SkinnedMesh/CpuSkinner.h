@@ -0,0 +1,71 @@
+#ifndef CPUSKINNER_H
+#define CPUSKINNER_H
+
+#include "LoadM3d.h"
+#include "../../../Common/ThreadPool.h"
+
+///<summary>
+/// A skinned vertex after skinning: the parts the bones change.
+///</summary>
+struct CpuSkinnedVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT3 TangentU;
+};
+
+///<summary>
+/// Skins M3DLoader::SkinnedVertex data on the CPU, so animated meshes can
+/// get skinned bounds, be picked, or be checked without a device.
+///
+/// Skin() is the fast path: the four bone matrices of a vertex are blended
+/// first and the blend is applied once, with SIMD, and vertex ranges are
+/// spread across a ThreadPool.  The bounding box of the skinned positions
+/// comes out of the same pass.  The static reference versions do exactly
+/// what the SKINNED vertex shaders do, one influence at a time.
+///</summary>
+class CpuSkinner
+{
+public:
+	void Initialize(ThreadPool* threadPool);
+
+	// Linear blend skinning with a matrix palette as uploaded to the SkinnedCB
+	// (transposed, from GetFinalTransforms).  output may not alias vertices.
+	void Skin(const M3DLoader::SkinnedVertex* vertices, UINT vertexCount,
+		const DirectX::XMFLOAT4X4* finalTransforms, CpuSkinnedVertex* output,
+		DirectX::BoundingBox& bounds);
+
+	// Linear blend skinning with a matrix palette as uploaded to the
+	// SkinnedCB, i.e., the transposed matrices from GetFinalTransforms.
+	static void SkinLinear(const M3DLoader::SkinnedVertex* vertices, UINT vertexCount,
+		const DirectX::XMFLOAT4X4* finalTransforms, CpuSkinnedVertex* output);
+
+	// Dual quaternion skinning with a palette from GetFinalDualQuaternions
+	// (SKINNED_DQ).
+	static void SkinDualQuaternion(const M3DLoader::SkinnedVertex* vertices, UINT vertexCount,
+		const DualQuaternion* finalDualQuats, CpuSkinnedVertex* output);
+
+	// The four bone weights of a vertex.  The shader derives the fourth
+	// from the three stored ones.
+	static void GetBoneWeights(const M3DLoader::SkinnedVertex& v, float weights[4])
+	{
+		weights[0] = v.BoneWeights.x;
+		weights[1] = v.BoneWeights.y;
+		weights[2] = v.BoneWeights.z;
+		weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
+	}
+
+private:
+	// One range of Skin(); grows [boundsMin, boundsMax] by the skinned positions.
+	static void SkinRange(const M3DLoader::SkinnedVertex* vertices, UINT begin, UINT end,
+		const DirectX::XMFLOAT4X4* finalTransforms, CpuSkinnedVertex* output,
+		DirectX::XMFLOAT4& boundsMin, DirectX::XMFLOAT4& boundsMax);
+
+	ThreadPool* mThreadPool = nullptr;
+
+	// Bounds of the vertices each thread skinned: min in mThreadBounds[2*i],
+	// max in mThreadBounds[2*i+1].
+	std::vector<DirectX::XMFLOAT4> mThreadBounds;
+};
+
+#endif // CPUSKINNER_H
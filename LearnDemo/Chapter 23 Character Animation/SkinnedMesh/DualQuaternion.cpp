@@ -0,0 +1,50 @@
+#include "DualQuaternion.h"
+
+using namespace DirectX;
+
+void DualQuaternion::Store(FXMMATRIX M)
+{
+	XMVECTOR real = XMQuaternionNormalize(XMQuaternionRotationMatrix(M));
+	XMVECTOR t = XMVectorSetW(M.r[3], 0.0f);
+
+	// Dual = 0.5 * t * real.  XMQuaternionMultiply(a, b) is the product b*a.
+	XMVECTOR dual = XMVectorScale(XMQuaternionMultiply(real, t), 0.5f);
+
+	XMStoreFloat4(&Real, real);
+	XMStoreFloat4(&Dual, dual);
+}
+
+XMMATRIX DualQuaternion::ToMatrix()const
+{
+	XMVECTOR real = XMLoadFloat4(&Real);
+	XMVECTOR dual = XMLoadFloat4(&Dual);
+
+	XMMATRIX M = XMMatrixRotationQuaternion(real);
+	M.r[3] = XMVectorSetW(Translation(real, dual), 1.0f);
+	return M;
+}
+
+void DualQuaternion::FromMatrices(const XMFLOAT4X4* M, UINT count, DualQuaternion* dq)
+{
+	for(UINT i = 0; i < count; ++i)
+	{
+		dq[i].Store(XMLoadFloat4x4(&M[i]));
+	}
+}
+
+XMVECTOR DualQuaternion::Translation(FXMVECTOR real, FXMVECTOR dual)
+{
+	// t = 2 * dual * conjugate(real), written out:
+	// 2 * (real.w*dual.xyz - dual.w*real.xyz + cross(real.xyz, dual.xyz))
+	XMVECTOR t = XMVectorMultiply(XMVectorSplatW(real), dual);
+	t = XMVectorNegativeMultiplySubtract(XMVectorSplatW(dual), real, t);
+	t = XMVectorAdd(t, XMVector3Cross(real, dual));
+	return XMVectorSetW(XMVectorScale(t, 2.0f), 0.0f);
+}
+
+XMVECTOR DualQuaternion::Rotate(FXMVECTOR v, FXMVECTOR q)
+{
+	// v + 2*cross(q.xyz, cross(q.xyz, v) + q.w*v)
+	XMVECTOR u = XMVectorMultiplyAdd(XMVectorSplatW(q), v, XMVector3Cross(q, v));
+	return XMVectorMultiplyAdd(XMVector3Cross(q, u), XMVectorReplicate(2.0f), v);
+}
@@ -0,0 +1,35 @@
+#ifndef DUALQUATERNION_H
+#define DUALQUATERNION_H
+
+#include "../../../Common/d3dUtil.h"
+
+///<summary>
+/// A unit dual quaternion: a rotation (Real) and a translation folded into
+/// the dual part (Dual = 0.5 * t * Real).  Eight floats per bone instead of
+/// sixteen, and blending them does not collapse the mesh at twisting
+/// joints the way blending matrices does.
+///
+/// Only rigid transforms can be represented; any scale in a bone transform
+/// is dropped.  Same layout as the shader palette: Real in gBoneDualQuats[2i],
+/// Dual in gBoneDualQuats[2i+1].
+///</summary>
+struct DualQuaternion
+{
+	// M is a rigid transform in the usual row vector convention (not transposed).
+	void Store(DirectX::FXMMATRIX M);
+	DirectX::XMMATRIX ToMatrix()const;
+
+	// Converts count rigid matrices to dual quaternions.
+	static void FromMatrices(const DirectX::XMFLOAT4X4* M, UINT count, DualQuaternion* dq);
+
+	// Translation encoded by a unit dual quaternion (real, dual).
+	static DirectX::XMVECTOR Translation(DirectX::FXMVECTOR real, DirectX::FXMVECTOR dual);
+
+	// Rotates v by the unit quaternion q (same result as XMVector3Rotate).
+	static DirectX::XMVECTOR Rotate(DirectX::FXMVECTOR v, DirectX::FXMVECTOR q);
+
+	DirectX::XMFLOAT4 Real;
+	DirectX::XMFLOAT4 Dual;
+};
+
+#endif // DUALQUATERNION_H
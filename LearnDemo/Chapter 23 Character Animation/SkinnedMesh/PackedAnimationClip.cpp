@@ -0,0 +1,216 @@
+#include "PackedAnimationClip.h"
+#include "SkinnedData.h"
+
+using namespace DirectX;
+
+void PackedAnimationClip::Build(const AnimationClip& clip, float framesPerSecond)
+{
+	mBoneCount = (UINT)clip.BoneAnimations.size();
+	mGroupCount = (mBoneCount + 3) / 4;
+
+	mStartTime = clip.GetClipStartTime();
+	mEndTime = clip.GetClipEndTime();
+
+	mKeyCount = (UINT)ceilf((mEndTime - mStartTime) * framesPerSecond) + 1;
+	mKeyCount = MathHelper::Max(mKeyCount, 2u);
+
+	const float step = (mEndTime - mStartTime) / (mKeyCount - 1);
+	mInvKeyStep = step > 0.0f ? 1.0f / step : 0.0f;
+
+	// Unused lanes of the last group hold the identity transform.
+	GroupKey identity;
+	for(UINT c = 0; c < ChannelCount; ++c)
+	{
+		float v = (c == Sx || c == Sy || c == Sz || c == Qw) ? 1.0f : 0.0f;
+		identity.Channels[c] = XMFLOAT4(v, v, v, v);
+	}
+	mKeys.assign((size_t)mKeyCount * mGroupCount, identity);
+
+	for(UINT bone = 0; bone < mBoneCount; ++bone)
+	{
+		const BoneAnimation& anim = clip.BoneAnimations[bone];
+		const UINT group = bone / 4;
+		const UINT lane = bone % 4;
+
+		XMVECTOR prevQ = XMQuaternionIdentity();
+		for(UINT k = 0; k < mKeyCount; ++k)
+		{
+			float t = MathHelper::Min(mStartTime + k*step, mEndTime);
+
+			// Sample through the regular path so the packed clip reproduces it,
+			// and pull the TRS back out of the matrix.
+			XMFLOAT4X4 M;
+			anim.Interpolate(t, M);
+
+			XMVECTOR S, Q, T;
+			XMMatrixDecompose(&S, &Q, &T, XMLoadFloat4x4(&M));
+
+			// Keep consecutive keys in the same hemisphere so nlerp takes the
+			// short way around without a run-time sign check.
+			if( k > 0 && XMVectorGetX(XMQuaternionDot(prevQ, Q)) < 0.0f )
+				Q = XMVectorNegate(Q);
+			prevQ = Q;
+
+			XMFLOAT3 s, p;
+			XMFLOAT4 q;
+			XMStoreFloat3(&s, S);
+			XMStoreFloat3(&p, T);
+			XMStoreFloat4(&q, Q);
+
+			const float values[ChannelCount] = { p.x, p.y, p.z, s.x, s.y, s.z, q.x, q.y, q.z, q.w };
+
+			GroupKey& key = mKeys[(size_t)k * mGroupCount + group];
+			for(UINT c = 0; c < ChannelCount; ++c)
+			{
+				(&key.Channels[c].x)[lane] = values[c];
+			}
+		}
+	}
+}
+
+float PackedAnimationClip::GetClipStartTime()const
+{
+	return mStartTime;
+}
+
+float PackedAnimationClip::GetClipEndTime()const
+{
+	return mEndTime;
+}
+
+UINT PackedAnimationClip::BoneCount()const
+{
+	return mBoneCount;
+}
+
+UINT PackedAnimationClip::KeyCount()const
+{
+	return mKeyCount;
+}
+
+size_t PackedAnimationClip::ByteSize()const
+{
+	return mKeys.size() * sizeof(GroupKey);
+}
+
+const PackedAnimationClip::GroupKey& PackedAnimationClip::Key(UINT key, UINT group)const
+{
+	return mKeys[(size_t)key * mGroupCount + group];
+}
+
+void PackedAnimationClip::Interpolate(float t, XMFLOAT4X4* boneTransforms, bool slerpCorrection)const
+{
+	// Keys are uniform and shared by all bones, so one index serves the whole clip.
+	t = MathHelper::Clamp(t, mStartTime, mEndTime);
+	float keyPos = (t - mStartTime) * mInvKeyStep;
+	UINT k = MathHelper::Min((UINT)keyPos, mKeyCount - 2);
+	float lerpPercent = MathHelper::Clamp(keyPos - (float)k, 0.0f, 1.0f);
+
+	const XMVECTOR one = XMVectorSplatOne();
+	const XMVECTOR two = XMVectorReplicate(2.0f);
+	const XMVECTOR half = XMVectorReplicate(0.5f);
+
+	for(UINT g = 0; g < mGroupCount; ++g)
+	{
+		const GroupKey& key0 = Key(k, g);
+		const GroupKey& key1 = Key(k + 1, g);
+
+		XMVECTOR c0[ChannelCount];
+		XMVECTOR c1[ChannelCount];
+		for(UINT c = 0; c < ChannelCount; ++c)
+		{
+			c0[c] = XMLoadFloat4(&key0.Channels[c]);
+			c1[c] = XMLoadFloat4(&key1.Channels[c]);
+		}
+
+		XMVECTOR s = XMVectorReplicate(lerpPercent);
+
+		//
+		// Rotation: nlerp, optionally with the blend factor bent towards slerp.
+		//
+
+		XMVECTOR qs = s;
+		if( slerpCorrection )
+		{
+			// cos(angle) between the two keys, one lane per bone.
+			XMVECTOR d = XMVectorMultiply(c0[Qx], c1[Qx]);
+			d = XMVectorMultiplyAdd(c0[Qy], c1[Qy], d);
+			d = XMVectorMultiplyAdd(c0[Qz], c1[Qz], d);
+			d = XMVectorMultiplyAdd(c0[Qw], c1[Qw], d);
+
+			// t' = t + t(t - 0.5)(t - 1)k, where k is a quadratic fit in cos(angle).
+			// Brings nlerp within ~1e-3 rad of slerp for any angle < 180 degrees.
+			XMVECTOR fit = XMVectorMultiplyAdd(d, XMVectorReplicate(0.331442f), XMVectorReplicate(-1.25654f));
+			fit = XMVectorMultiplyAdd(d, fit, XMVectorReplicate(0.931872f));
+
+			XMVECTOR b = XMVectorMultiply(XMVectorMultiply(s, XMVectorSubtract(s, half)), XMVectorSubtract(s, one));
+			qs = XMVectorMultiplyAdd(b, fit, s);
+		}
+
+		XMVECTOR qx = XMVectorLerpV(c0[Qx], c1[Qx], qs);
+		XMVECTOR qy = XMVectorLerpV(c0[Qy], c1[Qy], qs);
+		XMVECTOR qz = XMVectorLerpV(c0[Qz], c1[Qz], qs);
+		XMVECTOR qw = XMVectorLerpV(c0[Qw], c1[Qw], qs);
+
+		XMVECTOR lengthSq = XMVectorMultiply(qx, qx);
+		lengthSq = XMVectorMultiplyAdd(qy, qy, lengthSq);
+		lengthSq = XMVectorMultiplyAdd(qz, qz, lengthSq);
+		lengthSq = XMVectorMultiplyAdd(qw, qw, lengthSq);
+		XMVECTOR invLength = XMVectorReciprocalSqrt(lengthSq);
+		qx = XMVectorMultiply(qx, invLength);
+		qy = XMVectorMultiply(qy, invLength);
+		qz = XMVectorMultiply(qz, invLength);
+		qw = XMVectorMultiply(qw, invLength);
+
+		//
+		// Scale and translation: plain lerp.
+		//
+
+		XMVECTOR sx = XMVectorLerpV(c0[Sx], c1[Sx], s);
+		XMVECTOR sy = XMVectorLerpV(c0[Sy], c1[Sy], s);
+		XMVECTOR sz = XMVectorLerpV(c0[Sz], c1[Sz], s);
+		XMVECTOR tx = XMVectorLerpV(c0[Tx], c1[Tx], s);
+		XMVECTOR ty = XMVectorLerpV(c0[Ty], c1[Ty], s);
+		XMVECTOR tz = XMVectorLerpV(c0[Tz], c1[Tz], s);
+
+		//
+		// Build S*R*T for the four bones at once (same as XMMatrixAffineTransformation).
+		//
+
+		XMVECTOR xx = XMVectorMultiply(qx, qx), yy = XMVectorMultiply(qy, qy), zz = XMVectorMultiply(qz, qz);
+		XMVECTOR xy = XMVectorMultiply(qx, qy), xz = XMVectorMultiply(qx, qz), yz = XMVectorMultiply(qy, qz);
+		XMVECTOR wx = XMVectorMultiply(qw, qx), wy = XMVectorMultiply(qw, qy), wz = XMVectorMultiply(qw, qz);
+
+		XMVECTOR m00 = XMVectorNegativeMultiplySubtract(two, XMVectorAdd(yy, zz), one);
+		XMVECTOR m01 = XMVectorMultiply(two, XMVectorAdd(xy, wz));
+		XMVECTOR m02 = XMVectorMultiply(two, XMVectorSubtract(xz, wy));
+
+		XMVECTOR m10 = XMVectorMultiply(two, XMVectorSubtract(xy, wz));
+		XMVECTOR m11 = XMVectorNegativeMultiplySubtract(two, XMVectorAdd(xx, zz), one);
+		XMVECTOR m12 = XMVectorMultiply(two, XMVectorAdd(yz, wx));
+
+		XMVECTOR m20 = XMVectorMultiply(two, XMVectorAdd(xz, wy));
+		XMVECTOR m21 = XMVectorMultiply(two, XMVectorSubtract(yz, wx));
+		XMVECTOR m22 = XMVectorNegativeMultiplySubtract(two, XMVectorAdd(xx, yy), one);
+
+		const XMVECTOR zero = XMVectorZero();
+
+		// Each XMMATRIX below holds one matrix row for all four bones (element
+		// j of every vector is bone j).  Transposing gives that row per bone.
+		XMMATRIX row0 = XMMatrixTranspose(XMMATRIX(
+			XMVectorMultiply(sx, m00), XMVectorMultiply(sx, m01), XMVectorMultiply(sx, m02), zero));
+		XMMATRIX row1 = XMMatrixTranspose(XMMATRIX(
+			XMVectorMultiply(sy, m10), XMVectorMultiply(sy, m11), XMVectorMultiply(sy, m12), zero));
+		XMMATRIX row2 = XMMatrixTranspose(XMMATRIX(
+			XMVectorMultiply(sz, m20), XMVectorMultiply(sz, m21), XMVectorMultiply(sz, m22), zero));
+		XMMATRIX row3 = XMMatrixTranspose(XMMATRIX(tx, ty, tz, one));
+
+		const UINT firstBone = g * 4;
+		const UINT lanes = MathHelper::Min(4u, mBoneCount - firstBone);
+		for(UINT j = 0; j < lanes; ++j)
+		{
+			XMMATRIX M(row0.r[j], row1.r[j], row2.r[j], row3.r[j]);
+			XMStoreFloat4x4(&boneTransforms[firstBone + j], M);
+		}
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef PACKEDANIMATIONCLIP_H
+#define PACKEDANIMATIONCLIP_H
+
+#include "../../../Common/d3dUtil.h"
+#include "../../../Common/MathHelper.h"
+
+struct AnimationClip;
+
+///<summary>
+/// An AnimationClip repacked for SIMD evaluation.
+///
+/// Every bone is resampled to the same uniform key times, and the keys
+/// are stored structure-of-arrays in groups of four bones: for each key
+/// and group there is one float4 per channel (Tx, Ty, Tz, Sx, ..., Qw),
+/// where lane j belongs to bone 4*group+j.  One key lookup then drives
+/// four bones, and each channel is interpolated with a single vector op.
+///
+/// Rotations are blended with nlerp.  Neighbouring keys are flipped into
+/// the same hemisphere at build time, so no sign test is needed at run
+/// time.  With slerpCorrection the blend factor is adjusted per lane to
+/// approximate slerp's constant angular velocity.
+///</summary>
+class PackedAnimationClip
+{
+public:
+	void Build(const AnimationClip& clip, float framesPerSecond);
+
+	float GetClipStartTime()const;
+	float GetClipEndTime()const;
+
+	UINT BoneCount()const;
+	UINT KeyCount()const;
+	size_t ByteSize()const;
+
+	// Writes the to-parent transform of every bone at time t.  The matrices
+	// come straight out of the SoA registers through a 4x4 transpose per
+	// bone group, in the same row-vector layout AnimationClip::Interpolate
+	// produces.  boneTransforms must have room for BoneCount() matrices.
+	void Interpolate(float t, DirectX::XMFLOAT4X4* boneTransforms, bool slerpCorrection = true)const;
+
+private:
+	enum Channel
+	{
+		Tx = 0, Ty, Tz,
+		Sx, Sy, Sz,
+		Qx, Qy, Qz, Qw,
+		ChannelCount
+	};
+
+	// One key of one four-bone group.
+	struct GroupKey
+	{
+		DirectX::XMFLOAT4 Channels[ChannelCount];
+	};
+
+	const GroupKey& Key(UINT key, UINT group)const;
+
+	std::vector<GroupKey> mKeys;
+
+	UINT mBoneCount = 0;
+	UINT mGroupCount = 0;
+	UINT mKeyCount = 0;
+
+	float mStartTime = 0.0f;
+	float mEndTime = 0.0f;
+	float mInvKeyStep = 0.0f;
+};
+
+#endif // PACKEDANIMATIONCLIP_H
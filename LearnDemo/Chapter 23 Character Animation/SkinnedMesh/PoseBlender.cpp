@@ -0,0 +1,71 @@
+#include "PoseBlender.h"
+
+using namespace DirectX;
+
+void PoseBlender::Initialize(const SkinnedData* skinInfo)
+{
+	mSkinInfo = skinInfo;
+
+	UINT numBones = skinInfo->BoneCount();
+	mPose.resize(numBones);
+	mLayerPose.resize(numBones);
+	mToParentTransforms.resize(numBones);
+}
+
+void PoseBlender::GetFinalTransforms(const PoseBlendLayer* layers, UINT layerCount,
+	std::vector<XMFLOAT4X4>& finalTransforms)
+{
+	const UINT numBones = (UINT)mPose.size();
+
+	if(layerCount == 0)
+	{
+		for(UINT i = 0; i < numBones; ++i)
+			finalTransforms[i] = MathHelper::Identity4x4();
+		return;
+	}
+
+	// The base layer is taken as is.
+	mSkinInfo->GetLocalPose(layers[0].ClipName, layers[0].TimePos, mPose.data());
+
+	for(UINT layer = 1; layer < layerCount; ++layer)
+	{
+		const PoseBlendLayer& blendLayer = layers[layer];
+		if(blendLayer.Weight <= 0.0f)
+			continue;
+
+		mSkinInfo->GetLocalPose(blendLayer.ClipName, blendLayer.TimePos, mLayerPose.data());
+
+		for(UINT i = 0; i < numBones; ++i)
+		{
+			float w = blendLayer.Weight;
+			if(blendLayer.BoneMask != nullptr)
+				w *= (*blendLayer.BoneMask)[i];
+
+			if(w <= 0.0f)
+				continue;
+
+			BonePose& pose = mPose[i];
+			const BonePose& layerPose = mLayerPose[i];
+
+			XMVECTOR S = XMVectorLerp(XMLoadFloat3(&pose.Scale), XMLoadFloat3(&layerPose.Scale), w);
+			XMVECTOR P = XMVectorLerp(XMLoadFloat3(&pose.Translation), XMLoadFloat3(&layerPose.Translation), w);
+
+			// nlerp, taking the short way around.
+			XMVECTOR q0 = XMLoadFloat4(&pose.RotationQuat);
+			XMVECTOR q1 = XMLoadFloat4(&layerPose.RotationQuat);
+			if( XMVectorGetX(XMQuaternionDot(q0, q1)) < 0.0f )
+				q1 = XMVectorNegate(q1);
+			XMVECTOR Q = XMQuaternionNormalize(XMVectorLerp(q0, q1, w));
+
+			pose.Store(S, P, Q);
+		}
+	}
+
+	for(UINT i = 0; i < numBones; ++i)
+	{
+		XMStoreFloat4x4(&mToParentTransforms[i], mPose[i].ToMatrix());
+	}
+
+	// The expensive local to root concatenation, once for the blended pose.
+	mSkinInfo->ComputeFinalTransforms(mToParentTransforms, finalTransforms);
+}
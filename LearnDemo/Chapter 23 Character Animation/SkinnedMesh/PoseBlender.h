@@ -0,0 +1,53 @@
+#ifndef POSEBLENDER_H
+#define POSEBLENDER_H
+
+#include "SkinnedData.h"
+
+///<summary>
+/// One input of a PoseBlender: a clip sampled at TimePos, laid over the
+/// layers before it with the given weight.
+///</summary>
+struct PoseBlendLayer
+{
+	std::string ClipName;
+	float TimePos = 0.0f;
+	float Weight = 1.0f;
+
+	// Optional per-bone scale on Weight (e.g., 1 for the upper body bones
+	// and 0 elsewhere).  Must have SkinnedData::BoneCount() entries.
+	const std::vector<float>* BoneMask = nullptr;
+};
+
+///<summary>
+/// Blends N clips in joint space and runs the hierarchy pass once, rather
+/// than computing a full final-transform palette per clip.
+///
+/// Layers are applied in order.  The first one is the base pose; every
+/// later layer is lerped over the result so far by Weight*BoneMask[bone]
+/// (nlerp for rotations).  So a cross-fade is two layers with the second
+/// weighted by the fade, and masking a layer leaves the masked-out bones
+/// to the layers below.  To average N clips evenly, give layer i the
+/// weight 1/(i+1).
+///
+/// All scratch memory is allocated by Initialize; blending allocates
+/// nothing.
+///</summary>
+class PoseBlender
+{
+public:
+	void Initialize(const SkinnedData* skinInfo);
+
+	// finalTransforms must have skinInfo->BoneCount() entries.  With no
+	// layers they are set to the bind pose (identity).
+	void GetFinalTransforms(const PoseBlendLayer* layers, UINT layerCount,
+		std::vector<DirectX::XMFLOAT4X4>& finalTransforms);
+
+private:
+	const SkinnedData* mSkinInfo = nullptr;
+
+	std::vector<BonePose> mPose;
+	std::vector<BonePose> mLayerPose;
+	std::vector<DirectX::XMFLOAT4X4> mToParentTransforms;
+};
+
+#endif // POSEBLENDER_H
@@ -0,0 +1,219 @@
+#include "PoseCache.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+void PoseCache::Initialize(UINT capacity, UINT maxBones, float timeQuantum)
+{
+	// A miss always needs an entry to evict, so keep at least one.
+	capacity = MathHelper::Max(capacity, 1u);
+
+	mMaxBones = maxBones;
+	mTimeQuantum = timeQuantum;
+
+	mEntries.assign(capacity, Entry());
+	mPalettes.resize((size_t)capacity * maxBones);
+	mScratch.resize(maxBones);
+
+	UINT tableSize = 1;
+	while(tableSize < 2 * capacity)
+		tableSize *= 2;
+	mTable.resize(tableSize);
+	mTableMask = tableSize - 1;
+
+	Clear();
+	ResetCounters();
+}
+
+void PoseCache::SetTimeQuantum(float timeQuantum)
+{
+	mTimeQuantum = timeQuantum;
+	Clear();
+}
+
+float PoseCache::GetTimeQuantum()const
+{
+	return mTimeQuantum;
+}
+
+UINT PoseCache::GetClipHandle(const SkinnedData* skinInfo, const std::string& clipName)
+{
+	for(UINT i = 0; i < mClips.size(); ++i)
+	{
+		if(mClips[i].SkinnedInfo == skinInfo && mClips[i].ClipName == clipName)
+			return i;
+	}
+
+	ClipInfo clip;
+	clip.SkinnedInfo = skinInfo;
+	clip.ClipName = clipName;
+	mClips.push_back(clip);
+
+	return (UINT)mClips.size() - 1;
+}
+
+const XMFLOAT4X4* PoseCache::GetFinalTransforms(UINT clipHandle, float timePos, UINT lod)
+{
+	const ClipInfo& clip = mClips[clipHandle];
+
+	// Key layout: clip handle (20 bits) | LOD (4 bits) | time step (40 bits).
+	const float quantum = mTimeQuantum * (float)(1u << lod);
+	const UINT64 step = (UINT64)(MathHelper::Max(timePos, 0.0f) / quantum + 0.5f);
+	const UINT64 key = ((UINT64)clipHandle << 44) | ((UINT64)(lod & 0xF) << 40) | (step & 0xFFFFFFFFFFull);
+
+	UINT slot = FindSlot(key);
+	if(mTable[slot] != NoEntry)
+	{
+		++mHits;
+
+		// Move to the front of the LRU list.
+		const UINT index = mTable[slot];
+		UnlinkLru(index);
+		PushFrontLru(index);
+
+		return &mPalettes[(size_t)index * mMaxBones];
+	}
+
+	++mMisses;
+
+	UINT index;
+	if(mUsedEntries < mEntries.size())
+	{
+		index = mUsedEntries++;
+	}
+	else
+	{
+		// Reuse the least recently used entry.  Removing its key can move
+		// other keys, so find the new key's slot again.
+		++mEvictions;
+		index = mLruTail;
+		UnlinkLru(index);
+		RemoveKey(mEntries[index].Key);
+		slot = FindSlot(key);
+	}
+
+	mEntries[index].Key = key;
+	PushFrontLru(index);
+	mTable[slot] = index;
+
+	XMFLOAT4X4* palette = &mPalettes[(size_t)index * mMaxBones];
+	clip.SkinnedInfo->GetFinalTransforms(clip.ClipName, step * quantum, mScratch.data(), palette);
+
+	return palette;
+}
+
+void PoseCache::Clear()
+{
+	std::fill(mTable.begin(), mTable.end(), NoEntry);
+	mUsedEntries = 0;
+	mLruHead = NoEntry;
+	mLruTail = NoEntry;
+}
+
+void PoseCache::ResetCounters()
+{
+	mHits = 0;
+	mMisses = 0;
+	mEvictions = 0;
+}
+
+UINT64 PoseCache::Hits()const
+{
+	return mHits;
+}
+
+UINT64 PoseCache::Misses()const
+{
+	return mMisses;
+}
+
+UINT64 PoseCache::Evictions()const
+{
+	return mEvictions;
+}
+
+float PoseCache::HitRate()const
+{
+	UINT64 lookups = mHits + mMisses;
+	return lookups > 0 ? (float)mHits / (float)lookups : 0.0f;
+}
+
+UINT PoseCache::EntryCount()const
+{
+	return mUsedEntries;
+}
+
+size_t PoseCache::MemoryUse()const
+{
+	return (mPalettes.size() + mScratch.size()) * sizeof(XMFLOAT4X4) +
+		mEntries.size() * sizeof(Entry) + mTable.size() * sizeof(UINT);
+}
+
+UINT PoseCache::HomeSlot(UINT64 key)const
+{
+	// Fibonacci hashing; the high bits are the well mixed ones.
+	return (UINT)((key * 0x9E3779B97F4A7C15ull) >> 32) & mTableMask;
+}
+
+UINT PoseCache::FindSlot(UINT64 key)const
+{
+	UINT slot = HomeSlot(key);
+	while(mTable[slot] != NoEntry && mEntries[mTable[slot]].Key != key)
+	{
+		slot = (slot + 1) & mTableMask;
+	}
+	return slot;
+}
+
+void PoseCache::RemoveKey(UINT64 key)
+{
+	UINT hole = FindSlot(key);
+	if(mTable[hole] == NoEntry)
+		return;
+	mTable[hole] = NoEntry;
+
+	// Shift back the keys after the hole that can no longer be reached
+	// from their home slot, so that probing never stops early at the hole.
+	UINT slot = (hole + 1) & mTableMask;
+	while(mTable[slot] != NoEntry)
+	{
+		const UINT home = HomeSlot(mEntries[mTable[slot]].Key);
+		const bool reachable = hole <= slot ? (hole < home && home <= slot) : (hole < home || home <= slot);
+		if(!reachable)
+		{
+			mTable[hole] = mTable[slot];
+			mTable[slot] = NoEntry;
+			hole = slot;
+		}
+		slot = (slot + 1) & mTableMask;
+	}
+}
+
+void PoseCache::UnlinkLru(UINT index)
+{
+	Entry& entry = mEntries[index];
+	if(entry.Prev != NoEntry)
+		mEntries[entry.Prev].Next = entry.Next;
+	else
+		mLruHead = entry.Next;
+
+	if(entry.Next != NoEntry)
+		mEntries[entry.Next].Prev = entry.Prev;
+	else
+		mLruTail = entry.Prev;
+
+	entry.Prev = NoEntry;
+	entry.Next = NoEntry;
+}
+
+void PoseCache::PushFrontLru(UINT index)
+{
+	Entry& entry = mEntries[index];
+	entry.Prev = NoEntry;
+	entry.Next = mLruHead;
+	if(mLruHead != NoEntry)
+		mEntries[mLruHead].Prev = index;
+	else
+		mLruTail = index;
+	mLruHead = index;
+}
@@ -0,0 +1,104 @@
+#ifndef POSECACHE_H
+#define POSECACHE_H
+
+#include "SkinnedData.h"
+
+///<summary>
+/// Shares finished bone palettes between instances playing the same clip.
+///
+/// Time is snapped to a multiple of the time quantum, so every instance
+/// within the same quantum of a clip gets the same palette.  Entries are
+/// keyed by (clip handle, quantized time, LOD); LOD n snaps to
+/// quantum * 2^n, so distant characters share more.  The cache holds a
+/// fixed number of palettes, allocated up front, and evicts the least
+/// recently used one when it is full.  The LRU list and the lookup table
+/// are arrays of entry indices sized in Initialize, so a miss allocates
+/// nothing.
+///
+/// Not thread safe.  A returned palette stays valid until the next call
+/// to GetFinalTransforms that misses.
+///</summary>
+class PoseCache
+{
+public:
+	// capacity palettes (at least one) of up to maxBones bones each.
+	void Initialize(UINT capacity, UINT maxBones, float timeQuantum);
+
+	// Changing the quantum invalidates every entry.
+	void SetTimeQuantum(float timeQuantum);
+	float GetTimeQuantum()const;
+
+	// A small integer standing for (skinInfo, clipName), so lookups don't
+	// hash strings.  Registering the same pair twice returns the same handle.
+	UINT GetClipHandle(const SkinnedData* skinInfo, const std::string& clipName);
+
+	// Returns the final transforms (skinInfo->BoneCount() of them) of the clip
+	// at timePos snapped to the quantum for this LOD.
+	const DirectX::XMFLOAT4X4* GetFinalTransforms(UINT clipHandle, float timePos, UINT lod = 0);
+
+	void Clear();
+	void ResetCounters();
+
+	UINT64 Hits()const;
+	UINT64 Misses()const;
+	UINT64 Evictions()const;
+	float HitRate()const;
+
+	UINT EntryCount()const;
+	size_t MemoryUse()const;
+
+private:
+	struct ClipInfo
+	{
+		const SkinnedData* SkinnedInfo = nullptr;
+		std::string ClipName;
+	};
+
+	static const UINT NoEntry = 0xFFFFFFFF;
+
+	// Prev and Next link the entry into the LRU list.
+	struct Entry
+	{
+		UINT64 Key = 0;
+		UINT Prev = NoEntry;
+		UINT Next = NoEntry;
+	};
+
+	// Lookup table slot the key hashes to.
+	UINT HomeSlot(UINT64 key)const;
+
+	// Slot holding the entry with this key, or the empty slot it would go in.
+	UINT FindSlot(UINT64 key)const;
+	void RemoveKey(UINT64 key);
+
+	void UnlinkLru(UINT index);
+	void PushFrontLru(UINT index);
+
+	std::vector<ClipInfo> mClips;
+
+	std::vector<Entry> mEntries;
+	std::vector<DirectX::XMFLOAT4X4> mPalettes;   // mEntries.size()*mMaxBones
+	std::vector<DirectX::XMFLOAT4X4> mScratch;
+
+	// Entries [0, mUsedEntries) hold palettes; the rest have never been used
+	// since the last Clear.
+	UINT mUsedEntries = 0;
+
+	// Head is the most recently used entry, tail the least.
+	UINT mLruHead = NoEntry;
+	UINT mLruTail = NoEntry;
+
+	// Open addressing with linear probing: entry indices, NoEntry for an empty
+	// slot.  A power of two at least twice the capacity, so probes stay short.
+	std::vector<UINT> mTable;
+	UINT mTableMask = 0;
+
+	UINT mMaxBones = 0;
+	float mTimeQuantum = 1.0f / 60.0f;
+
+	UINT64 mHits = 0;
+	UINT64 mMisses = 0;
+	UINT64 mEvictions = 0;
+};
+
+#endif // POSECACHE_H
@@ -62,10 +62,123 @@ cbuffer cbPerObject : register(b0)
 	uint gObjPad2;
 };
 
+#if defined(VERTEX_ANIMATION)
+// A clip baked by VertexAnimationBaker.  Crowds drawn from it need no bone
+// palette, so the layout goes where the palette would be.
+cbuffer cbSkinned : register(b1)
+{
+    uint gVatWidth;
+    uint gVatRowsPerFrame;
+    uint gVatFrameCount;
+    float gVatFrameRate;
+    float gVatDuration;
+    uint gVatPad0;
+    uint gVatPad1;
+    uint gVatPad2;
+};
+
+// Per instance: where it stands and how far into the clip it is.
+struct VertexAnimationInstance
+{
+    float4x4 World;
+    float TimeOffset;
+    uint InstPad0;
+    uint InstPad1;
+    uint InstPad2;
+};
+
+Texture2D<uint4> gVertexAnimation : register(t0, space2);
+StructuredBuffer<VertexAnimationInstance> gVatInstances : register(t1, space2);
+
+float3 DecodeOctahedralNormal(uint packed)
+{
+    float2 e = float2(packed & 0xFF, packed >> 8) / 255.0f * 2.0f - 1.0f;
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    if(n.z < 0.0f)
+        n.xy = (1.0f - abs(n.yx)) * (n.xy >= 0.0f ? 1.0f : -1.0f);
+    return normalize(n);
+}
+
+void LoadBakedVertex(uint vertexId, uint frame, out float3 posL, out float3 normalL)
+{
+    // Rows are consecutive, so vertex v of a frame is texel v counted from the frame's first row.
+    uint2 texel = uint2(vertexId % gVatWidth, frame*gVatRowsPerFrame + vertexId / gVatWidth);
+    uint4 v = gVertexAnimation.Load(int3(texel, 0));
+    posL = f16tof32(v.xyz);
+    normalL = DecodeOctahedralNormal(v.w);
+}
+
+// The vertex at timePos (looped), blended between the two nearest frames.
+void SampleBakedVertex(uint vertexId, float timePos, out float3 posL, out float3 normalL)
+{
+    float t = gVatDuration > 0.0f ? fmod(timePos, gVatDuration) : 0.0f;
+    t = t < 0.0f ? t + gVatDuration : t;
+
+    // A zero length clip bakes a single frame; f0 and f1 are then both 0.
+    uint f0 = min((uint)(t * gVatFrameRate), gVatFrameCount > 1 ? gVatFrameCount - 2 : 0);
+    uint f1 = min(f0 + 1, gVatFrameCount - 1);
+    float t0 = f0 / gVatFrameRate;
+    float t1 = min(f1 / gVatFrameRate, gVatDuration);
+    float s = t1 > t0 ? saturate((t - t0) / (t1 - t0)) : 0.0f;
+
+    float3 p0, n0, p1, n1;
+    LoadBakedVertex(vertexId, f0, p0, n0);
+    LoadBakedVertex(vertexId, f1, p1, n1);
+
+    posL = lerp(p0, p1, s);
+    normalL = normalize(lerp(n0, n1, s));
+}
+#elif defined(SKINNED_DQ)
+// Dual quaternion palette: the rotation of bone i in gBoneDualQuats[2*i],
+// the dual (translation) part in gBoneDualQuats[2*i+1].  Half the size
+// of the matrix palette.
+cbuffer cbSkinned : register(b1)
+{
+    float4 gBoneDualQuats[192];
+};
+
+// Rotates v by the unit quaternion q.
+float3 QuatRotate(float4 q, float3 v)
+{
+    return v + 2.0f*cross(q.xyz, cross(q.xyz, v) + q.w*v);
+}
+
+// Blends the dual quaternions of up to four bones.  Quaternions q and -q
+// are the same rotation, so each one is flipped into the hemisphere of
+// the first before it is added in.
+void BlendBoneDualQuats(float weights[4], uint4 boneIndices, out float4 real, out float4 dual)
+{
+    float4 real0 = gBoneDualQuats[2*boneIndices[0]];
+
+    real = float4(0.0f, 0.0f, 0.0f, 0.0f);
+    dual = float4(0.0f, 0.0f, 0.0f, 0.0f);
+    for(int i = 0; i < 4; ++i)
+    {
+        float4 r = gBoneDualQuats[2*boneIndices[i]];
+        float4 d = gBoneDualQuats[2*boneIndices[i]+1];
+
+        float w = dot(r, real0) < 0.0f ? -weights[i] : weights[i];
+        real += w*r;
+        dual += w*d;
+    }
+
+    float invLength = rsqrt(dot(real, real));
+    real *= invLength;
+    dual *= invLength;
+}
+
+// Applies the rigid transform of a unit dual quaternion to a point.
+float3 DualQuatTransformPoint(float4 real, float4 dual, float3 p)
+{
+    float3 t = 2.0f*(real.w*dual.xyz - dual.w*real.xyz + cross(real.xyz, dual.xyz));
+    return QuatRotate(real, p) + t;
+}
+#else
 cbuffer cbSkinned : register(b1)
 {
     float4x4 gBoneTransforms[96];
 };
+#endif
 
 // Constant data that varies per material.
 cbuffer cbPass : register(b2)
@@ -28,6 +28,10 @@ struct VertexIn
     float3 BoneWeights : WEIGHTS;
     uint4 BoneIndices  : BONEINDICES;
 #endif
+#ifdef VERTEX_ANIMATION
+    uint VertexId   : SV_VertexID;
+    uint InstanceId : SV_InstanceID;
+#endif
 };
 
 struct VertexOut
@@ -55,6 +59,14 @@ VertexOut VS(VertexIn vin)
     weights[2] = vin.BoneWeights.z;
     weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
 
+#ifdef SKINNED_DQ
+    float4 real, dual;
+    BlendBoneDualQuats(weights, vin.BoneIndices, real, dual);
+
+    vin.PosL = DualQuatTransformPoint(real, dual, vin.PosL);
+    vin.NormalL = QuatRotate(real, vin.NormalL);
+    vin.TangentL.xyz = QuatRotate(real, vin.TangentL.xyz);
+#else
     float3 posL = float3(0.0f, 0.0f, 0.0f);
     float3 normalL = float3(0.0f, 0.0f, 0.0f);
     float3 tangentL = float3(0.0f, 0.0f, 0.0f);
@@ -71,16 +83,28 @@ VertexOut VS(VertexIn vin)
     vin.PosL = posL;
     vin.NormalL = normalL;
     vin.TangentL.xyz = tangentL;
+#endif // SKINNED_DQ
+#endif
+
+#ifdef VERTEX_ANIMATION
+    // Baked skinned vertex.  Tangents aren't baked; the bind pose tangent is
+    // re-orthogonalized against the normal in the pixel shader, which is
+    // close enough for background characters.
+    VertexAnimationInstance inst = gVatInstances[vin.InstanceId];
+    SampleBakedVertex(vin.VertexId, gTotalTime + inst.TimeOffset, vin.PosL, vin.NormalL);
+    float4x4 world = inst.World;
+#else
+    float4x4 world = gWorld;
 #endif
 
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(vin.PosL, 1.0f), world);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(vin.NormalL, (float3x3)world);
 	
-	vout.TangentW = mul(vin.TangentL, (float3x3)gWorld);
+	vout.TangentW = mul(vin.TangentL, (float3x3)world);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
@@ -52,6 +52,14 @@ VertexOut VS(VertexIn vin)
     weights[2] = vin.BoneWeights.z;
     weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
 
+#ifdef SKINNED_DQ
+    float4 real, dual;
+    BlendBoneDualQuats(weights, vin.BoneIndices, real, dual);
+
+    vin.PosL = DualQuatTransformPoint(real, dual, vin.PosL);
+    vin.NormalL = QuatRotate(real, vin.NormalL);
+    vin.TangentL.xyz = QuatRotate(real, vin.TangentL.xyz);
+#else
     float3 posL = float3(0.0f, 0.0f, 0.0f);
     float3 normalL = float3(0.0f, 0.0f, 0.0f);
     float3 tangentL = float3(0.0f, 0.0f, 0.0f);
@@ -68,6 +76,7 @@ VertexOut VS(VertexIn vin)
     vin.PosL = posL;
     vin.NormalL = normalL;
     vin.TangentL.xyz = tangentL;
+#endif // SKINNED_DQ
 #endif
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
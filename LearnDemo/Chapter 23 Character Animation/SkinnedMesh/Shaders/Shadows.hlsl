@@ -34,6 +34,12 @@ VertexOut VS(VertexIn vin)
     weights[2] = vin.BoneWeights.z;
     weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
 
+#ifdef SKINNED_DQ
+    float4 real, dual;
+    BlendBoneDualQuats(weights, vin.BoneIndices, real, dual);
+
+    vin.PosL = DualQuatTransformPoint(real, dual, vin.PosL);
+#else
     float3 posL = float3(0.0f, 0.0f, 0.0f);
     for(int i = 0; i < 4; ++i)
     {
@@ -44,6 +50,7 @@ VertexOut VS(VertexIn vin)
     }
 
     vin.PosL = posL;
+#endif // SKINNED_DQ
 #endif
 
     // Transform to world space.
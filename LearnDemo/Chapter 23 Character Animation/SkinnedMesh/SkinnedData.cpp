@@ -13,6 +13,20 @@ Keyframe::Keyframe()
 Keyframe::~Keyframe()
 {
 }
+
+void BonePose::Store(FXMVECTOR S, FXMVECTOR P, FXMVECTOR Q)
+{
+	XMStoreFloat3(&Scale, S);
+	XMStoreFloat3(&Translation, P);
+	XMStoreFloat4(&RotationQuat, Q);
+}
+
+XMMATRIX BonePose::ToMatrix()const
+{
+	XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	return XMMatrixAffineTransformation(XMLoadFloat3(&Scale), zero, 
+		XMLoadFloat4(&RotationQuat), XMLoadFloat3(&Translation));
+}
  
 float BoneAnimation::GetStartTime()const
 {
@@ -29,53 +43,151 @@ float BoneAnimation::GetEndTime()const
 }
 
 void BoneAnimation::Interpolate(float t, XMFLOAT4X4& M)const
+{
+	XMVECTOR S, P, Q;
+	Interpolate(t, S, P, Q);
+
+	XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+}
+
+void BoneAnimation::Interpolate(float t, XMVECTOR& S, XMVECTOR& P, XMVECTOR& Q)const
 {
 	if( t <= Keyframes.front().TimePos )
 	{
-		XMVECTOR S = XMLoadFloat3(&Keyframes.front().Scale);
-		XMVECTOR P = XMLoadFloat3(&Keyframes.front().Translation);
-		XMVECTOR Q = XMLoadFloat4(&Keyframes.front().RotationQuat);
-
-		XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
-		XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+		S = XMLoadFloat3(&Keyframes.front().Scale);
+		P = XMLoadFloat3(&Keyframes.front().Translation);
+		Q = XMLoadFloat4(&Keyframes.front().RotationQuat);
 	}
 	else if( t >= Keyframes.back().TimePos )
 	{
-		XMVECTOR S = XMLoadFloat3(&Keyframes.back().Scale);
-		XMVECTOR P = XMLoadFloat3(&Keyframes.back().Translation);
-		XMVECTOR Q = XMLoadFloat4(&Keyframes.back().RotationQuat);
-
-		XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
-		XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+		S = XMLoadFloat3(&Keyframes.back().Scale);
+		P = XMLoadFloat3(&Keyframes.back().Translation);
+		Q = XMLoadFloat4(&Keyframes.back().RotationQuat);
 	}
 	else
 	{
-		for(UINT i = 0; i < Keyframes.size()-1; ++i)
-		{
-			if( t >= Keyframes[i].TimePos && t <= Keyframes[i+1].TimePos )
-			{
-				float lerpPercent = (t - Keyframes[i].TimePos) / (Keyframes[i+1].TimePos - Keyframes[i].TimePos);
+		InterpolateSegment(FindKeyframe(t), t, S, P, Q);
+	}
+}
 
-				XMVECTOR s0 = XMLoadFloat3(&Keyframes[i].Scale);
-				XMVECTOR s1 = XMLoadFloat3(&Keyframes[i+1].Scale);
+void BoneAnimation::Interpolate(float t, XMFLOAT4X4& M, UINT& keyIndex)const
+{
+	if( t <= Keyframes.front().TimePos || t >= Keyframes.back().TimePos )
+	{
+		// Clamped to the first/last keyframe; no search needed.
+		Interpolate(t, M);
+		return;
+	}
 
-				XMVECTOR p0 = XMLoadFloat3(&Keyframes[i].Translation);
-				XMVECTOR p1 = XMLoadFloat3(&Keyframes[i+1].Translation);
+	keyIndex = FindKeyframe(t, keyIndex);
 
-				XMVECTOR q0 = XMLoadFloat4(&Keyframes[i].RotationQuat);
-				XMVECTOR q1 = XMLoadFloat4(&Keyframes[i+1].RotationQuat);
+	XMVECTOR S, P, Q;
+	InterpolateSegment(keyIndex, t, S, P, Q);
 
-				XMVECTOR S = XMVectorLerp(s0, s1, lerpPercent);
-				XMVECTOR P = XMVectorLerp(p0, p1, lerpPercent);
-				XMVECTOR Q = XMQuaternionSlerp(q0, q1, lerpPercent);
+	XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+}
 
-				XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
-				XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+UINT BoneAnimation::FindKeyframe(float t)const
+{
+	const UINT lastSegment = (UINT)Keyframes.size() - 2;
 
-				break;
-			}
-		}
+	if( mInvKeyStep > 0.0f )
+	{
+		// Keys are evenly spaced, so the segment index can be computed directly.
+		UINT i = (UINT)((t - Keyframes.front().TimePos) * mInvKeyStep);
+		return MathHelper::Min(i, lastSegment);
+	}
+
+	// Keyframes are sorted by time.  Find the first keyframe after t; the
+	// segment we want starts one before it.
+	auto it = std::upper_bound(Keyframes.begin(), Keyframes.end(), t,
+		[](float time, const Keyframe& key) { return time < key.TimePos; });
+
+	UINT i = (UINT)(it - Keyframes.begin());
+	return MathHelper::Clamp(i, 1u, lastSegment + 1) - 1;
+}
+
+UINT BoneAnimation::FindKeyframe(float t, UINT hint)const
+{
+	const UINT lastSegment = (UINT)Keyframes.size() - 2;
+
+	// The hint is useless if time went backwards (e.g., the clip looped) or it
+	// belongs to another clip.
+	if( mInvKeyStep > 0.0f || hint > lastSegment || t < Keyframes[hint].TimePos )
+		return FindKeyframe(t);
+
+	// During playback time advances by a frame, which rarely crosses more
+	// than a key or two, so walk forward a little before giving up.
+	const UINT maxSteps = 4;
+	for(UINT step = 0; step <= maxSteps && hint <= lastSegment; ++step, ++hint)
+	{
+		if( t <= Keyframes[hint+1].TimePos )
+			return hint;
+	}
+
+	return FindKeyframe(t);
+}
+
+void BoneAnimation::InterpolateSegment(UINT i, float t, XMVECTOR& S, XMVECTOR& P, XMVECTOR& Q)const
+{
+	float lerpPercent = (t - Keyframes[i].TimePos) / (Keyframes[i+1].TimePos - Keyframes[i].TimePos);
+
+	XMVECTOR s0 = XMLoadFloat3(&Keyframes[i].Scale);
+	XMVECTOR s1 = XMLoadFloat3(&Keyframes[i+1].Scale);
+
+	XMVECTOR p0 = XMLoadFloat3(&Keyframes[i].Translation);
+	XMVECTOR p1 = XMLoadFloat3(&Keyframes[i+1].Translation);
+
+	XMVECTOR q0 = XMLoadFloat4(&Keyframes[i].RotationQuat);
+	XMVECTOR q1 = XMLoadFloat4(&Keyframes[i+1].RotationQuat);
+
+	S = XMVectorLerp(s0, s1, lerpPercent);
+	P = XMVectorLerp(p0, p1, lerpPercent);
+	Q = XMQuaternionSlerp(q0, q1, lerpPercent);
+}
+
+void BoneAnimation::ResampleUniform(float framesPerSecond)
+{
+	const float startTime = GetStartTime();
+	const float endTime = GetEndTime();
+
+	// Round the key count up so the spacing is never larger than requested,
+	// and keep the original first/last keys so the time range is unchanged.
+	UINT numKeys = (UINT)ceilf((endTime - startTime) * framesPerSecond) + 1;
+	numKeys = MathHelper::Max(numKeys, 2u);
+	const float step = (endTime - startTime) / (numKeys - 1);
+
+	std::vector<Keyframe> resampled(numKeys);
+	resampled.front() = Keyframes.front();
+	resampled.back() = Keyframes.back();
+
+	for(UINT i = 1; i + 1 < numKeys; ++i)
+	{
+		float t = startTime + i*step;
+
+		XMVECTOR S, P, Q;
+		InterpolateSegment(FindKeyframe(t), t, S, P, Q);
+
+		resampled[i].TimePos = t;
+		XMStoreFloat3(&resampled[i].Scale, S);
+		XMStoreFloat3(&resampled[i].Translation, P);
+		XMStoreFloat4(&resampled[i].RotationQuat, Q);
 	}
+
+	Keyframes = std::move(resampled);
+	mInvKeyStep = step > 0.0f ? 1.0f / step : 0.0f;
+}
+
+bool BoneAnimation::IsUniform()const
+{
+	return mInvKeyStep > 0.0f;
+}
+
+void AnimationCursor::Reset()
+{
+	std::fill(KeyIndices.begin(), KeyIndices.end(), 0);
 }
 
 float AnimationClip::GetClipStartTime()const
@@ -103,6 +215,16 @@ float AnimationClip::GetClipEndTime()const
 }
 
 void AnimationClip::Interpolate(float t, std::vector<XMFLOAT4X4>& boneTransforms)const
+{
+	Interpolate(t, boneTransforms.data());
+}
+
+void AnimationClip::Interpolate(float t, std::vector<XMFLOAT4X4>& boneTransforms, AnimationCursor& cursor)const
+{
+	Interpolate(t, boneTransforms.data(), cursor);
+}
+
+void AnimationClip::Interpolate(float t, XMFLOAT4X4* boneTransforms)const
 {
 	for(UINT i = 0; i < BoneAnimations.size(); ++i)
 	{
@@ -110,18 +232,51 @@ void AnimationClip::Interpolate(float t, std::vector<XMFLOAT4X4>& boneTransforms
 	}
 }
 
+void AnimationClip::Interpolate(float t, XMFLOAT4X4* boneTransforms, AnimationCursor& cursor)const
+{
+	if( cursor.KeyIndices.size() != BoneAnimations.size() )
+		cursor.KeyIndices.assign(BoneAnimations.size(), 0);
+
+	for(UINT i = 0; i < BoneAnimations.size(); ++i)
+	{
+		BoneAnimations[i].Interpolate(t, boneTransforms[i], cursor.KeyIndices[i]);
+	}
+}
+
+void AnimationClip::ResampleUniform(float framesPerSecond)
+{
+	for(UINT i = 0; i < BoneAnimations.size(); ++i)
+	{
+		BoneAnimations[i].ResampleUniform(framesPerSecond);
+	}
+}
+
 float SkinnedData::GetClipStartTime(const std::string& clipName)const
 {
+	auto compressed = mCompressedAnimations.find(clipName);
+	if(compressed != mCompressedAnimations.end())
+		return compressed->second.GetClipStartTime();
+
 	auto clip = mAnimations.find(clipName);
 	return clip->second.GetClipStartTime();
 }
 
 float SkinnedData::GetClipEndTime(const std::string& clipName)const
 {
+	auto compressed = mCompressedAnimations.find(clipName);
+	if(compressed != mCompressedAnimations.end())
+		return compressed->second.GetClipEndTime();
+
 	auto clip = mAnimations.find(clipName);
 	return clip->second.GetClipEndTime();
 }
 
+const AnimationClip* SkinnedData::GetClip(const std::string& clipName)const
+{
+	auto clip = mAnimations.find(clipName);
+	return clip != mAnimations.end() ? &clip->second : nullptr;
+}
+
 UINT SkinnedData::BoneCount()const
 {
 	return mBoneHierarchy.size();
@@ -134,6 +289,173 @@ void SkinnedData::Set(std::vector<int>& boneHierarchy,
 	mBoneHierarchy = boneHierarchy;
 	mBoneOffsets   = boneOffsets;
 	mAnimations    = animations;
+	mPackedAnimations.clear();
+	mCompressedAnimations.clear();
+
+	BuildLevels();
+}
+
+bool SkinnedData::IsParentFirst()const
+{
+	return mParentFirst;
+}
+
+UINT SkinnedData::LevelCount()const
+{
+	return mLevelStarts.empty() ? 0 : (UINT)mLevelStarts.size() - 1;
+}
+
+UINT SkinnedData::BoneLodCount()const
+{
+	// The roots of the tallest trees are always sampled.
+	UINT maxHeight = 0;
+	for(UINT height : mBoneHeights)
+	{
+		maxHeight = MathHelper::Max(maxHeight, height);
+	}
+	return maxHeight + 1;
+}
+
+UINT SkinnedData::SampledBoneCount(UINT boneLod)const
+{
+	UINT count = 0;
+	for(UINT height : mBoneHeights)
+	{
+		count += height >= boneLod ? 1 : 0;
+	}
+	return count;
+}
+
+void SkinnedData::BuildLevels()
+{
+	const int numBones = (int)mBoneHierarchy.size();
+
+	// Depth of every bone, found by walking up to a root or to a bone whose
+	// depth is already known.  Bones on the current walk are marked -2, so
+	// coming back to one means a cycle.
+	std::vector<int> depth(numBones, -1);
+	std::vector<int> path;
+	for(int i = 0; i < numBones; ++i)
+	{
+		path.clear();
+
+		int bone = i;
+		while(bone >= 0 && depth[bone] == -1)
+		{
+			depth[bone] = -2;
+
+			int parent = mBoneHierarchy[bone];
+			bool valid = parent < numBones && (parent < 0 || depth[parent] != -2);
+			assert(valid && "bad bone hierarchy");
+			if(!valid)
+			{
+				mBoneHierarchy[bone] = -1;
+				parent = -1;
+			}
+
+			path.push_back(bone);
+			bone = parent;
+		}
+
+		int d = bone >= 0 ? depth[bone] : -1;
+		for(auto it = path.rbegin(); it != path.rend(); ++it)
+		{
+			depth[*it] = ++d;
+		}
+	}
+
+	mParentFirst = true;
+	int maxDepth = -1;
+	for(int i = 0; i < numBones; ++i)
+	{
+		mParentFirst = mParentFirst && mBoneHierarchy[i] < i;
+		maxDepth = MathHelper::Max(maxDepth, depth[i]);
+	}
+
+	// Counting sort by depth; bones keep their relative order within a level.
+	mLevelStarts.assign(maxDepth + 2, 0);
+	for(int i = 0; i < numBones; ++i)
+	{
+		mLevelStarts[depth[i] + 1]++;
+	}
+	for(int k = 1; k < (int)mLevelStarts.size(); ++k)
+	{
+		mLevelStarts[k] += mLevelStarts[k-1];
+	}
+
+	mLevelBones.resize(numBones);
+	mLevelParents.resize(numBones);
+	std::vector<UINT> next(mLevelStarts.begin(), mLevelStarts.end() - 1);
+	for(int i = 0; i < numBones; ++i)
+	{
+		UINT j = next[depth[i]]++;
+		mLevelBones[j] = i;
+		mLevelParents[j] = mBoneHierarchy[i] >= 0 ? mBoneHierarchy[i] : i;
+	}
+
+	// Heights, deepest level first so children are done before their parents.
+	mBoneHeights.assign(numBones, 0);
+	for(int j = numBones - 1; j >= 0; --j)
+	{
+		UINT bone = mLevelBones[j];
+		UINT parent = mLevelParents[j];
+		if(parent != bone)
+			mBoneHeights[parent] = MathHelper::Max(mBoneHeights[parent], mBoneHeights[bone] + 1);
+	}
+
+	// The offset transform is the inverse of the bone's bind pose to-root
+	// transform, so its bind pose to-parent transform is inverse(offset) * offset[parent].
+	mBindToParent.resize(numBones);
+	for(int i = 0; i < numBones && i < (int)mBoneOffsets.size(); ++i)
+	{
+		XMMATRIX offset = XMLoadFloat4x4(&mBoneOffsets[i]);
+		XMMATRIX bindToRoot = XMMatrixInverse(nullptr, offset);
+
+		int parent = mBoneHierarchy[i];
+		XMMATRIX parentOffset = parent >= 0 ? XMLoadFloat4x4(&mBoneOffsets[parent]) : XMMatrixIdentity();
+
+		XMStoreFloat4x4(&mBindToParent[i], XMMatrixMultiply(bindToRoot, parentOffset));
+	}
+}
+ 
+void SkinnedData::ResampleClips(float framesPerSecond)
+{
+	for(auto& clip : mAnimations)
+	{
+		clip.second.ResampleUniform(framesPerSecond);
+	}
+
+	// Packed copies were built from the old keys.
+	mPackedAnimations.clear();
+}
+
+void SkinnedData::PackClips(float framesPerSecond)
+{
+	mPackedAnimations.clear();
+	for(auto& clip : mAnimations)
+	{
+		mPackedAnimations[clip.first].Build(clip.second, framesPerSecond);
+	}
+}
+ 
+void SkinnedData::CompressClips(const ClipCompressionSettings& settings)
+{
+	mCompressedAnimations.clear();
+	for(auto& clip : mAnimations)
+	{
+		mCompressedAnimations[clip.first].Build(clip.second, settings);
+	}
+
+	// The float keys are what compression is meant to save; only the
+	// compressed copies are kept.
+	mAnimations.clear();
+	mPackedAnimations.clear();
+}
+
+const CompressedAnimationClip* SkinnedData::GetCompressedClip(const std::string& clipName)const
+{
+	auto clip = mCompressedAnimations.find(clipName);
+	return clip != mCompressedAnimations.end() ? &clip->second : nullptr;
 }
  
 void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos,  std::vector<XMFLOAT4X4>& finalTransforms)const
@@ -143,38 +465,265 @@ void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos,
 	std::vector<XMFLOAT4X4> toParentTransforms(numBones);
 
 	// Interpolate all the bones of this clip at the given time instance.
+	InterpolateClip(clipName, timePos, toParentTransforms.data(), nullptr);
+
+	ComputeFinalTransforms(toParentTransforms, finalTransforms);
+}
+
+void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos,  
+	std::vector<XMFLOAT4X4>& finalTransforms, AnimationCursor& cursor)const
+{
+	UINT numBones = mBoneOffsets.size();
+
+	std::vector<XMFLOAT4X4> toParentTransforms(numBones);
+
+	InterpolateClip(clipName, timePos, toParentTransforms.data(), &cursor);
+
+	ComputeFinalTransforms(toParentTransforms, finalTransforms);
+}
+
+void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos, 
+	XMFLOAT4X4* scratch, XMFLOAT4X4* finalTransforms, ThreadPool* threadPool)const
+{
+	InterpolateClip(clipName, timePos, scratch, nullptr);
+	ConcatenateToRoot(scratch, threadPool);
+	ApplyBoneOffsets(scratch, finalTransforms, threadPool);
+}
+
+void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos, UINT boneLod,
+	XMFLOAT4X4* scratch, XMFLOAT4X4* finalTransforms)const
+{
+	InterpolateClip(clipName, timePos, scratch, nullptr, boneLod);
+	ConcatenateToRoot(scratch);
+	ApplyBoneOffsets(scratch, finalTransforms);
+}
+
+void SkinnedData::GetFinalDualQuaternions(const std::string& clipName, float timePos, 
+	XMFLOAT4X4* scratch, DualQuaternion* finalDualQuats)const
+{
+	GetFinalDualQuaternions(clipName, timePos, 0, scratch, finalDualQuats);
+}
+
+void SkinnedData::GetFinalDualQuaternions(const std::string& clipName, float timePos, UINT boneLod,
+	XMFLOAT4X4* scratch, DualQuaternion* finalDualQuats)const
+{
+	InterpolateClip(clipName, timePos, scratch, nullptr, boneLod);
+	ConcatenateToRoot(scratch);
+
+	UINT numBones = mBoneOffsets.size();
+	for(UINT i = 0; i < numBones; ++i)
+	{
+		XMMATRIX offset = XMLoadFloat4x4(&mBoneOffsets[i]);
+		XMMATRIX toRoot = XMLoadFloat4x4(&scratch[i]);
+
+		// Not transposed: the shader reads the quaternions as plain float4s.
+		finalDualQuats[i].Store(XMMatrixMultiply(offset, toRoot));
+	}
+}
+
+void SkinnedData::InterpolateClip(const std::string& clipName, float timePos, 
+	XMFLOAT4X4* toParentTransforms, AnimationCursor* cursor, UINT boneLod)const
+{
+	if(boneLod > 0)
+	{
+		const UINT numBones = mBoneOffsets.size();
+		XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+
+		auto compressed = mCompressedAnimations.find(clipName);
+		auto clip = mAnimations.find(clipName);
+
+		if(mPackedAnimations.count(clipName) > 0)
+		{
+			// Packed clips sample four bones per op; skipping some saves little.
+			mPackedAnimations.find(clipName)->second.Interpolate(timePos, toParentTransforms);
+		}
+		else if(compressed != mCompressedAnimations.end())
+		{
+			for(UINT i = 0; i < numBones; ++i)
+			{
+				if(mBoneHeights[i] < boneLod)
+					continue;
+
+				XMVECTOR S, P, Q;
+				compressed->second.Interpolate(i, timePos, S, P, Q);
+				XMStoreFloat4x4(&toParentTransforms[i], XMMatrixAffineTransformation(S, zero, Q, P));
+			}
+		}
+		else
+		{
+			for(UINT i = 0; i < numBones; ++i)
+			{
+				if(mBoneHeights[i] >= boneLod)
+					clip->second.BoneAnimations[i].Interpolate(timePos, toParentTransforms[i]);
+			}
+		}
+
+		for(UINT i = 0; i < numBones; ++i)
+		{
+			if(mBoneHeights[i] < boneLod)
+				toParentTransforms[i] = mBindToParent[i];
+		}
+		return;
+	}
+
+	// Packed and compressed clips have their own key lookup and ignore the cursor.
+	auto packed = mPackedAnimations.find(clipName);
+	if(packed != mPackedAnimations.end())
+	{
+		packed->second.Interpolate(timePos, toParentTransforms);
+		return;
+	}
+
+	auto compressed = mCompressedAnimations.find(clipName);
+	if(compressed != mCompressedAnimations.end())
+	{
+		compressed->second.Interpolate(timePos, toParentTransforms);
+		return;
+	}
+
+	auto clip = mAnimations.find(clipName);
+	if(cursor != nullptr)
+		clip->second.Interpolate(timePos, toParentTransforms, *cursor);
+	else
+		clip->second.Interpolate(timePos, toParentTransforms);
+}
+
+void SkinnedData::GetLocalPose(const std::string& clipName, float timePos, BonePose* pose)const
+{
+	UINT numBones = mBoneOffsets.size();
+
+	auto compressed = mCompressedAnimations.find(clipName);
+	if(compressed != mCompressedAnimations.end())
+	{
+		for(UINT i = 0; i < numBones; ++i)
+		{
+			XMVECTOR S, P, Q;
+			compressed->second.Interpolate(i, timePos, S, P, Q);
+			pose[i].Store(S, P, Q);
+		}
+		return;
+	}
+
+	// Packed clips only keep matrices, but the source clip is still loaded.
 	auto clip = mAnimations.find(clipName);
-	clip->second.Interpolate(timePos, toParentTransforms);
+	for(UINT i = 0; i < numBones; ++i)
+	{
+		XMVECTOR S, P, Q;
+		clip->second.BoneAnimations[i].Interpolate(timePos, S, P, Q);
+		pose[i].Store(S, P, Q);
+	}
+}
+
+void SkinnedData::ComputeFinalTransforms(const std::vector<XMFLOAT4X4>& toParentTransforms, 
+	std::vector<XMFLOAT4X4>& finalTransforms, ThreadPool* threadPool)const
+{
+	// Build the toRootTransforms in finalTransforms, which saves a scratch array.
+	std::copy(toParentTransforms.begin(), toParentTransforms.begin() + mBoneOffsets.size(), finalTransforms.begin());
+
+	ConcatenateToRoot(finalTransforms.data(), threadPool);
+	ApplyBoneOffsets(finalTransforms.data(), finalTransforms.data(), threadPool);
+}
+
+void SkinnedData::ConcatenateToRoot(XMFLOAT4X4* transforms, ThreadPool* threadPool)const
+{
+	UINT numBones = mBoneOffsets.size();
 
 	//
 	// Traverse the hierarchy and transform all the bones to the root space.
+	// A parent's entry has to be turned into its toRootTransform before a
+	// child reads it.
 	//
 
-	std::vector<XMFLOAT4X4> toRootTransforms(numBones);
+	if(mParentFirst && threadPool == nullptr)
+	{
+		// Parents come before their children, so walking the array in order
+		// works.  A root bone has no parent, so its toRootTransform is just its
+		// local bone transform, which is already in place.
+		for(UINT i = 1; i < numBones; ++i)
+		{
+			XMMATRIX toParent = XMLoadFloat4x4(&transforms[i]);
+
+			int parentIndex = mBoneHierarchy[i];
+			if(parentIndex < 0)
+				continue;
+
+			XMMATRIX parentToRoot = XMLoadFloat4x4(&transforms[parentIndex]);
 
-	// The root bone has index 0.  The root bone has no parent, so its toRootTransform
-	// is just its local bone transform.
-	toRootTransforms[0] = toParentTransforms[0];
+			XMMATRIX toRoot = XMMatrixMultiply(toParent, parentToRoot);
 
-	// Now find the toRootTransform of the children.
-	for(UINT i = 1; i < numBones; ++i)
+			XMStoreFloat4x4(&transforms[i], toRoot);
+		}
+		return;
+	}
+
+	// Otherwise go level by level; the roots (level 0) are already done.  The
+	// bones of a level are independent, so a wide level can be split across
+	// threads.  Below a few hundred bones the hand-off costs more than it saves.
+	const UINT parallelLevelSize = 256;
+	const UINT grainSize = 64;
+
+	for(UINT k = 1; k + 1 < mLevelStarts.size(); ++k)
 	{
-		XMMATRIX toParent = XMLoadFloat4x4(&toParentTransforms[i]);
+		UINT begin = mLevelStarts[k];
+		UINT end = mLevelStarts[k+1];
 
-		int parentIndex = mBoneHierarchy[i];
-		XMMATRIX parentToRoot = XMLoadFloat4x4(&toRootTransforms[parentIndex]);
+		if(threadPool != nullptr && end - begin >= parallelLevelSize)
+		{
+			threadPool->ParallelFor(end - begin, grainSize, [&](UINT rangeBegin, UINT rangeEnd, UINT)
+			{
+				ConcatenateLevelRange(transforms, begin + rangeBegin, begin + rangeEnd);
+			});
+		}
+		else
+		{
+			ConcatenateLevelRange(transforms, begin, end);
+		}
+	}
+}
+
+void SkinnedData::ConcatenateLevelRange(XMFLOAT4X4* transforms, UINT begin, UINT end)const
+{
+	for(UINT j = begin; j < end; ++j)
+	{
+		UINT bone = mLevelBones[j];
 
-		XMMATRIX toRoot = XMMatrixMultiply(toParent, parentToRoot);
+		XMMATRIX toParent = XMLoadFloat4x4(&transforms[bone]);
+		XMMATRIX parentToRoot = XMLoadFloat4x4(&transforms[mLevelParents[j]]);
 
-		XMStoreFloat4x4(&toRootTransforms[i], toRoot);
+		XMStoreFloat4x4(&transforms[bone], XMMatrixMultiply(toParent, parentToRoot));
 	}
+}
+
+void SkinnedData::ApplyBoneOffsets(const XMFLOAT4X4* toRootTransforms, XMFLOAT4X4* finalTransforms,
+	ThreadPool* threadPool)const
+{
+	UINT numBones = mBoneOffsets.size();
+
+	const UINT parallelBoneCount = 256;
+	const UINT grainSize = 64;
+
+	if(threadPool != nullptr && numBones >= parallelBoneCount)
+	{
+		threadPool->ParallelFor(numBones, grainSize, [&](UINT begin, UINT end, UINT)
+		{
+			ApplyBoneOffsets(toRootTransforms, finalTransforms, begin, end);
+		});
+	}
+	else
+	{
+		ApplyBoneOffsets(toRootTransforms, finalTransforms, 0, numBones);
+	}
+}
 
+void SkinnedData::ApplyBoneOffsets(const XMFLOAT4X4* toRootTransforms, XMFLOAT4X4* finalTransforms,
+	UINT begin, UINT end)const
+{
 	// Premultiply by the bone offset transform to get the final transform.
-	for(UINT i = 0; i < numBones; ++i)
+	for(UINT i = begin; i < end; ++i)
 	{
 		XMMATRIX offset = XMLoadFloat4x4(&mBoneOffsets[i]);
 		XMMATRIX toRoot = XMLoadFloat4x4(&toRootTransforms[i]);
         XMMATRIX finalTransform = XMMatrixMultiply(offset, toRoot);
 		XMStoreFloat4x4(&finalTransforms[i], XMMatrixTranspose(finalTransform));
 	}
-}
\ No newline at end of file
+}
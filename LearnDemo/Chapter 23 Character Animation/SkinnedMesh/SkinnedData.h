@@ -3,6 +3,10 @@
 
 #include "../../../Common/d3dUtil.h"
 #include "../../../Common/MathHelper.h"
+#include "../../../Common/ThreadPool.h"
+#include "PackedAnimationClip.h"
+#include "CompressedAnimationClip.h"
+#include "DualQuaternion.h"
 
 ///<summary>
 /// A Keyframe defines the bone transformation at an instant in time.
@@ -18,6 +22,21 @@ struct Keyframe
     DirectX::XMFLOAT4 RotationQuat;
 };
 
+///<summary>
+/// The transform of one bone relative to its parent (joint space), kept as
+/// scale/rotation/translation so poses can be blended before they are
+/// turned into matrices.
+///</summary>
+struct BonePose
+{
+	void Store(DirectX::FXMVECTOR S, DirectX::FXMVECTOR P, DirectX::FXMVECTOR Q);
+	DirectX::XMMATRIX ToMatrix()const;
+
+	DirectX::XMFLOAT3 Translation;
+	DirectX::XMFLOAT3 Scale;
+	DirectX::XMFLOAT4 RotationQuat;
+};
+
 ///<summary>
 /// A BoneAnimation is defined by a list of keyframes.  For time
 /// values inbetween two keyframes, we interpolate between the
@@ -31,8 +50,42 @@ struct BoneAnimation
 	float GetEndTime()const;
 
     void Interpolate(float t, DirectX::XMFLOAT4X4& M)const;
+	void Interpolate(float t, DirectX::XMVECTOR& S, DirectX::XMVECTOR& P, DirectX::XMVECTOR& Q)const;
+
+	// Same as above, but starts the keyframe search from the segment in keyIndex
+	// and writes back the segment that was used.  When t only moves forward
+	// (normal playback) this is amortized O(1).
+	void Interpolate(float t, DirectX::XMFLOAT4X4& M, UINT& keyIndex)const;
+
+	// Returns the index i of the keyframe segment [i, i+1] that bounds t.
+	// t must lie strictly inside [GetStartTime(), GetEndTime()].
+	UINT FindKeyframe(float t)const;
+	UINT FindKeyframe(float t, UINT hint)const;
+
+	// Replaces the keyframes with keys sampled at a fixed rate over the same
+	// time range, so FindKeyframe can compute the index directly.
+	void ResampleUniform(float framesPerSecond);
+	bool IsUniform()const;
 
 	std::vector<Keyframe> Keyframes; 	
+
+private:
+	void InterpolateSegment(UINT i, float t, 
+		DirectX::XMVECTOR& S, DirectX::XMVECTOR& P, DirectX::XMVECTOR& Q)const;
+
+	// 1/(time between keys) after ResampleUniform, 0 for arbitrary key spacing.
+	float mInvKeyStep = 0.0f;
+};
+
+///<summary>
+/// Per-instance playback state: remembers the keyframe segment every bone
+/// sampled last time, so the next lookup can start from there.
+///</summary>
+struct AnimationCursor
+{
+	void Reset();
+
+	std::vector<UINT> KeyIndices;
 };
 
 ///<summary>
@@ -46,6 +99,11 @@ struct AnimationClip
 	float GetClipEndTime()const;
 
     void Interpolate(float t, std::vector<DirectX::XMFLOAT4X4>& boneTransforms)const;
+    void Interpolate(float t, std::vector<DirectX::XMFLOAT4X4>& boneTransforms, AnimationCursor& cursor)const;
+    void Interpolate(float t, DirectX::XMFLOAT4X4* boneTransforms)const;
+    void Interpolate(float t, DirectX::XMFLOAT4X4* boneTransforms, AnimationCursor& cursor)const;
+
+	void ResampleUniform(float framesPerSecond);
 
     std::vector<BoneAnimation> BoneAnimations; 	
 };
@@ -59,24 +117,134 @@ public:
 	float GetClipStartTime(const std::string& clipName)const;
 	float GetClipEndTime(const std::string& clipName)const;
 
+	// Returns nullptr if there is no clip with that name.
+	const AnimationClip* GetClip(const std::string& clipName)const;
+
+	// boneHierarchy[i] is the parent of bone i, or -1 for a root.  Bones do not
+	// have to come after their parents; if they don't, the hierarchy is
+	// evaluated in depth order instead (bone indices, and so the vertex data
+	// and palettes, stay as they are).  A parent index that is out of range
+	// or part of a cycle is an error; that bone is treated as a root.
 	void Set(
 		std::vector<int>& boneHierarchy, 
 		std::vector<DirectX::XMFLOAT4X4>& boneOffsets,
 		std::unordered_map<std::string, AnimationClip>& animations);
 
+	// True if every bone comes after its parent.
+	bool IsParentFirst()const;
+
+	// Number of hierarchy levels (1 for a skeleton that is only roots).
+	UINT LevelCount()const;
+
+	// Bone LOD for distant characters.  At bone LOD n, bones with no
+	// descendants n or more levels down (n = 1: the leaf bones) are not
+	// sampled; they keep their bind pose relative to their parent.  Bone
+	// LOD 0 samples every bone.
+	UINT BoneLodCount()const;
+	UINT SampledBoneCount(UINT boneLod)const;
+
 	 // In a real project, you'd want to cache the result if there was a chance
 	 // that you were calling this several times with the same clipName at 
-	 // the same timePos.
+	 // the same timePos.  PoseCache does that for crowds.
     void GetFinalTransforms(const std::string& clipName, float timePos, 
 		 std::vector<DirectX::XMFLOAT4X4>& finalTransforms)const;
 
+	// Same as above, but uses (and advances) a per-instance playback cursor
+	// for the keyframe lookups.
+    void GetFinalTransforms(const std::string& clipName, float timePos, 
+		 std::vector<DirectX::XMFLOAT4X4>& finalTransforms, AnimationCursor& cursor)const;
+
+	// Allocation-free version for batch updates.  scratch (BoneCount() matrices)
+	// holds the intermediate transforms; finalTransforms is only written, never
+	// read, so it can point straight into a mapped upload buffer.  It may also
+	// be scratch itself.
+	// With a threadPool, wide hierarchy levels are split across its threads
+	// (worth it for rigs of many hundreds of bones; never pass one from inside
+	// a ThreadPool job).
+	void GetFinalTransforms(const std::string& clipName, float timePos, 
+		DirectX::XMFLOAT4X4* scratch, DirectX::XMFLOAT4X4* finalTransforms,
+		ThreadPool* threadPool = nullptr)const;
+
+	// Same, at a reduced bone LOD.
+	void GetFinalTransforms(const std::string& clipName, float timePos, UINT boneLod,
+		DirectX::XMFLOAT4X4* scratch, DirectX::XMFLOAT4X4* finalTransforms)const;
+
+	// The same palette as dual quaternions (BoneCount() of them) for SKINNED_DQ.
+	// Bone scale is lost, see DualQuaternion.
+	void GetFinalDualQuaternions(const std::string& clipName, float timePos, 
+		DirectX::XMFLOAT4X4* scratch, DualQuaternion* finalDualQuats)const;
+	void GetFinalDualQuaternions(const std::string& clipName, float timePos, UINT boneLod,
+		DirectX::XMFLOAT4X4* scratch, DualQuaternion* finalDualQuats)const;
+
+	// Resamples every clip to a fixed key rate (see BoneAnimation::ResampleUniform).
+	void ResampleClips(float framesPerSecond);
+
+	// Builds a PackedAnimationClip for every clip.  From then on GetFinalTransforms
+	// samples the packed copy, four bones per SIMD op, instead of bone by bone.
+	void PackClips(float framesPerSecond);
+
+	// Replaces every clip with a CompressedAnimationClip and frees the float
+	// keys, so GetClip, ResampleClips and PackClips have nothing left to work on.
+	void CompressClips(const ClipCompressionSettings& settings = ClipCompressionSettings());
+
+	// Returns nullptr if the clip was not compressed.
+	const CompressedAnimationClip* GetCompressedClip(const std::string& clipName)const;
+
+	// Samples every bone of a clip in joint space.  pose must have room for
+	// BoneCount() entries.
+	void GetLocalPose(const std::string& clipName, float timePos, BonePose* pose)const;
+
+	// The hierarchy pass on its own: concatenates to-parent transforms down to
+	// the root and applies the bone offsets.  Used by GetFinalTransforms, and
+	// by anything that builds its own local pose (e.g., PoseBlender).
+	// finalTransforms must have BoneCount() entries; it doubles as scratch,
+	// so nothing is allocated.
+	void ComputeFinalTransforms(const std::vector<DirectX::XMFLOAT4X4>& toParentTransforms, 
+		std::vector<DirectX::XMFLOAT4X4>& finalTransforms, ThreadPool* threadPool = nullptr)const;
+
 private:
+	// Samples whichever representation of the clip is loaded.  cursor may be null.
+	void InterpolateClip(const std::string& clipName, float timePos, 
+		DirectX::XMFLOAT4X4* toParentTransforms, AnimationCursor* cursor, UINT boneLod = 0)const;
+
+	// Checks the hierarchy and sorts the bones by depth into mLevelBones.
+	void BuildLevels();
+
+	// In place: to-parent transforms in, to-root transforms out.
+	void ConcatenateToRoot(DirectX::XMFLOAT4X4* transforms, ThreadPool* threadPool = nullptr)const;
+
+	// Concatenates mLevelBones[begin, end), whose parents are all done.
+	void ConcatenateLevelRange(DirectX::XMFLOAT4X4* transforms, UINT begin, UINT end)const;
+
+	// finalTransforms[i] = transpose(offset[i] * toRoot[i]).  The two arrays may alias.
+	void ApplyBoneOffsets(const DirectX::XMFLOAT4X4* toRootTransforms, DirectX::XMFLOAT4X4* finalTransforms,
+		ThreadPool* threadPool = nullptr)const;
+	void ApplyBoneOffsets(const DirectX::XMFLOAT4X4* toRootTransforms, DirectX::XMFLOAT4X4* finalTransforms,
+		UINT begin, UINT end)const;
+
     // Gives parentIndex of ith bone.
 	std::vector<int> mBoneHierarchy;
 
+	// Bones sorted by depth: level k is mLevelBones[mLevelStarts[k], mLevelStarts[k+1]),
+	// with the parent of mLevelBones[j] in mLevelParents[j].  Bones of one level
+	// don't depend on each other.
+	std::vector<UINT> mLevelBones;
+	std::vector<UINT> mLevelParents;
+	std::vector<UINT> mLevelStarts;
+	bool mParentFirst = true;
+
+	// Height of each bone above its deepest descendant (0 for a leaf), and
+	// its to-parent transform in the bind pose, for bone LOD.
+	std::vector<UINT> mBoneHeights;
+	std::vector<DirectX::XMFLOAT4X4> mBindToParent;
+
 	std::vector<DirectX::XMFLOAT4X4> mBoneOffsets;
    
 	std::unordered_map<std::string, AnimationClip> mAnimations;
+
+	std::unordered_map<std::string, PackedAnimationClip> mPackedAnimations;
+
+	std::unordered_map<std::string, CompressedAnimationClip> mCompressedAnimations;
 };
  
 #endif // SKINNEDDATA_H
\ No newline at end of file
@@ -12,6 +12,9 @@
 //#include "AnimSsao.h"
 //#include "SkinnedData.h"
 //#include "LoadM3d.h"
+//#include "AnimationBatch.h"
+//#include "AnimationLod.h"
+//#include "VertexAnimationBaker.h"
 //
 //using Microsoft::WRL::ComPtr;
 //using namespace DirectX;
@@ -26,6 +29,10 @@
 //    std::string ClipName;
 //    float TimePos = 0.0f;
 //
+//    // Remembers the keyframe each bone used last frame, so the next lookup
+//    // only has to step forward from there.
+//    AnimationCursor Cursor;
+//
 //    // Called every frame and increments the time position, interpolates the 
 //    // animations for each bone based on the current animation clip, and 
 //    // generates the final transforms which are ultimately set to the effect
@@ -39,7 +46,7 @@
 //            TimePos = 0.0f;
 //
 //        // Compute the final transforms for this time position.
-//        SkinnedInfo->GetFinalTransforms(ClipName, TimePos, FinalTransforms);
+//        SkinnedInfo->GetFinalTransforms(ClipName, TimePos, FinalTransforms, Cursor);
 //    }
 //};
 //
@@ -135,6 +142,8 @@
 //    void BuildMaterials();
 //    void BuildRenderItems();
 //    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+//    void BuildCrowd();
+//    void DrawCrowd(ID3D12GraphicsCommandList* cmdList);
 //    void DrawSceneToShadowMap();
 //	void DrawNormalsAndDepth();
 //
@@ -188,6 +197,35 @@
 //    UINT mSkinnedSrvHeapStart = 0;
 //    std::string mSkinnedModelFilename = "E:\\DX12Book\\DX12LearnProject\\DX12Learn\\LearnDemo\\Chapter 23 Character Animation\\SkinnedMesh\\Models\\soldier.m3d";
 //    std::unique_ptr<SkinnedModelInstance> mSkinnedModelInst; 
+//
+//    // Animated characters, updated in parallel.  Character i's palette goes
+//    // to element i of the frame's SkinnedCB.
+//    ThreadPool mThreadPool;
+//    AnimationBatch mAnimationBatch;
+//
+//    // Skin with dual quaternions (SKINNED_DQ): half the palette upload and no
+//    // candy-wrapper collapse at twisting joints.  Palettes then go to the
+//    // frame's SkinnedDualQuatCB.
+//    bool mDualQuatSkinning = false;
+//
+//    // Per-subset palettes of only the bones each subset is weighted to.
+//    // Character i's palette p is element i*PaletteCount() + p of the SkinnedCB.
+//    SubsetPalettes mSubsetPalettes;
+//    std::vector<AnimatedCharacter> mCharacters;
+//
+//    // Evaluates distant characters less often and with fewer bones.
+//    // mCharacterBounds[i] is character i's world space bounding sphere.
+//    AnimationLod mAnimationLod;
+//    std::vector<DirectX::BoundingSphere> mCharacterBounds;
+//
+//    // Background crowd drawn from a baked clip: instanced, no palettes.
+//    UINT mCrowdSize = 400;
+//    VertexAnimationTexture mCrowdVat;
+//    Microsoft::WRL::ComPtr<ID3D12Resource> mCrowdVatTexture = nullptr;
+//    Microsoft::WRL::ComPtr<ID3D12Resource> mCrowdVatUploader = nullptr;
+//    std::unique_ptr<UploadBuffer<VertexAnimationConstants>> mCrowdVatCB = nullptr;
+//    std::unique_ptr<UploadBuffer<VertexAnimationInstance>> mCrowdInstances = nullptr;
+//    UINT mCrowdVatSrvIndex = 0;
 //    SkinnedData mSkinnedInfo;
 //    std::vector<M3DLoader::Subset> mSkinnedSubsets;
 //    std::vector<M3DLoader::M3dMaterial> mSkinnedMats;
@@ -286,6 +324,7 @@
 //    BuildShapeGeometry();
 //	BuildMaterials();
 //    BuildRenderItems();
+//    BuildCrowd();
 //    BuildFrameResources();
 //    BuildPSOs();
 //
@@ -480,6 +519,9 @@
 //    mCommandList->SetPipelineState(mPSOs["skinnedOpaque"].Get());
 //    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::SkinnedOpaque]);
 //
+//    mCommandList->SetPipelineState(mPSOs["vertexAnimated"].Get());
+//    DrawCrowd(mCommandList.Get());
+//
 //    mCommandList->SetPipelineState(mPSOs["debug"].Get());
 //    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Debug]);
 //
@@ -590,18 +632,24 @@
 //
 //void SkinnedMeshApp::UpdateSkinnedCBs(const GameTimer& gt)
 //{
-//    auto currSkinnedCB = mCurrFrameResource->SkinnedCB.get();
-//   
-//    // We only have one skinned model being animated.
-//    mSkinnedModelInst->UpdateSkinnedAnimation(gt.DeltaTime());
-//        
-//    SkinnedConstants skinnedConstants;
-//    std::copy(
-//        std::begin(mSkinnedModelInst->FinalTransforms),
-//        std::end(mSkinnedModelInst->FinalTransforms),
-//        &skinnedConstants.BoneTransforms[0]);
-//
-//    currSkinnedCB->CopyData(0, skinnedConstants);
+//    // Pick each character's animation LOD and which poses to evaluate this frame.
+//    mAnimationLod.Select(mCharacters.data(), (UINT)mCharacters.size(), mCharacterBounds.data(),
+//        mCamera.GetPosition(), mCamera.GetProj4x4f()._22);
+//
+//    // Evaluate every character on the thread pool; the palettes are written
+//    // straight into the mapped constant buffer, so there is nothing to copy.
+//    if(mDualQuatSkinning)
+//    {
+//        auto currSkinnedCB = mCurrFrameResource->SkinnedDualQuatCB.get();
+//        mAnimationBatch.Update(mCharacters.data(), (UINT)mCharacters.size(), gt.DeltaTime(),
+//            currSkinnedCB->MappedData(), currSkinnedCB->ElementByteSize());
+//    }
+//    else
+//    {
+//        auto currSkinnedCB = mCurrFrameResource->SkinnedCB.get();
+//        mAnimationBatch.Update(mCharacters.data(), (UINT)mCharacters.size(), gt.DeltaTime(),
+//            currSkinnedCB->MappedData(), currSkinnedCB->ElementByteSize());
+//    }
 //}
 // 
 //void SkinnedMeshApp::UpdateMaterialBuffer(const GameTimer& gt)
@@ -855,8 +903,12 @@
 //	CD3DX12_DESCRIPTOR_RANGE texTable1;
 //	texTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 48, 3, 0);
 //
+//    // Baked vertex animation texture of the crowd.
+//    CD3DX12_DESCRIPTOR_RANGE vatTable;
+//    vatTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 2);
+//
 //    // Root parameter can be a table, root descriptor or root constants.
-//    CD3DX12_ROOT_PARAMETER slotRootParameter[6];
+//    CD3DX12_ROOT_PARAMETER slotRootParameter[8];
 //
 //	// Perfomance TIP: Order from most frequent to least frequent.
 //    slotRootParameter[0].InitAsConstantBufferView(0);
@@ -865,11 +917,13 @@
 //    slotRootParameter[3].InitAsShaderResourceView(0, 1);
 //	slotRootParameter[4].InitAsDescriptorTable(1, &texTable0, D3D12_SHADER_VISIBILITY_PIXEL);
 //	slotRootParameter[5].InitAsDescriptorTable(1, &texTable1, D3D12_SHADER_VISIBILITY_PIXEL);
+//    slotRootParameter[6].InitAsDescriptorTable(1, &vatTable, D3D12_SHADER_VISIBILITY_VERTEX);
+//    slotRootParameter[7].InitAsShaderResourceView(1, 2, D3D12_SHADER_VISIBILITY_VERTEX);
 //
 //	auto staticSamplers = GetStaticSamplers();
 //
 //    // A root signature is an array of root parameters.
-//	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(6, slotRootParameter,
+//	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(8, slotRootParameter,
 //		(UINT)staticSamplers.size(), staticSamplers.data(),
 //		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 //
@@ -1055,6 +1109,10 @@
 //    nullSrv.Offset(1, mCbvSrvUavDescriptorSize);
 //    md3dDevice->CreateShaderResourceView(nullptr, &srvDesc, nullSrv);
 //
+//    mCrowdVatSrvIndex = mNullTexSrvIndex2 + 1;
+//    srvDesc.Format = DXGI_FORMAT_R16G16B16A16_UINT;
+//    md3dDevice->CreateShaderResourceView(mCrowdVatTexture.Get(), &srvDesc, GetCpuSrv(mCrowdVatSrvIndex));
+//
 //    mShadowMap->BuildDescriptors(
 //        GetCpuSrv(mShadowMapHeapIndex),
 //        GetGpuSrv(mShadowMapHeapIndex),
@@ -1077,14 +1135,30 @@
 //		NULL, NULL
 //	};
 //
-//    const D3D_SHADER_MACRO skinnedDefines[] =
+//    const D3D_SHADER_MACRO skinnedMatrixDefines[] =
+//    {
+//        "SKINNED", "1",
+//        NULL, NULL
+//    };
+//
+//    const D3D_SHADER_MACRO skinnedDualQuatDefines[] =
 //    {
 //        "SKINNED", "1",
+//        "SKINNED_DQ", "1",
+//        NULL, NULL
+//    };
+//
+//    const D3D_SHADER_MACRO* skinnedDefines = mDualQuatSkinning ? skinnedDualQuatDefines : skinnedMatrixDefines;
+//
+//    const D3D_SHADER_MACRO vertexAnimationDefines[] =
+//    {
+//        "VERTEX_ANIMATION", "1",
 //        NULL, NULL
 //    };
 //
 //	mShaders["standardVS"] = d3dUtil::CompileShader(L"E:\\DX12Book\\DX12LearnProject\\DX12Learn\\LearnDemo\\Chapter 23 Character Animation\\SkinnedMesh\\Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
 //    mShaders["skinnedVS"] = d3dUtil::CompileShader(L"E:\\DX12Book\\DX12LearnProject\\DX12Learn\\LearnDemo\\Chapter 23 Character Animation\\SkinnedMesh\\Shaders\\Default.hlsl", skinnedDefines, "VS", "vs_5_1");
+//    mShaders["vertexAnimatedVS"] = d3dUtil::CompileShader(L"E:\\DX12Book\\DX12LearnProject\\DX12Learn\\LearnDemo\\Chapter 23 Character Animation\\SkinnedMesh\\Shaders\\Default.hlsl", vertexAnimationDefines, "VS", "vs_5_1");
 //	mShaders["opaquePS"] = d3dUtil::CompileShader(L"E:\\DX12Book\\DX12LearnProject\\DX12Learn\\LearnDemo\\Chapter 23 Character Animation\\SkinnedMesh\\Shaders\\Default.hlsl", nullptr, "PS", "ps_5_1");
 //
 //    mShaders["shadowVS"] = d3dUtil::CompileShader(L"E:\\DX12Book\\DX12LearnProject\\DX12Learn\\LearnDemo\\Chapter 23 Character Animation\\SkinnedMesh\\Shaders\\Shadows.hlsl", nullptr, "VS", "vs_5_1");
@@ -1283,11 +1357,64 @@
 //	m3dLoader.LoadM3d(mSkinnedModelFilename, vertices, indices, 
 //        mSkinnedSubsets, mSkinnedMats, mSkinnedInfo);
 //
+//	// Sample the clips four bones at a time from SoA keys.
+//	mSkinnedInfo.PackClips(60.0f);
+//
+//	// Or keep them compressed instead: ~10x less key memory, slower to sample.
+//	//mSkinnedInfo.CompressClips();
+//
 //    mSkinnedModelInst = std::make_unique<SkinnedModelInstance>();
 //    mSkinnedModelInst->SkinnedInfo = &mSkinnedInfo;
 //    mSkinnedModelInst->FinalTransforms.resize(mSkinnedInfo.BoneCount());
 //    mSkinnedModelInst->ClipName = "Take1";
 //    mSkinnedModelInst->TimePos = 0.0f;
+//
+//    AnimatedCharacter character;
+//    character.SkinnedInfo = &mSkinnedInfo;
+//    character.ClipName = "Take1";
+//    mCharacters.push_back(character);
+//
+//    mAnimationBatch.Initialize(&mThreadPool, mSkinnedInfo.BoneCount());
+//    mAnimationBatch.SetPaletteFormat(mDualQuatSkinning ?
+//        AnimationBatch::PaletteFormat::DualQuaternion : AnimationBatch::PaletteFormat::Matrix);
+//
+//    // Bake the clip for the background crowd the first time; after that the
+//    // .dds is just loaded.  Baking reads the bone indices, so it goes before
+//    // the palettes are compacted.
+//    const std::string vatFilename = "Models/soldier_Take1_vat.dds";
+//    if(!VertexAnimationBaker::ReadDdsLayout(vatFilename, mCrowdVat))
+//    {
+//        VertexAnimationBaker::Bake(mSkinnedInfo, "Take1", vertices, 30.0f, mCrowdVat);
+//        VertexAnimationBaker::SaveDds(vatFilename, mCrowdVat);
+//    }
+//    ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(), mCommandList.Get(),
+//        AnsiToWString(vatFilename).c_str(), mCrowdVatTexture, mCrowdVatUploader));
+//
+//    // Compact the palettes (this rewrites the vertices' bone indices, so it
+//    // has to happen before the vertex buffer is made).
+//    if(mSubsetPalettes.Build(vertices, indices, mSkinnedSubsets, mSkinnedInfo.BoneCount(), true))
+//        mAnimationBatch.SetSubsetPalettes(&mSubsetPalettes);
+//
+//    // Full rate up close; every 2nd frame without the leaf bones below a
+//    // tenth of the screen height; every 4th frame with fewer still below 4%.
+//    // At most 64 characters' worth of bones per frame.
+//    mAnimationLod.Initialize(
+//        {
+//            { 0.25f, 1, 0 },
+//            { 0.10f, 2, 1 },
+//            { 0.04f, 4, 2 },
+//            { 0.00f, 4, 3 }
+//        }, 64 * mSkinnedInfo.BoneCount());
+//
+//    // Same transform as the skinned render items (see BuildRenderItems).
+//    BoundingBox modelBounds;
+//    BoundingBox::CreateFromPoints(modelBounds, vertices.size(), &vertices[0].Pos, sizeof(M3DLoader::SkinnedVertex));
+//    modelBounds.Transform(modelBounds, XMMatrixScaling(0.05f, 0.05f, -0.05f) * 
+//        XMMatrixRotationY(MathHelper::Pi) * XMMatrixTranslation(0.0f, 0.0f, -5.0f));
+//
+//    BoundingSphere characterBounds;
+//    BoundingSphere::CreateFromBoundingBox(characterBounds, modelBounds);
+//    mCharacterBounds.assign(mCharacters.size(), characterBounds);
 // 
 //	const UINT vbByteSize = (UINT)vertices.size() * sizeof(SkinnedVertex);
 //    const UINT ibByteSize = (UINT)indices.size()  * sizeof(std::uint16_t);
@@ -1377,6 +1504,19 @@
 //    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&skinnedOpaquePsoDesc, IID_PPV_ARGS(&mPSOs["skinnedOpaque"])));
 //
 //    //
+//    // PSO for the vertex animated crowd.  Position and normal come from the
+//    // baked texture; the rest of the skinned vertex is read with the static
+//    // layout, which matches its first four elements.
+//    //
+//    D3D12_GRAPHICS_PIPELINE_STATE_DESC vertexAnimatedPsoDesc = opaquePsoDesc;
+//    vertexAnimatedPsoDesc.VS =
+//    {
+//        reinterpret_cast<BYTE*>(mShaders["vertexAnimatedVS"]->GetBufferPointer()),
+//        mShaders["vertexAnimatedVS"]->GetBufferSize()
+//    };
+//    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&vertexAnimatedPsoDesc, IID_PPV_ARGS(&mPSOs["vertexAnimated"])));
+//
+//    //
 //    // PSO for shadow map pass.
 //    //
 //    D3D12_GRAPHICS_PIPELINE_STATE_DESC smapPsoDesc = opaquePsoDesc;
@@ -1540,8 +1680,9 @@
 //    {
 //        mFrameResources.push_back(std::make_unique<AnimFrameResource>(md3dDevice.Get(),
 //            2, (UINT)mAllRitems.size(), 
-//            1,
-//            (UINT)mMaterials.size()));
+//            (UINT)mCharacters.size() * MathHelper::Max(1u, mSubsetPalettes.PaletteCount()),
+//            (UINT)mMaterials.size(),
+//            mDualQuatSkinning));
 //    }
 //}
 //
@@ -1752,7 +1893,7 @@
 //
 //        // All render items for this solider.m3d instance share
 //        // the same skinned model instance.
-//        ritem->SkinnedCBIndex = 0;
+//        ritem->SkinnedCBIndex = mSubsetPalettes.PaletteCount() > 0 ? mSubsetPalettes.GetPaletteIndex(i) : 0;
 //        ritem->SkinnedModelInst = mSkinnedModelInst.get();
 //
 //        mRitemLayer[(int)RenderLayer::SkinnedOpaque].push_back(ritem.get());
@@ -1763,10 +1904,14 @@
 //void SkinnedMeshApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 //{
 //    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-//    UINT skinnedCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(SkinnedConstants));
+//    UINT skinnedCBByteSize = mDualQuatSkinning ?
+//        d3dUtil::CalcConstantBufferByteSize(sizeof(SkinnedDualQuatConstants)) :
+//        d3dUtil::CalcConstantBufferByteSize(sizeof(SkinnedConstants));
 //
 //	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-//    auto skinnedCB = mCurrFrameResource->SkinnedCB->Resource();
+//    auto skinnedCB = mDualQuatSkinning ?
+//        mCurrFrameResource->SkinnedDualQuatCB->Resource() :
+//        mCurrFrameResource->SkinnedCB->Resource();
 //
 //    // For each render item...
 //    for(size_t i = 0; i < ritems.size(); ++i)
@@ -1795,6 +1940,60 @@
 //    }
 //}
 //
+//void SkinnedMeshApp::BuildCrowd()
+//{
+//    // The crowd doesn't move, so its instances and layout are written once.
+//    mCrowdVatCB = std::make_unique<UploadBuffer<VertexAnimationConstants>>(md3dDevice.Get(), 1, true);
+//    mCrowdInstances = std::make_unique<UploadBuffer<VertexAnimationInstance>>(md3dDevice.Get(), mCrowdSize, false);
+//
+//    VertexAnimationConstants vatConstants;
+//    vatConstants.Width = mCrowdVat.Width;
+//    vatConstants.RowsPerFrame = mCrowdVat.RowsPerFrame;
+//    vatConstants.FrameCount = mCrowdVat.FrameCount;
+//    vatConstants.FrameRate = mCrowdVat.FrameRate;
+//    vatConstants.Duration = mCrowdVat.Duration;
+//    mCrowdVatCB->CopyData(0, vatConstants);
+//
+//    // A grid behind the scene, each one at its own point in the clip.
+//    XMMATRIX modelScale = XMMatrixScaling(0.05f, 0.05f, -0.05f);
+//    XMMATRIX modelRot = XMMatrixRotationY(MathHelper::Pi);
+//    const UINT columns = 20;
+//    for(UINT i = 0; i < mCrowdSize; ++i)
+//    {
+//        float x = ((float)(i % columns) - 0.5f*columns) * 3.0f;
+//        float z = 20.0f + (float)(i / columns) * 3.0f;
+//
+//        VertexAnimationInstance instance;
+//        XMStoreFloat4x4(&instance.World, XMMatrixTranspose(modelScale*modelRot*XMMatrixTranslation(x, 0.0f, z)));
+//        instance.TimeOffset = MathHelper::RandF(0.0f, mCrowdVat.Duration);
+//        mCrowdInstances->CopyData(i, instance);
+//    }
+//}
+//
+//void SkinnedMeshApp::DrawCrowd(ID3D12GraphicsCommandList* cmdList)
+//{
+//    if(mCrowdSize == 0)
+//        return;
+//
+//    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+//    auto objectCB = mCurrFrameResource->ObjectCB->Resource();
+//
+//    cmdList->SetGraphicsRootConstantBufferView(1, mCrowdVatCB->Resource()->GetGPUVirtualAddress());
+//    cmdList->SetGraphicsRootDescriptorTable(6, GetGpuSrv(mCrowdVatSrvIndex));
+//    cmdList->SetGraphicsRootShaderResourceView(7, mCrowdInstances->Resource()->GetGPUVirtualAddress());
+//
+//    // One instanced draw per subset of the soldier, for the materials.
+//    for(auto ri : mRitemLayer[(int)RenderLayer::SkinnedOpaque])
+//    {
+//        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+//        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+//        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+//        cmdList->SetGraphicsRootConstantBufferView(0, objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize);
+//
+//        cmdList->DrawIndexedInstanced(ri->IndexCount, mCrowdSize, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+//    }
+//}
+//
 //void SkinnedMeshApp::DrawSceneToShadowMap()
 //{
 //    mCommandList->RSSetViewports(1, &mShadowMap->Viewport());
@@ -0,0 +1,145 @@
+#include "SubsetPalettes.h"
+#include "CpuSkinner.h"
+
+using namespace DirectX;
+
+bool SubsetPalettes::Build(std::vector<M3DLoader::SkinnedVertex>& vertices, const std::vector<USHORT>& indices,
+	const std::vector<M3DLoader::Subset>& subsets, UINT boneCount, 
+	bool mergeSubsets, UINT maxPaletteBones)
+{
+	mPaletteBones.clear();
+	mSubsetPalette.clear();
+
+	const UINT subsetCount = (UINT)subsets.size();
+
+	// Which bones each subset uses.
+	std::vector<std::vector<bool>> used(subsetCount, std::vector<bool>(boneCount, false));
+	for(UINT s = 0; s < subsetCount; ++s)
+	{
+		const M3DLoader::Subset& subset = subsets[s];
+
+		for(UINT i = subset.FaceStart*3; i < (subset.FaceStart + subset.FaceCount)*3; ++i)
+		{
+			if(indices[i] < subset.VertexStart || indices[i] >= subset.VertexStart + subset.VertexCount)
+				return false;
+		}
+
+		for(UINT i = subset.VertexStart; i < subset.VertexStart + subset.VertexCount; ++i)
+		{
+			// A bone only needs a slot if it has weight.
+			float weights[4];
+			CpuSkinner::GetBoneWeights(vertices[i], weights);
+
+			for(int j = 0; j < 4; ++j)
+			{
+				if(weights[j] != 0.0f)
+					used[s][vertices[i].BoneIndices[j]] = true;
+			}
+		}
+	}
+
+	// Group subsets into palettes.
+	std::vector<bool> paletteUsed;
+	for(UINT s = 0; s < subsetCount; ++s)
+	{
+		UINT subsetBones = 0;
+		UINT unionBones = 0;
+		for(UINT b = 0; b < boneCount; ++b)
+		{
+			subsetBones += used[s][b] ? 1 : 0;
+			unionBones += (used[s][b] || (!paletteUsed.empty() && paletteUsed[b])) ? 1 : 0;
+		}
+
+		if(subsetBones > maxPaletteBones)
+		{
+			mPaletteBones.clear();
+			mSubsetPalette.clear();
+			return false;
+		}
+
+		if(!mergeSubsets || paletteUsed.empty() || unionBones > maxPaletteBones)
+		{
+			mPaletteBones.emplace_back();
+			paletteUsed.assign(boneCount, false);
+		}
+
+		for(UINT b = 0; b < boneCount; ++b)
+		{
+			if(used[s][b] && !paletteUsed[b])
+			{
+				paletteUsed[b] = true;
+				mPaletteBones.back().push_back(b);
+			}
+		}
+
+		mSubsetPalette.push_back((UINT)mPaletteBones.size() - 1);
+	}
+
+	// Remap the vertices to palette slots.  Influences without weight go to
+	// slot 0.
+	std::vector<UINT> slot(boneCount);
+	for(UINT s = 0; s < subsetCount; ++s)
+	{
+		const std::vector<UINT>& bones = mPaletteBones[mSubsetPalette[s]];
+
+		std::fill(slot.begin(), slot.end(), 0);
+		for(UINT i = 0; i < bones.size(); ++i)
+		{
+			slot[bones[i]] = i;
+		}
+
+		const M3DLoader::Subset& subset = subsets[s];
+		for(UINT i = subset.VertexStart; i < subset.VertexStart + subset.VertexCount; ++i)
+		{
+			for(int j = 0; j < 4; ++j)
+			{
+				vertices[i].BoneIndices[j] = (BYTE)slot[vertices[i].BoneIndices[j]];
+			}
+		}
+	}
+
+	return true;
+}
+
+UINT SubsetPalettes::PaletteCount()const
+{
+	return (UINT)mPaletteBones.size();
+}
+
+UINT SubsetPalettes::GetPaletteIndex(UINT subset)const
+{
+	return mSubsetPalette[subset];
+}
+
+const std::vector<UINT>& SubsetPalettes::GetPaletteBones(UINT palette)const
+{
+	return mPaletteBones[palette];
+}
+
+UINT SubsetPalettes::TotalPaletteBones()const
+{
+	UINT total = 0;
+	for(const auto& bones : mPaletteBones)
+	{
+		total += (UINT)bones.size();
+	}
+	return total;
+}
+
+void SubsetPalettes::Gather(UINT palette, const XMFLOAT4X4* finalTransforms, XMFLOAT4X4* dest)const
+{
+	const std::vector<UINT>& bones = mPaletteBones[palette];
+	for(UINT i = 0; i < bones.size(); ++i)
+	{
+		dest[i] = finalTransforms[bones[i]];
+	}
+}
+
+void SubsetPalettes::Gather(UINT palette, const DualQuaternion* finalDualQuats, DualQuaternion* dest)const
+{
+	const std::vector<UINT>& bones = mPaletteBones[palette];
+	for(UINT i = 0; i < bones.size(); ++i)
+	{
+		dest[i] = finalDualQuats[bones[i]];
+	}
+}
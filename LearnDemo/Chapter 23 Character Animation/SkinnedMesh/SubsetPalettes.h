@@ -0,0 +1,48 @@
+#ifndef SUBSETPALETTES_H
+#define SUBSETPALETTES_H
+
+#include "LoadM3d.h"
+
+///<summary>
+/// Gives the subsets of a skinned mesh bone palettes that hold only the
+/// bones their vertices are actually weighted to, and rewrites the
+/// vertices' BoneIndices to index into those palettes.  At draw time each
+/// palette is gathered from the full BoneCount() palette and only it is
+/// uploaded.
+///
+/// With mergeSubsets, consecutive subsets share one palette as long as the
+/// union of their bones fits; otherwise every subset gets its own, which
+/// repeats any bone two subsets both use.
+///</summary>
+class SubsetPalettes
+{
+public:
+	// Vertices must belong to a single subset each ([VertexStart, VertexStart+VertexCount),
+	// as written by M3DLoader).  Returns false, and leaves the vertices alone,
+	// if a subset indexes outside its vertex range or needs more than
+	// maxPaletteBones bones.
+	bool Build(std::vector<M3DLoader::SkinnedVertex>& vertices, const std::vector<USHORT>& indices,
+		const std::vector<M3DLoader::Subset>& subsets, UINT boneCount, 
+		bool mergeSubsets, UINT maxPaletteBones = 96);
+
+	UINT PaletteCount()const;
+
+	// The palette subset i is drawn with.
+	UINT GetPaletteIndex(UINT subset)const;
+
+	// Skeleton bone of each slot of a palette.
+	const std::vector<UINT>& GetPaletteBones(UINT palette)const;
+
+	// Bones in all palettes together: what gets uploaded per character.
+	UINT TotalPaletteBones()const;
+
+	// dest[slot] = finalTransforms[GetPaletteBones(palette)[slot]].
+	void Gather(UINT palette, const DirectX::XMFLOAT4X4* finalTransforms, DirectX::XMFLOAT4X4* dest)const;
+	void Gather(UINT palette, const DualQuaternion* finalDualQuats, DualQuaternion* dest)const;
+
+private:
+	std::vector<std::vector<UINT>> mPaletteBones;
+	std::vector<UINT> mSubsetPalette;
+};
+
+#endif // SUBSETPALETTES_H
@@ -0,0 +1,244 @@
+#include "VertexAnimationBaker.h"
+#include "CpuSkinner.h"
+#include <DirectXPackedVector.h>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	// The parts of the .dds format SaveDds writes (see DDSTextureLoader.cpp).
+	const uint32_t DdsMagic = 0x20534444;   // "DDS "
+	const uint32_t DdsFourCC = 0x00000004;
+	const uint32_t DdsDx10 = 0x30315844;    // "DX10"
+	const uint32_t DdsFlags = 0x0000100F;   // CAPS | HEIGHT | WIDTH | PITCH | PIXELFORMAT
+	const uint32_t DdsCapsTexture = 0x00001000;
+	const uint32_t VatTag = 0x31544156;     // "VAT1"
+
+	struct DdsPixelFormat
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t RGBBitCount;
+		uint32_t RBitMask;
+		uint32_t GBitMask;
+		uint32_t BBitMask;
+		uint32_t ABitMask;
+	};
+
+	struct DdsHeader
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DdsPixelFormat ddspf;
+		uint32_t caps;
+		uint32_t caps2;
+		uint32_t caps3;
+		uint32_t caps4;
+		uint32_t reserved2;
+	};
+
+	struct DdsHeaderDxt10
+	{
+		uint32_t dxgiFormat;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+
+	uint32_t FloatBits(float f)
+	{
+		uint32_t bits;
+		memcpy(&bits, &f, sizeof(bits));
+		return bits;
+	}
+
+	float BitsToFloat(uint32_t bits)
+	{
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+}
+
+bool VertexAnimationBaker::Bake(const SkinnedData& skinInfo, const std::string& clipName,
+	const std::vector<M3DLoader::SkinnedVertex>& vertices, float frameRate,
+	VertexAnimationTexture& vat, UINT maxDimension)
+{
+	if(skinInfo.GetClip(clipName) == nullptr || vertices.empty() || frameRate <= 0.0f ||
+		maxDimension == 0)
+		return false;
+
+	const UINT numBones = skinInfo.BoneCount();
+	const UINT numVertices = (UINT)vertices.size();
+	const float duration = skinInfo.GetClipEndTime(clipName);
+
+	// Wrap long meshes over several rows, keeping the rows as even as possible.
+	vat.VertexCount = numVertices;
+	vat.RowsPerFrame = (numVertices + maxDimension - 1) / maxDimension;
+	vat.Width = (numVertices + vat.RowsPerFrame - 1) / vat.RowsPerFrame;
+	vat.FrameRate = frameRate;
+	vat.Duration = duration;
+	vat.FrameCount = (UINT)ceilf(duration*frameRate - 0.001f) + 1;
+
+	if(vat.Height() > maxDimension)
+		return false;
+
+	vat.Texels.assign((size_t)vat.Width * vat.Height() * 4, 0);
+
+	std::vector<XMFLOAT4X4> scratch(numBones);
+	std::vector<XMFLOAT4X4> finalTransforms(numBones);
+	std::vector<CpuSkinnedVertex> skinned(numVertices);
+
+	for(UINT f = 0; f < vat.FrameCount; ++f)
+	{
+		float t = MathHelper::Min(f / frameRate, duration);
+		skinInfo.GetFinalTransforms(clipName, t, scratch.data(), finalTransforms.data());
+		CpuSkinner::SkinLinear(vertices.data(), numVertices, finalTransforms.data(), skinned.data());
+
+		USHORT* frame = &vat.Texels[(size_t)f * vat.RowsPerFrame * vat.Width * 4];
+		for(UINT v = 0; v < numVertices; ++v)
+		{
+			USHORT* texel = frame + (size_t)v * 4;
+			texel[0] = XMConvertFloatToHalf(skinned[v].Pos.x);
+			texel[1] = XMConvertFloatToHalf(skinned[v].Pos.y);
+			texel[2] = XMConvertFloatToHalf(skinned[v].Pos.z);
+			texel[3] = EncodeNormal(XMLoadFloat3(&skinned[v].Normal));
+		}
+	}
+
+	return true;
+}
+
+bool VertexAnimationBaker::SaveDds(const std::string& filename, const VertexAnimationTexture& vat)
+{
+	std::ofstream fout(filename, std::ios::binary);
+	if(!fout)
+		return false;
+
+	DdsHeader header = {};
+	header.size = sizeof(DdsHeader);
+	header.flags = DdsFlags;
+	header.height = vat.Height();
+	header.width = vat.Width;
+	header.pitchOrLinearSize = vat.Width * 4 * sizeof(USHORT);
+	header.mipMapCount = 1;
+	header.reserved1[0] = VatTag;
+	header.reserved1[1] = vat.VertexCount;
+	header.reserved1[2] = vat.FrameCount;
+	header.reserved1[3] = vat.RowsPerFrame;
+	header.reserved1[4] = FloatBits(vat.FrameRate);
+	header.reserved1[5] = FloatBits(vat.Duration);
+	header.ddspf.size = sizeof(DdsPixelFormat);
+	header.ddspf.flags = DdsFourCC;
+	header.ddspf.fourCC = DdsDx10;
+	header.caps = DdsCapsTexture;
+
+	DdsHeaderDxt10 dx10 = {};
+	dx10.dxgiFormat = DXGI_FORMAT_R16G16B16A16_UINT;
+	dx10.resourceDimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	dx10.arraySize = 1;
+
+	fout.write(reinterpret_cast<const char*>(&DdsMagic), sizeof(DdsMagic));
+	fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	fout.write(reinterpret_cast<const char*>(&dx10), sizeof(dx10));
+	fout.write(reinterpret_cast<const char*>(vat.Texels.data()), vat.ByteSize());
+
+	return (bool)fout;
+}
+
+bool VertexAnimationBaker::ReadDdsLayout(const std::string& filename, VertexAnimationTexture& vat)
+{
+	std::ifstream fin(filename, std::ios::binary);
+
+	uint32_t magic = 0;
+	DdsHeader header = {};
+	fin.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	fin.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if(!fin || magic != DdsMagic || header.reserved1[0] != VatTag)
+		return false;
+
+	vat.Width = header.width;
+	vat.VertexCount = header.reserved1[1];
+	vat.FrameCount = header.reserved1[2];
+	vat.RowsPerFrame = header.reserved1[3];
+	vat.FrameRate = BitsToFloat(header.reserved1[4]);
+	vat.Duration = BitsToFloat(header.reserved1[5]);
+	vat.Texels.clear();
+
+	return true;
+}
+
+void VertexAnimationBaker::SampleVertex(const VertexAnimationTexture& vat, UINT vertex, float timePos,
+	XMFLOAT3& pos, XMFLOAT3& normal)
+{
+	float t = vat.Duration > 0.0f ? fmodf(timePos, vat.Duration) : 0.0f;
+	if(t < 0.0f)
+		t += vat.Duration;
+
+	// The frame at or before t and the one after it; the last interval can
+	// be shorter than 1/FrameRate.
+	UINT f0 = MathHelper::Min((UINT)(t * vat.FrameRate), vat.FrameCount > 1 ? vat.FrameCount - 2 : 0);
+	UINT f1 = MathHelper::Min(f0 + 1, vat.FrameCount - 1);
+	float t0 = f0 / vat.FrameRate;
+	float t1 = MathHelper::Min(f1 / vat.FrameRate, vat.Duration);
+	float s = t1 > t0 ? MathHelper::Clamp((t - t0) / (t1 - t0), 0.0f, 1.0f) : 0.0f;
+
+	// Rows are consecutive, so vertex v is texel v of its frame.
+	const size_t frameTexels = (size_t)vat.RowsPerFrame * vat.Width;
+	const USHORT* a = &vat.Texels[(f0*frameTexels + vertex) * 4];
+	const USHORT* b = &vat.Texels[(f1*frameTexels + vertex) * 4];
+
+	XMVECTOR p0 = XMVectorSet(XMConvertHalfToFloat(a[0]), XMConvertHalfToFloat(a[1]), XMConvertHalfToFloat(a[2]), 0.0f);
+	XMVECTOR p1 = XMVectorSet(XMConvertHalfToFloat(b[0]), XMConvertHalfToFloat(b[1]), XMConvertHalfToFloat(b[2]), 0.0f);
+	XMStoreFloat3(&pos, XMVectorLerp(p0, p1, s));
+	XMStoreFloat3(&normal, XMVector3Normalize(XMVectorLerp(DecodeNormal(a[3]), DecodeNormal(b[3]), s)));
+}
+
+USHORT VertexAnimationBaker::EncodeNormal(FXMVECTOR n)
+{
+	// Project onto the octahedron |x|+|y|+|z| = 1 and fold the lower half
+	// over the upper one.
+	XMFLOAT3 v;
+	XMStoreFloat3(&v, n);
+
+	float invL1 = 1.0f / (fabsf(v.x) + fabsf(v.y) + fabsf(v.z));
+	float x = v.x * invL1;
+	float y = v.y * invL1;
+	if(v.z < 0.0f)
+	{
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	UINT ux = (UINT)(MathHelper::Clamp(x*0.5f + 0.5f, 0.0f, 1.0f) * 255.0f + 0.5f);
+	UINT uy = (UINT)(MathHelper::Clamp(y*0.5f + 0.5f, 0.0f, 1.0f) * 255.0f + 0.5f);
+	return (USHORT)(ux | (uy << 8));
+}
+
+XMVECTOR VertexAnimationBaker::DecodeNormal(USHORT packed)
+{
+	float x = (packed & 0xFF) / 255.0f * 2.0f - 1.0f;
+	float y = (packed >> 8) / 255.0f * 2.0f - 1.0f;
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	if(z < 0.0f)
+	{
+		float unfoldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float unfoldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+
+	return XMVector3Normalize(XMVectorSet(x, y, z, 0.0f));
+}
@@ -0,0 +1,69 @@
+#ifndef VERTEXANIMATIONBAKER_H
+#define VERTEXANIMATIONBAKER_H
+
+#include "SkinnedData.h"
+#include "LoadM3d.h"
+
+///<summary>
+/// A clip baked to skinned vertices (a vertex animation texture).
+///
+/// Width x FrameCount*RowsPerFrame texels of DXGI_FORMAT_R16G16B16A16_UINT,
+/// four USHORTs per texel.  Vertex v of frame f is texel
+/// (v % Width, f*RowsPerFrame + v / Width): its position as three half
+/// floats, then its normal octahedral encoded as two bytes (x in the low
+/// byte).  The last frame is the end of the clip, so playback blends
+/// between two neighbouring frames and never wraps mid-blend.
+///</summary>
+struct VertexAnimationTexture
+{
+	UINT VertexCount = 0;
+	UINT FrameCount = 0;
+	UINT Width = 0;
+	UINT RowsPerFrame = 0;
+	float FrameRate = 0.0f;
+	float Duration = 0.0f;
+
+	std::vector<USHORT> Texels;
+
+	UINT Height()const { return FrameCount * RowsPerFrame; }
+	size_t ByteSize()const { return Texels.size() * sizeof(USHORT); }
+};
+
+///<summary>
+/// Bakes skinned clips to VertexAnimationTextures for crowds: every
+/// instance draws the same mesh with no bone palette, just a world matrix
+/// and a time offset, and the vertex shader (VERTEX_ANIMATION in
+/// Default.hlsl) reads its vertex out of the texture.  Needs no device, so
+/// it can run offline; the result is saved as a .dds that the demo loads
+/// like any other texture.
+///</summary>
+class VertexAnimationBaker
+{
+public:
+	// Samples the clip every 1/frameRate seconds, skins the vertices with
+	// CpuSkinner and packs them.  Returns false if there is no such clip, the
+	// arguments are out of range, or the texture would not fit in
+	// maxDimension x maxDimension.
+	static bool Bake(const SkinnedData& skinInfo, const std::string& clipName,
+		const std::vector<M3DLoader::SkinnedVertex>& vertices, float frameRate,
+		VertexAnimationTexture& vat, UINT maxDimension = 16384);
+
+	// Writes the texels as a DX10 .dds.  The layout (vertex count, frame
+	// count, rows per frame, frame rate) goes into the header's reserved
+	// words, where ReadDdsLayout finds it again.
+	static bool SaveDds(const std::string& filename, const VertexAnimationTexture& vat);
+
+	// Reads back the layout of a .dds written by SaveDds, without the texels.
+	static bool ReadDdsLayout(const std::string& filename, VertexAnimationTexture& vat);
+
+	// What the vertex shader computes: vertex v at timePos (looped), blended
+	// between the two nearest frames.
+	static void SampleVertex(const VertexAnimationTexture& vat, UINT vertex, float timePos,
+		DirectX::XMFLOAT3& pos, DirectX::XMFLOAT3& normal);
+
+private:
+	static USHORT EncodeNormal(DirectX::FXMVECTOR n);
+	static DirectX::XMVECTOR DecodeNormal(USHORT packed);
+};
+
+#endif // VERTEXANIMATIONBAKER_H
@@ -10,6 +10,7 @@
 //#include "../../Common/GeometryGenerator.h"
 //#include "FrameResource.h"
 //#include "Waves.h"
+//#include "../../Common/OcclusionCuller.h"
 //
 //using Microsoft::WRL::ComPtr;
 //using namespace DirectX;
@@ -39,6 +40,9 @@
 //
 //	MeshGeometry* Geo = nullptr;
 //
+//	// World space bounds, for occlusion culling.
+//	BoundingBox Bounds;
+//
 //	// Primitive topology.
 //	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //
@@ -78,6 +82,7 @@
 //	void UpdateObjectCBs(const GameTimer& gt);
 //	void UpdateMainPassCB(const GameTimer& gt);
 //	void UpdateWaves(const GameTimer& gt);
+//	void UpdateOcclusion(const GameTimer& gt);
 //
 //    void BuildRootSignature();
 //    void BuildShadersAndInputLayout();
@@ -86,6 +91,7 @@
 //    void BuildPSOs();
 //    void BuildFrameResources();
 //    void BuildRenderItems();
+//	void BuildOccluders();
 //	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
 //
 //    float GetHillsHeight(float x, float z)const;
@@ -109,6 +115,12 @@
 //
 //	RenderItem* mWavesRitem = nullptr;
 //
+//	// The water is drawn as square patches of WavesPatchQuads x WavesPatchQuads
+//	// quads, so that the ones behind the hills can be skipped.
+//	static const int WavesPatchQuads = 16;
+//	UINT mWavesPatchCount = 0;
+//	std::vector<RenderItem*> mWavesPatchRitems;
+//
 //	// List of all the render items.
 //	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 //
@@ -121,6 +133,18 @@
 //
 //    bool mIsWireframe = false;
 //
+//	// A coarse copy of the hills, drawn into a CPU depth buffer each frame to
+//	// find the water patches hidden behind them.
+//	ThreadPool mThreadPool;
+//	OcclusionCuller mOcclusionCuller;
+//	std::vector<XMFLOAT3> mLandOccluderVertices;
+//	std::vector<UINT> mLandOccluderIndices;
+//	std::vector<OcclusionCuller::Occluder> mOccluders;
+//	std::vector<BoundingBox> mOcclusionBoxes;
+//	std::vector<BYTE> mOcclusionVisible;
+//	std::vector<RenderItem*> mVisibleOpaqueRitems;
+//	bool mOcclusionCullingEnabled = true;
+//
 //	XMFLOAT3 mEyePos = { 0.0f, 0.0f, 0.0f };
 //	XMFLOAT4X4 mView = MathHelper::Identity4x4();
 //	XMFLOAT4X4 mProj = MathHelper::Identity4x4();
@@ -184,10 +208,13 @@
 //	BuildLandGeometry();
 //    BuildWavesGeometryBuffers();
 //    BuildRenderItems();
-//	BuildRenderItems();
+//	BuildOccluders();
 //    BuildFrameResources();
 //	BuildPSOs();
 //
+//	// A quarter of the demo's resolution in each direction is plenty.
+//	mOcclusionCuller.Initialize(&mThreadPool, 320, 180);
+//
 //    // Execute the initialization commands.
 //    ThrowIfFailed(mCommandList->Close());
 //    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
@@ -230,6 +257,7 @@
 //	UpdateObjectCBs(gt);
 //	UpdateMainPassCB(gt);
 //	UpdateWaves(gt);
+//	UpdateOcclusion(gt);
 //}
 //
 //void LandAndWavesApp::Draw(const GameTimer& gt)
@@ -272,7 +300,7 @@
 //	auto passCB = mCurrFrameResource->PassCB->Resource();
 //	mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
 //
-//	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+//	DrawRenderItems(mCommandList.Get(), mVisibleOpaqueRitems);
 //
 //	// Indicate a state transition on the resource usage.
 //	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -349,6 +377,12 @@
 //        mIsWireframe = true;
 //    else
 //        mIsWireframe = false;
+//
+//	if(GetAsyncKeyState('2') & 0x8000)
+//		mOcclusionCullingEnabled = true;
+//
+//	if(GetAsyncKeyState('3') & 0x8000)
+//		mOcclusionCullingEnabled = false;
 //}
 //
 //void LandAndWavesApp::UpdateCamera(const GameTimer& gt)
@@ -441,11 +475,15 @@
 //	// Update the wave vertex buffer with the new solution.
 //    // ò˷²˶㻺
 //	auto currWavesVB = mCurrFrameResource->WavesVB.get();
+//	float minY = MathHelper::Infinity;
+//	float maxY = -MathHelper::Infinity;
 //	for(int i = 0; i < mWaves->VertexCount(); ++i)
 //	{
 //		Vertex v;
 //
 //		v.Pos = mWaves->Position(i);
+//		minY = MathHelper::Min(minY, v.Pos.y);
+//		maxY = MathHelper::Max(maxY, v.Pos.y);
 //        v.Color = XMFLOAT4(DirectX::Colors::Blue);
 //
 //		currWavesVB->CopyData(i, v);
@@ -455,6 +493,13 @@
 //    // ȾĶ̬㻺õǰ֡Ķ㻺
 //	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
 //
+//	// The patches keep their x and z extents; only the height of the water moves.
+//	for(auto ri : mWavesPatchRitems)
+//	{
+//		ri->Bounds.Center.y = 0.5f*(minY + maxY);
+//		ri->Bounds.Extents.y = 0.5f*(maxY - minY);
+//	}
+//
 //    /*
 //        ǱһݲȾãmWavesRitemӶԶ̬ص䶥㻺
 //        ȾĶ㻺Ǹ̬Ļÿһ֡ڷı䣬бҪ
@@ -471,6 +516,36 @@
 //    */
 //}
 //
+//void LandAndWavesApp::UpdateOcclusion(const GameTimer& gt)
+//{
+//	// Draw the hills into the CPU depth buffer and test the land and the
+//	// water patches against it.
+//	XMMATRIX viewProj = XMMatrixMultiply(XMLoadFloat4x4(&mView), XMLoadFloat4x4(&mProj));
+//	mOcclusionCuller.Render(viewProj, mOccluders.data(), (UINT)mOccluders.size());
+//
+//	const auto& opaqueRitems = mRitemLayer[(int)RenderLayer::Opaque];
+//	mOcclusionBoxes.resize(opaqueRitems.size());
+//	mOcclusionVisible.resize(opaqueRitems.size());
+//	for(size_t i = 0; i < opaqueRitems.size(); ++i)
+//	{
+//		mOcclusionBoxes[i] = opaqueRitems[i]->Bounds;
+//	}
+//	mOcclusionCuller.TestBoxes(mOcclusionBoxes.data(), (UINT)mOcclusionBoxes.size(), mOcclusionVisible.data());
+//
+//	mVisibleOpaqueRitems.clear();
+//	for(size_t i = 0; i < opaqueRitems.size(); ++i)
+//	{
+//		if(mOcclusionVisible[i] || !mOcclusionCullingEnabled)
+//			mVisibleOpaqueRitems.push_back(opaqueRitems[i]);
+//	}
+//
+//	std::wostringstream outs;
+//	outs.precision(3);
+//	outs << L"Land and Waves Demo    " << 100.0f*mOcclusionCuller.RejectedFraction() << L"% occluded in "
+//		<< mOcclusionCuller.RenderMs() + mOcclusionCuller.TestMs() << L" ms";
+//	mMainWndCaption = outs.str();
+//}
+//
 //void LandAndWavesApp::BuildRootSignature()
 //{
 //    /*
@@ -623,6 +698,7 @@
 //	submesh.IndexCount = (UINT)indices.size();
 //	submesh.StartIndexLocation = 0;
 //	submesh.BaseVertexLocation = 0;
+//	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 //
 //	geo->DrawArgs["grid"] = submesh;
 //
@@ -634,23 +710,44 @@
 //	std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
 //	assert(mWaves->VertexCount() < 0x0000ffff);
 //
-//	// Iterate over each quad.
+//	// Iterate over each quad, a patch at a time rather than a row at a time,
+//	// so that every patch is one contiguous range of the index buffer.
 //	int m = mWaves->RowCount();
 //	int n = mWaves->ColumnCount();
 //	int k = 0;
-//	for(int i = 0; i < m - 1; ++i)
+//	std::vector<SubmeshGeometry> patches;
+//	for(int pi = 0; pi < m - 1; pi += WavesPatchQuads)
 //	{
-//		for(int j = 0; j < n - 1; ++j)
+//		for(int pj = 0; pj < n - 1; pj += WavesPatchQuads)
 //		{
-//			indices[k] = i*n + j;
-//			indices[k + 1] = i*n + j + 1;
-//			indices[k + 2] = (i + 1)*n + j;
-//
-//			indices[k + 3] = (i + 1)*n + j;
-//			indices[k + 4] = i*n + j + 1;
-//			indices[k + 5] = (i + 1)*n + j + 1;
-//
-//			k += 6; // next quad
+//			int iEnd = MathHelper::Min(pi + WavesPatchQuads, m - 1);
+//			int jEnd = MathHelper::Min(pj + WavesPatchQuads, n - 1);
+//
+//			SubmeshGeometry patch;
+//			patch.StartIndexLocation = k;
+//			patch.BaseVertexLocation = 0;
+//
+//			for(int i = pi; i < iEnd; ++i)
+//			{
+//				for(int j = pj; j < jEnd; ++j)
+//				{
+//					indices[k] = i*n + j;
+//					indices[k + 1] = i*n + j + 1;
+//					indices[k + 2] = (i + 1)*n + j;
+//
+//					indices[k + 3] = (i + 1)*n + j;
+//					indices[k + 4] = i*n + j + 1;
+//					indices[k + 5] = (i + 1)*n + j + 1;
+//
+//					k += 6; // next quad
+//				}
+//			}
+//
+//			// The water is still flat here; UpdateWaves sets the height of the bounds.
+//			patch.IndexCount = k - patch.StartIndexLocation;
+//			BoundingBox::CreateFromPoints(patch.Bounds,
+//				XMLoadFloat3(&mWaves->Position(pi*n + pj)), XMLoadFloat3(&mWaves->Position(iEnd*n + jEnd)));
+//			patches.push_back(patch);
 //		}
 //	}
 //
@@ -682,6 +779,10 @@
 //
 //	geo->DrawArgs["grid"] = submesh;
 //
+//	mWavesPatchCount = (UINT)patches.size();
+//	for(UINT p = 0; p < mWavesPatchCount; ++p)
+//		geo->DrawArgs["patch" + std::to_string(p)] = patches[p];
+//
 //	mGeometries["waterGeo"] = std::move(geo);
 //}
 //
@@ -737,34 +838,70 @@
 //
 //void LandAndWavesApp::BuildRenderItems()
 //{
-//	auto wavesRitem = std::make_unique<RenderItem>();
-//	wavesRitem->World = MathHelper::Identity4x4();
-//	wavesRitem->ObjCBIndex = 0;
-//	wavesRitem->Geo = mGeometries["waterGeo"].get();
-//	wavesRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-//	wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["grid"].IndexCount;
-//	wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-//	wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-//
-//	mWavesRitem = wavesRitem.get();
-//
-//	mRitemLayer[(int)RenderLayer::Opaque].push_back(wavesRitem.get());
+//	// One render item per water patch.  They all share waterGeo, so
+//	// mWavesRitem (the first) is enough to update its vertex buffer.
+//	UINT objCBIndex = 0;
+//	for(UINT p = 0; p < mWavesPatchCount; ++p)
+//	{
+//		const SubmeshGeometry& patch = mGeometries["waterGeo"]->DrawArgs["patch" + std::to_string(p)];
+//
+//		auto wavesRitem = std::make_unique<RenderItem>();
+//		wavesRitem->World = MathHelper::Identity4x4();
+//		wavesRitem->ObjCBIndex = objCBIndex++;
+//		wavesRitem->Geo = mGeometries["waterGeo"].get();
+//		wavesRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+//		wavesRitem->IndexCount = patch.IndexCount;
+//		wavesRitem->StartIndexLocation = patch.StartIndexLocation;
+//		wavesRitem->BaseVertexLocation = patch.BaseVertexLocation;
+//		wavesRitem->Bounds = patch.Bounds;
+//
+//		if(mWavesRitem == nullptr)
+//			mWavesRitem = wavesRitem.get();
+//
+//		mWavesPatchRitems.push_back(wavesRitem.get());
+//		mRitemLayer[(int)RenderLayer::Opaque].push_back(wavesRitem.get());
+//		mAllRitems.push_back(std::move(wavesRitem));
+//	}
 //
 //	auto gridRitem = std::make_unique<RenderItem>();
 //	gridRitem->World = MathHelper::Identity4x4();
-//	gridRitem->ObjCBIndex = 1;
+//	gridRitem->ObjCBIndex = objCBIndex++;
 //	gridRitem->Geo = mGeometries["landGeo"].get();
 //	gridRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
 //	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
 //	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+//	gridRitem->Bounds = gridRitem->Geo->DrawArgs["grid"].Bounds;
 //
 //	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
 //
-//	mAllRitems.push_back(std::move(wavesRitem));
 //	mAllRitems.push_back(std::move(gridRitem));
 //}
 //
+//void LandAndWavesApp::BuildOccluders()
+//{
+//	// The hills on a grid of 5 unit cells rather than the land's 3.2, and
+//	// dropped by 3 units: across a cell the hills bend away from a flat
+//	// triangle by less than 2 units, so the occluder stays under the land
+//	// everywhere and never hides water the real hills don't.
+//	GeometryGenerator geoGen;
+//	GeometryGenerator::MeshData grid = geoGen.CreateGrid(160.0f, 160.0f, 33, 33);
+//
+//	for(const auto& vertex : grid.Vertices)
+//	{
+//		XMFLOAT3 p = vertex.Position;
+//		p.y = GetHillsHeight(p.x, p.z) - 3.0f;
+//		mLandOccluderVertices.push_back(p);
+//	}
+//	mLandOccluderIndices.assign(grid.Indices32.begin(), grid.Indices32.end());
+//
+//	OcclusionCuller::Occluder landOccluder;
+//	landOccluder.Vertices = mLandOccluderVertices.data();
+//	landOccluder.Indices = mLandOccluderIndices.data();
+//	landOccluder.IndexCount = (UINT)mLandOccluderIndices.size();
+//	mOccluders.push_back(landOccluder);
+//}
+//
 //void LandAndWavesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 //{
 //	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
@@ -0,0 +1,462 @@
+#include "DrawBenchmark.h"
+#include "../../Common/MathHelper.h"
+#include "../../Common/GeometryGenerator.h"
+#include "../../Common/BenchmarkTimer.h"
+#include <algorithm>
+#include <iomanip>
+
+using namespace DirectX;
+
+namespace
+{
+	// What the sort key needs from a RenderItem.
+	struct SceneItem
+	{
+		UINT Layer;
+		UINT Pso;
+		UINT Geometry;
+		UINT Material;
+		XMFLOAT3 Position;
+	};
+
+	// itemCount items, one in ten transparent, in random order in a 200x200
+	// area around the origin.
+	std::vector<SceneItem> MakeSceneItems(UINT itemCount, UINT psoCount, UINT geometryCount, UINT materialCount)
+	{
+		std::vector<SceneItem> items(itemCount);
+		for(auto& item : items)
+		{
+			item.Layer = rand() % 10 == 0 ? 1 : 0;
+			item.Pso = item.Layer*(psoCount / 2) + rand() % (psoCount / 2);
+			item.Geometry = rand() % geometryCount;
+			item.Material = rand() % materialCount;
+			item.Position = XMFLOAT3(MathHelper::RandF(-100.0f, 100.0f), MathHelper::RandF(0.0f, 10.0f),
+				MathHelper::RandF(-100.0f, 100.0f));
+		}
+		return items;
+	}
+
+	// What AutoInstancer needs from a RenderItem.
+	struct InstancedItem
+	{
+		UINT ObjCBIndex = 0;
+		const void* Mat = nullptr;
+		const void* Geo = nullptr;
+		D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		UINT IndexCount = 0;
+		UINT StartIndexLocation = 0;
+		int BaseVertexLocation = 0;
+	};
+
+	// Stand-ins for the MeshGeometry and Material pointers; only their
+	// addresses are compared.
+	BYTE gGeometries[32];
+	BYTE gMaterials[64];
+
+	// Draws submesh s of geometry g; the submeshes of a geometry follow one
+	// another in its index buffer.
+	InstancedItem MakeInstancedItem(UINT objCBIndex, UINT g, UINT s, UINT m)
+	{
+		InstancedItem item;
+		item.ObjCBIndex = objCBIndex;
+		item.Mat = &gMaterials[m];
+		item.Geo = &gGeometries[g];
+		item.IndexCount = 300 + 60*s;
+		item.StartIndexLocation = 1000*s;
+		item.BaseVertexLocation = 500*s;
+		return item;
+	}
+
+	// The box, grid, skull, 10 cylinders and 10 spheres of LitColumnsApp.
+	std::vector<InstancedItem> MakeLitColumnsItems()
+	{
+		std::vector<InstancedItem> items;
+		items.push_back(MakeInstancedItem(0, 0, 0, 1));   // box, stone0
+		items.push_back(MakeInstancedItem(1, 0, 1, 2));   // grid, tile0
+		items.push_back(MakeInstancedItem(2, 1, 0, 3));   // skull, skullMat
+		for(UINT i = 0; i < 5; ++i)
+		{
+			UINT objCBIndex = (UINT)items.size();
+			items.push_back(MakeInstancedItem(objCBIndex, 0, 3, 0));       // cylinders, bricks0
+			items.push_back(MakeInstancedItem(objCBIndex + 1, 0, 3, 0));
+			items.push_back(MakeInstancedItem(objCBIndex + 2, 0, 2, 1));   // spheres, stone0
+			items.push_back(MakeInstancedItem(objCBIndex + 3, 0, 2, 1));
+		}
+		return items;
+	}
+
+	// itemCount items in random order over geometryCount geometries of 4
+	// submeshes each and materialCount materials.
+	std::vector<InstancedItem> MakeRandomItems(UINT itemCount, UINT geometryCount, UINT materialCount)
+	{
+		std::vector<InstancedItem> items;
+		for(UINT i = 0; i < itemCount; ++i)
+		{
+			items.push_back(MakeInstancedItem(i, rand() % geometryCount, rand() % 4, rand() % materialCount));
+		}
+		return items;
+	}
+
+	// The lit columns demo's vertex format.
+	struct ColumnsVertex
+	{
+		XMFLOAT3 Pos;
+		XMFLOAT3 Normal;
+	};
+
+	// The lit columns demo's box, grid and cylinder in one MeshGeometry
+	// with CPU copies, as BuildShapeGeometry makes it.
+	void BuildShapeGeometry(MeshGeometry& geo)
+	{
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData meshes[] =
+		{
+			geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3),
+			geoGen.CreateGrid(20.0f, 30.0f, 60, 40),
+			geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20)
+		};
+		const char* names[] = { "box", "grid", "cylinder" };
+
+		std::vector<ColumnsVertex> vertices;
+		std::vector<std::uint16_t> indices;
+		for(UINT m = 0; m < 3; ++m)
+		{
+			SubmeshGeometry submesh;
+			submesh.IndexCount = (UINT)meshes[m].Indices32.size();
+			submesh.StartIndexLocation = (UINT)indices.size();
+			submesh.BaseVertexLocation = (INT)vertices.size();
+			geo.DrawArgs[names[m]] = submesh;
+
+			for(const auto& v : meshes[m].Vertices)
+			{
+				vertices.push_back({ v.Position, v.Normal });
+			}
+			const auto& indices16 = meshes[m].GetIndices16();
+			indices.insert(indices.end(), indices16.begin(), indices16.end());
+		}
+
+		const UINT vbByteSize = (UINT)vertices.size() * sizeof(ColumnsVertex);
+		const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+		D3DCreateBlob(vbByteSize, geo.VertexBufferCPU.GetAddressOf());
+		CopyMemory(geo.VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+		D3DCreateBlob(ibByteSize, geo.IndexBufferCPU.GetAddressOf());
+		CopyMemory(geo.IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+
+		geo.VertexByteStride = sizeof(ColumnsVertex);
+		geo.VertexBufferByteSize = vbByteSize;
+		geo.IndexFormat = DXGI_FORMAT_R16_UINT;
+		geo.IndexBufferByteSize = ibByteSize;
+	}
+
+	struct StaticItem
+	{
+		const char* Submesh;
+		XMFLOAT4X4 World;
+		UINT MaterialId;
+	};
+
+	StaticItem MakeStaticItem(const char* submesh, CXMMATRIX world, UINT materialId)
+	{
+		StaticItem item;
+		item.Submesh = submesh;
+		XMStoreFloat4x4(&item.World, world);
+		item.MaterialId = materialId;
+		return item;
+	}
+
+	// The items LitColumnsApp marks static.
+	std::vector<StaticItem> MakeLitColumnsStaticItems()
+	{
+		std::vector<StaticItem> items;
+		items.push_back(MakeStaticItem("box", XMMatrixScaling(2.0f, 2.0f, 2.0f)*XMMatrixTranslation(0.0f, 0.5f, 0.0f), 1));
+		items.push_back(MakeStaticItem("grid", XMMatrixIdentity(), 2));
+		for(int i = 0; i < 5; ++i)
+		{
+			items.push_back(MakeStaticItem("cylinder", XMMatrixTranslation(-5.0f, 1.5f, -10.0f + i*5.0f), 0));
+			items.push_back(MakeStaticItem("cylinder", XMMatrixTranslation(+5.0f, 1.5f, -10.0f + i*5.0f), 0));
+		}
+		return items;
+	}
+
+	// Columns and walls (stretched boxes, some mirrored) at random.
+	std::vector<StaticItem> MakeCourtyardItems(UINT itemCount, UINT materialCount)
+	{
+		std::vector<StaticItem> items;
+		for(UINT i = 0; i < itemCount; ++i)
+		{
+			XMMATRIX translation = XMMatrixTranslation(MathHelper::RandF(-200.0f, 200.0f), 1.5f,
+				MathHelper::RandF(-200.0f, 200.0f));
+			UINT materialId = rand() % materialCount;
+			if(rand() % 3 == 0)
+			{
+				float sx = rand() % 2 == 0 ? 4.0f : -4.0f;
+				XMMATRIX world = XMMatrixScaling(sx, 6.0f, 0.5f)*XMMatrixRotationY(MathHelper::RandF(0.0f, XM_2PI))*translation;
+				items.push_back(MakeStaticItem("box", world, materialId));
+			}
+			else
+			{
+				items.push_back(MakeStaticItem("cylinder", translation, materialId));
+			}
+		}
+		return items;
+	}
+}
+
+void DrawBenchmark::RenderQueueSorting(std::ostream& out)
+{
+	const UINT itemCounts[] = { 10000, 100000 };
+	const UINT psoCount = 4;
+	const UINT geometryCount = 32;
+	const UINT materialCount = 64;
+	const float farZ = 1000.0f;
+
+	const XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 20.0f, -150.0f, 1.0f),
+		XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+
+	out << "Render queue, " << psoCount << " PSOs, " << geometryCount << " geometries, "
+		<< materialCount << " materials, ms per frame\n";
+	out << std::setw(8) << "items" << std::setw(9) << "keys" << std::setw(9) << "radix" << std::setw(8) << "passes"
+		<< std::setw(13) << "stable_sort" << std::setw(12) << "binds/draw" << std::setw(12) << "binds/draw"
+		<< std::setw(12) << "eliminated" << std::setw(6) << "same" << "\n";
+	out << std::setw(59) << "unsorted" << std::setw(12) << "sorted" << "\n";
+
+	for(UINT itemCount : itemCounts)
+	{
+		std::vector<SceneItem> items = MakeSceneItems(itemCount, psoCount, geometryCount, materialCount);
+
+		// What building the queue from the visible items costs each frame.
+		RenderQueue queue;
+		double keyMs = BenchmarkTimer::BestTimeMs(5, [&]()
+		{
+			queue.Clear();
+			for(UINT i = 0; i < itemCount; ++i)
+			{
+				const SceneItem& item = items[i];
+				float depth = XMVectorGetZ(XMVector3Transform(XMLoadFloat3(&item.Position), view)) / farZ;
+
+				// Transparent items back to front.
+				if(item.Layer == 1)
+					depth = 1.0f - depth;
+
+				queue.Add(RenderQueue::MakeKey(item.Layer, item.Pso, item.Geometry, item.Material, depth), i);
+			}
+		});
+
+		std::vector<std::pair<UINT64, UINT>> unsorted(itemCount);
+		for(UINT i = 0; i < itemCount; ++i)
+		{
+			unsorted[i] = std::make_pair(queue.GetKey(i), queue.GetItem(i));
+		}
+
+		RenderQueue sorted;
+		double radixMs = BenchmarkTimer::BestTimeMs(5, [&]()
+		{
+			sorted = queue;
+			sorted.Sort();
+		});
+
+		std::vector<std::pair<UINT64, UINT>> reference;
+		double stdMs = BenchmarkTimer::BestTimeMs(5, [&]()
+		{
+			reference = unsorted;
+			std::stable_sort(reference.begin(), reference.end(),
+				[](const std::pair<UINT64, UINT>& a, const std::pair<UINT64, UINT>& b) { return a.first < b.first; });
+		});
+
+		bool same = true;
+		for(UINT i = 0; i < itemCount && same; ++i)
+		{
+			same = sorted.GetKey(i) == reference[i].first && sorted.GetItem(i) == reference[i].second;
+		}
+
+		// DrawRenderItems in insertion order sets the vertex buffer, index
+		// buffer, topology, object CBV and material CBV for every item, and
+		// the PSO once per layer.  Sorted, geometry (3 calls), material and
+		// PSO are only set when they change; the object CBV still is per item.
+		const UINT unsortedBinds = 5*itemCount + 2;
+		RenderQueue::BindCounts binds = sorted.CountBinds();
+		const UINT sortedBinds = binds.Pso + 3*binds.Geometry + binds.Material + itemCount;
+
+		out << std::setw(8) << itemCount << std::fixed << std::setprecision(3)
+			<< std::setw(9) << keyMs << std::setw(9) << radixMs << std::setw(8) << sorted.SortPasses()
+			<< std::setw(13) << stdMs << std::setprecision(2)
+			<< std::setw(12) << (double)unsortedBinds / itemCount << std::setw(12) << (double)sortedBinds / itemCount
+			<< std::setprecision(1) << std::setw(11) << 100.0*(unsortedBinds - sortedBinds) / unsortedBinds << "%"
+			<< std::setw(6) << (same ? "yes" : "NO") << "\n";
+	}
+
+	out << std::endl;
+}
+
+void DrawBenchmark::AutoInstancing(std::ostream& out)
+{
+	struct Scene
+	{
+		const char* Name;
+		std::vector<InstancedItem> Items;
+	};
+	std::vector<Scene> scenes;
+	scenes.push_back({ "lit columns", MakeLitColumnsItems() });
+	scenes.push_back({ "10k, 32 kinds", MakeRandomItems(10000, 2, 4) });
+	scenes.push_back({ "10k, 8192 kinds", MakeRandomItems(10000, 32, 64) });
+	scenes.push_back({ "100k, 32 kinds", MakeRandomItems(100000, 2, 4) });
+	scenes.push_back({ "100k, 8192 kinds", MakeRandomItems(100000, 32, 64) });
+
+	out << "Automatic instancing, per frame\n";
+	out << std::setw(18) << "scene" << std::setw(8) << "items" << std::setw(9) << "draws"
+		<< std::setw(9) << "draws" << std::setw(11) << "root sets" << std::setw(11) << "root sets"
+		<< std::setw(12) << "eliminated" << std::setw(10) << "build ms" << std::setw(7) << "valid" << "\n";
+	out << std::setw(35) << "single" << std::setw(9) << "batched" << std::setw(11) << "single"
+		<< std::setw(11) << "batched" << "\n";
+
+	for(Scene& scene : scenes)
+	{
+		std::vector<InstancedItem*> ritems;
+		for(InstancedItem& item : scene.Items)
+		{
+			ritems.push_back(&item);
+		}
+		const UINT itemCount = (UINT)ritems.size();
+
+		AutoInstancer<InstancedItem> instancer;
+		double buildMs = BenchmarkTimer::BestTimeMs(5, [&]()
+		{
+			instancer.Build(ritems);
+		});
+
+		// Every item must have its own slot, and every slot of a batch must
+		// hold an item that draws what the batch draws.
+		const auto& batches = instancer.GetBatches();
+		bool valid = instancer.InstanceCount() == itemCount;
+		std::vector<const InstancedItem*> slotItems(itemCount, nullptr);
+		for(const InstancedItem* ri : ritems)
+		{
+			UINT slot = instancer.GetInstanceIndex(ri->ObjCBIndex);
+			valid = valid && slot < itemCount && slotItems[slot] == nullptr;
+			if(valid)
+				slotItems[slot] = ri;
+		}
+		for(UINT b = 0; b < (UINT)batches.size() && valid; ++b)
+		{
+			const InstancedItem* first = batches[b].First;
+			for(UINT slot = batches[b].FirstInstance; slot < batches[b].FirstInstance + batches[b].InstanceCount; ++slot)
+			{
+				const InstancedItem* ri = slotItems[slot];
+				valid = valid && ri->Geo == first->Geo && ri->IndexCount == first->IndexCount &&
+					ri->StartIndexLocation == first->StartIndexLocation && ri->Mat == first->Mat;
+			}
+		}
+
+		// Batches in geometry and material order, as LitColumnsApp draws them.
+		RenderQueue queue;
+		for(UINT i = 0; i < (UINT)batches.size(); ++i)
+		{
+			const InstancedItem* ri = batches[i].First;
+			UINT geometry = (UINT)((const BYTE*)ri->Geo - gGeometries);
+			UINT material = (UINT)((const BYTE*)ri->Mat - gMaterials);
+			queue.Add(RenderQueue::MakeKey(0, 0, geometry*4 + ri->StartIndexLocation / 1000, material, 0.0f), i);
+		}
+		queue.Sort();
+
+		// On its own, each item sets its object CBV and material CBV.  Batched,
+		// each draw sets its object SRV and the material only when it changes.
+		const UINT singleRootSets = 2*itemCount;
+		const UINT batchedRootSets = queue.Size() + queue.CountBinds().Material;
+
+		out << std::setw(18) << scene.Name << std::setw(8) << itemCount << std::setw(9) << itemCount
+			<< std::setw(9) << queue.Size() << std::setw(11) << singleRootSets << std::setw(11) << batchedRootSets
+			<< std::fixed << std::setprecision(1)
+			<< std::setw(11) << 100.0*(singleRootSets - batchedRootSets) / singleRootSets << "%"
+			<< std::setprecision(3) << std::setw(10) << buildMs << std::setw(7) << (valid ? "yes" : "NO") << "\n";
+	}
+
+	out << std::endl;
+}
+
+void DrawBenchmark::StaticBatching(std::ostream& out)
+{
+	MeshGeometry geo;
+	BuildShapeGeometry(geo);
+
+	StaticBatcher::VertexLayout layout;
+	layout.ByteStride = sizeof(ColumnsVertex);
+	layout.PositionOffset = offsetof(ColumnsVertex, Pos);
+	layout.NormalOffset = offsetof(ColumnsVertex, Normal);
+
+	// A World and TexTransform per item, as LitColumnsApp's ObjectConstants.
+	const UINT objectByteSize = 2*sizeof(XMFLOAT4X4);
+
+	struct Scene
+	{
+		const char* Name;
+		std::vector<StaticItem> Items;
+		float ChunkSize;
+	};
+	std::vector<Scene> scenes;
+	std::vector<StaticItem> courtyard = MakeCourtyardItems(10000, 8);
+	scenes.push_back({ "lit columns", MakeLitColumnsStaticItems(), 10.0f });
+	scenes.push_back({ "courtyard", courtyard, 25.0f });
+	scenes.push_back({ "courtyard", courtyard, 100.0f });
+
+	out << "Static batching, draws per frame and KB\n";
+	out << std::setw(12) << "scene" << std::setw(7) << "chunk" << std::setw(7) << "items" << std::setw(8) << "chunks"
+		<< std::setw(8) << "saved" << std::setw(10) << "object" << std::setw(10) << "source" << std::setw(10) << "baked"
+		<< std::setw(11) << "vs source" << std::setw(10) << "build ms" << std::setw(7) << "valid" << "\n";
+	out << std::setw(52) << "removed" << "\n";
+
+	for(const Scene& scene : scenes)
+	{
+		const UINT itemCount = (UINT)scene.Items.size();
+
+		StaticBatcher batcher(layout, scene.ChunkSize);
+		UINT indexCount = 0;
+		for(const StaticItem& item : scene.Items)
+		{
+			const SubmeshGeometry& submesh = geo.DrawArgs[item.Submesh];
+			if(batcher.Add(geo, submesh.IndexCount, submesh.StartIndexLocation, submesh.BaseVertexLocation,
+				item.World, MathHelper::Identity4x4(), item.MaterialId))
+			{
+				indexCount += submesh.IndexCount;
+			}
+		}
+
+		double buildMs = BenchmarkTimer::BestTimeMs(3, [&]()
+		{
+			batcher.Build();
+		});
+
+		// Every index must be kept, and every chunk's vertices must be inside
+		// its bounds and reachable with 16-bit indices.
+		const auto& chunks = batcher.GetChunks();
+		const auto& indices = batcher.GetIndices();
+		const BYTE* vertices = batcher.GetVertices().data();
+		bool valid = indices.size() == indexCount;
+		for(const auto& chunk : chunks)
+		{
+			BoundingBox bounds = chunk.Bounds;
+			bounds.Extents.x += 0.001f;
+			bounds.Extents.y += 0.001f;
+			bounds.Extents.z += 0.001f;
+			for(UINT i = chunk.StartIndexLocation; i < chunk.StartIndexLocation + chunk.IndexCount && valid; ++i)
+			{
+				const ColumnsVertex* v = reinterpret_cast<const ColumnsVertex*>(
+					vertices + (size_t)(chunk.BaseVertexLocation + indices[i]) * sizeof(ColumnsVertex));
+				valid = bounds.Contains(XMLoadFloat3(&v->Pos)) != DISJOINT;
+			}
+		}
+
+		const UINT chunkCount = (UINT)chunks.size();
+		const double objectKB = (double)(itemCount - chunkCount) * objectByteSize / 1024.0;
+		const double sourceKB = batcher.SourceByteSize() / 1024.0;
+		const double bakedKB = batcher.BatchedByteSize() / 1024.0;
+
+		out << std::setw(12) << scene.Name << std::setw(7) << scene.ChunkSize << std::setw(7) << itemCount
+			<< std::setw(8) << chunkCount << std::setw(8) << itemCount - chunkCount
+			<< std::fixed << std::setprecision(1) << std::setw(10) << objectKB
+			<< std::setw(10) << sourceKB << std::setw(10) << bakedKB << std::setw(10) << bakedKB / sourceKB << "x"
+			<< std::setprecision(3) << std::setw(10) << buildMs << std::setw(7) << (valid ? "yes" : "NO") << "\n";
+		out.unsetf(std::ios::fixed);
+	}
+
+	out << std::endl;
+}
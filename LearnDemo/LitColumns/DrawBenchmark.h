@@ -0,0 +1,42 @@
+#ifndef DRAWBENCHMARK_H
+#define DRAWBENCHMARK_H
+
+#include "../../Common/RenderQueue.h"
+#include "../../Common/AutoInstancer.h"
+#include "../../Common/StaticBatcher.h"
+#include <ostream>
+
+///<summary>
+/// Headless measurements of how many draws and state changes a frame takes
+/// to submit.  The scenes are random items over the lit columns demo's
+/// kinds of geometry and materials.  Nothing here needs a device, e.g.:
+///
+///    std::ofstream fout("DrawBenchmark.txt");
+///    DrawBenchmark::RenderQueueSorting(fout);
+///</summary>
+class DrawBenchmark
+{
+public:
+	// 10k and 100k items in random order over 2 layers, 4 PSOs, 32
+	// geometries and 64 materials: the time to build their keys and to
+	// sort them with RenderQueue against std::stable_sort, and the state
+	// changes DrawRenderItems makes in insertion order (every bind for
+	// every item) against the sorted queue with repeated binds skipped.
+	static void RenderQueueSorting(std::ostream& out);
+
+	// The lit columns scene, and 10k and 100k random items over few and
+	// many kinds of submesh and material: draws and root descriptor sets
+	// (object and material) per frame with every item drawn on its own
+	// against AutoInstancer batches sorted by RenderQueue, and the time
+	// Build takes.
+	static void AutoInstancing(std::ostream& out);
+
+	// The lit columns demo's static box, grid and columns, and 10k random
+	// columns and walls over a 400x400 courtyard with 8 materials, at two
+	// chunk sizes: draws and per-object constants with every item drawn on
+	// its own against the StaticBatcher chunks, the bytes the baked
+	// geometry takes against the shared source submeshes, and Build time.
+	static void StaticBatching(std::ostream& out);
+};
+
+#endif // DRAWBENCHMARK_H
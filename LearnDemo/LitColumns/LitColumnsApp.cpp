@@ -6,6 +6,9 @@
 //#include "../../Common/MathHelper.h"
 //#include "../../Common/UploadBuffer.h"
 //#include "../../Common/GeometryGenerator.h"
+//#include "../../Common/RenderQueue.h"
+//#include "../../Common/AutoInstancer.h"
+//#include "../../Common/StaticBatcher.h"
 //#include "FrameResourceLitColumns.h"
 //
 //using Microsoft::WRL::ComPtr;
@@ -36,7 +39,8 @@
 //	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
 //	int NumFramesDirty = gNumFrameResources;
 //
-//	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+//	// Identifies this render item; its slot in the ObjectBuffer is given by
+//	// mAutoInstancer.GetInstanceIndex(ObjCBIndex).
 //	UINT ObjCBIndex = -1;
 //
 //	Material* Mat = nullptr;
@@ -49,6 +53,15 @@
 //    UINT IndexCount = 0;
 //    UINT StartIndexLocation = 0;
 //    int BaseVertexLocation = 0;
+//
+//	// Never moves after BuildRenderItems, so BuildStaticBatches bakes it into
+//	// a world space chunk.
+//	bool Static = false;
+//
+//	// World space bounds of a static chunk, which is culled by them.  Other
+//	// items are always drawn.
+//	bool HasBounds = false;
+//	BoundingBox Bounds;
 //};
 //
 //class LitColumnsApp : public D3DApp
@@ -76,6 +89,7 @@
 //	void UpdateObjectCBs(const GameTimer& gt);
 //	void UpdateMaterialCBs(const GameTimer& gt);
 //	void UpdateMainPassCB(const GameTimer& gt);
+//	void UpdateRenderQueue(const GameTimer& gt);
 //
 //    void BuildRootSignature();
 //    void BuildShadersAndInputLayout();
@@ -85,7 +99,9 @@
 //    void BuildFrameResources();
 //    void BuildMaterials();
 //    void BuildRenderItems();
-//    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+//	void BuildStaticBatches();
+//    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList,
+//		const std::vector<AutoInstancer<RenderItem>::Batch>& batches, const RenderQueue& queue);
 // 
 //private:
 //
@@ -114,6 +130,14 @@
 //	// Render items divided by PSO.
 //	std::vector<RenderItem*> mOpaqueRitems;
 //
+//	// The opaque items merged into instanced draws.
+//	AutoInstancer<RenderItem> mAutoInstancer;
+//
+//	// This frame's opaque batches sorted by geometry, material and depth, and
+//	// the geometry id each MeshGeometry has in the sort keys.
+//	RenderQueue mRenderQueue;
+//	std::unordered_map<const MeshGeometry*, UINT> mGeometryIds;
+//
 //    PassConstants mMainPassCB;
 //
 //	XMFLOAT3 mEyePos = { 0.0f, 0.0f, 0.0f };
@@ -225,6 +249,7 @@
 //	UpdateObjectCBs(gt);
 //	UpdateMaterialCBs(gt);
 //	UpdateMainPassCB(gt);
+//	UpdateRenderQueue(gt);
 //}
 //
 //void LitColumnsApp::Draw(const GameTimer& gt)
@@ -258,7 +283,7 @@
 //	auto passCB = mCurrFrameResource->PassCB->Resource();
 //	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
 //
-//    DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
+//    DrawRenderItems(mCommandList.Get(), mAutoInstancer.GetBatches(), mRenderQueue);
 //
 //    // Indicate a state transition on the resource usage.
 //	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -356,7 +381,7 @@
 //
 //void LitColumnsApp::UpdateObjectCBs(const GameTimer& gt)
 //{
-//	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
+//	auto currObjectBuffer = mCurrFrameResource->ObjectBuffer.get();
 //	for(auto& e : mAllRitems)
 //	{
 //		// Only update the cbuffer data if the constants have changed.  
@@ -370,7 +395,7 @@
 //			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
 //			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
 //
-//			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+//			currObjectBuffer->CopyData(mAutoInstancer.GetInstanceIndex(e->ObjCBIndex), objConstants);
 //
 //			// Next FrameResourceLitColumns need to be updated too.
 //			e->NumFramesDirty--;
@@ -439,13 +464,59 @@
 //	currPassCB->CopyData(0, mMainPassCB);
 //}
 //
+//void LitColumnsApp::UpdateRenderQueue(const GameTimer& gt)
+//{
+//	XMMATRIX view = XMLoadFloat4x4(&mView);
+//
+//	BoundingFrustum viewFrustum;
+//	BoundingFrustum::CreateFromMatrix(viewFrustum, XMLoadFloat4x4(&mProj));
+//	BoundingFrustum worldFrustum;
+//	viewFrustum.Transform(worldFrustum, XMMatrixInverse(nullptr, view));
+//
+//	// One layer and PSO; nearest first within a geometry and material.  A
+//	// batch is keyed by its first item's depth.  Static chunks out of view
+//	// are left out.
+//	const auto& batches = mAutoInstancer.GetBatches();
+//	UINT chunksCulled = 0;
+//	UINT itemCount = 0;
+//	mRenderQueue.Clear();
+//	for(UINT i = 0; i < (UINT)batches.size(); ++i)
+//	{
+//		const RenderItem* ri = batches[i].First;
+//		if(ri->HasBounds && worldFrustum.Contains(ri->Bounds) == DISJOINT)
+//		{
+//			++chunksCulled;
+//			continue;
+//		}
+//		itemCount += batches[i].InstanceCount;
+//
+//		// Chunks are in world space already; their depth is their center's.
+//		XMVECTOR posW = ri->HasBounds ? XMVectorSetW(XMLoadFloat3(&ri->Bounds.Center), 1.0f) :
+//			XMVectorSet(ri->World._41, ri->World._42, ri->World._43, 1.0f);
+//		float depth = XMVectorGetZ(XMVector3Transform(posW, view)) / 1000.0f;
+//
+//		mRenderQueue.Add(RenderQueue::MakeKey(0, 0, mGeometryIds[ri->Geo], ri->Mat->MatCBIndex, depth), i);
+//	}
+//	mRenderQueue.Sort();
+//
+//	// Drawing each item on its own set the geometry (3 calls), material and
+//	// object data for every item.
+//	RenderQueue::BindCounts binds = mRenderQueue.CountBinds();
+//	UINT bindsSkipped = 5*itemCount - 3*binds.Geometry - binds.Material - mRenderQueue.Size();
+//
+//	std::wostringstream outs;
+//	outs << L"Lit Columns Demo    " << itemCount << L" items in " << mRenderQueue.Size() << L" draws, "
+//		<< bindsSkipped << L" binds skipped, " << chunksCulled << L" static chunks culled";
+//	mMainWndCaption = outs.str();
+//}
+//
 //void LitColumnsApp::BuildRootSignature()
 //{
 //	// Root parameter can be a table, root descriptor or root constants.
 //	CD3DX12_ROOT_PARAMETER slotRootParameter[3];
 //
-//	// Create root CBV.
-//	slotRootParameter[0].InitAsConstantBufferView(0);
+//	// Object data is a root SRV so a batch can index its instances.
+//	slotRootParameter[0].InitAsShaderResourceView(0);
 //	slotRootParameter[1].InitAsConstantBufferView(1);
 //	slotRootParameter[2].InitAsConstantBufferView(2);
 //
@@ -779,6 +850,7 @@
 //	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
 //	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
 //	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+//	boxRitem->Static = true;
 //	mAllRitems.push_back(std::move(boxRitem));
 //
 //    auto gridRitem = std::make_unique<RenderItem>();
@@ -791,6 +863,7 @@
 //    gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
 //    gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
 //    gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+//	gridRitem->Static = true;
 //	mAllRitems.push_back(std::move(gridRitem));
 //
 //	auto skullRitem = std::make_unique<RenderItem>();
@@ -829,6 +902,7 @@
 //		leftCylRitem->IndexCount = leftCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
 //		leftCylRitem->StartIndexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
 //		leftCylRitem->BaseVertexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+//		leftCylRitem->Static = true;
 //
 //		XMStoreFloat4x4(&rightCylRitem->World, leftCylWorld);
 //		XMStoreFloat4x4(&rightCylRitem->TexTransform, brickTexTransform);
@@ -839,6 +913,7 @@
 //		rightCylRitem->IndexCount = rightCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
 //		rightCylRitem->StartIndexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
 //		rightCylRitem->BaseVertexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+//		rightCylRitem->Static = true;
 //
 //		XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
 //		leftSphereRitem->TexTransform = MathHelper::Identity4x4();
@@ -866,34 +941,144 @@
 //		mAllRitems.push_back(std::move(rightSphereRitem));
 //	}
 //
+//	BuildStaticBatches();
+//
 //	// All the render items are opaque.
 //	for(auto& e : mAllRitems)
 //		mOpaqueRitems.push_back(e.get());
+//
+//	UINT geometryId = 0;
+//	for(auto& e : mGeometries)
+//		mGeometryIds[e.second.get()] = geometryId++;
+//
+//	// The 10 spheres become one draw.
+//	mAutoInstancer.Build(mOpaqueRitems);
 //}
 //
-//void LitColumnsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+//void LitColumnsApp::BuildStaticBatches()
+//{
+//	StaticBatcher::VertexLayout layout;
+//	layout.ByteStride = sizeof(Vertex);
+//	layout.PositionOffset = offsetof(Vertex, Pos);
+//	layout.NormalOffset = offsetof(Vertex, Normal);
+//
+//	// Cells a little bigger than a pair of columns.
+//	StaticBatcher batcher(layout, 10.0f);
+//
+//	std::vector<std::unique_ptr<RenderItem>> ritems;
+//	UINT objCBIndex = 0;
+//	for(auto& e : mAllRitems)
+//	{
+//		objCBIndex = MathHelper::Max(objCBIndex, e->ObjCBIndex + 1);
+//		// An item too big for a chunk stays a render item of its own.
+//		if(!e->Static || !batcher.Add(*e->Geo, e->IndexCount, e->StartIndexLocation, e->BaseVertexLocation,
+//			e->World, e->TexTransform, e->Mat->MatCBIndex))
+//		{
+//			ritems.push_back(std::move(e));
+//		}
+//	}
+//	batcher.Build();
+//
+//	const std::vector<BYTE>& vertices = batcher.GetVertices();
+//	const std::vector<std::uint16_t>& indices = batcher.GetIndices();
+//	const UINT vbByteSize = (UINT)vertices.size();
+//	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+//
+//	auto geo = std::make_unique<MeshGeometry>();
+//	geo->Name = "staticGeo";
+//
+//	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+//	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+//
+//	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+//	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+//
+//	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+//		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+//
+//	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+//		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+//
+//	geo->VertexByteStride = sizeof(Vertex);
+//	geo->VertexBufferByteSize = vbByteSize;
+//	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+//	geo->IndexBufferByteSize = ibByteSize;
+//
+//	std::vector<Material*> materials(mMaterials.size());
+//	for(auto& e : mMaterials)
+//		materials[e.second->MatCBIndex] = e.second.get();
+//
+//	// One item per chunk, already in world space.
+//	for(const StaticBatcher::Chunk& chunk : batcher.GetChunks())
+//	{
+//		auto chunkRitem = std::make_unique<RenderItem>();
+//		chunkRitem->World = MathHelper::Identity4x4();
+//		chunkRitem->TexTransform = MathHelper::Identity4x4();
+//		chunkRitem->ObjCBIndex = objCBIndex++;
+//		chunkRitem->Mat = materials[chunk.MaterialId];
+//		chunkRitem->Geo = geo.get();
+//		chunkRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+//		chunkRitem->IndexCount = chunk.IndexCount;
+//		chunkRitem->StartIndexLocation = chunk.StartIndexLocation;
+//		chunkRitem->BaseVertexLocation = chunk.BaseVertexLocation;
+//		chunkRitem->HasBounds = true;
+//		chunkRitem->Bounds = chunk.Bounds;
+//		ritems.push_back(std::move(chunkRitem));
+//	}
+//
+//	std::ostringstream outs;
+//	outs << "Static batching: " << batcher.ItemCount() << " items in " << batcher.GetChunks().size()
+//		<< " chunks, " << batcher.BatchedByteSize() << " bytes baked from " << batcher.SourceByteSize() << "\n";
+//	::OutputDebugStringA(outs.str().c_str());
+//
+//	mGeometries[geo->Name] = std::move(geo);
+//	mAllRitems = std::move(ritems);
+//}
+//
+//void LitColumnsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList,
+//	const std::vector<AutoInstancer<RenderItem>::Batch>& batches, const RenderQueue& queue)
 //{
-//    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
 //    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
 // 
-//	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
+//	auto objectBuffer = mCurrFrameResource->ObjectBuffer->Resource();
 //	auto matCB = mCurrFrameResource->MaterialCB->Resource();
 //
-//    // For each render item...
-//    for(size_t i = 0; i < ritems.size(); ++i)
+//	// Only set what changed since the previous item in sorted order.
+//	const MeshGeometry* lastGeo = nullptr;
+//	D3D12_PRIMITIVE_TOPOLOGY lastPrimitiveType = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+//	const Material* lastMat = nullptr;
+//
+//    // For each batch...
+//    for(UINT i = 0; i < queue.Size(); ++i)
 //    {
-//        auto ri = ritems[i];
+//		const auto& batch = batches[queue.GetItem(i)];
+//        auto ri = batch.First;
 //
-//        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-//        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-//        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+//		if(ri->Geo != lastGeo)
+//		{
+//			cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+//			cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+//			lastGeo = ri->Geo;
+//		}
+//		if(ri->PrimitiveType != lastPrimitiveType)
+//		{
+//			cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+//			lastPrimitiveType = ri->PrimitiveType;
+//		}
 //
-//        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
-//		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex*matCBByteSize;
+//		// SV_InstanceID starts at 0 whatever StartInstanceLocation is, so the
+//		// view starts at the batch's first instance instead.
+//        D3D12_GPU_VIRTUAL_ADDRESS objectAddress = objectBuffer->GetGPUVirtualAddress() +
+//			batch.FirstInstance*sizeof(ObjectConstants);
+//        cmdList->SetGraphicsRootShaderResourceView(0, objectAddress);
 //
-//        cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
-//		cmdList->SetGraphicsRootConstantBufferView(1, matCBAddress);
+//		if(ri->Mat != lastMat)
+//		{
+//			D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex*matCBByteSize;
+//			cmdList->SetGraphicsRootConstantBufferView(1, matCBAddress);
+//			lastMat = ri->Mat;
+//		}
 //
-//        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+//        cmdList->DrawIndexedInstanced(ri->IndexCount, batch.InstanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
 //    }
 //}
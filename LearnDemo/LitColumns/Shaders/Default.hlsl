@@ -22,11 +22,15 @@
 
 // Constant data that varies per frame.
 
-cbuffer cbPerObject : register(b0)
+struct ObjectData
 {
-    float4x4 gWorld;
+    float4x4 World;
+    float4x4 TexTransform;
 };
 
+// The objects of the batch being drawn, one per instance.
+StructuredBuffer<ObjectData> gObjectData : register(t0);
+
 cbuffer cbMaterial : register(b1)
 {
 	float4 gDiffuseAlbedo;
@@ -74,9 +78,11 @@ struct VertexOut
     float3 NormalW : NORMAL;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
 	VertexOut vout = (VertexOut)0.0f;
+
+    float4x4 gWorld = gObjectData[instanceID].World;
 	
     // Transform to world space.
     float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);